@@ -43,6 +43,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/types/_ssize_t.h>
 
 #ifndef _MODE_T_DECLARED
 typedef int mode_t; /*!< Used for some file attributes. */
@@ -136,6 +137,9 @@ typedef int pid_t; /*!< Process ID. */
 #define O_EXEC_ALTPCAP  0x20000  /*!< The executable file can set new process
                                   *   bounding capabilities on exec().
                                   */
+#define O_NOCACHE       0x40000  /*!< Bypass the buffer cache, used by the
+                                  *   buffer cache itself.
+                                  */
 #endif
 
 #define AT_FDCWD            0x40000000 /*!< Use the current working directory to
@@ -150,6 +154,11 @@ typedef int pid_t; /*!< Process ID. */
 #define AT_SYMLINK_FOLLOW   0x40 /*!< Follow symbolic link. */
 #define AT_REMOVEDIR        0x80 /*!< Remove directory instead of file. */
 
+/*
+ * splice() flags.
+ */
+#define SPLICE_F_NONBLOCK   0x02 /*!< Don't block on pipe I/O. */
+
 /**
  * File lock.
  */
@@ -188,6 +197,16 @@ struct _fs_open_args {
     mode_t mode;
 };
 
+/**
+ * Arguments for SYSCALL_IPC_SPLICE.
+ */
+struct _ipc_splice_args {
+    int fd_in;
+    int fd_out;
+    size_t len;
+    unsigned flags;
+};
+
 #endif
 
 #ifndef KERNEL_INTERNAL
@@ -209,6 +228,21 @@ int creat(const char *, mode_t);
  */
 int fcntl(int fd, int cmd, ... /* arg */);
 
+/**
+ * Move data between a pipe and a file without copying it through the user
+ * space.
+ * At least one of the file descriptors must refer to a pipe. The data is
+ * read from and written to the current file offsets.
+ * @param fd_in     is the file descriptor to read from.
+ * @param fd_out    is the file descriptor to write to.
+ * @param len       is the maximum number of bytes to move.
+ * @param flags     is a bitwise or of SPLICE_F flags.
+ * @return Returns the number of bytes moved;
+ *         0 if there was nothing to read and the write end of the input pipe
+ *         is closed; Otherwise -1 and errno is set.
+ */
+ssize_t splice(int fd_in, int fd_out, size_t len, unsigned flags);
+
 /**
  * @}
  */
@@ -0,0 +1,110 @@
+/**
+ *******************************************************************************
+ * @file    poll.h
+ * @author  Olli Vanhoja
+ * @brief   Definitions for the poll() function.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+/**
+ * @addtogroup libc
+ * @{
+ */
+
+#ifndef POLL_H
+#define POLL_H
+
+#include <sys/cdefs.h>
+
+#define POLLIN      0x0001 /*!< Data other than high-priority data may be
+                            *   read without blocking. */
+#define POLLRDNORM  0x0002 /*!< Normal data may be read without blocking. */
+#define POLLRDBAND  0x0004 /*!< Priority data may be read without blocking. */
+#define POLLPRI     0x0008 /*!< High priority data may be read without
+                            *   blocking. */
+#define POLLOUT     0x0010 /*!< Normal data may be written without blocking. */
+#define POLLWRNORM  POLLOUT /*!< Equivalent to POLLOUT. */
+#define POLLWRBAND  0x0020 /*!< Priority data may be written. */
+#define POLLERR     0x0040 /*!< An error has occurred (revents only). */
+#define POLLHUP     0x0080 /*!< Device has been disconnected
+                            *   (revents only). */
+#define POLLNVAL    0x0100 /*!< Invalid fd member (revents only). */
+
+/**
+ * Type used for the number of file descriptors.
+ */
+typedef unsigned int nfds_t;
+
+/**
+ * Poll file descriptor.
+ */
+struct pollfd {
+    int fd;             /*!< The following descriptor being polled. */
+    short events;       /*!< The input event flags. */
+    short revents;      /*!< The output event flags. */
+};
+
+#if defined(__SYSCALL_DEFS__) || defined(KERNEL_INTERNAL)
+
+/**
+ * Arguments struct for SYSCALL_FS_POLL
+ */
+struct _fs_poll_args {
+    struct pollfd * fds;
+    nfds_t nfds;
+    int timeout; /*!< Timeout in ms; -1 = infinite. */
+};
+
+#endif /* __SYSCALL_DEFS__ */
+
+#ifndef KERNEL_INTERNAL
+__BEGIN_DECLS
+
+/**
+ * Input/output multiplexing.
+ * Examine the file descriptors in fds for readiness of the events requested.
+ * @param fds       is an array of pollfd structs.
+ * @param nfds      is the number of elements in fds.
+ * @param timeout   is the maximum time to wait in milliseconds;
+ *                  -1 = wait indefinitely; 0 = return immediately.
+ * @return Returns the number of structs having a non-zero revents;
+ *         0 if the call timed out; Otherwise -1 and errno is set.
+ * @throws EFAULT   fds points outside of the address space of the process.
+ *         EINTR    A signal was caught while waiting.
+ *         EINVAL   nfds is greater than the number of open files allowed.
+ *         ENOMEM   Not enough kernel memory.
+ */
+int poll(struct pollfd fds[], nfds_t nfds, int timeout);
+
+__END_DECLS
+#endif /* !KERNEL_INTERNAL */
+
+#endif /* POLL_H */
+
+/**
+ * @}
+ */
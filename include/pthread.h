@@ -140,6 +140,7 @@
  */
 #define PTHREAD_NEEDS_INIT          0
 #define PTHREAD_DONE_INIT           1
+#define PTHREAD_INPROGRESS_INIT     2
 
 /*
  * Static once initialization values.
@@ -149,9 +150,10 @@
 /*
  * Static initialization values.
  */
-#define PTHREAD_MUTEX_INITIALIZER {0, 0, -1, -1, -1}
-#define PTHREAD_ERRORCHECK_MUTEX_INITIALIZER_NP {0, 0, -1, -1, -1}
-#define PTHREAD_COND_INITIALIZER    NULL
+#define PTHREAD_MUTEX_INITIALIZER {0, 0, -1, -1, PTHREAD_PROCESS_PRIVATE}
+#define PTHREAD_ERRORCHECK_MUTEX_INITIALIZER_NP \
+    {0, 0, -1, -1, PTHREAD_PROCESS_PRIVATE}
+#define PTHREAD_COND_INITIALIZER    {0, PTHREAD_PROCESS_PRIVATE}
 #define PTHREAD_RWLOCK_INITIALIZER  NULL
 
 /*
@@ -189,8 +191,7 @@ enum pthread_mutextype {
 
 typedef int pthread_key_t;
 typedef struct _pthread_once {
-    int state;
-    pthread_key_t key;
+    int state; /*!< Futex, one of the PTHREAD_*_INIT values. */
 } pthread_once_t;
 
 struct _pthread_cleanup_info {
@@ -298,13 +299,16 @@ int     pthread_barrierattr_setpshared(pthread_barrierattr_t *, int);
  * @}
  */
 
-/*
 int     pthread_condattr_destroy(pthread_condattr_t *);
+/*
 int     pthread_condattr_getclock(const pthread_condattr_t *,
             clockid_t *);
+*/
 int     pthread_condattr_getpshared(const pthread_condattr_t *, int *);
 int     pthread_condattr_init(pthread_condattr_t *);
+/*
 int     pthread_condattr_setclock(pthread_condattr_t *, clockid_t);
+*/
 int     pthread_condattr_setpshared(pthread_condattr_t *, int);
 int     pthread_cond_broadcast(pthread_cond_t *);
 int     pthread_cond_destroy(pthread_cond_t *);
@@ -314,7 +318,6 @@ int     pthread_cond_signal(pthread_cond_t *);
 int     pthread_cond_timedwait(pthread_cond_t *,
             pthread_mutex_t *__mutex, const struct timespec *);
 int     pthread_cond_wait(pthread_cond_t *, pthread_mutex_t *__mutex);
-*/
 int     pthread_equal(pthread_t, pthread_t);
 
 void    *pthread_getspecific(pthread_key_t);
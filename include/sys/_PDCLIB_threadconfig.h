@@ -6,7 +6,7 @@
 /* Just include pthread.h */
 #include <pthread.h>
 #define _PDCLIB_THR_T pthread_t
-//#define _PDCLIB_CND_T pthread_cond_t
+#define _PDCLIB_CND_T pthread_cond_t
 #define _PDCLIB_MTX_T pthread_mutex_t
 #define _PDCLIB_TSS_DTOR_ITERATIONS 5
 #define _PDCLIB_TSS_T pthread_key_t
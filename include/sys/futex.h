@@ -0,0 +1,119 @@
+/**
+ *******************************************************************************
+ * @file    futex.h
+ * @author  Olli Vanhoja
+ * @brief   Fast userspace mutex wait queues.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+/**
+ * @addtogroup LIBC
+ * @{
+ */
+
+#ifndef _SYS_FUTEX_H_
+#define _SYS_FUTEX_H_
+
+#include <sys/cdefs.h>
+
+/*
+ * Futex flags.
+ */
+#define FUTEX_PRIVATE   0x1 /*!< The futex is only used inside a single process.
+                             *   Keyed by the virtual address, so it's faster
+                             *   and works in copy-on-write memory. */
+
+#if defined(__SYSCALL_DEFS__) || defined(KERNEL_INTERNAL)
+/**
+ * Arguments for SYSCALL_IPC_FUTEX_WAIT and SYSCALL_IPC_FUTEX_WAKE.
+ */
+struct _ipc_futex_args {
+    int * uaddr;    /*!< Address of the futex word. */
+    int val;        /*!< WAIT: expected value of the futex word;
+                     *   WAKE: maximum number of threads to wake up. */
+    int flags;      /*!< Futex flags. */
+    long timeout;   /*!< WAIT: timeout in ms; 0 = no timeout. */
+};
+#endif
+
+#ifndef KERNEL_INTERNAL
+__BEGIN_DECLS
+
+/**
+ * Wait on a futex.
+ * Atomically check that the futex word still contains val and sleep until
+ * futex_wake() is called for the same futex.
+ * @param uaddr is a pointer to the futex word.
+ * @param val is the expected value.
+ * @param flags are the futex flags.
+ * @param timeout is the timeout in ms; 0 = no timeout.
+ * @return Returns 0 if woken up; Otherwise -1 and errno is set to
+ *         EAGAIN if the value didn't match or ETIMEDOUT.
+ */
+int futex_wait(int * uaddr, int val, int flags, long timeout);
+
+/**
+ * Wake up threads waiting on a futex.
+ * @param uaddr is a pointer to the futex word.
+ * @param n is the maximum number of threads to wake up.
+ * @param flags are the futex flags.
+ * @return Returns the number of threads woken up;
+ *         Otherwise -1 and errno is set.
+ */
+int futex_wake(int * uaddr, int n, int flags);
+
+__END_DECLS
+#else /* KERNEL_INTERNAL */
+
+/**
+ * Wait on a futex of the current process.
+ * @param uaddr is a pointer to the futex word.
+ * @param val is the expected value.
+ * @param flags are the futex flags.
+ * @param timeout is the timeout in ms; 0 = no timeout.
+ * @return Returns 0 if woken up; -EAGAIN if the value didn't match;
+ *         Otherwise a negative errno is returned.
+ */
+int futex_wait(__user int * uaddr, int val, int flags, long timeout);
+
+/**
+ * Wake up threads waiting on a futex of the current process.
+ * @param uaddr is a pointer to the futex word.
+ * @param n is the maximum number of threads to wake up.
+ * @param flags are the futex flags.
+ * @return Returns the number of threads woken up;
+ *         Otherwise a negative errno is returned.
+ */
+int futex_wake(__user int * uaddr, int n, int flags);
+
+#endif /* KERNEL_INTERNAL */
+
+#endif /* !_SYS_FUTEX_H_ */
+
+/**
+ * @}
+ */
@@ -0,0 +1,110 @@
+/**
+ *******************************************************************************
+ * @file    kdata.h
+ * @author  Olli Vanhoja
+ * @brief   Kernel data pages shared with the user space.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+/**
+ * @addtogroup kdata
+ * Kernel data pages.
+ * The kernel maps two read-only pages to every process at exec. The first one
+ * is shared by all processes and contains the system time and load averages,
+ * the second one is private to the process and contains its pid and ppid.
+ * These are used by libc to implement some frequently called functions
+ * without a system call.
+ * @{
+ */
+
+#ifndef SYS_KDATA_H
+#define SYS_KDATA_H
+
+#include <stdint.h>
+#include <sys/types/_pid_t.h>
+#include <sys/types/_timespec.h>
+
+#define KDATA_ADDR      0x0fffd000 /*!< Address of the shared kernel data. */
+#define KDATA_PROC_ADDR 0x0fffe000 /*!< Address of the process data. */
+
+/**
+ * Shared kernel data.
+ * The time is updated on every scheduler tick and it's protected with a
+ * sequence counter that is odd while an update is in progress.
+ */
+struct kdata {
+    uint32_t kd_seq;                /*!< Sequence counter. */
+    struct timespec kd_uptime;      /*!< Time since boot. */
+    struct timespec kd_realtime;    /*!< Wall clock time. */
+    uint32_t kd_loads[3];           /*!< Load averages scaled by 100. */
+};
+
+/**
+ * Per process kernel data.
+ */
+struct kdata_proc {
+    pid_t kp_pid;                   /*!< Process ID. */
+    pid_t kp_ppid;                  /*!< Parent process ID. */
+};
+
+#ifndef KERNEL_INTERNAL
+
+#define KDATA       ((const volatile struct kdata *)KDATA_ADDR)
+#define KDATA_PROC  ((const volatile struct kdata_proc *)KDATA_PROC_ADDR)
+
+/**
+ * Begin reading seq protected fields of struct kdata.
+ * @return Returns the sequence number to be passed to kdata_read_retry().
+ */
+static inline uint32_t kdata_read_begin(void)
+{
+    uint32_t seq;
+
+    while ((seq = KDATA->kd_seq) & 1);
+    __asm__ volatile ("" : : : "memory");
+
+    return seq;
+}
+
+/**
+ * Check if the fields read after kdata_read_begin() are consistent.
+ * @return Returns 0 if the data is consistent and the read is complete.
+ */
+static inline int kdata_read_retry(uint32_t seq)
+{
+    __asm__ volatile ("" : : : "memory");
+
+    return KDATA->kd_seq != seq;
+}
+
+#endif /* !KERNEL_INTERNAL */
+
+#endif /* SYS_KDATA_H */
+
+/**
+ * @}
+ */
@@ -0,0 +1,95 @@
+/**
+ *******************************************************************************
+ * @file    select.h
+ * @author  Olli Vanhoja
+ * @brief   Select types.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+/**
+ * @addtogroup libc
+ * @{
+ */
+
+#ifndef SELECT_H
+#define SELECT_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types/_timeval.h>
+
+/**
+ * Maximum number of file descriptors in an fd_set.
+ */
+#define FD_SETSIZE  256
+
+#define _NFDBITS    (sizeof(uint32_t) * 8)
+
+/**
+ * File descriptor set.
+ */
+typedef struct fd_set {
+    uint32_t fds_bits[(FD_SETSIZE + _NFDBITS - 1) / _NFDBITS];
+} fd_set;
+
+#define FD_CLR(fd, set) \
+    ((set)->fds_bits[(fd) / _NFDBITS] &= ~(1u << ((fd) % _NFDBITS)))
+#define FD_ISSET(fd, set) \
+    (((set)->fds_bits[(fd) / _NFDBITS] & (1u << ((fd) % _NFDBITS))) != 0)
+#define FD_SET(fd, set) \
+    ((set)->fds_bits[(fd) / _NFDBITS] |= (1u << ((fd) % _NFDBITS)))
+#define FD_ZERO(set) do {                                           \
+    for (unsigned _i = 0; _i < sizeof((set)->fds_bits) / sizeof(uint32_t); \
+         _i++)                                                      \
+        (set)->fds_bits[_i] = 0;                                    \
+} while (0)
+
+#ifndef KERNEL_INTERNAL
+__BEGIN_DECLS
+
+/**
+ * Synchronous I/O multiplexing.
+ * select() is implemented on top of poll() and has the same limitations.
+ * @param nfds      is the highest numbered fd in any of the sets plus one.
+ * @param readfds   is an optional set of fds to be checked for reading.
+ * @param writefds  is an optional set of fds to be checked for writing.
+ * @param errorfds  is an optional set of fds to be checked for errors.
+ * @param timeout   is the maximum time to wait; NULL = wait indefinitely.
+ * @return Returns the total number of bits set in the sets;
+ *         0 if the call timed out; Otherwise -1 and errno is set.
+ */
+int select(int nfds, fd_set * restrict readfds, fd_set * restrict writefds,
+           fd_set * restrict errorfds, struct timeval * restrict timeout);
+
+__END_DECLS
+#endif /* !KERNEL_INTERNAL */
+
+#endif /* SELECT_H */
+
+/**
+ * @}
+ */
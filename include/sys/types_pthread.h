@@ -73,7 +73,7 @@ typedef struct pthread_attr {
 } pthread_attr_t;
 
 typedef struct pthread_condattr {
-    int dummy;
+    int pshared;
 } pthread_condattr_t;
 
 /**
@@ -85,10 +85,10 @@ typedef struct pthread_mutexattr {
 } pthread_mutexattr_t;
 
 typedef struct pthread_mutex {
-    int lock;       /*!< Exclusive access to mutex state:
+    int lock;       /*!< Exclusive access to mutex state, used as a futex:
                      * - 0: unlocked/free
                      * - 1: locked - no other waiters
-                     * - -1: locked - with possible other waiters
+                     * - 2: locked - with possible other waiters
                      */
 
   int recursion;    /*!< Number of unlocks a thread needs to perform
@@ -96,8 +96,14 @@ typedef struct pthread_mutex {
                      */
   int kind;         /*!< Mutex type */
   pthread_t owner;  /*!< Thread owning the mutex */
+  int pshared;      /*!< PTHREAD_PROCESS_PRIVATE or PTHREAD_PROCESS_SHARED */
 } pthread_mutex_t;
 
+typedef struct pthread_cond {
+    int seq;        /*!< Futex, incremented on every signal and broadcast. */
+    int pshared;    /*!< PTHREAD_PROCESS_PRIVATE or PTHREAD_PROCESS_SHARED */
+} pthread_cond_t;
+
 /*
  * Once definitions.
  */
@@ -135,6 +135,9 @@
 #define SYSCALL_PROC_TIMES          SYSCALL_MMTOTYPE(SYSCALL_GROUP_PROC, 0x16)
 #define SYSCALL_PROC_GETBREAK       SYSCALL_MMTOTYPE(SYSCALL_GROUP_PROC, 0x17)
 #define SYSCALL_IPC_PIPE            SYSCALL_MMTOTYPE(SYSCALL_GROUP_IPC, 0x00)
+#define SYSCALL_IPC_FUTEX_WAIT      SYSCALL_MMTOTYPE(SYSCALL_GROUP_IPC, 0x01)
+#define SYSCALL_IPC_FUTEX_WAKE      SYSCALL_MMTOTYPE(SYSCALL_GROUP_IPC, 0x02)
+#define SYSCALL_IPC_SPLICE          SYSCALL_MMTOTYPE(SYSCALL_GROUP_IPC, 0x03)
 #define SYSCALL_FS_OPEN             SYSCALL_MMTOTYPE(SYSCALL_GROUP_FS, 0x00)
 #define SYSCALL_FS_CLOSE            SYSCALL_MMTOTYPE(SYSCALL_GROUP_FS, 0x01)
 #define SYSCALL_FS_CLOSE_ALL        SYSCALL_MMTOTYPE(SYSCALL_GROUP_FS, 0x02)
@@ -158,6 +161,7 @@
 #define SYSCALL_FS_UMASK            SYSCALL_MMTOTYPE(SYSCALL_GROUP_FS, 0x14)
 #define SYSCALL_FS_MOUNT            SYSCALL_MMTOTYPE(SYSCALL_GROUP_FS, 0x15)
 #define SYSCALL_FS_UMOUNT           SYSCALL_MMTOTYPE(SYSCALL_GROUP_FS, 0x16)
+#define SYSCALL_FS_POLL             SYSCALL_MMTOTYPE(SYSCALL_GROUP_FS, 0x17)
 #define SYSCALL_IOCTL_GETSET        SYSCALL_MMTOTYPE(SYSCALL_GROUP_IOCTL, 0x00)
 #define SYSCALL_SHMEM_MMAP          SYSCALL_MMTOTYPE(SYSCALL_GROUP_SHMEM, 0x00)
 #define SYSCALL_SHMEM_MUNMAP        SYSCALL_MMTOTYPE(SYSCALL_GROUP_SHMEM, 0x01)
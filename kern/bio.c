@@ -32,40 +32,223 @@
 
 #include <errno.h>
 #include <fcntl.h>
-#include <idle.h>
 #include <kstring.h>
+#include <libkern.h>
 #include <sys/linker_set.h>
+#include <sys/sysctl.h>
 #include <sys/tree.h>
 #include <sys/types.h>
 #include <buf.h>
 #include <fs/devfs.h>
+#include <hal/hw_timers.h>
 #include <kerror.h>
+#include <kinit.h>
 #include <kmalloc.h>
+#include <thread.h>
+#include <waitq.h>
 
 /*
- * Used to protect access caching data structures and synchronizing access
- * to some functions.
- *
- * TODO We'd like to use MTX_TYPE_TICKET here but bio_clean() makes it
- * impossible right now.
+ * Buffer lookups are protected by the vnode lock of the vnode owning the
+ * buffer splay tree and released buffers are kept in lists sharded by
+ * the vnode and block number. Threads accessing unrelated files don't
+ * need to share any locks.
+ */
+#define BIO_RELSE_NR_SHARDS 4
+
+static struct bio_relse_shard {
+    mtx_t lock;
+    TAILQ_HEAD(bio_relse_list_head, buf) list;
+} bio_relse_shards[BIO_RELSE_NR_SHARDS];
+
+#define BIO_RELSE_SHARD(bp)                                                 \
+    (&bio_relse_shards[((uintptr_t)(bp)->b_file.vnode / sizeof(vnode_t) +   \
+                        (bp)->b_blkno) % BIO_RELSE_NR_SHARDS])
+
+/*
+ * The relse lists are in LRU order. Clean buffers are evicted from the head
+ * of the lists when the cache grows over its budget, buffers that have been
+ * referenced since the previous scan get a second chance. Dirty buffers are
+ * written back by the flusher thread.
+ */
+#define BIO_FLUSH_BATCH     32          /*!< Max buffers per flush round. */
+#define BIO_CLUSTER_MAX     (64 * 1024) /*!< Max size of a clustered I/O. */
+#define BIO_RA_MAX          32          /*!< Max read-ahead window. */
+
+static struct waitq bio_flush_waitq = WAITQ_INITIALIZER(bio_flush_waitq);
+
+SYSCTL_DECL(_vfs_bio);
+SYSCTL_NODE(_vfs, OID_AUTO, bio, CTLFLAG_RW, 0,
+            "Buffer cache");
+
+static int bio_maxbytes = configBIO_CACHE_SIZE * 1024;
+SYSCTL_INT(_vfs_bio, OID_AUTO, maxbytes, CTLFLAG_RW,
+           &bio_maxbytes, 0, "Buffer cache size budget");
+
+static atomic_t bio_nbytes;
+SYSCTL_INT(_vfs_bio, OID_AUTO, bytes, CTLFLAG_RD,
+           &bio_nbytes, 0, "Bytes cached");
+
+static atomic_t bio_ndirty;
+SYSCTL_INT(_vfs_bio, OID_AUTO, dirty, CTLFLAG_RD,
+           &bio_ndirty, 0, "Dirty bytes waiting for writeback");
+
+static int bio_dirty_age = 5000;
+SYSCTL_INT(_vfs_bio, OID_AUTO, dirty_age, CTLFLAG_RW,
+           &bio_dirty_age, 0, "Writeback age of dirty buffers [ms]");
+
+static int bio_flush_period = 1000;
+SYSCTL_INT(_vfs_bio, OID_AUTO, flush_period, CTLFLAG_RW,
+           &bio_flush_period, 0, "Flusher period [ms]");
+
+static atomic_t bio_nevicted;
+SYSCTL_INT(_vfs_bio, OID_AUTO, evicted, CTLFLAG_RD,
+           &bio_nevicted, 0, "Number of buffers evicted");
+
+static atomic_t bio_nclustered;
+SYSCTL_INT(_vfs_bio, OID_AUTO, clustered, CTLFLAG_RD,
+           &bio_nclustered, 0, "Number of buffers transferred in clusters");
+
+static int bio_ra_max = 16;
+SYSCTL_INT(_vfs_bio, OID_AUTO, ra_max, CTLFLAG_RW,
+           &bio_ra_max, 0, "Max read-ahead window [blocks]");
+
+static atomic_t bio_nra;
+SYSCTL_INT(_vfs_bio, OID_AUTO, ra, CTLFLAG_RD,
+           &bio_nra, 0, "Number of read-ahead blocks requested");
+
+/*
+ * Asynchronous I/O requests are queued here and processed by the bio I/O
+ * thread.
  */
-static mtx_t cache_lock = MTX_INITIALIZER(MTX_TYPE_SPIN, MTX_OPT_SLEEP |
-                                                         MTX_OPT_PRICEIL);
-static TAILQ_HEAD(bio_relse_list_head, buf) relse_list =
-     TAILQ_HEAD_INITIALIZER(relse_list);
+static mtx_t bio_ioq_lock = MTX_INITIALIZER(MTX_TYPE_TICKET, 0);
+static STAILQ_HEAD(bio_ioq_head, buf) bio_ioq =
+    STAILQ_HEAD_INITIALIZER(bio_ioq);
+static struct waitq bio_ioq_waitq = WAITQ_INITIALIZER(bio_ioq_waitq);
+static pthread_t bio_iod_tid = -1;
 
 static void _bio_readin(struct buf * bp);
 static void _bio_writeout(struct buf * bp);
 static void bl_brelse(struct buf * bp);
+static void bl_relse_remove(struct buf * bp);
+static void bl_biodone(struct buf * bp);
+static void bl_delwri_set(struct buf * bp);
+static void bl_delwri_clear(struct buf * bp);
+static void bio_ioq_insert(struct buf * bp);
 static int biowait_timo(struct buf * bp, long timeout);
-static void bio_clean(uintptr_t freebufs);
+static int bio_cluster_adjacent(struct buf * a, struct buf * b, size_t csize);
+static void bio_read_cluster(struct buf * bufs[], size_t n);
+static void bio_balance(void);
+static void * bio_flush_thread(void * arg);
 
 SPLAY_GENERATE(bufhd_splay, buf, sentry_, biobuf_compar);
 
 /* Init bio, called by vralloc_init() */
 void _bio_init(void)
 {
-    cache_lock.pri.p_lock = NICE_MIN;
+    for (size_t i = 0; i < BIO_RELSE_NR_SHARDS; i++) {
+        struct bio_relse_shard * shard = &bio_relse_shards[i];
+
+        mtx_init(&shard->lock, MTX_TYPE_TICKET, 0);
+        TAILQ_INIT(&shard->list);
+    }
+}
+
+static void * bio_iod_thread(void * arg)
+{
+    struct buf * bufs[BIO_RA_MAX];
+
+    while (1) {
+        struct buf * bp;
+        size_t n = 1;
+
+        mtx_lock(&bio_ioq_lock);
+        while (STAILQ_EMPTY(&bio_ioq)) {
+            (void)waitq_sleep(&bio_ioq_waitq, &bio_ioq_lock, 0);
+        }
+        bp = STAILQ_FIRST(&bio_ioq);
+        STAILQ_REMOVE_HEAD(&bio_ioq, ioq_entry_);
+        bufs[0] = bp;
+
+        /* Merge adjacent read-ahead blocks into a single read. */
+        if (bp->b_flags & B_READ) {
+            size_t csize = bp->b_bcount;
+            struct buf * nbp;
+
+            while (n < num_elem(bufs) && (nbp = STAILQ_FIRST(&bio_ioq)) &&
+                   (nbp->b_flags & B_READ) &&
+                   bio_cluster_adjacent(bufs[n - 1], nbp, csize)) {
+                STAILQ_REMOVE_HEAD(&bio_ioq, ioq_entry_);
+                csize += nbp->b_bcount;
+                bufs[n++] = nbp;
+            }
+        }
+        mtx_unlock(&bio_ioq_lock);
+
+        if (n > 1) {
+            bio_read_cluster(bufs, n);
+            continue;
+        }
+
+        BUF_LOCK(bp);
+        if (bp->b_flags & B_READ)
+            _bio_readin(bp);
+        else
+            _bio_writeout(bp);
+        BUF_UNLOCK(bp);
+    }
+
+    return NULL;
+}
+
+int __kinit__ bio_init(void)
+{
+    SUBSYS_DEP(sched_init);
+    SUBSYS_INIT("bio");
+
+    struct sched_param param = {
+        .sched_policy = SCHED_OTHER,
+        .sched_priority = NZERO,
+    };
+    pthread_t tid;
+
+    tid = kthread_create("biod", &param, 0, bio_iod_thread, NULL);
+    if (tid < 0) {
+        KERROR(KERROR_ERR, "Failed to create a thread for bio\n");
+        return tid;
+    }
+    bio_iod_tid = tid;
+
+    tid = kthread_create("bioflush", &param, 0, bio_flush_thread, NULL);
+    if (tid < 0) {
+        KERROR(KERROR_ERR, "Failed to create a thread for bio flush\n");
+        return tid;
+    }
+
+    return 0;
+}
+
+/**
+ * Queue an asynchronous I/O request.
+ * The buffer must be busy and B_ASYNC set.
+ */
+static void bio_ioq_insert(struct buf * bp)
+{
+    if (bio_iod_tid < 0) {
+        /* No I/O thread yet, do it synchronously. */
+        BUF_LOCK(bp);
+        if (bp->b_flags & B_READ)
+            _bio_readin(bp);
+        else
+            _bio_writeout(bp);
+        BUF_UNLOCK(bp);
+
+        return;
+    }
+
+    mtx_lock(&bio_ioq_lock);
+    STAILQ_INSERT_TAIL(&bio_ioq, bp, ioq_entry_);
+    waitq_wakeup(&bio_ioq_waitq);
+    mtx_unlock(&bio_ioq_lock);
 }
 
 /*
@@ -82,26 +265,100 @@ int biobuf_compar(struct buf * a, struct buf * b)
 int bread(vnode_t * vnode, size_t blkno, int size, struct buf ** bpp)
 {
     struct buf * bp;
+    int err;
 
     bp = getblk(vnode, blkno, size, 0);
     if (!bp)
         return -ENOMEM;
 
     BUF_LOCK(bp);
-    _bio_readin(bp);
+    if (bp->b_bcount != (size_t)size) {
+        bp->b_bcount = size;
+        bp->b_flags &= ~B_CACHE;
+    }
+    if (!(bp->b_flags & B_CACHE))
+        _bio_readin(bp);
+    err = (bp->b_flags & B_ERROR) ? bp->b_error : 0;
     BUF_UNLOCK(bp);
 
-    bp->b_bcount = size;
     *bpp = bp;
 
-    return 0;
+    return err;
 }
 
 int  breadn(vnode_t * vnode, size_t blkno, int size, size_t rablks[],
             int rasizes[], int nrablks, struct buf ** bpp)
 {
-    /* TODO */
-    return -ENOTSUP;
+    int err;
+
+    err = bread(vnode, blkno, size, bpp);
+    if (err)
+        return err;
+
+    for (int i = 0; i < nrablks; i++) {
+        struct buf * rabp;
+
+        if (incore(vnode, rablks[i]))
+            continue;
+
+        rabp = getblk(vnode, rablks[i], rasizes[i], 0);
+        if (!rabp)
+            break;
+
+        BUF_LOCK(rabp);
+        if (rabp->b_flags & (B_CACHE | B_DELWRI)) {
+            /*
+             * The block got cached after the incore() check, don't
+             * overwrite valid or dirty data.
+             */
+            BUF_UNLOCK(rabp);
+            brelse(rabp);
+            continue;
+        }
+        rabp->b_flags &= ~(B_DONE | B_ERROR);
+        rabp->b_flags |= B_ASYNC | B_READ;
+        rabp->b_bcount = rasizes[i];
+        BUF_UNLOCK(rabp);
+
+        bio_ioq_insert(rabp);
+        atomic_inc(&bio_nra);
+    }
+
+    return 0;
+}
+
+int bread_ra(vnode_t * vnode, struct file_ra * ra, size_t blkno, int size,
+             size_t nblks, struct buf ** bpp)
+{
+    size_t rablks[BIO_RA_MAX];
+    int rasizes[BIO_RA_MAX];
+    const size_t ra_max = imin(imax(bio_ra_max, 0), BIO_RA_MAX);
+    off_t start, end;
+    int n = 0;
+
+    if ((off_t)blkno == ra->ra_next && ra_max > 0) {
+        ra->ra_win = (ra->ra_win == 0) ? 1 : ulmin(ra->ra_win * 2, ra_max);
+    } else {
+        /* Random access. */
+        ra->ra_win = 0;
+        ra->ra_end = 0;
+    }
+    ra->ra_next = blkno + 1;
+
+    /* Only request blocks that haven't been requested yet. */
+    start = omax((off_t)blkno + 1, ra->ra_end);
+    end = (off_t)blkno + 1 + ra->ra_win;
+    if (nblks > 0 && end > (off_t)nblks)
+        end = nblks;
+    for (off_t i = start; i < end; i++) {
+        rablks[n] = i;
+        rasizes[n] = size;
+        n++;
+    }
+    if (end > ra->ra_end)
+        ra->ra_end = end;
+
+    return breadn(vnode, blkno, size, rablks, rasizes, n, bpp);
 }
 
 void bio_readin(struct buf * bp)
@@ -116,6 +373,7 @@ static void _bio_readin(struct buf * bp)
     file_t * file;
     vnode_t * vnode;
     struct uio uio;
+    ssize_t retval;
 
     KASSERT(mtx_test(&bp->lock), "bp should be locked\n");
 
@@ -133,13 +391,24 @@ static void _bio_readin(struct buf * bp)
     bp->b_flags &= ~B_DONE;
 
     if (uio_buf2kuio(bp, &uio)) {
-        /* TODO Error handling */
-        return;
+        bp->b_flags |= B_ERROR;
+        bp->b_error = -EIO;
+        goto out;
     }
     vnode->vnode_ops->lseek(file, bp->b_blkno, SEEK_SET);
-    vnode->vnode_ops->read(file, &uio, bp->b_bcount);
+    retval = vnode->vnode_ops->read(file, &uio, bp->b_bcount);
+    if (retval < 0) {
+        bp->b_flags |= B_ERROR;
+        bp->b_error = retval;
+    }
 
-    bp->b_flags |= B_DONE;
+out:
+    if (bp->b_flags & B_ERROR)
+        bp->b_flags &= ~B_CACHE;
+    else
+        bp->b_flags |= B_CACHE;
+    bp->b_flags &= ~B_READ;
+    bl_biodone(bp);
 }
 
 void bio_writeout(struct buf * bp)
@@ -157,6 +426,7 @@ static void _bio_writeout(struct buf * bp)
     file_t * file;
     vnode_t * vnode;
     struct uio uio;
+    ssize_t retval;
 
     KASSERT(mtx_test(&bp->lock), "bp should be locked\n");
 
@@ -175,20 +445,28 @@ static void _bio_writeout(struct buf * bp)
     vnode = file->vnode;
 
     if (uio_buf2kuio(bp, &uio)) {
-        /* TODO Error handling */
-        return;
+        bp->b_flags |= B_ERROR;
+        bp->b_error = -EIO;
+        goto out;
     }
     vnode->vnode_ops->lseek(file, bp->b_blkno, SEEK_SET);
-    vnode->vnode_ops->write(file, &uio, bp->b_bcount);
+    retval = vnode->vnode_ops->write(file, &uio, bp->b_bcount);
+    if (retval < 0) {
+        bp->b_flags |= B_ERROR;
+        bp->b_error = retval;
+    } else {
+        bp->b_flags |= B_CACHE;
+    }
 
 out:
-    bp->b_flags |= B_DONE;
+    bl_biodone(bp);
 }
 
 int bwrite(struct buf * bp)
 {
     unsigned flags;
     vnode_t * vnode;
+    int err;
 
     KASSERT(bp, "bp != NULL\n");
 
@@ -206,24 +484,25 @@ int bwrite(struct buf * bp)
 
     BUF_LOCK(bp);
     flags = bp->b_flags;
-    bp->b_flags &= ~(B_DONE | B_ERROR | B_ASYNC | B_DELWRI);
-    bp->b_flags |= B_BUSY;
+    bl_delwri_clear(bp);
+    bp->b_flags &= ~(B_DONE | B_ERROR | B_ASYNC | B_READ);
+    bp->b_flags |= B_BUSY | (flags & B_ASYNC);
     bp->b_error = 0;
-    BUF_UNLOCK(bp);
 
     /* TODO Use dirty offsets */
     if (flags & B_ASYNC) {
-        /* TODO */
+        BUF_UNLOCK(bp);
+        bio_ioq_insert(bp);
 
         return 0;
-    } else {
-        BUF_LOCK(bp);
-        _bio_writeout(bp);
-        bp->b_flags &= ~B_BUSY;
-        BUF_UNLOCK(bp);
     }
 
-    return 0;
+    _bio_writeout(bp);
+    err = (bp->b_flags & B_ERROR) ? bp->b_error : 0;
+    bl_brelse(bp);
+    BUF_UNLOCK(bp);
+
+    return err;
 }
 
 void bawrite(struct buf * bp)
@@ -237,8 +516,42 @@ void bawrite(struct buf * bp)
 void bdwrite(struct buf * bp)
 {
     BUF_LOCK(bp);
-    bp->b_flags |= B_DELWRI;
+    bl_delwri_set(bp);
+    bl_brelse(bp);
     BUF_UNLOCK(bp);
+
+    bio_balance();
+}
+
+/**
+ * Mark a buffer dirty.
+ * The caller must hold the buffer lock.
+ */
+static void bl_delwri_set(struct buf * bp)
+{
+    KASSERT(mtx_test(&bp->lock), "Lock is required.");
+
+    if (bp->b_flags & B_DELWRI)
+        return;
+
+    bp->b_flags |= B_DELWRI | B_CACHE;
+    bp->b_dirtytime = get_utime();
+    atomic_add(&bio_ndirty, bp->b_bufsize);
+}
+
+/**
+ * Clear the dirty status of a buffer.
+ * The caller must hold the buffer lock.
+ */
+static void bl_delwri_clear(struct buf * bp)
+{
+    KASSERT(mtx_test(&bp->lock), "Lock is required.");
+
+    if (!(bp->b_flags & B_DELWRI))
+        return;
+
+    bp->b_flags &= ~B_DELWRI;
+    atomic_sub(&bio_ndirty, bp->b_bufsize);
 }
 
 void bio_clrbuf(struct buf * bp)
@@ -254,9 +567,10 @@ void bio_clrbuf(struct buf * bp)
     if (flags & B_DELWRI) {
         _bio_writeout(bp);
     } else if (flags & B_ASYNC) {
-        biowait(bp);
+        (void)biowait_timo(bp, 0);
     }
-    bp->b_flags &= ~(B_DELWRI | B_ERROR);
+    bl_delwri_clear(bp);
+    bp->b_flags &= ~B_ERROR;
     bp->b_flags |= B_BUSY;
     BUF_UNLOCK(bp);
 
@@ -264,6 +578,7 @@ void bio_clrbuf(struct buf * bp)
 
     BUF_LOCK(bp);
     bp->b_flags &= ~B_BUSY;
+    waitq_wakeup_all(&bp->b_waitq);
     BUF_UNLOCK(bp);
 }
 
@@ -278,10 +593,10 @@ static struct buf * create_blk(vnode_t * vnode, size_t blkno, size_t size,
     bp->b_blkno = blkno;
 
     /* fd for the file */
-    fs_fildes_set(&bp->b_file, vnode, O_RDWR);
+    fs_fildes_set(&bp->b_file, vnode, O_RDWR | O_NOCACHE);
     bp->b_file.stream = NULL;
 
-    fs_fildes_set(&bp->b_devfile, vnode, O_RDWR);
+    fs_fildes_set(&bp->b_devfile, vnode, O_RDWR | O_NOCACHE);
     bp->b_devfile.stream = NULL;
 
     /* fd for the device */
@@ -294,101 +609,162 @@ static struct buf * create_blk(vnode_t * vnode, size_t blkno, size_t size,
         bp->b_devfile.vnode = NULL;
     }
 
-    bp->b_flags |= B_DONE;
-    bp->b_flags &= ~B_BUSY; /* Unbusy for now */
+    /* The new buffer is busy for the caller. */
+    bp->b_flags |= B_DONE | B_BUSY;
 
-    VN_LOCK(vnode);
+    return bp;
+}
 
-    /* Put to the buffer splay tree of the vnode. */
-    if (SPLAY_INSERT(bufhd_splay, &vnode->vn_bpo.sroot, bp))
-        panic("Double insert");
+/**
+ * Find a buffer from the buffer splay tree of a vnode.
+ * The caller must hold VN_LOCK(vnode).
+ */
+static struct buf * bl_incore(vnode_t * vnode, size_t blkno)
+{
+    struct bufhd * bf = &vnode->vn_bpo;
+    struct buf find;
 
-    VN_UNLOCK(vnode);
+    KASSERT(mtx_test(&vnode->vn_lock), "vnode should be locked");
 
-    return bp;
+    if (SPLAY_EMPTY(&bf->sroot))
+        return NULL;
+
+    find.b_file.vnode = vnode;
+    find.b_blkno = blkno;
+
+    return SPLAY_FIND(bufhd_splay, &bf->sroot, &find);
 }
 
 struct buf * getblk(vnode_t * vnode, size_t blkno, size_t size, int slptimeo)
 {
     struct buf * bp;
+    size_t oldsize;
 
     if (!vnode)
         return NULL;
 
-    /* For now we want to synchronize access to this function. */
-    mtx_lock(&cache_lock);
-
-    bp = incore(vnode, blkno);
+retry:
+    VN_LOCK(vnode);
+    bp = bl_incore(vnode, blkno);
     if (!bp) { /* Not found, create a new buffer. */
-        bp = create_blk(vnode, blkno, size, slptimeo);
-        if (!bp)
-            goto fail;
-    }
+        struct buf * nbp;
 
-    /* Found */
-retry:
-    biowait(bp); /* Wait until I/O has completed. */
+        VN_UNLOCK(vnode);
 
-    /*
-     * Wait until the buffer is released. It is possible that we don't get it
-     * locked for us on first try, so we just keep trying until it's not set
-     * busy by some other thread.
-     */
-    while (bp->b_flags & B_BUSY)
-        thread_yield(THREAD_YIELD_LAZY);
-    BUF_LOCK(bp);
-    if (bp->b_flags & B_BUSY) {
+        nbp = create_blk(vnode, blkno, size, slptimeo);
+        if (!nbp)
+            return NULL;
+
+        VN_LOCK(vnode);
+        if (SPLAY_INSERT(bufhd_splay, &vnode->vn_bpo.sroot, nbp)) {
+            /* Someone else created the same block while we were away. */
+            VN_UNLOCK(vnode);
+            vrfree(nbp);
+            goto retry;
+        }
+        VN_UNLOCK(vnode);
+        bp = nbp;
+        atomic_add(&bio_nbytes, bp->b_bufsize);
+    } else {
+        /*
+         * Sleep until the buffer is released. The buffer may be removed from
+         * the cache while we are sleeping, so we hold a reference to it and
+         * start the lookup over after waking up.
+         */
+        BUF_LOCK(bp);
+        if (bp->b_flags & B_BUSY) {
+            int err;
+
+            VN_UNLOCK(vnode);
+            if (kobj_ref(&bp->b_obj)) {
+                /* The buffer is being freed. */
+                BUF_UNLOCK(bp);
+                goto retry;
+            }
+            err = waitq_sleep(&bp->b_waitq, &bp->lock, slptimeo);
+            BUF_UNLOCK(bp);
+            vrfree(bp);
+            if (err)
+                return NULL;
+            goto retry;
+        }
+        bp->b_flags |= B_BUSY | B_REF;
+        /* Remove from the released list. */
+        bl_relse_remove(bp);
         BUF_UNLOCK(bp);
-        goto retry;
+        VN_UNLOCK(vnode);
     }
-    bp->b_flags |= B_BUSY;
-    /* Remove from the released list. */
-    TAILQ_REMOVE(&relse_list, bp, relse_entry_);
-    BUF_UNLOCK(bp);
 
+    oldsize = bp->b_bufsize;
     allocbuf(bp, size); /* Resize if necessary */
 
     BUF_LOCK(bp);
+    if (bp->b_bufsize != oldsize) {
+        const int delta = (int)bp->b_bufsize - (int)oldsize;
+
+        atomic_add(&bio_nbytes, delta);
+        if (bp->b_flags & B_DELWRI)
+            atomic_add(&bio_ndirty, delta);
+        bp->b_flags &= ~B_CACHE;
+    }
     bp->b_flags &= ~B_ERROR;
     bp->b_error = 0;
     BUF_UNLOCK(bp);
 
-fail:
-    mtx_unlock(&cache_lock);
+    bio_balance();
 
     return bp;
 }
 
 struct buf * incore(vnode_t * vnode, size_t blkno)
 {
-    struct bufhd * bf;
     struct buf * bp;
-    struct buf find;
 
     if (!vnode)
         return NULL;
 
-    bf = &vnode->vn_bpo;
-
-    if (SPLAY_EMPTY(&bf->sroot))
-        return NULL;
-
-    find.b_file.vnode = vnode;
-    find.b_blkno = blkno;
-    bp = SPLAY_FIND(bufhd_splay, &bf->sroot, &find);
+    VN_LOCK(vnode);
+    bp = bl_incore(vnode, blkno);
+    VN_UNLOCK(vnode);
 
     return bp;
 }
 
 static void bl_brelse(struct buf * bp)
 {
+    struct bio_relse_shard * shard = BIO_RELSE_SHARD(bp);
+
     KASSERT(mtx_test(&bp->lock), "Lock is required.");
 
     bp->b_flags &= ~B_BUSY;
 
-    mtx_lock(&cache_lock);
-    TAILQ_INSERT_TAIL(&relse_list, bp, relse_entry_);
-    mtx_unlock(&cache_lock);
+    if (!(bp->b_flags & B_RELSE)) {
+        mtx_lock(&shard->lock);
+        TAILQ_INSERT_TAIL(&shard->list, bp, relse_entry_);
+        bp->b_flags |= B_RELSE;
+        mtx_unlock(&shard->lock);
+    }
+
+    waitq_wakeup_all(&bp->b_waitq);
+}
+
+/**
+ * Remove a buffer from the released list.
+ * The caller must hold the buffer lock.
+ */
+static void bl_relse_remove(struct buf * bp)
+{
+    struct bio_relse_shard * shard = BIO_RELSE_SHARD(bp);
+
+    KASSERT(mtx_test(&bp->lock), "Lock is required.");
+
+    if (!(bp->b_flags & B_RELSE))
+        return;
+
+    mtx_lock(&shard->lock);
+    TAILQ_REMOVE(&shard->list, bp, relse_entry_);
+    bp->b_flags &= ~B_RELSE;
+    mtx_unlock(&shard->lock);
 }
 
 void brelse(struct buf * bp)
@@ -398,82 +774,553 @@ void brelse(struct buf * bp)
     BUF_UNLOCK(bp);
 }
 
-void biodone(struct buf * bp)
+/**
+ * Mark I/O complete and wakeup the threads waiting for it.
+ * An asynchronous buffer is also released.
+ * The caller must hold the buffer lock.
+ */
+static void bl_biodone(struct buf * bp)
 {
-    BUF_LOCK(bp);
-
-    KASSERT(bp->b_flags & B_DONE, "dup biodone");
+    KASSERT(mtx_test(&bp->lock), "Lock is required.");
 
     bp->b_flags |= B_DONE;
 
-    if (bp->b_flags & B_ASYNC)
+    if (bp->b_flags & B_ASYNC) {
+        bp->b_flags &= ~B_ASYNC;
         bl_brelse(bp);
+    } else {
+        waitq_wakeup_all(&bp->b_waitq);
+    }
+}
+
+void biodone(struct buf * bp)
+{
+    BUF_LOCK(bp);
+
+    KASSERT(!(bp->b_flags & B_DONE), "dup biodone");
+
+    bl_biodone(bp);
 
     BUF_UNLOCK(bp);
 }
 
+/**
+ * Wait for I/O to complete.
+ * The caller must hold the buffer lock.
+ * @param timeout is the timeout in ms; 0 = no timeout.
+ */
 static int biowait_timo(struct buf * bp, long timeout)
 {
-    /* TODO timeout */
+    KASSERT(mtx_test(&bp->lock), "Lock is required.");
 
-    while (!(bp->b_flags & B_DONE));
+    while (!(bp->b_flags & B_DONE)) {
+        if (waitq_sleep(&bp->b_waitq, &bp->lock, timeout))
+            return -ETIMEDOUT;
+    }
 
-    return bp->b_error;
+    if (bp->b_flags & B_ERROR)
+        return (bp->b_error != 0) ? bp->b_error : -EIO;
+    return 0;
 }
 
 int biowait(struct buf * bp)
 {
-    return biowait_timo(bp, 0);
+    int err;
+
+    BUF_LOCK(bp);
+    err = biowait_timo(bp, 0);
+    BUF_UNLOCK(bp);
+
+    return err;
 }
 
-/**
- * Cleanup released buffers.
- * @param freebufs  tells if released buffers should be freed after write out.
- */
-static void bio_clean(uintptr_t freebufs)
+void bio_vnode_cleanup(vnode_t * vnode)
 {
     struct buf * bp;
-    struct buf * bp_tmp;
 
-    if (mtx_trylock(&cache_lock))
-        return; /* Don't enter if we don't get exclusive access. */
+    KASSERT(vnode != NULL, "vnode can't be null.");
 
-    TAILQ_FOREACH_SAFE(bp, &relse_list, relse_entry_, bp_tmp) {
-        file_t * file;
-
-        /* Skip if already locked or BUSY */
-        if (mtx_trylock(&bp->lock) || (bp->b_flags & B_BUSY))
+    VN_LOCK(vnode);
+    while ((bp = SPLAY_MIN(bufhd_splay, &vnode->vn_bpo.sroot))) {
+        BUF_LOCK(bp);
+        if (bp->b_flags & B_BUSY) {
+            VN_UNLOCK(vnode);
+            if (!kobj_ref(&bp->b_obj)) {
+                (void)waitq_sleep(&bp->b_waitq, &bp->lock, 0);
+                BUF_UNLOCK(bp);
+                vrfree(bp);
+            } else {
+                BUF_UNLOCK(bp);
+            }
+            VN_LOCK(vnode);
             continue;
+        }
 
-        file = &bp->b_file;
+        SPLAY_REMOVE(bufhd_splay, &vnode->vn_bpo.sroot, bp);
+        bl_relse_remove(bp);
+        VN_UNLOCK(vnode);
 
-        /* Write out if delayed write was set. */
         if (bp->b_flags & B_DELWRI) {
             bp->b_flags |= B_BUSY;
             bp->b_flags &= ~B_ASYNC;
-
             _bio_writeout(bp);
+            bl_delwri_clear(bp);
+            bp->b_flags &= ~B_BUSY;
         }
+        atomic_sub(&bio_nbytes, bp->b_bufsize);
 
-        if (freebufs &&
-            !(bp->b_flags & B_LOCKED) &&
-            !VN_TRYLOCK(file->vnode)) {
-            SPLAY_REMOVE(bufhd_splay, &file->vnode->vn_bpo.sroot, bp);
-            TAILQ_REMOVE(&relse_list, bp, relse_entry_);
-            vrfree(bp);
-            VN_UNLOCK(file->vnode);
+        /* Anyone still waiting will start the lookup over. */
+        waitq_wakeup_all(&bp->b_waitq);
+        BUF_UNLOCK(bp);
+        vrfree(bp);
+
+        VN_LOCK(vnode);
+    }
+    VN_UNLOCK(vnode);
+}
+
+/**
+ * Test if the buffer cache should be shrinked.
+ */
+static int bio_pressure(void)
+{
+    return atomic_read(&bio_nbytes) > bio_maxbytes ||
+           atomic_read(&bio_ndirty) > bio_maxbytes / 2;
+}
+
+/**
+ * Evict clean released buffers until the cache is within its budget.
+ * The relse lists are scanned in LRU order and a buffer that was referenced
+ * since the previous scan gets a second chance.
+ */
+static void bio_evict(void)
+{
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < BIO_RELSE_NR_SHARDS; i++) {
+            struct bio_relse_shard * shard = &bio_relse_shards[i];
+            struct buf * bp;
+            struct buf * bp_tmp;
+
+            if (atomic_read(&bio_nbytes) <= bio_maxbytes)
+                return;
+
+            if (mtx_trylock(&shard->lock))
+                continue;
+
+            TAILQ_FOREACH_SAFE(bp, &shard->list, relse_entry_, bp_tmp) {
+                vnode_t * vnode;
+
+                if (atomic_read(&bio_nbytes) <= bio_maxbytes)
+                    break;
+
+                if (mtx_trylock(&bp->lock))
+                    continue;
+                if ((bp->b_flags & (B_BUSY | B_DELWRI | B_LOCKED)) ||
+                    !waitq_empty(&bp->b_waitq)) {
+                    BUF_UNLOCK(bp);
+                    continue;
+                }
+                if (bp->b_flags & B_REF) { /* Second chance. */
+                    bp->b_flags &= ~B_REF;
+                    BUF_UNLOCK(bp);
+                    continue;
+                }
+
+                vnode = bp->b_file.vnode;
+                if (vnode) {
+                    if (VN_TRYLOCK(vnode)) {
+                        BUF_UNLOCK(bp);
+                        continue;
+                    }
+                    SPLAY_REMOVE(bufhd_splay, &vnode->vn_bpo.sroot, bp);
+                    VN_UNLOCK(vnode);
+                    atomic_sub(&bio_nbytes, bp->b_bufsize);
+                }
+                TAILQ_REMOVE(&shard->list, bp, relse_entry_);
+                bp->b_flags &= ~B_RELSE;
+                BUF_UNLOCK(bp);
+
+                vrfree(bp);
+                atomic_inc(&bio_nevicted);
+            }
+
+            mtx_unlock(&shard->lock);
+        }
+    }
+}
+
+/**
+ * Keep the buffer cache within its budget.
+ * Clean buffers are evicted immediately and the flusher is woken up if there
+ * are too many dirty buffers.
+ */
+static void bio_balance(void)
+{
+    if (atomic_read(&bio_nbytes) > bio_maxbytes)
+        bio_evict();
+    if (bio_pressure())
+        waitq_wakeup(&bio_flush_waitq);
+}
+
+/**
+ * Collect released dirty buffers for writeback.
+ * The collected buffers are marked busy but left on the relse lists.
+ * @param all if set all dirty buffers are collected regardless of their age.
+ */
+static size_t bio_flush_collect(struct buf * bufs[], size_t max, int all)
+{
+    const uint64_t now = get_utime();
+    const uint64_t age = (uint64_t)bio_dirty_age * 1000;
+    size_t n = 0;
+
+    for (size_t i = 0; i < BIO_RELSE_NR_SHARDS && n < max; i++) {
+        struct bio_relse_shard * shard = &bio_relse_shards[i];
+        struct buf * bp;
+
+        mtx_lock(&shard->lock);
+        TAILQ_FOREACH(bp, &shard->list, relse_entry_) {
+            if (n == max)
+                break;
+
+            if (mtx_trylock(&bp->lock))
+                continue;
+            /* Back off from buffers that failed to write recently. */
+            if (!(bp->b_flags & B_DELWRI) || (bp->b_flags & B_BUSY) ||
+                ((!all || (bp->b_flags & B_ERROR)) &&
+                 now - bp->b_dirtytime < age)) {
+                BUF_UNLOCK(bp);
+                continue;
+            }
+            bp->b_flags |= B_BUSY;
+            bp->b_flags &= ~B_ASYNC;
+            BUF_UNLOCK(bp);
+
+            bufs[n++] = bp;
+        }
+        mtx_unlock(&shard->lock);
+    }
+
+    return n;
+}
+
+/**
+ * Order buffers by file and block number.
+ */
+static int bio_cluster_cmp(struct buf * a, struct buf * b)
+{
+    if (a->b_file.vnode != b->b_file.vnode)
+        return (uintptr_t)a->b_file.vnode < (uintptr_t)b->b_file.vnode ? -1 : 1;
+    if (a->b_blkno != b->b_blkno)
+        return a->b_blkno < b->b_blkno ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Get the file used for I/O on a buffer.
+ */
+static file_t * bio_iofile(struct buf * bp)
+{
+    return (bp->b_devfile.vnode) ? &bp->b_devfile : &bp->b_file;
+}
+
+/**
+ * Get the size of the unit of b_blkno.
+ * Devices are addressed in device blocks and other files in bytes.
+ */
+static size_t bio_blksize(struct buf * bp)
+{
+    vnode_t * vnode = bio_iofile(bp)->vnode;
+
+    if ((S_ISBLK(vnode->vn_mode) || S_ISCHR(vnode->vn_mode)) &&
+        vnode->vn_specinfo) {
+        struct dev_info * devnfo = (struct dev_info *)vnode->vn_specinfo;
+
+        return (devnfo->block_size > 0) ? devnfo->block_size : 1;
+    }
+    return 1;
+}
+
+/**
+ * Test if b can be appended to a cluster ending with a.
+ */
+static int bio_cluster_adjacent(struct buf * a, struct buf * b, size_t csize)
+{
+    const size_t blksize = bio_blksize(a);
+
+    return a->b_file.vnode == b->b_file.vnode &&
+           a->b_devfile.vnode == b->b_devfile.vnode &&
+           !((a->b_flags | b->b_flags) & B_NOSYNC) &&
+           (a->b_bcount % blksize) == 0 &&
+           a->b_blkno + a->b_bcount / blksize == b->b_blkno &&
+           csize + b->b_bcount <= BIO_CLUSTER_MAX;
+}
+
+/**
+ * Read adjacent blocks with a single device read.
+ * The buffers must be busy asynchronous read requests.
+ */
+static void bio_read_cluster(struct buf * bufs[], size_t n)
+{
+    struct buf * first = bufs[0];
+    file_t * file = bio_iofile(first);
+    struct uio uio;
+    uint8_t * data;
+    size_t size = 0;
+    ssize_t retval;
+
+    for (size_t i = 0; i < n; i++) {
+        size += bufs[i]->b_bcount;
+    }
+
+    data = kmalloc(size);
+    if (!data) {
+        for (size_t i = 0; i < n; i++) {
+            BUF_LOCK(bufs[i]);
+            _bio_readin(bufs[i]);
+            BUF_UNLOCK(bufs[i]);
+        }
+        return;
+    }
+
+    uio_init_kbuf(&uio, data, size);
+    file->vnode->vnode_ops->lseek(file, first->b_blkno, SEEK_SET);
+    retval = file->vnode->vnode_ops->read(file, &uio, size);
+
+    for (size_t i = 0, off = 0; i < n; off += bufs[i]->b_bcount, i++) {
+        struct buf * bp = bufs[i];
+
+        BUF_LOCK(bp);
+        if (retval >= 0 && off + bp->b_bcount <= (size_t)retval) {
+            memcpy((void *)bp->b_data, data + off, bp->b_bcount);
+            bp->b_flags |= B_CACHE;
         } else {
-            bp->b_flags &= ~B_BUSY;
+            bp->b_flags |= B_ERROR;
+            bp->b_error = (retval < 0) ? retval : -EIO;
+            bp->b_flags &= ~B_CACHE;
+        }
+        bp->b_flags &= ~B_READ;
+        bl_biodone(bp);
+        BUF_UNLOCK(bp);
+    }
+    kfree(data);
+    atomic_add(&bio_nclustered, n);
+}
+
+/**
+ * Complete a buffer written by the flusher.
+ * If the write failed the buffer is kept dirty and the flusher will retry
+ * after bio_dirty_age.
+ * The caller must hold the buffer lock.
+ */
+static void bl_flush_done(struct buf * bp, int err)
+{
+    KASSERT(mtx_test(&bp->lock), "Lock is required.");
+
+    if (err) {
+        bp->b_flags |= B_ERROR;
+        bp->b_error = err;
+        bp->b_dirtytime = get_utime();
+    } else {
+        bl_delwri_clear(bp);
+    }
+    bp->b_flags |= B_DONE;
+    bp->b_flags &= ~B_BUSY;
+    waitq_wakeup_all(&bp->b_waitq);
+}
+
+/**
+ * Write out adjacent dirty buffers with a single device write.
+ * @return Returns 0 if succeed; Otherwise a negative errno.
+ */
+static int bio_write_cluster(struct buf * bufs[], size_t n)
+{
+    struct buf * first = bufs[0];
+    file_t * file;
+    struct uio uio;
+    uint8_t * data;
+    size_t size = 0;
+    ssize_t retval;
+    int err = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        size += bufs[i]->b_bcount;
+    }
+
+    data = (n > 1) ? kmalloc(size) : NULL;
+    if (!data) {
+        for (size_t i = 0; i < n; i++) {
+            struct buf * bp = bufs[i];
+
+            int werr = 0;
+
+            BUF_LOCK(bp);
+            _bio_writeout(bp);
+            if (bp->b_flags & B_ERROR)
+                werr = (bp->b_error) ? bp->b_error : -EIO;
+            bl_flush_done(bp, werr);
             BUF_UNLOCK(bp);
+            if (werr && !err)
+                err = werr;
+        }
+        return err;
+    }
+
+    for (size_t i = 0, off = 0; i < n; off += bufs[i]->b_bcount, i++) {
+        memcpy(data + off, (void *)bufs[i]->b_data, bufs[i]->b_bcount);
+    }
+
+    file = bio_iofile(first);
+    uio_init_kbuf(&uio, data, size);
+    file->vnode->vnode_ops->lseek(file, first->b_blkno, SEEK_SET);
+    retval = file->vnode->vnode_ops->write(file, &uio, size);
+    kfree(data);
+
+    err = (retval < 0) ? (int)retval : 0;
+    for (size_t i = 0; i < n; i++) {
+        BUF_LOCK(bufs[i]);
+        bl_flush_done(bufs[i], err);
+        BUF_UNLOCK(bufs[i]);
+    }
+    atomic_add(&bio_nclustered, n);
+
+    return err;
+}
+
+/**
+ * Write out collected dirty buffers clustered by the block number.
+ * @return Returns 0 if succeed; Otherwise the first error encountered.
+ */
+static int bio_flush_bufs(struct buf * bufs[], size_t n)
+{
+    size_t i;
+    int err = 0;
+
+    /* Insertion sort, n is small. */
+    for (i = 1; i < n; i++) {
+        struct buf * bp = bufs[i];
+        size_t j = i;
+
+        while (j > 0 && bio_cluster_cmp(bufs[j - 1], bp) > 0) {
+            bufs[j] = bufs[j - 1];
+            j--;
         }
+        bufs[j] = bp;
     }
 
-    mtx_unlock(&cache_lock);
+    i = 0;
+    while (i < n) {
+        size_t j = i + 1;
+        size_t csize = bufs[i]->b_bcount;
+        int retval;
+
+        while (j < n && bio_cluster_adjacent(bufs[j - 1], bufs[j], csize)) {
+            csize += bufs[j]->b_bcount;
+            j++;
+        }
+        retval = bio_write_cluster(bufs + i, j - i);
+        if (retval && !err)
+            err = retval;
+        i = j;
+    }
+
+    return err;
 }
-/*
- * Idle task for cleaning up buffers.
+
+/**
+ * Buffer cache flusher.
+ * Writes back dirty buffers older than bio_dirty_age periodically and all
+ * dirty buffers when the cache is under pressure.
+ */
+static void * bio_flush_thread(void * arg)
+{
+    struct buf * bufs[BIO_FLUSH_BATCH];
+
+    while (1) {
+        int pressure;
+        size_t n;
+        int err;
+
+        (void)waitq_sleep(&bio_flush_waitq, NULL,
+                          (bio_flush_period > 0) ? bio_flush_period : 1000);
+
+        /* Don't keep retrying if writes are failing. */
+        do {
+            pressure = bio_pressure();
+            n = bio_flush_collect(bufs, num_elem(bufs), pressure);
+            err = bio_flush_bufs(bufs, n);
+            if (pressure)
+                bio_evict();
+        } while (!err && pressure && n == num_elem(bufs));
+    }
+
+    return NULL;
+}
+
+/**
+ * Wait until a buffer is no longer busy and drop the reference to it.
+ * The caller must hold a reference to the buffer.
  */
-IDLE_TASK(bio_clean, 0);
+static void bio_wait_notbusy(struct buf * bp)
+{
+    BUF_LOCK(bp);
+    while (bp->b_flags & B_BUSY) {
+        (void)waitq_sleep(&bp->b_waitq, &bp->lock, 0);
+    }
+    BUF_UNLOCK(bp);
+    vrfree(bp);
+}
+
+int bio_vnode_sync(vnode_t * vnode)
+{
+    struct buf * bufs[BIO_FLUSH_BATCH];
+
+    KASSERT(vnode != NULL, "vnode can't be null.");
+
+    /*
+     * Rescan the buffers until there are no dirty buffers left, busy buffers
+     * may be dirty once they are released.
+     */
+    while (1) {
+        struct buf * bp;
+        struct buf * busy = NULL;
+        size_t n = 0;
+        int err;
+
+        VN_LOCK(vnode);
+        SPLAY_FOREACH(bp, bufhd_splay, &vnode->vn_bpo.sroot) {
+            if (n == num_elem(bufs))
+                break;
+
+            BUF_LOCK(bp);
+            if (!(bp->b_flags & B_DELWRI)) {
+                BUF_UNLOCK(bp);
+                continue;
+            }
+            if (bp->b_flags & B_BUSY) {
+                /* Wait for the first busy buffer after this batch. */
+                if (!busy && !kobj_ref(&bp->b_obj))
+                    busy = bp;
+                BUF_UNLOCK(bp);
+                continue;
+            }
+            bp->b_flags |= B_BUSY;
+            bp->b_flags &= ~B_ASYNC;
+            BUF_UNLOCK(bp);
+
+            bufs[n++] = bp;
+        }
+        VN_UNLOCK(vnode);
+
+        err = bio_flush_bufs(bufs, n);
+        if (busy) {
+            bio_wait_notbusy(busy);
+        } else if (n == 0) {
+            return 0;
+        }
+        if (err)
+            return err;
+    }
+}
 
 int bio_geterror(struct buf * bp)
 {
@@ -33,7 +33,9 @@
 #include <errno.h>
 #include <sys/time.h>
 #include <syscall.h>
+#include <hal/core.h>
 #include <hal/hw_timers.h>
+#include <kdata.h>
 #include <kerror.h>
 #include <kinit.h>
 #include <klocks.h>
@@ -42,43 +44,74 @@
 #include <libkern.h>
 
 #define SEC_MS 1000
-#define SEC_US 1000000
 #define SEC_NS 1000000000
 
 /**
  * Current system time.
+ * Updates are serialized with timelock and readers use time_seq to get a
+ * consistent copy without locking.
  */
 static struct timespec uptime;
 static struct timespec realtime_off;
-static mtx_t timelock = MTX_INITIALIZER(MTX_TYPE_SPIN, 0);
+static unsigned time_seq; /*!< Odd while the time is being updated. */
+static mtx_t timelock = MTX_INITIALIZER(MTX_TYPE_SPIN, MTX_OPT_DINT);
+
+static void time_write_begin(void)
+{
+    time_seq++;
+    cpu_wmb();
+}
+
+static void time_write_end(void)
+{
+    struct timespec realtime;
+
+    cpu_wmb();
+    time_seq++;
+
+    timespec_add(&realtime, &uptime, &realtime_off);
+    kdata_update_time(&uptime, &realtime);
+}
+
+static unsigned time_read_begin(void)
+{
+    unsigned seq;
+
+    while ((seq = *(volatile unsigned *)&time_seq) & 1);
+    cpu_wmb();
+
+    return seq;
+}
+
+static int time_read_retry(unsigned seq)
+{
+    cpu_wmb();
+
+    return *(volatile unsigned *)&time_seq != seq;
+}
 
 /**
  * Update time counters.
+ * The time is advanced by the delta since the previous update, so it's
+ * irrelevant how often this function is called.
  */
 static void _update_time(void)
 {
     static uint64_t utime_last;
-    static uint64_t sec_next;
     uint64_t utime = get_utime();
-    uint64_t usecdiff;
+    uint64_t nsec;
 
     KASSERT(mtx_test(&timelock), "timelock should be locked");
 
-    /* Update seconds */
-    if (utime >= sec_next) {
-        uptime.tv_sec++;
-        sec_next = utime + SEC_US;
-    }
+    time_write_begin();
 
-    /* Update nsecs */
-    if (utime_last > utime)
-        usecdiff = (~0 - utime_last) + utime;
-    else
-        usecdiff = utime - utime_last;
-    uptime.tv_nsec = (uptime.tv_nsec + usecdiff * 1000);
-    uptime.tv_nsec = uptime.tv_nsec - (uptime.tv_nsec / SEC_NS) * SEC_NS;
+    nsec = (uint64_t)uptime.tv_nsec + (utime - utime_last) * 1000;
+    uptime.tv_sec += nsec / SEC_NS;
+    uptime.tv_nsec = nsec % SEC_NS;
 
     utime_last = utime;
+
+    time_write_end();
 }
 
 void update_time(void)
@@ -107,22 +140,30 @@ void nanotime(struct timespec * ts)
 
 void getnanotime(struct timespec * tsp)
 {
-    mtx_lock(&timelock);
-    *tsp = uptime;
-    mtx_unlock(&timelock);
+    unsigned seq;
+
+    do {
+        seq = time_read_begin();
+        *tsp = uptime;
+    } while (time_read_retry(seq));
 }
 
 void getrealtime(struct timespec * tsp)
 {
-    mtx_lock(&timelock);
-    timespec_add(tsp, &uptime, &realtime_off);
-    mtx_unlock(&timelock);
+    unsigned seq;
+
+    do {
+        seq = time_read_begin();
+        timespec_add(tsp, &uptime, &realtime_off);
+    } while (time_read_retry(seq));
 }
 
 void setrealtime(struct timespec * tsp)
 {
     mtx_lock(&timelock);
+    time_write_begin();
     timespec_sub(&realtime_off, tsp, &uptime);
+    time_write_end();
     mtx_unlock(&timelock);
 }
 
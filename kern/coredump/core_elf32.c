@@ -401,6 +401,11 @@ static off_t dump_regions(file_t * file, const struct vm_mm_struct * mm)
         if (SKIP_REGION(region))
             continue;
 
+        /* Pages still shared with a COW source aren't in b_data yet. */
+        err = vm_populate_region(region);
+        if (err)
+            return err;
+
         err = write2file(file, (void *)region->b_data, region->b_bufsize);
         if (err != region->b_bufsize)
             return err;
@@ -33,7 +33,7 @@
 
 #include <errno.h>
 #include <sys/sysctl.h>
-#include <bitmap.h>
+#include <buddy.h>
 #include <dynmem.h>
 #include <kerror.h>
 #include <klocks.h>
@@ -62,9 +62,7 @@
  */
 #define DYNMEM_MAPSIZE  ((configDYNMEM_SIZE) / DYNMEM_PAGE_SIZE)
 
-#define DYNMEM_BITMAPSIZE       E2BITMAP_SIZE(DYNMEM_MAPSIZE)
 #define SIZEOF_DYNMEMMAP        (DYNMEM_MAPSIZE * sizeof(uint32_t))
-#define SIZEOF_DYNMEMMAP_BITMAP (DYNMEM_BITMAPSIZE * sizeof(uint32_t))
 
 struct dynmem_desc {
     unsigned control    : 10;
@@ -78,7 +76,12 @@ struct dynmem_desc {
  * Dynmemmap allocation table.
  */
 static struct dynmem_desc dynmemmap[DYNMEM_MAPSIZE];
-static bitmap_t dynmemmap_bitmap[DYNMEM_BITMAPSIZE];
+
+/**
+ * Buddy allocator for free dynmem sections.
+ */
+static struct buddy dynmem_buddy;
+static struct buddy_blk dynmem_buddy_blk[DYNMEM_MAPSIZE];
 
 /**
  * Struct for temporary storage.
@@ -86,7 +89,7 @@ static bitmap_t dynmemmap_bitmap[DYNMEM_BITMAPSIZE];
 static mmu_region_t dynmem_region;
 
 /**
- * Lock used to protect dynmem_region struct, dynmem_bitmap and dynmemmap
+ * Lock used to protect dynmem_region struct, dynmem_buddy and dynmemmap
  * access.
  */
 static mtx_t dynmem_region_lock = MTX_INITIALIZER(MTX_TYPE_SPIN, 0);
@@ -186,9 +189,8 @@ static void mark_reserved_areas(void)
                                                     area->caddr_end;
         bytes = (end_addr - area->caddr_start + 1);
         blkcount = bytes / DYNMEM_PAGE_SIZE;
-        err = bitmap_block_update(dynmemmap_bitmap, 1, pos, blkcount,
-                                  SIZEOF_DYNMEMMAP_BITMAP);
-        KASSERT(err == 0, "vreg map update OOB");
+        err = buddy_reserve(&dynmem_buddy, pos, blkcount);
+        KASSERT(err == 0, "dynmem reserve failed");
         dynmem_free -= bytes;
         dynmem_reserved += bytes;
     }
@@ -199,6 +201,8 @@ static void mark_reserved_areas(void)
  */
 void dynmem_init(void)
 {
+    buddy_init(&dynmem_buddy, dynmem_buddy_blk, DYNMEM_MAPSIZE);
+    buddy_free(&dynmem_buddy, 0, DYNMEM_MAPSIZE);
     mark_reserved_areas();
 }
 
@@ -297,8 +301,8 @@ void * dynmem_alloc_region(size_t size, uint32_t ap, uint32_t ctrl)
 
     mtx_lock(&dynmem_region_lock);
 
-    if (bitmap_block_search(&pos, size, dynmemmap_bitmap,
-                           SIZEOF_DYNMEMMAP_BITMAP)) {
+    err = buddy_alloc(&dynmem_buddy, size, &pos);
+    if (err) {
         KERROR(KERROR_ERR, "%s(size %u): Out of dynmem, free %u/%u\n",
                __func__, size, dynmem_free, configDYNMEM_SIZE);
         goto out;
@@ -307,9 +311,6 @@ void * dynmem_alloc_region(size_t size, uint32_t ap, uint32_t ctrl)
     /* Update sysctl stats */
     dynmem_free -= size * DYNMEM_PAGE_SIZE;
 
-    err = bitmap_block_update(dynmemmap_bitmap, 1, pos, size,
-                              SIZEOF_DYNMEMMAP_BITMAP);
-    KASSERT(err == 0, "dynmem map update OOB");
     retval = kmap_allocation(pos, size, ap, ctrl);
 
 out:
@@ -347,7 +348,6 @@ void dynmem_free_region(void * addr)
 {
     size_t i;
     struct dynmem_desc * dp;
-    int err;
 
     mtx_lock(&dynmem_region_lock);
 
@@ -377,9 +377,7 @@ void dynmem_free_region(void * addr)
 
     /* Mark the region as unused. */
     memset(dp, 0, dynmem_region.num_pages * sizeof(struct dynmem_desc));
-    err = bitmap_block_update(dynmemmap_bitmap, 1, i, dynmem_region.num_pages,
-                              SIZEOF_DYNMEMMAP_BITMAP);
-    KASSERT(err == 0, "vreg map update OOB");
+    buddy_free(&dynmem_buddy, i, dynmem_region.num_pages);
 
     /* Update sysctl stats */
     dynmem_free += dynmem_region.num_pages * DYNMEM_PAGE_SIZE;
@@ -38,6 +38,7 @@
 #include <unistd.h>
 #include <buf.h>
 #include <exec.h>
+#include <kdata.h>
 #include <kerror.h>
 #include <kmalloc.h>
 #include <kstring.h>
@@ -188,6 +189,11 @@ int exec_file(struct exec_loadfn * loader, int fildes,
         KERROR_DBG("Unable to map a new env\n");
         goto fail;
     }
+
+    /* Map kernel data pages */
+    err = kdata_map(curproc);
+    if (err)
+        goto fail;
     vm_fixmemmap_proc(curproc);
 
     KERROR_DBG("Memory mapping done (pid = %d)\n", curproc->pid);
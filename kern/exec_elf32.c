@@ -213,33 +213,38 @@ static ssize_t read_section(struct elf_ctx * ctx, size_t sect_index,
 }
 
 /**
- * Create a memory region and load a section to it.
+ * Create a memory region for a section.
+ * The section is demand paged from the shared file image of the section and
+ * a writable section gets a private copy of each page on the first write.
  */
 static int load_section(struct elf_ctx * ctx, size_t sect_index,
                         struct buf ** region)
 {
     struct elf32_phdr * phdr = &ctx->phdr[sect_index];
+    struct buf * img;
     struct buf * sect;
-    void * ldp;
-    int prot, err;
+    int prot;
 
     if (phdr->p_memsz < phdr->p_filesz) {
         return -ENOEXEC;
     }
 
     prot = p_flags2b_uflags(phdr->p_flags);
-    sect = vm_newsect(phdr->p_vaddr + ctx->rbase, phdr->p_memsz, prot);
-    if (!sect) {
+    img = exec_textcache_get(ctx->file->vnode, phdr->p_offset, phdr->p_filesz,
+                             phdr->p_vaddr + ctx->rbase, phdr->p_memsz, prot);
+    if (!img) {
         return -ENOMEM;
     }
 
-    ldp = (void *)(sect->b_data + (phdr->p_vaddr - sect->b_mmu.vaddr));
-    err = read_section(ctx, sect_index, ldp, phdr->p_memsz);
-    if (err < 0) {
-        if (sect->vm_ops->rfree) {
-            sect->vm_ops->rfree(sect);
-        }
-        return -ENOEXEC;
+    if (!(prot & VM_PROT_WRITE)) {
+        *region = img;
+        return 0;
+    }
+
+    sect = img->vm_ops->rpclone(img);
+    img->vm_ops->rfree(img);
+    if (!sect) {
+        return -ENOMEM;
     }
 
     *region = sect;
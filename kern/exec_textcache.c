@@ -0,0 +1,252 @@
+/**
+ *******************************************************************************
+ * @file    exec_textcache.c
+ * @author  Olli Vanhoja
+ * @brief   Shared cache of executable file images.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#include <errno.h>
+#include <sys/queue.h>
+#include <sys/stat.h>
+#include <sys/sysctl.h>
+#include <sys/time.h>
+#include <buf.h>
+#include <exec.h>
+#include <fs/fs.h>
+#include <klocks.h>
+#include <vm/vm.h>
+
+/*
+ * The text cache keeps the demand paged file images of the loadable segments
+ * of recently executed files, so that all the processes executing the same
+ * file share the same read-only pages and a page is read from the file only
+ * once. The image of a writable segment is never mapped as such, instead the
+ * processes get lazy COW clones of it.
+ *
+ * Each entry holds a reference to its region, and the region holds a
+ * reference to the vnode. An entry is only evicted when no process is using
+ * its region anymore. Entries are recycled in LRU order.
+ */
+
+struct tc_entry {
+    struct buf * tc_region;     /*!< File image, NULL if unused. */
+    off_t tc_foff;              /*!< File offset of the segment. */
+    size_t tc_filesz;           /*!< Size of the segment in the file. */
+    uintptr_t tc_vaddr;         /*!< Address of the segment. */
+    size_t tc_memsz;            /*!< Size of the segment in memory. */
+    int tc_prot;                /*!< Protection of the segment. */
+    off_t tc_size;              /*!< File size when the entry was created. */
+    struct timespec tc_mtim;    /*!< File mtime when the entry was created. */
+    TAILQ_ENTRY(tc_entry) tc_lru;
+};
+
+static struct tc_entry tc_entries[configEXEC_TEXTCACHE_SIZE];
+static TAILQ_HEAD(tc_lru_head, tc_entry) tc_lru =
+    TAILQ_HEAD_INITIALIZER(tc_lru);
+static int tc_initialized;
+static mtx_t tc_lock = MTX_INITIALIZER(MTX_TYPE_SPIN, 0);
+
+SYSCTL_DECL(_vm_textcache);
+SYSCTL_NODE(_vm, OID_AUTO, textcache, CTLFLAG_RW, 0,
+            "Shared text cache");
+
+static int tc_enabled = 1;
+SYSCTL_INT(_vm_textcache, OID_AUTO, enabled, CTLFLAG_RW,
+           &tc_enabled, 0, "Text cache enabled");
+
+static atomic_t tc_nhits;
+SYSCTL_INT(_vm_textcache, OID_AUTO, hits, CTLFLAG_RD,
+           &tc_nhits, 0, "Number of segments found in the cache");
+
+static atomic_t tc_nmisses;
+SYSCTL_INT(_vm_textcache, OID_AUTO, misses, CTLFLAG_RD,
+           &tc_nmisses, 0, "Number of segments not found in the cache");
+
+/**
+ * Initialize the LRU list.
+ * @note tc_lock must be held.
+ */
+static void tc_init(void)
+{
+    if (tc_initialized)
+        return;
+
+    for (size_t i = 0; i < num_elem(tc_entries); i++) {
+        TAILQ_INSERT_TAIL(&tc_lru, &tc_entries[i], tc_lru);
+    }
+    tc_initialized = 1;
+}
+
+static struct tc_entry * tc_find(vnode_t * vnode, off_t foff, size_t filesz,
+                                 uintptr_t vaddr, size_t memsz, int prot)
+{
+    struct tc_entry * tcp;
+
+    TAILQ_FOREACH(tcp, &tc_lru, tc_lru) {
+        if (tcp->tc_region && tcp->tc_region->b_file.vnode == vnode &&
+            tcp->tc_foff == foff && tcp->tc_filesz == filesz &&
+            tcp->tc_vaddr == vaddr && tcp->tc_memsz == memsz &&
+            tcp->tc_prot == prot)
+            return tcp;
+    }
+
+    return NULL;
+}
+
+/**
+ * Remove an entry and move it to the head of the LRU.
+ * @return Returns the region of the entry to be freed by the caller after
+ *         tc_lock is released.
+ */
+static struct buf * tc_remove(struct tc_entry * tcp)
+{
+    struct buf * region = tcp->tc_region;
+
+    TAILQ_REMOVE(&tc_lru, tcp, tc_lru);
+    TAILQ_INSERT_HEAD(&tc_lru, tcp, tc_lru);
+    tcp->tc_region = NULL;
+
+    return region;
+}
+
+/**
+ * Get an entry for a new region.
+ * The least recently used entry not used by any process is recycled.
+ * @param[out] old is set to the region of a recycled entry.
+ * @return Returns an unused entry; NULL if all entries are busy.
+ */
+static struct tc_entry * tc_alloc(struct buf ** old)
+{
+    struct tc_entry * tcp;
+
+    *old = NULL;
+    TAILQ_FOREACH(tcp, &tc_lru, tc_lru) {
+        if (!tcp->tc_region) {
+            return tcp;
+        }
+        if (kobj_refcnt(&tcp->tc_region->b_obj) == 1) {
+            *old = tc_remove(tcp);
+            return tcp;
+        }
+    }
+
+    return NULL;
+}
+
+static int tc_valid(const struct tc_entry * tcp, const struct stat * st)
+{
+    return tcp->tc_size == st->st_size &&
+           timespec_cmp(&tcp->tc_mtim, &st->st_mtim, ==);
+}
+
+struct buf * exec_textcache_get(vnode_t * vnode, off_t foff, size_t filesz,
+                                uintptr_t vaddr, size_t memsz, int prot)
+{
+    struct stat st;
+    struct tc_entry * tcp;
+    struct buf * region;
+    struct buf * old = NULL;
+
+    if (!tc_enabled || vnode->vnode_ops->stat(vnode, &st)) {
+        return vm_newsect_file(vnode, foff, filesz, vaddr, memsz, prot);
+    }
+
+    mtx_lock(&tc_lock);
+    tc_init();
+    tcp = tc_find(vnode, foff, filesz, vaddr, memsz, prot);
+    if (tcp) {
+        if (tc_valid(tcp, &st)) {
+            region = tcp->tc_region;
+            region->vm_ops->rref(region);
+            TAILQ_REMOVE(&tc_lru, tcp, tc_lru);
+            TAILQ_INSERT_TAIL(&tc_lru, tcp, tc_lru);
+            mtx_unlock(&tc_lock);
+
+            atomic_inc(&tc_nhits);
+            return region;
+        }
+
+        /* The file was modified after the image was cached. */
+        old = tc_remove(tcp);
+    }
+    mtx_unlock(&tc_lock);
+
+    if (old)
+        vrfree(old);
+    atomic_inc(&tc_nmisses);
+
+    region = vm_newsect_file(vnode, foff, filesz, vaddr, memsz, prot);
+    if (!region)
+        return NULL;
+
+    mtx_lock(&tc_lock);
+    /* Someone else may have cached the same segment meanwhile. */
+    if (!tc_find(vnode, foff, filesz, vaddr, memsz, prot) &&
+        (tcp = tc_alloc(&old))) {
+        region->vm_ops->rref(region);
+        tcp->tc_region = region;
+        tcp->tc_foff = foff;
+        tcp->tc_filesz = filesz;
+        tcp->tc_vaddr = vaddr;
+        tcp->tc_memsz = memsz;
+        tcp->tc_prot = prot;
+        tcp->tc_size = st.st_size;
+        tcp->tc_mtim = st.st_mtim;
+        TAILQ_REMOVE(&tc_lru, tcp, tc_lru);
+        TAILQ_INSERT_TAIL(&tc_lru, tcp, tc_lru);
+    }
+    mtx_unlock(&tc_lock);
+
+    if (old)
+        vrfree(old);
+
+    return region;
+}
+
+void exec_textcache_purge_sb(struct fs_superblock * sb)
+{
+    struct buf * region;
+
+    do {
+        struct tc_entry * tcp;
+
+        region = NULL;
+        mtx_lock(&tc_lock);
+        tc_init();
+        TAILQ_FOREACH(tcp, &tc_lru, tc_lru) {
+            if (tcp->tc_region && tcp->tc_region->b_file.vnode->sb == sb) {
+                region = tc_remove(tcp);
+                break;
+            }
+        }
+        mtx_unlock(&tc_lock);
+
+        if (region)
+            vrfree(region);
+    } while (region);
+}
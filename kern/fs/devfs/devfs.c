@@ -32,8 +32,10 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/dev_major.h>
 #include <sys/ioctl.h>
+#include <buf.h>
 #include <fs/devfs.h>
 #include <fs/fs.h>
 #include <fs/fs_util.h>
@@ -44,6 +46,7 @@
 #include <kmalloc.h>
 #include <kstring.h>
 #include <libkern.h>
+#include <poll.h>
 #include <proc.h>
 
 /**
@@ -60,12 +63,14 @@ static void devfs_event_fd_closed(struct proc_info * p, file_t * file);
 static int devfs_stat(vnode_t * vnode, struct stat * buf);
 static int dev_ioctl(file_t * file, unsigned request,
                      void * arg, size_t arg_len);
+static int dev_poll(file_t * file, int events, struct poll_table * pt);
 
 vnode_ops_t devfs_vnode_ops = {
     .read = dev_read,
     .write = dev_write,
     .lseek = dev_lseek,
     .ioctl = dev_ioctl,
+    .poll = dev_poll,
     .event_fd_created = devfs_event_fd_created,
     .event_fd_closed = devfs_event_fd_closed,
     .stat = devfs_stat,
@@ -234,6 +239,96 @@ int devfs_lookup(vnode_t ** result, char * str)
     return 0;
 }
 
+/**
+ * Get the number of device blocks spanned by a transfer of bytes.
+ * The seek position of a device file is counted in blocks.
+ */
+static off_t dev_bytes2blocks(struct dev_info * devnfo, ssize_t bytes)
+{
+    const size_t bsize = devnfo->block_size;
+
+    if (bytes <= 0)
+        return 0;
+    return (off_t)(((size_t)bytes + bsize - 1) / bsize);
+}
+
+/**
+ * Read from a block device through the buffer cache.
+ * Sequential reads will start an asynchronous read-ahead of the following
+ * blocks.
+ */
+static ssize_t dev_read_cached(file_t * file, struct dev_info * devnfo,
+                               uint8_t * buf, size_t bcount)
+{
+    vnode_t * const vnode = file->vnode;
+    const size_t bsize = devnfo->block_size;
+    const size_t nblks = (devnfo->num_blocks > 0) ? devnfo->num_blocks : 0;
+    size_t blkno = file->seek_pos;
+    size_t bytes_rd = 0;
+    int err = 0;
+
+    while (bytes_rd < bcount) {
+        struct buf * bp = NULL;
+        size_t n;
+
+        if (nblks > 0 && blkno >= nblks)
+            break;
+
+        err = bread_ra(vnode, &file->f_ra, blkno, bsize, nblks, &bp);
+        if (err) {
+            if (bp)
+                brelse(bp);
+            break;
+        }
+
+        n = min(bsize, bcount - bytes_rd);
+        memcpy(buf + bytes_rd, (void *)bp->b_data, n);
+        brelse(bp);
+
+        bytes_rd += n;
+        blkno++;
+        if (n < bsize)
+            break;
+    }
+
+    file->seek_pos = blkno;
+    return (bytes_rd > 0) ? (ssize_t)bytes_rd : err;
+}
+
+/**
+ * Keep the buffer cache coherent with a write done directly to a device.
+ */
+static void dev_write_cached(file_t * file, struct dev_info * devnfo,
+                             off_t blkno, const uint8_t * buf, ssize_t bytes)
+{
+    vnode_t * const vnode = file->vnode;
+    const size_t bsize = devnfo->block_size;
+
+    if (!S_ISBLK(vnode->vn_mode) || (file->oflags & O_NOCACHE) || bytes <= 0)
+        return;
+
+    for (size_t off = 0; off < (size_t)bytes; off += bsize, blkno++) {
+        struct buf * bp;
+
+        if (!incore(vnode, blkno))
+            continue;
+
+        bp = getblk(vnode, blkno, bsize, 0);
+        if (!bp)
+            continue;
+
+        BUF_LOCK(bp);
+        if (off + bsize <= (size_t)bytes) {
+            memcpy((void *)bp->b_data, buf + off, bsize);
+            bp->b_flags |= B_CACHE;
+        } else {
+            bp->b_flags &= ~B_CACHE;
+        }
+        BUF_UNLOCK(bp);
+        brelse(bp);
+    }
+}
+
 ssize_t dev_read(file_t * file, struct uio * uio, size_t bcount)
 {
     vnode_t * const vnode = file->vnode;
@@ -253,9 +348,14 @@ ssize_t dev_read(file_t * file, struct uio * uio, size_t bcount)
     if (err)
         return err;
 
+    if (S_ISBLK(vnode->vn_mode) && !(oflags & O_NOCACHE))
+        return dev_read_cached(file, devnfo, buf, bcount);
+
     if ((devnfo->flags & DEV_FLAGS_MB_READ) &&
             ((bcount / devnfo->block_size) > 1)) {
-        return devnfo->read(devnfo, offset, buf, bcount, oflags);
+        bytes_rd = devnfo->read(devnfo, offset, buf, bcount, oflags);
+        file->seek_pos += dev_bytes2blocks(devnfo, bytes_rd);
+        return bytes_rd;
     }
 
     buf_offset = 0;
@@ -282,7 +382,7 @@ ssize_t dev_read(file_t * file, struct uio * uio, size_t bcount)
 
     bytes_rd = buf_offset;
 out:
-    file->seek_pos += bytes_rd;
+    file->seek_pos += dev_bytes2blocks(devnfo, bytes_rd);
     return bytes_rd;
 }
 
@@ -307,7 +407,10 @@ ssize_t dev_write(file_t * file, struct uio * uio, size_t bcount)
 
     if ((devnfo->flags & DEV_FLAGS_MB_WRITE) &&
             ((bcount / devnfo->block_size) > 1)) {
-        return devnfo->write(devnfo, offset, buf, bcount, oflags);
+        bytes_wr = devnfo->write(devnfo, offset, buf, bcount, oflags);
+        dev_write_cached(file, devnfo, offset, buf, bytes_wr);
+        file->seek_pos += dev_bytes2blocks(devnfo, bytes_wr);
+        return bytes_wr;
     }
 
     buf_offset = 0;
@@ -334,7 +437,8 @@ ssize_t dev_write(file_t * file, struct uio * uio, size_t bcount)
 
     bytes_wr = buf_offset;
 out:
-    file->seek_pos += bytes_wr;
+    dev_write_cached(file, devnfo, offset, buf, bytes_wr);
+    file->seek_pos += dev_bytes2blocks(devnfo, bytes_wr);
     return bytes_wr;
 }
 
@@ -390,3 +494,16 @@ static int dev_ioctl(file_t * file, unsigned request, void * arg, size_t arg_len
         return -EINVAL;
     }
 }
+
+static int dev_poll(file_t * file, int events, struct poll_table * pt)
+{
+    struct dev_info * devnfo = (struct dev_info *)file->vnode->vn_specinfo;
+
+    if (!devnfo)
+        return POLLNVAL;
+
+    if (devnfo->poll)
+        return devnfo->poll(file, devnfo, events, pt);
+
+    return nofs_poll(file, events, pt);
+}
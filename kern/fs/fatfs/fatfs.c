@@ -38,6 +38,7 @@
 #include <sys/ioctl.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
+#include <buf.h>
 #include <kerror.h>
 #include <kinit.h>
 #include <kstring.h>
@@ -45,6 +46,7 @@
 #include <fs/fs_util.h>
 #include <fs/vfs_hash.h>
 #include <kmalloc.h>
+#include <kmem_cache.h>
 #include <proc.h>
 #include "fatfs.h"
 
@@ -70,6 +72,7 @@ static int fresult2errno(int fresult);
 static struct fs fatfs_fs = {
     .fsname = FATFS_FSNAME,
     .fs_majornum = VDEV_MJNR_FATFS,
+    .fs_flags = FS_FLAG_NAMECACHE,
     .mount = fatfs_mount,
     .sblist_head = SLIST_HEAD_INITIALIZER(),
 };
@@ -77,6 +80,14 @@ static struct fs fatfs_fs = {
 static vfs_hash_ctx_t vfs_hash_ctx;
 static uint32_t fatfs_siphash_key[2];
 
+static void fatfs_inode_ctor(void * obj);
+
+/**
+ * Cache for fatfs inodes.
+ */
+KMEM_CACHE_DEFINE(fatfs_inode_cache, struct fatfs_inode, 32,
+                  fatfs_inode_ctor, NULL);
+
 vnode_ops_t fatfs_vnode_ops = {
     .write = fatfs_write,
     .read = fatfs_read,
@@ -126,11 +137,22 @@ int __kinit__ fatfs_init(void)
     return 0;
 }
 
+/**
+ * Construct a new fatfs inode for the cache.
+ * The constructed state of an inode is the same as after finalize_inode().
+ */
+static void fatfs_inode_ctor(void * obj)
+{
+    memset(obj, 0, sizeof(struct fatfs_inode));
+}
+
 static vnode_t * create_raw_inode(const struct fs_superblock * sb)
 {
     struct fatfs_inode * in;
 
-    in = kzalloc(sizeof(struct fatfs_inode));
+    in = kmem_cache_alloc(&fatfs_inode_cache);
+    if (!in)
+        return NULL;
 
     return &in->in_vnode;
 }
@@ -309,6 +331,7 @@ fail:
 static int fatfs_umount(struct fs_superblock * fs_sb)
 {
     struct fatfs_sb * fatfs_sb = get_ffsb_of_sb(fs_sb);
+    int err;
 
     /* TODO sync open vnodes and release them */
 
@@ -318,11 +341,14 @@ static int fatfs_umount(struct fs_superblock * fs_sb)
      */
     fs_remove_superblock(fs_sb->fs, &fatfs_sb->sb);
     f_umount(&fatfs_sb->ff_fs);
+    err = bio_vnode_sync(fatfs_sb->ff_devfile.vnode);
+    if (err)
+        KERROR(KERROR_ERR, "fatfs: Failed to sync on umount (%d)\n", err);
     vrele(fatfs_sb->ff_devfile.vnode);
     inpool_destroy(&fatfs_sb->inpool);
     kfree(fatfs_sb);
 
-    return 0;
+    return err;
 }
 
 /**
@@ -477,6 +503,64 @@ fail:
     return retval;
 }
 
+#ifdef configFATFS_FASTSEEK
+/**
+ * Initial size of a cluster link map in DWORDs.
+ */
+#define FATFS_CLMT_INIT 32
+
+/**
+ * Drop the cluster link map of a file.
+ */
+static void fatfs_clmt_drop(struct fatfs_inode * in)
+{
+    kfree(in->fp.cltbl);
+    in->fp.cltbl = NULL;
+}
+
+/**
+ * Build a cluster link map for a file.
+ * If the map doesn't fit in the table FatFs returns the required size, so
+ * the table is reallocated and the map is created again. If the map can't be
+ * built the file is accessed by following the FAT chain and the map is not
+ * built again until the file size changes.
+ */
+static void fatfs_clmt_build(struct fatfs_inode * in)
+{
+    FF_FIL * fp = &in->fp;
+    DWORD tlen = FATFS_CLMT_INIT;
+
+    while (1) {
+        DWORD * tbl;
+        FRESULT err;
+
+        tbl = kmalloc(tlen * sizeof(DWORD));
+        if (!tbl)
+            break;
+
+        tbl[0] = tlen;
+        fp->cltbl = tbl;
+        err = f_lseek(fp, CREATE_LINKMAP);
+        if (err == FR_OK)
+            return;
+
+        if (err != FR_NOT_ENOUGH_CORE || tbl[0] <= tlen) {
+            fatfs_clmt_drop(in);
+            break;
+        }
+        tlen = tbl[0];
+        fatfs_clmt_drop(in);
+    }
+
+    /*
+     * FatFs aborts the file if it fails to walk the chain but the file
+     * position isn't changed, so the normal seek can still be used.
+     */
+    fp->err = 0;
+    in->in_clmt_fail = fp->fsize;
+}
+#endif
+
 /**
  * Sync inode and destroy cached data linked to the inode.
  */
@@ -498,6 +582,10 @@ static void finalize_inode(vnode_t * vnode)
             f_sync(&in->fp);
     }
 
+#ifdef configFATFS_FASTSEEK
+    if (S_ISREG(vnode->vn_mode))
+        fatfs_clmt_drop(in);
+#endif
     kfree(in->in_fpath);
     memset(in, 0, sizeof(*in));
 }
@@ -513,7 +601,7 @@ static void destroy_vnode(vnode_t * vnode)
 
     /* TODO Free the inode, currently something fails and the kernel freezes. */
 #if 0
-    kfree(in);
+    kmem_cache_free(&fatfs_inode_cache, in);
 #endif
 }
 
@@ -725,6 +813,33 @@ static int fatfs_lookup(vnode_t * dir, const char * name, vnode_t ** result)
     return retval;
 }
 
+/**
+ * Select the seek mode for an access to a file.
+ * Fast seek can't extend a file, so the cluster link map is dropped if the
+ * access extends the file and otherwise it's built for large files.
+ * @param in        is the inode.
+ * @param offset    is the offset of the access.
+ * @param count     is the number of bytes accessed.
+ * @param extend    is set if the access may extend the file.
+ */
+void fatfs_select_seek(struct fatfs_inode * in, off_t offset, size_t count,
+                       int extend)
+{
+#ifdef configFATFS_FASTSEEK
+    FF_FIL * fp = &in->fp;
+
+    if (offset > (off_t)fp->fsize ||
+        (extend && offset + (off_t)count > (off_t)fp->fsize)) {
+        if (fp->cltbl)
+            fatfs_clmt_drop(in);
+    } else if (!fp->cltbl && !fp->err &&
+               fp->fsize >= configFATFS_FASTSEEK_MIN &&
+               fp->fsize != in->in_clmt_fail) {
+        fatfs_clmt_build(in);
+    }
+#endif
+}
+
 ssize_t fatfs_read(file_t * file, struct uio * uio, size_t count)
 {
     void * buf;
@@ -735,6 +850,7 @@ ssize_t fatfs_read(file_t * file, struct uio * uio, size_t count)
     if (!S_ISREG(file->vnode->vn_mode))
         return -EOPNOTSUPP;
 
+    fatfs_select_seek(in, file->seek_pos, count, 0);
     err = f_lseek(&in->fp, file->seek_pos);
     if (err)
         return -EIO;
@@ -761,6 +877,7 @@ ssize_t fatfs_write(file_t * file, struct uio * uio, size_t count)
     if (!S_ISREG(file->vnode->vn_mode))
         return -EOPNOTSUPP;
 
+    fatfs_select_seek(in, file->seek_pos, count, 1);
     err = f_lseek(&in->fp, file->seek_pos);
     if (err)
         return -EIO;
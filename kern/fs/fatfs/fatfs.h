@@ -63,6 +63,10 @@ struct fatfs_inode {
     FF_FIL fp;
     FF_DIR dp;
     };
+#ifdef configFATFS_FASTSEEK
+    DWORD in_clmt_fail; /*!< File size when building the cluster link map
+                         *   failed; 0 if not failed. */
+#endif
 };
 
 /**
@@ -114,6 +118,8 @@ int fatfs_stat(vnode_t * vnode, struct stat * buf);
 int fatfs_chmod(vnode_t * vnode, mode_t mode);
 int fatfs_chflags(vnode_t * vnode, fflags_t flags);
 int fatfs_chown(vnode_t * vnode, uid_t owner, gid_t group);
+void fatfs_select_seek(struct fatfs_inode * in, off_t offset, size_t count,
+                       int extend);
 
 #endif /* FATFS_H */
 
@@ -34,6 +34,7 @@
 #include <libkern.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <buf.h>
 #include <kstring.h>
 #include <libkern.h>
 #include <hal/core.h>
@@ -42,8 +43,24 @@
 #include <fs/devfs.h>
 #include "fatfs.h"
 
+/**
+ * Max number of sectors read ahead by a single multi-sector read.
+ */
+#define FATFS_DISK_RA_MAX 16
+
+/**
+ * Test if a sector belongs to the FAT area.
+ * FAT sectors are rewritten often, so writing them out is delayed.
+ */
+static int is_fat_sector(FATFS * ff_fs, DWORD sector)
+{
+    return sector >= ff_fs->fatbase &&
+           sector - ff_fs->fatbase < ff_fs->fsize * ff_fs->n_fats;
+}
+
 /**
  * Read sector(s).
+ * The sectors are read through the buffer cache of the device vnode.
  * @param buff      is a data buffer to store read data.
  * @param sector    is a sector address in LBA.
  * @param count     is the number of bytes to read.
@@ -52,34 +69,42 @@
 DRESULT fatfs_disk_read(FATFS * ff_fs, uint8_t * buff, DWORD sector,
                         unsigned int count)
 {
-    file_t * file = &get_ffsb_of_fffs(ff_fs)->ff_devfile;
-    struct vnode_ops * vnops = file->vnode->vnode_ops;
-    struct uio uio;
-    ssize_t retval;
+    vnode_t * vndev = get_ffsb_of_fffs(ff_fs)->ff_devfile.vnode;
+    const size_t ssize = ff_fs->ssize;
+    const size_t nsect = count / ssize;
 
-    retval = vnops->lseek(file, sector, SEEK_SET);
-    if (retval < 0) {
-#ifdef configFATFS_DEBUG
-        KERROR(KERROR_ERR, "%s(): err %i\n", __func__, retval);
-#endif
-        return RES_ERROR;
-    }
+    if (count % ssize)
+        return RES_PARERR;
 
-    uio_init_kbuf(&uio, buff, count);
-    retval = vnops->read(file, &uio, count);
-    if (retval < 0) {
+    for (size_t i = 0; i < nsect; i++) {
+        struct buf * bp = NULL;
+        int err;
+
+        if (i == 0 && nsect > 1) {
+            /* Read the rest of a multi-sector request ahead. */
+            size_t rablks[FATFS_DISK_RA_MAX];
+            int rasizes[FATFS_DISK_RA_MAX];
+            int nra = (int)min(nsect - 1, (size_t)FATFS_DISK_RA_MAX);
+
+            for (int j = 0; j < nra; j++) {
+                rablks[j] = sector + 1 + j;
+                rasizes[j] = ssize;
+            }
+            err = breadn(vndev, sector, ssize, rablks, rasizes, nra, &bp);
+        } else {
+            err = bread(vndev, sector + i, ssize, &bp);
+        }
+        if (err) {
 #ifdef configFATFS_DEBUG
-        KERROR(KERROR_ERR, "%s(): err %i\n", __func__, retval);
+            KERROR(KERROR_ERR, "%s(): err %i\n", __func__, err);
 #endif
-        return RES_ERROR;
-    }
+            if (bp)
+                brelse(bp);
+            return RES_ERROR;
+        }
 
-    if (retval != (ssize_t)count) {
-#ifdef configFATFS_DEBUG
-        KERROR(KERROR_WARN, "retval(%i) != count(%i)\n",
-                (uint32_t)retval, (uint32_t)count);
-#endif
-        return RES_PARERR;
+        memcpy(buff + i * ssize, (void *)bp->b_data, ssize);
+        brelse(bp);
     }
 
     return 0;
@@ -87,6 +112,9 @@ DRESULT fatfs_disk_read(FATFS * ff_fs, uint8_t * buff, DWORD sector,
 
 /**
  * Write sector(s).
+ * The sectors are written through the buffer cache of the device vnode.
+ * Sectors in the FAT area are delayed written and other sectors are
+ * written immediately.
  * @param buff      is the data buffer to be written.
  * @param sector    is a sector address in LBA.
  * @param count     is the number of bytes to write.
@@ -94,31 +122,42 @@ DRESULT fatfs_disk_read(FATFS * ff_fs, uint8_t * buff, DWORD sector,
 DRESULT fatfs_disk_write(FATFS * ff_fs, const uint8_t * buff, DWORD sector,
                          unsigned int count)
 {
-    file_t * file = &get_ffsb_of_fffs(ff_fs)->ff_devfile;
-    struct vnode_ops * vnops = file->vnode->vnode_ops;
-    struct uio uio;
-    ssize_t retval;
+    vnode_t * vndev = get_ffsb_of_fffs(ff_fs)->ff_devfile.vnode;
+    const size_t ssize = ff_fs->ssize;
+    const size_t nsect = count / ssize;
 
-    retval = vnops->lseek(file, sector, SEEK_SET);
-    if (retval < 0) {
-#ifdef configFATFS_DEBUG
-        KERROR(KERROR_ERR, "%s(): err %i\n", __func__, retval);
-#endif
-        return RES_ERROR;
-    }
+    if (count % ssize)
+        return RES_PARERR;
 
-    uio_init_kbuf(&uio, (void *)buff, count);
-    retval = vnops->write(file, &uio, count);
-    if (retval < 0) {
+    for (size_t i = 0; i < nsect; i++) {
+        struct buf * bp;
+
+        /* The whole sector is overwritten, so there is no need to read it. */
+        bp = getblk(vndev, sector + i, ssize, 0);
+        if (!bp)
+            return RES_ERROR;
+
+        BUF_LOCK(bp);
+        memcpy((void *)bp->b_data, buff + i * ssize, ssize);
+        bp->b_flags |= B_CACHE;
+        bp->b_flags &= ~B_ERROR;
+        BUF_UNLOCK(bp);
+
+        if (is_fat_sector(ff_fs, sector + i)) {
+            bdwrite(bp);
+        } else {
+            int err;
+
+            err = bwrite(bp);
+            if (err) {
 #ifdef configFATFS_DEBUG
-        KERROR(KERROR_ERR, "%s(): err %i\n", __func__, retval);
+                KERROR(KERROR_ERR, "%s(): err %i\n", __func__, err);
 #endif
-        return RES_ERROR;
+                return RES_ERROR;
+            }
+        }
     }
 
-    if (retval != (ssize_t)count)
-        return RES_PARERR;
-
     return 0;
 }
 
@@ -139,6 +178,13 @@ DRESULT fatfs_disk_ioctl(FATFS * ff_fs, unsigned cmd, void * buff, size_t bsize)
 
     switch (cmd) {
     case CTRL_SYNC:
+    case IOCTL_FLSBLKBUF:
+        /* Write out the delayed writes before flushing the device. */
+        if (bio_vnode_sync(file->vnode))
+            return RES_ERROR;
+        if (cmd == CTRL_SYNC)
+            return 0;
+        break;
     case CTRL_ERASE_SECTOR:
         /* TODO Not implemented yet. */
         return 0;
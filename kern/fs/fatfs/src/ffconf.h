@@ -16,7 +16,11 @@
  * To enable fast seek feature, set _USE_FASTSEEK to 1.
  * 0:Disable or 1:Enable
  */
+#ifdef configFATFS_FASTSEEK
+#define _USE_FASTSEEK   1
+#else
 #define _USE_FASTSEEK   0
+#endif
 
 /*---------------------------------------------------------------------------/
 / Locale and Namespace Configurations
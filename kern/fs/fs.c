@@ -38,12 +38,15 @@
 #include <termios.h>
 #include <unistd.h>
 #include <buf.h>
+#include <exec.h>
 #include <fs/fs.h>
 #include <fs/fs_util.h>
 #include <fs/mbr.h>
+#include <fs/namecache.h>
 #include <kerror.h>
 #include <kinit.h>
 #include <kmalloc.h>
+#include <kmem_cache.h>
 #include <ksignal.h>
 #include <kstring.h>
 #include <libkern.h>
@@ -59,6 +62,13 @@ static mtx_t fslock = MTX_INITIALIZER(MTX_TYPE_SPIN, 0);
 #define FS_UNLOCK()     mtx_unlock(&fslock)
 #define FS_TESTLOCK()   mtx_test(&fslock)
 
+static void fs_fildes_ctor(void * obj);
+
+/*
+ * Cache for kfreeable file descriptors.
+ */
+KMEM_CACHE_DEFINE(fs_fildes_cache, file_t, 64, fs_fildes_ctor, NULL);
+
 SYSCTL_NODE(, CTL_VFS, vfs, CTLFLAG_RW, 0,
             "File system");
 
@@ -236,6 +246,9 @@ int fs_mount(vnode_t * target, const char * source, const char * fsname,
         VN_UNLOCK(root);
     }
 
+    /* The old entries of target are now hidden by the mount. */
+    namecache_purge_dir(target);
+
     /* TODO inherit permissions */
 
     KERROR_DBG("Mount OK\n");
@@ -284,9 +297,40 @@ int fs_umount(struct fs_superblock * sb)
     root->vn_prev_mountpoint = root;
     VN_UNLOCK(root);
 
+    namecache_purge_sb(sb);
+    exec_textcache_purge_sb(sb);
+
     return sb->umount(sb);
 }
 
+/**
+ * Lookup a single path component from dir.
+ * The result is taken from the name cache if possible.
+ */
+static int lookup_name(vnode_t * dir, const char * name, vnode_t ** vnode)
+{
+    unsigned gen;
+    int err;
+
+    /* Dotdot may cross a mount point and it's not cached. */
+    if (!strcmp(name, ".."))
+        return dir->vnode_ops->lookup(dir, name, vnode);
+
+    err = namecache_lookup(dir, name, vnode);
+    if (err != -EAGAIN)
+        return err;
+
+    gen = namecache_gen();
+    err = dir->vnode_ops->lookup(dir, name, vnode);
+    if (err == 0) {
+        namecache_enter(dir, name, *vnode, gen);
+    } else if (err == -ENOENT) {
+        namecache_enter(dir, name, NULL, gen);
+    }
+
+    return err;
+}
+
 int lookup_vnode(vnode_t ** result, vnode_t * root, const char * str, int oflags)
 {
     char * path;
@@ -330,7 +374,7 @@ int lookup_vnode(vnode_t ** result, vnode_t * root, const char * str, int oflags
 
 again:  /* Get vnode by name in this dir. */
         vnode = NULL;
-        retval = (*result)->vnode_ops->lookup(*result, nodename, &vnode);
+        retval = lookup_name(*result, nodename, &vnode);
         vrele(*result);
         KASSERT((retval == 0 && vnode != NULL) || (retval != 0),
                 "vnode should be valid if !retval");
@@ -540,10 +584,21 @@ static void fs_fildes_dtor(struct kobj * obj)
     KERROR_DBG("%s(%p), vnode %pV\n", __func__, obj, vn);
 
     if (file->oflags & O_KFREEABLE)
-        kfree(file);
+        kmem_cache_free(&fs_fildes_cache, file);
     vrele(vn);
 }
 
+/**
+ * Construct a new file descriptor for the fildes cache.
+ */
+static void fs_fildes_ctor(void * obj)
+{
+    file_t * file = (file_t *)obj;
+
+    memset(file, 0, sizeof(file_t));
+    kobj_init(&file->f_obj, fs_fildes_dtor);
+}
+
 int fs_fildes_set(file_t * fildes, vnode_t * vnode, int oflags)
 {
     if (!(fildes && vnode))
@@ -551,6 +606,7 @@ int fs_fildes_set(file_t * fildes, vnode_t * vnode, int oflags)
 
     fildes->vnode = vnode;
     fildes->oflags = oflags;
+    memset(&fildes->f_ra, 0, sizeof(fildes->f_ra));
     kobj_init(&fildes->f_obj, fs_fildes_dtor);
 
     return 0;
@@ -599,18 +655,19 @@ perms_ok:
     if (retval < 0)
         goto out;
 
-    new_fildes = kzalloc(sizeof(file_t));
+    new_fildes = kmem_cache_alloc(&fs_fildes_cache);
     if (!new_fildes) {
         retval = -ENOMEM;
         goto out;
     }
 
-    if (S_ISDIR(vnode->vn_mode))
-        new_fildes->seek_pos = DIRENT_SEEK_START;
+    /* The rest is set by fs_fildes_set(). */
+    new_fildes->seek_pos = S_ISDIR(vnode->vn_mode) ? DIRENT_SEEK_START : 0;
+    new_fildes->stream = NULL;
 
     int fd = fs_fildes_curproc_next(new_fildes, 0);
     if (fd < 0) {
-        kfree(new_fildes);
+        kmem_cache_free(&fs_fildes_cache, new_fildes);
         retval = fd;
         goto out;
     }
@@ -854,6 +911,7 @@ int fs_creat_curproc(const char * pathname, mode_t mode, vnode_t ** result)
     mode &= ~S_IFMT; /* Filter out file type bits */
     mode &= ~curproc->files->umask;
     retval = dir->vnode_ops->create(dir, name, mode, result);
+    namecache_purge_dir(dir);
 
     KERROR_DBG("%s() result: %p\n", __func__, *result);
 
@@ -905,7 +963,10 @@ int fs_link_curproc(int fd1, const char * path1,
         return err;
     }
 
-    return vndir_dst->vnode_ops->link(vndir_dst, vn_src, targetname);
+    err = vndir_dst->vnode_ops->link(vndir_dst, vn_src, targetname);
+    namecache_purge_dir(vndir_dst);
+
+    return err;
 }
 
 int fs_unlink_curproc(int fd, const char * path, int atflags)
@@ -926,6 +987,8 @@ int fs_unlink_curproc(int fd, const char * path, int atflags)
 
         /* unlink() is prohibited on directories for non-root users. */
         err = fnode->vnode_ops->stat(fnode, &stat);
+        if (!err && S_ISDIR(stat.st_mode))
+            namecache_purge_dir(fnode);
         vrele(fnode);
         if (err) {
             return err;
@@ -956,7 +1019,15 @@ int fs_unlink_curproc(int fd, const char * path, int atflags)
         return err;
     }
 
-    return dir->vnode_ops->unlink(dir, filename);
+    /*
+     * The name cache must not hold a reference to the vnode while it's being
+     * unlinked.
+     */
+    namecache_purge_dir(dir);
+    err = dir->vnode_ops->unlink(dir, filename);
+    namecache_purge_dir(dir);
+
+    return err;
 }
 
 int fs_mkdir_curproc(const char * pathname, mode_t mode)
@@ -978,13 +1049,17 @@ int fs_mkdir_curproc(const char * pathname, mode_t mode)
 
     mode &= ~S_IFMT; /* Filter out file type bits */
     mode &= ~curproc->files->umask;
-    return dir->vnode_ops->mkdir(dir, name, mode);
+    err = dir->vnode_ops->mkdir(dir, name, mode);
+    namecache_purge_dir(dir);
+
+    return err;
 }
 
 int fs_rmdir_curproc(const char * pathname)
 {
     kmalloc_autofree char * name = NULL;
     vnode_autorele vnode_t * dir = NULL;
+    vnode_t * vn;
     int err;
 
     err = getvndir(pathname, &dir, &name, 0);
@@ -1003,7 +1078,20 @@ int fs_rmdir_curproc(const char * pathname)
         return err;
     }
 
-    return dir->vnode_ops->rmdir(dir, name);
+    /*
+     * Purge the entries of the directory to be removed as well as its entry
+     * in the parent dir, so that the name cache doesn't hold any references
+     * to it.
+     */
+    if (!dir->vnode_ops->lookup(dir, name, &vn)) {
+        namecache_purge_dir(vn);
+        vrele(vn);
+    }
+    namecache_purge_dir(dir);
+    err = dir->vnode_ops->rmdir(dir, name);
+    namecache_purge_dir(dir);
+
+    return err;
 }
 
 int fs_utimes_curproc(int fildes, const struct timespec times[2])
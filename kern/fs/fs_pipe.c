@@ -38,14 +38,18 @@
 #include <unistd.h>
 #include <buf.h>
 #include <fs/fs.h>
+#include <fs/fs_poll.h>
 #include <fs/fs_util.h>
 #include <kerror.h>
 #include <kinit.h>
 #include <kmalloc.h>
+#include <kobj.h>
 #include <libkern.h>
 #include <proc.h>
 #include <queue_r.h>
 #include <kern_ipc.h>
+#include <poll.h>
+#include <waitq.h>
 
 /*
  * TODO
@@ -54,16 +58,6 @@
  *   available
  */
 
-/*
- * Just a humble guess that lazy yield may render improved performance on
- * MP system.
- */
-#ifdef configMP
-#define PIPE_YIELD_STRATEGY THREAD_YIELD_LAZY
-#else
-#define PIPE_YIELD_STRATEGY THREAD_YIELD_IMMEDIATE
-#endif
-
 /**
  * Pipe descriptor pointed by file->stream.
  */
@@ -71,6 +65,8 @@ struct stream_pipe {
     struct vnode vnode;
     struct queue_cb q;
     struct buf * bp;
+    struct waitq sp_waitq;      /*!< Threads waiting for a state change. */
+    mtx_t sp_wait_lock;         /*!< Protects sleeping on sp_waitq. */
     file_t file0; /*!< Read end. */
     file_t file1; /*!< Write end. */
     uid_t owner;
@@ -86,10 +82,12 @@ static ssize_t fs_pipe_read(file_t * file, struct uio * uio, size_t count);
 static int fs_pipe_stat(vnode_t * vnode, struct stat * stat);
 static int fs_pipe_chmod(vnode_t * vnode, mode_t mode);
 static int fs_pipe_chown(vnode_t * vnode, uid_t owner, gid_t group);
+static int fs_pipe_poll(file_t * file, int events, struct poll_table * pt);
 
 static vnode_ops_t fs_pipe_ops = {
     .write = fs_pipe_write,
     .read = fs_pipe_read,
+    .poll = fs_pipe_poll,
     .stat = fs_pipe_stat,
     .chmod = fs_pipe_chmod,
     .chown = fs_pipe_chown,
@@ -118,10 +116,64 @@ int __kinit__ fs_pipe_init(void)
     return 0;
 }
 
+static void pipe_wakeup(struct stream_pipe * pipe)
+{
+    /*
+     * The sleeper checks the pipe state and goes to sleep while holding
+     * sp_wait_lock, so taking it here guarantees that the wakeup isn't lost.
+     */
+    mtx_lock(&pipe->sp_wait_lock);
+    if (!waitq_empty(&pipe->sp_waitq))
+        waitq_wakeup_all(&pipe->sp_waitq);
+    mtx_unlock(&pipe->sp_wait_lock);
+}
+
+/**
+ * Test if the other end of the pipe has been closed.
+ */
+static int pipe_end_closed(file_t * file)
+{
+    return kobj_refcnt(&file->f_obj) <= 0;
+}
+
+/**
+ * Wait until there is data in the pipe or the write end is closed.
+ */
+static void pipe_wait_data(struct stream_pipe * pipe)
+{
+    mtx_lock(&pipe->sp_wait_lock);
+    while (queue_isempty(&pipe->q) && !pipe_end_closed(&pipe->file1)) {
+        waitq_sleep(&pipe->sp_waitq, &pipe->sp_wait_lock, 0);
+    }
+    mtx_unlock(&pipe->sp_wait_lock);
+}
+
+/**
+ * Wait until there is space in the pipe or the read end is closed.
+ */
+static void pipe_wait_space(struct stream_pipe * pipe)
+{
+    mtx_lock(&pipe->sp_wait_lock);
+    while (queue_isfull(&pipe->q) && !pipe_end_closed(&pipe->file0)) {
+        waitq_sleep(&pipe->sp_waitq, &pipe->sp_wait_lock, 0);
+    }
+    mtx_unlock(&pipe->sp_wait_lock);
+}
+
+static void fs_pipe_fildes_dtor(struct kobj * obj)
+{
+    file_t * file = containerof(obj, struct file, f_obj);
+
+    /* Pollers of the other end must see the hangup. */
+    pipe_wakeup(file->stream);
+    vrele(file->vnode);
+}
+
 static void init_file(file_t * file, vnode_t * vn, struct stream_pipe * pipe,
                       int oflags)
 {
     fs_fildes_set(file, vn, oflags);
+    kobj_init(&file->f_obj, fs_pipe_fildes_dtor);
 
     file->oflags &= ~O_CLOEXEC;
     file->stream = pipe;
@@ -198,6 +250,8 @@ int fs_pipe_curproc_creat(struct files_struct * files, int fildes[2],
     /* Init queue */
     pipe->bp = bp;
     pipe->q = queue_create((char *)bp->b_data, sizeof(char), len);
+    waitq_init(&pipe->sp_waitq);
+    mtx_init(&pipe->sp_wait_lock, MTX_TYPE_SPIN, MTX_OPT_DEFAULT);
     pipe->owner = curproc->cred.euid;
     pipe->group = curproc->cred.egid;
 
@@ -244,7 +298,7 @@ static ssize_t fs_pipe_write(file_t * file, struct uio * uio, size_t count)
     if (!(file->oflags & O_WRONLY))
         return -EBADF;
 
-    if (kobj_ref(&pipe->file0.f_obj)) {
+    if (pipe_end_closed(&pipe->file0)) {
         return -EPIPE;
     }
 
@@ -255,17 +309,28 @@ static ssize_t fs_pipe_write(file_t * file, struct uio * uio, size_t count)
     /* TODO Implement O_NONBLOCK */
 
     for (size_t i = 0; i < count;) {
-        if (queue_push(&pipe->q, buf_addr + i))
-            i++;
-        /*
-         * FIXME Yielding is really needed but currently there seems to some
-         *       strange performance issues.
-         */
-#if 0
-        thread_yield(PIPE_YIELD_STRATEGY);
-#endif
+        char * p;
+        size_t n;
+
+        p = queue_alloc_get_n(&pipe->q, &n);
+        if (!p) {
+            /* Let the reader empty the pipe. */
+            pipe_wakeup(pipe);
+            if (pipe_end_closed(&pipe->file0))
+                return i;
+            pipe_wait_space(pipe);
+            continue;
+        }
+
+        n = min(n, count - i);
+        memcpy(p, buf_addr + i, n);
+        queue_alloc_commit_n(&pipe->q, n);
+        i += n;
     }
 
+    if (count > 0)
+        pipe_wakeup(pipe);
+
     return count;
 }
 
@@ -274,15 +339,9 @@ static ssize_t fs_pipe_read(file_t * file, struct uio * uio, size_t count)
     struct stream_pipe * pipe = (struct stream_pipe *)file->stream;
     char * buf_addr;
     int oflags = file->oflags;
-    int trycount = 0;
     int err;
 
-    /*
-     * TODO Atomic pipes
-     *
-     * Instead of using that trycount we should actually make pipes atomic per
-     * PIPE_BUF and return immediately after some data is received.
-     */
+    /* TODO Atomic pipes per PIPE_BUF */
 
     if (!(oflags & O_RDONLY))
         return -EBADF;
@@ -292,26 +351,173 @@ static ssize_t fs_pipe_read(file_t * file, struct uio * uio, size_t count)
         return err;
 
     for (size_t i = 0; i < count;) {
-        if (queue_isempty(&pipe->q) &&
-            ((trycount++ > 5 && (i > 0 || (oflags & O_NONBLOCK))) ||
-            kobj_ref(&pipe->file1.f_obj))) {
-            return i;
+        char * p;
+        size_t n;
+
+        p = queue_peek_n(&pipe->q, &n);
+        if (!p) {
+            /* Return what we have got so far. */
+            if (i > 0 || (oflags & O_NONBLOCK) ||
+                pipe_end_closed(&pipe->file1)) {
+                if (i > 0)
+                    pipe_wakeup(pipe);
+                return i;
+            }
+            pipe_wait_data(pipe);
+            continue;
         }
 
-        if (queue_pop(&pipe->q, buf_addr + i))
-            i++;
-        /*
-         * FIXME Yielding is really needed but currently there seems to some
-         *       strange performance issues.
-         */
-#if 0
-        thread_yield(PIPE_YIELD_STRATEGY);
-#endif
+        n = min(n, count - i);
+        memcpy(buf_addr + i, p, n);
+        queue_skip(&pipe->q, n);
+        i += n;
     }
 
+    if (count > 0)
+        pipe_wakeup(pipe);
+
     return count;
 }
 
+static int is_pipe(file_t * file)
+{
+    return file->vnode->vnode_ops == &fs_pipe_ops;
+}
+
+/**
+ * Move data from a pipe to a file.
+ * The data is passed to the file directly from the pipe buffer.
+ */
+static ssize_t pipe_splice_out(struct stream_pipe * pipe, file_t * out,
+                               size_t len, int flags)
+{
+    size_t moved = 0;
+    ssize_t retval = 0;
+
+    while (moved < len) {
+        struct uio uio;
+        char * p;
+        size_t n;
+
+        p = queue_peek_n(&pipe->q, &n);
+        if (!p) {
+            if (moved > 0 || pipe_end_closed(&pipe->file1))
+                break;
+            if (flags & SPLICE_F_NONBLOCK) {
+                retval = -EAGAIN;
+                break;
+            }
+            pipe_wait_data(pipe);
+            continue;
+        }
+
+        n = min(n, len - moved);
+        uio_init_kbuf(&uio, p, n);
+        retval = out->vnode->vnode_ops->write(out, &uio, n);
+        if (retval <= 0)
+            break;
+
+        queue_skip(&pipe->q, retval);
+        moved += retval;
+    }
+
+    if (moved > 0) {
+        pipe_wakeup(pipe);
+        return moved;
+    }
+    return retval;
+}
+
+/**
+ * Move data from a file to a pipe.
+ * The file is read directly to the pipe buffer.
+ */
+static ssize_t pipe_splice_in(file_t * in, struct stream_pipe * pipe,
+                              size_t len, int flags)
+{
+    size_t moved = 0;
+    ssize_t retval = 0;
+
+    while (moved < len) {
+        struct uio uio;
+        char * p;
+        size_t n;
+
+        if (pipe_end_closed(&pipe->file0)) {
+            retval = -EPIPE;
+            break;
+        }
+
+        p = queue_alloc_get_n(&pipe->q, &n);
+        if (!p) {
+            if (moved > 0)
+                break;
+            if (flags & SPLICE_F_NONBLOCK) {
+                retval = -EAGAIN;
+                break;
+            }
+            pipe_wait_space(pipe);
+            continue;
+        }
+
+        n = min(n, len - moved);
+        uio_init_kbuf(&uio, p, n);
+        retval = in->vnode->vnode_ops->read(in, &uio, n);
+        if (retval <= 0)
+            break;
+
+        queue_alloc_commit_n(&pipe->q, retval);
+        moved += retval;
+        if ((size_t)retval < n)
+            break; /* EOF or no more data available. */
+    }
+
+    if (moved > 0) {
+        pipe_wakeup(pipe);
+        return moved;
+    }
+    return retval;
+}
+
+ssize_t fs_pipe_splice(file_t * in, file_t * out, size_t len, int flags)
+{
+    if (!((in->oflags & O_RDONLY) && (out->oflags & O_WRONLY)))
+        return -EBADF;
+
+    if (is_pipe(in)) {
+        if (out->stream == in->stream)
+            return -EINVAL;
+        return pipe_splice_out(in->stream, out, len, flags);
+    } else if (is_pipe(out)) {
+        return pipe_splice_in(in, out->stream, len, flags);
+    }
+
+    return -EINVAL;
+}
+
+static int fs_pipe_poll(file_t * file, int events, struct poll_table * pt)
+{
+    struct stream_pipe * pipe = (struct stream_pipe *)file->stream;
+    int revents = 0;
+
+    poll_wait(pt, &pipe->sp_waitq);
+
+    if (file->oflags & O_RDONLY) {
+        if (!queue_isempty(&pipe->q))
+            revents |= events & (POLLIN | POLLRDNORM);
+        if (pipe_end_closed(&pipe->file1))
+            revents |= POLLHUP;
+    }
+    if (file->oflags & O_WRONLY) {
+        if (pipe_end_closed(&pipe->file0))
+            revents |= POLLERR;
+        else if (!queue_isfull(&pipe->q))
+            revents |= events & (POLLOUT | POLLWRNORM);
+    }
+
+    return revents;
+}
+
 int fs_pipe_stat(vnode_t * vnode, struct stat * stat)
 {
     struct stream_pipe * pipe = (struct stream_pipe *)vnode->vn_specinfo;
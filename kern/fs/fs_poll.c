@@ -0,0 +1,264 @@
+/**
+ *******************************************************************************
+ * @file    fs_poll.c
+ * @author  Olli Vanhoja
+ * @brief   poll() and select() support.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#include <errno.h>
+#include <hal/core.h>
+#include <hal/hw_timers.h>
+#include <kmalloc.h>
+#include <kobj.h>
+#include <proc.h>
+#include <thread.h>
+#include <fs/fs.h>
+#include <fs/fs_poll.h>
+
+/**
+ * Poll interval used if the poll table runs out of entries.
+ */
+#define POLL_OVERFLOW_INTERVAL 10
+
+void poll_wait(struct poll_table * pt, struct waitq * wq)
+{
+    struct poll_entry * pe;
+
+    if (!pt)
+        return;
+
+    if (pt->pt_count >= pt->pt_size) {
+        /* Can't wait on this queue, fall back to polling. */
+        poll_wait_interval(pt, POLL_OVERFLOW_INTERVAL);
+        return;
+    }
+
+    pe = &pt->pt_entries[pt->pt_count++];
+    pe->pe_wq = wq;
+    pe->pe_file = NULL;
+    waitq_add(wq, &pe->pe_we);
+}
+
+void poll_wait_interval(struct poll_table * pt, long ms)
+{
+    if (!pt)
+        return;
+
+    if (pt->pt_interval == 0 || ms < pt->pt_interval)
+        pt->pt_interval = ms;
+}
+
+/**
+ * Remove all entries from a poll table.
+ * @return Returns the number of entries that were woken up.
+ */
+static int poll_table_clear(struct poll_table * pt)
+{
+    int woken = 0;
+
+    for (size_t i = 0; i < pt->pt_count; i++) {
+        struct poll_entry * pe = &pt->pt_entries[i];
+
+        woken += waitq_remove(pe->pe_wq, &pe->pe_we);
+    }
+
+    /*
+     * The wait queues are owned by the files, so the refs can be released
+     * only after all entries are removed.
+     */
+    for (size_t i = 0; i < pt->pt_count; i++) {
+        struct poll_entry * pe = &pt->pt_entries[i];
+
+        if (pe->pe_file)
+            kobj_unref(&pe->pe_file->f_obj);
+    }
+    pt->pt_count = 0;
+    pt->pt_interval = 0;
+
+    return woken;
+}
+
+static int poll_table_woken(struct poll_table * pt)
+{
+    for (size_t i = 0; i < pt->pt_count; i++) {
+        struct poll_entry * pe = &pt->pt_entries[i];
+        int woken;
+
+        mtx_lock(&pe->pe_wq->wq_lock);
+        woken = pe->pe_we.we_woken;
+        mtx_unlock(&pe->pe_wq->wq_lock);
+        if (woken)
+            return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Sleep until any of the wait queues in a poll table is woken up.
+ * @param ms is the maximum time to sleep; -1 = infinite.
+ */
+static void poll_table_sleep(struct poll_table * pt, long ms)
+{
+    int timer_id = -1;
+    istate_t s;
+
+    if (pt->pt_interval > 0 && (ms < 0 || pt->pt_interval < ms))
+        ms = pt->pt_interval;
+
+    /*
+     * Interrupts are kept disabled between checking the wakeup status and
+     * blocking, see waitq_sleep().
+     */
+    s = get_interrupt_state();
+    disable_interrupt();
+
+    if (poll_table_woken(pt)) {
+        set_interrupt_state(s);
+        return;
+    }
+
+    if (ms >= 0) {
+        timer_id = thread_alarm((ms > 0) ? ms : 1);
+        if (timer_id < 0) {
+            /* Out of timers, poll instead. */
+            set_interrupt_state(s);
+            thread_yield(THREAD_YIELD_LAZY);
+            return;
+        }
+    }
+
+    thread_wait();
+    set_interrupt_state(s);
+
+    if (timer_id >= 0)
+        thread_alarm_rele(timer_id);
+}
+
+/**
+ * Scan all polled files once.
+ * @return Returns the number of ready files.
+ */
+static int poll_scan(struct pollfd * fds, nfds_t nfds, struct poll_table * pt)
+{
+    files_t * files = curproc->files;
+    int nready = 0;
+
+    for (nfds_t i = 0; i < nfds; i++) {
+        struct pollfd * pfd = &fds[i];
+        file_t * file;
+        vnode_t * vn;
+        size_t first;
+        int revents;
+
+        pfd->revents = 0;
+        if (pfd->fd < 0)
+            continue;
+
+        file = fs_fildes_ref(files, pfd->fd, 1);
+        if (!file) {
+            pfd->revents = POLLNVAL;
+            nready++;
+            continue;
+        }
+
+        vn = file->vnode;
+        first = (pt) ? pt->pt_count : 0;
+        revents = (vn->vnode_ops->poll) ?
+            vn->vnode_ops->poll(file, pfd->events, pt) :
+            nofs_poll(file, pfd->events, pt);
+        if (pt && pt->pt_count > first) {
+            /* Keep the file and its wait queues alive while sleeping. */
+            pt->pt_entries[first].pe_file = file;
+        } else {
+            fs_fildes_ref(files, pfd->fd, -1);
+        }
+
+        pfd->revents = revents & (pfd->events | POLLERR | POLLHUP | POLLNVAL);
+        if (pfd->revents) {
+            nready++;
+            /* No need to wait anymore. */
+            pt = NULL;
+        }
+    }
+
+    return nready;
+}
+
+int fs_poll_curproc(struct pollfd * fds, nfds_t nfds, int timeout)
+{
+    struct poll_table pt = {
+        .pt_count = 0,
+        .pt_interval = 0,
+    };
+    const uint64_t deadline = (timeout > 0) ?
+        get_utime() + (uint64_t)timeout * 1000 : 0;
+    int nready;
+
+    if (nfds > (nfds_t)curproc->files->count)
+        return -EINVAL;
+
+    /* Most files have a separate wait queue for reading and writing. */
+    pt.pt_size = 2 * nfds;
+    pt.pt_entries = kmalloc((pt.pt_size + 1) * sizeof(struct poll_entry));
+    if (!pt.pt_entries)
+        return -ENOMEM;
+
+    while (1) {
+        long ms = -1;
+        int untimed;
+
+        nready = poll_scan(fds, nfds, (timeout != 0) ? &pt : NULL);
+        if (nready > 0 || timeout == 0)
+            break;
+
+        if (timeout > 0) {
+            uint64_t now = get_utime();
+
+            if (now >= deadline)
+                break;
+            ms = (long)((deadline - now + 999) / 1000);
+        }
+
+        poll_table_sleep(&pt, ms);
+        untimed = (ms < 0 && pt.pt_interval == 0);
+        if (!poll_table_clear(&pt) && untimed) {
+            /*
+             * The thread was released by something else than a wait queue
+             * or a timer, most likely a signal.
+             */
+            nready = -EINTR;
+            break;
+        }
+    }
+
+    poll_table_clear(&pt);
+    kfree(pt.pt_entries);
+
+    return nready;
+}
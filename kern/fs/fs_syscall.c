@@ -42,6 +42,7 @@
 #include <errno.h>
 #include <kerror.h>
 #include <libkern.h>
+#include <kmalloc.h>
 #include <kstring.h>
 #include <vm/vm.h>
 #include <vm/vm_copyinstruct.h>
@@ -52,6 +53,7 @@
 #include <fs/devfs.h>
 #include <fs/fs.h>
 #include <fs/fs_util.h>
+#include <fs/fs_poll.h>
 
 static int sys_readwrite(__user void * user_args, int write)
 {
@@ -1096,6 +1098,55 @@ out:
     return retval;
 }
 
+static intptr_t sys_poll(__user void * user_args)
+{
+    struct _fs_poll_args args;
+    struct pollfd * fds;
+    size_t size;
+    int err;
+    int retval = -1;
+
+    err = copyin(user_args, &args, sizeof(args));
+    if (err) {
+        set_errno(EFAULT);
+        return -1;
+    }
+
+    if (args.nfds > (nfds_t)curproc->files->count) {
+        set_errno(EINVAL);
+        return -1;
+    }
+
+    size = args.nfds * sizeof(struct pollfd);
+    fds = kmalloc(size + 1);
+    if (!fds) {
+        set_errno(ENOMEM);
+        return -1;
+    }
+
+    err = copyin((__user void *)args.fds, fds, size);
+    if (err) {
+        set_errno(EFAULT);
+        goto out;
+    }
+
+    err = fs_poll_curproc(fds, args.nfds, args.timeout);
+    if (err < 0) {
+        set_errno(-err);
+        goto out;
+    }
+
+    if (copyout(fds, (__user void *)args.fds, size)) {
+        set_errno(EFAULT);
+        goto out;
+    }
+
+    retval = err;
+out:
+    kfree(fds);
+    return retval;
+}
+
 /**
  * Declarations of fs syscall functions.
  */
@@ -1123,5 +1174,6 @@ static const syscall_handler_t fs_sysfnmap[] = {
     ARRDECL_SYSCALL_HNDL(SYSCALL_FS_UMASK, sys_umask),
     ARRDECL_SYSCALL_HNDL(SYSCALL_FS_MOUNT, sys_mount),
     ARRDECL_SYSCALL_HNDL(SYSCALL_FS_UMOUNT, sys_umount),
+    ARRDECL_SYSCALL_HNDL(SYSCALL_FS_POLL, sys_poll),
 };
 SYSCALL_HANDLERDEF(fs_syscall, fs_sysfnmap)
@@ -159,22 +159,10 @@ void fs_vnode_init(vnode_t * vnode, ino_t vn_num, struct fs_superblock * sb,
 
 void fs_vnode_cleanup(vnode_t * vnode)
 {
-    struct buf * var;
-    struct buf * nxt;
-
     KASSERT(vnode != NULL, "vnode can't be null.");
 
-    /* Release associated buffers. */
-    if (!SPLAY_EMPTY(&vnode->vn_bpo.sroot)) {
-        for (var = SPLAY_MIN(bufhd_splay, &vnode->vn_bpo.sroot);
-                var != NULL; var = nxt) {
-            nxt = SPLAY_NEXT(bufhd_splay, &vnode->vn_bpo.sroot, var);
-            SPLAY_REMOVE(bufhd_splay, &vnode->vn_bpo.sroot, var);
-            if (!(var->b_flags & B_DONE))
-                var->b_flags |= B_DELWRI;
-            brelse(var);
-        }
-   }
+    /* Write out and free associated buffers. */
+    bio_vnode_cleanup(vnode);
 }
 
 void fs_parse_parm(char * parm, const char * names[],
@@ -32,19 +32,12 @@
  */
 
 #include <errno.h>
-#include <machine/atomic.h>
+#include <poll.h>
+#include <fs/fs_poll.h>
 #include <fs/fs_queue.h>
 #include <kerror.h>
 #include <libkern.h>
 
-/**
- * FSQ signaling end points.
- */
-enum wait4end {
-    FSQ_WAIT4READ,
-    FSQ_WAIT4WRITE,
-};
-
 struct fs_queue * fs_queue_create(size_t nr_blocks, size_t block_size)
 {
     struct buf * bp;
@@ -60,6 +53,10 @@ struct fs_queue * fs_queue_create(size_t nr_blocks, size_t block_size)
     fsq->qcb = queue_create(fsq->packet, block_size, nr_blocks);
     mtx_init(&fsq->wr_lock, MTX_TYPE_TICKET, MTX_OPT_DEFAULT);
     mtx_init(&fsq->rd_lock, MTX_TYPE_TICKET, MTX_OPT_DEFAULT);
+    mtx_init(&fsq->wait_lock, MTX_TYPE_SPIN, MTX_OPT_DEFAULT);
+    waitq_init(&fsq->rd_waitq);
+    waitq_init(&fsq->wr_waitq);
+    waitq_init(&fsq->poll_waitq);
     fsq->bp = bp;
 
     return fsq;
@@ -79,97 +76,22 @@ void fs_queue_destroy(struct fs_queue * fsq)
 }
 
 /**
- * Get a pointer to the end point signals pointer.
+ * Wake up the other end of a queue.
  * @param fsq is a pointer to the fs queue object.
- * @param ep selects the end point.
- * @return A pointer to a corresponding signals struct pointer.
+ * @param wq is the wait queue of the other end.
  */
-static struct signals ** fsq_get_sigs(struct fs_queue * fsq, enum wait4end ep)
+static void fsq_wakeup(struct fs_queue * fsq, struct waitq * wq)
 {
-    switch (ep) {
-    case FSQ_WAIT4READ:
-        return &fsq->waiting4read;
-    case FSQ_WAIT4WRITE:
-        return &fsq->waiting4write;
-    default:
-        panic("Invalid end point for waiting");
-    }
-}
-
-/**
- * Create a sigset to be used for fsq signal waiting.
- * @return A sigset_t with necessary signals set.
- */
-static sigset_t create_fsq_sigset(void)
-{
-    sigset_t sigset;
-
-    sigemptyset(&sigset);
-    sigaddset(&sigset, _SIGKERN);
-
-    return sigset;
-}
-
-/**
- * Initialize sigwait cond for the current thread.
- * @param fsq is a pointer to the fs queue object.
- * @param[out] oldset is the original signal set blocked.
- */
-static void fsq_sigwait_init(struct fs_queue * fsq, enum wait4end ep,
-                             sigset_t * oldset)
-{
-    sigset_t newset = create_fsq_sigset();
-    struct signals * sigs = &current_thread->sigs;
-    struct signals ** waitsigsp = fsq_get_sigs(fsq, ep);
-
-    ksignal_sigsmask(sigs, SIG_BLOCK, &newset, oldset);
-    while (atomic_cmpxchg_ptr((void **)waitsigsp, NULL, sigs));
-}
-
-/**
- * Wait for a signal telling us to continue the ongoing fsq operation.
- */
-static inline void fsq_sigwait(void)
-{
-    sigset_t newset = create_fsq_sigset();
-    siginfo_t retval;
-
     /*
-     * FIXME We should wait for a signal here but for some reason it causes
-     * everything to hang.
+     * The sleeper checks the queue state and goes to sleep while holding
+     * wait_lock, so taking it here guarantees that the wakeup isn't lost.
      */
+    mtx_lock(&fsq->wait_lock);
+    waitq_wakeup_all(wq);
+    mtx_unlock(&fsq->wait_lock);
 
-    ksignal_sigwait(&retval, &newset);
-}
-
-/**
- * Clear sigwait cond of the current thread.
- * @param fsq is a pointer to the fs queue object.
- */
-static void fsq_sigwait_clear(struct fs_queue * fsq, enum wait4end ep,
-                              sigset_t * oldset)
-{
-    struct signals * sigs = &current_thread->sigs;
-    struct signals ** waitsigsp = fsq_get_sigs(fsq, ep);
-
-    ksignal_sigsmask(sigs, SIG_SETMASK, oldset, NULL);
-    atomic_set_ptr((void **)waitsigsp, NULL);
-}
-
-/**
- * Send a signal to the other end if a tread is waiting there.
- * @param fsq is a pointer to the fs queue object.
- */
-static void fsq_sigsend(struct fs_queue * fsq, enum wait4end ep)
-{
-    struct signals * waitsigs;
-    struct ksignal_param param = {
-        .si_code = SIGKERN_FSQ,
-    };
-
-    waitsigs = atomic_read_ptr((void **)fsq_get_sigs(fsq, ep));
-    if (waitsigs)
-        ksignal_sendsig(waitsigs, _SIGKERN, &param);
+    if (!waitq_empty(&fsq->poll_waitq))
+        waitq_wakeup_all(&fsq->poll_waitq);
 }
 
 ssize_t fs_queue_write(struct fs_queue * fsq, uint8_t * buf, size_t count,
@@ -180,6 +102,7 @@ ssize_t fs_queue_write(struct fs_queue * fsq, uint8_t * buf, size_t count,
     size_t bytes;
     size_t left = count;
     ssize_t wr = 0;
+    int committed = 0;
 
     if (count == 0)
         return 0;
@@ -196,26 +119,25 @@ ssize_t fs_queue_write(struct fs_queue * fsq, uint8_t * buf, size_t count,
     }
 
     while (left > 0) {
-        if (offset == 0) {
-            if ((flags & FS_QUEUE_FLAGS_NONBLOCK) &&
-                !(p = queue_alloc_get(&fsq->qcb))) {
+        if (offset == 0 && !(p = queue_alloc_get(&fsq->qcb))) {
+            if (flags & FS_QUEUE_FLAGS_NONBLOCK)
                 goto out;
-            } else { /* Blocking IO */
-                sigset_t oldset;
 
-                fsq_sigwait_init(fsq, FSQ_WAIT4READ, &oldset);
-                while (!(p = queue_alloc_get(&fsq->qcb))) {
-
-                    /*
-                     * Queue is full.
-                     * Wait for the reading end to free some space.
-                     */
-                    fsq_sigwait();
-                }
+            /*
+             * Queue is full.
+             * Let the reader see what we have written so far and wait for it
+             * to free some space.
+             */
+            if (committed) {
+                fsq_wakeup(fsq, &fsq->rd_waitq);
+                committed = 0;
+            }
 
-                /* Reset sigmask and wait state. */
-                fsq_sigwait_clear(fsq, FSQ_WAIT4READ, &oldset);
+            mtx_lock(&fsq->wait_lock);
+            while (!(p = queue_alloc_get(&fsq->qcb))) {
+                waitq_sleep(&fsq->wr_waitq, &fsq->wait_lock, 0);
             }
+            mtx_unlock(&fsq->wait_lock);
         }
 
         bytes = min(left, fsq->qcb.b_size - offset);
@@ -233,7 +155,7 @@ ssize_t fs_queue_write(struct fs_queue * fsq, uint8_t * buf, size_t count,
         }
 
         queue_alloc_commit(&fsq->qcb);
-        fsq_sigsend(fsq, FSQ_WAIT4WRITE);
+        committed++;
     }
 
     if (bytes > 0 && !(flags & FS_QUEUE_FLAGS_PACKET)) {
@@ -246,6 +168,9 @@ ssize_t fs_queue_write(struct fs_queue * fsq, uint8_t * buf, size_t count,
 
 out:
     mtx_unlock(&fsq->wr_lock);
+    /* A single wakeup for all the packets written. */
+    if (committed)
+        fsq_wakeup(fsq, &fsq->rd_waitq);
     return wr;
 }
 
@@ -256,6 +181,7 @@ ssize_t fs_queue_read(struct fs_queue * fsq, uint8_t * buf, size_t count,
     size_t offset;
     size_t bytes = 0;
     size_t left = count;
+    int consumed = 0;
 
     /*
      * Freeze last_wr_packet because we might be reading it next,
@@ -271,30 +197,32 @@ ssize_t fs_queue_read(struct fs_queue * fsq, uint8_t * buf, size_t count,
     offset = fsq->last_rd;
 
     if (flags & FS_QUEUE_FLAGS_PACKET && count == 0) {
-        queue_skip(&fsq->qcb, 1);
+        consumed = queue_skip(&fsq->qcb, 1);
         goto out;
     }
 
     while (left > 0) {
         struct fs_queue_packet * p;
 
-        if ((flags & FS_QUEUE_FLAGS_NONBLOCK) &&
-            !queue_peek(&fsq->qcb, (void **)(&p))) {
-            goto out;
-        } else { /* Blocking IO */
-            sigset_t oldset;
+        if (!queue_peek(&fsq->qcb, (void **)(&p))) {
+            if (flags & FS_QUEUE_FLAGS_NONBLOCK)
+                goto out;
+
+            /*
+             * Queue is empty.
+             * Let the writer use the space freed so far and wait for it to
+             * write something.
+             */
+            if (consumed) {
+                fsq_wakeup(fsq, &fsq->wr_waitq);
+                consumed = 0;
+            }
 
-            fsq_sigwait_init(fsq, FSQ_WAIT4WRITE, &oldset);
+            mtx_lock(&fsq->wait_lock);
             while (!queue_peek(&fsq->qcb, (void **)(&p))) {
-                /*
-                 * Queue is empty.
-                 * Wait for the writing end to write something.
-                 */
-                fsq_sigwait();
+                waitq_sleep(&fsq->rd_waitq, &fsq->wait_lock, 0);
             }
-
-            /* Reset sigmask and wait state. */
-            fsq_sigwait_clear(fsq, FSQ_WAIT4WRITE, &oldset);
+            mtx_unlock(&fsq->wait_lock);
         }
 
         bytes = min(left, p->size - offset);
@@ -304,10 +232,12 @@ ssize_t fs_queue_read(struct fs_queue * fsq, uint8_t * buf, size_t count,
 
         if (flags & FS_QUEUE_FLAGS_PACKET) {
             queue_skip(&fsq->qcb, 1);
+            consumed++;
             bytes = 0;
             break;
         } else if (offset + bytes >= p->size) {
             queue_skip(&fsq->qcb, 1);
+            consumed++;
             bytes = 0;
             offset = 0;
         }
@@ -316,7 +246,24 @@ ssize_t fs_queue_read(struct fs_queue * fsq, uint8_t * buf, size_t count,
     fsq->last_rd = bytes;
 
 out:
-    fsq_sigsend(fsq, FSQ_WAIT4READ);
     mtx_unlock(&fsq->rd_lock);
+    /* A single wakeup for all the packets consumed. */
+    if (consumed)
+        fsq_wakeup(fsq, &fsq->wr_waitq);
     return rd;
 }
+
+int fs_queue_poll(struct fs_queue * fsq, int events, struct poll_table * pt)
+{
+    void * p;
+    int revents = 0;
+
+    poll_wait(pt, &fsq->poll_waitq);
+
+    if (queue_peek(&fsq->qcb, &p))
+        revents |= events & (POLLIN | POLLRDNORM);
+    if (!queue_isfull(&fsq->qcb))
+        revents |= events & (POLLOUT | POLLWRNORM);
+
+    return revents;
+}
@@ -0,0 +1,291 @@
+/**
+ *******************************************************************************
+ * @file    namecache.c
+ * @author  Olli Vanhoja
+ * @brief   VFS name cache.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/queue.h>
+#include <sys/sysctl.h>
+#include <fs/fs.h>
+#include <fs/namecache.h>
+#include <klocks.h>
+#include <kstring.h>
+#include <libkern.h>
+
+/*
+ * The name cache maps (directory vnode, component name) pairs to the vnodes
+ * returned by the lookup() vnop of the file system. A NULL vnode pointer is
+ * stored for names that don't exist in the directory, i.e. negative entries.
+ * Each entry holds a reference to both of its vnodes so the pointers stay
+ * valid until the entry is evicted or purged. Entries are recycled in LRU
+ * order.
+ *
+ * Only file systems setting FS_FLAG_NAMECACHE are cached because the
+ * directories of the other file systems may change without the vfs knowing
+ * about it.
+ */
+
+#define NC_HASH_SIZE        configFS_NAMECACHE_SIZE
+#define NC_PURGE_BATCH      16
+
+struct nc_entry {
+    vnode_t * nc_dvp;           /*!< Directory vnode, NULL if unused. */
+    vnode_t * nc_vp;            /*!< Vnode or NULL for a negative entry. */
+    LIST_ENTRY(nc_entry) nc_hash;
+    TAILQ_ENTRY(nc_entry) nc_lru;
+    uint32_t nc_hashval;
+    char nc_name[NC_NAME_MAX + 1];
+};
+
+static struct nc_entry nc_entries[configFS_NAMECACHE_SIZE];
+static size_t nc_nused;
+static LIST_HEAD(nc_hash_head, nc_entry) nc_hashtbl[NC_HASH_SIZE];
+static TAILQ_HEAD(nc_lru_head, nc_entry) nc_lru =
+    TAILQ_HEAD_INITIALIZER(nc_lru);
+static unsigned nc_gen;
+static mtx_t nc_lock = MTX_INITIALIZER(MTX_TYPE_SPIN, 0);
+
+SYSCTL_DECL(_vfs_namecache);
+SYSCTL_NODE(_vfs, OID_AUTO, namecache, CTLFLAG_RW, 0,
+            "Name cache");
+
+static int nc_enabled = 1;
+SYSCTL_INT(_vfs_namecache, OID_AUTO, enabled, CTLFLAG_RW,
+           &nc_enabled, 0, "Name cache enabled");
+
+static atomic_t nc_nhits;
+SYSCTL_INT(_vfs_namecache, OID_AUTO, hits, CTLFLAG_RD,
+           &nc_nhits, 0, "Number of positive hits");
+
+static atomic_t nc_nneghits;
+SYSCTL_INT(_vfs_namecache, OID_AUTO, neghits, CTLFLAG_RD,
+           &nc_nneghits, 0, "Number of negative hits");
+
+static atomic_t nc_nmisses;
+SYSCTL_INT(_vfs_namecache, OID_AUTO, misses, CTLFLAG_RD,
+           &nc_nmisses, 0, "Number of misses");
+
+static int nc_cacheable(vnode_t * dir, const char * name, size_t * len)
+{
+    if (!nc_enabled || !(dir->sb && dir->sb->fs &&
+                         (dir->sb->fs->fs_flags & FS_FLAG_NAMECACHE)))
+        return 0;
+
+    *len = strlenn(name, NC_NAME_MAX + 2);
+    return *len <= NC_NAME_MAX;
+}
+
+static uint32_t nc_hash(vnode_t * dir, const char * name, size_t len)
+{
+    uint32_t k[2] = { (uint32_t)(uintptr_t)dir, 0x6e616d65 };
+
+    return halfsiphash32(name, len, k);
+}
+
+static struct nc_entry * nc_find(vnode_t * dir, const char * name,
+                                 uint32_t hashval)
+{
+    struct nc_entry * ncp;
+
+    LIST_FOREACH(ncp, &nc_hashtbl[hashval % NC_HASH_SIZE], nc_hash) {
+        if (ncp->nc_hashval == hashval && ncp->nc_dvp == dir &&
+            !strcmp(ncp->nc_name, name))
+            return ncp;
+    }
+
+    return NULL;
+}
+
+/**
+ * Remove an entry from the hash and move it to the head of the LRU.
+ * The caller must release the vnodes of the entry.
+ */
+static void nc_remove(struct nc_entry * ncp)
+{
+    LIST_REMOVE(ncp, nc_hash);
+    TAILQ_REMOVE(&nc_lru, ncp, nc_lru);
+    TAILQ_INSERT_HEAD(&nc_lru, ncp, nc_lru);
+    ncp->nc_dvp = NULL;
+    ncp->nc_vp = NULL;
+}
+
+unsigned namecache_gen(void)
+{
+    return nc_gen;
+}
+
+int namecache_lookup(vnode_t * dir, const char * name, vnode_t ** vpp)
+{
+    struct nc_entry * ncp;
+    vnode_t * vp;
+    size_t len;
+
+    if (!nc_cacheable(dir, name, &len))
+        return -EAGAIN;
+
+    mtx_lock(&nc_lock);
+    ncp = nc_find(dir, name, nc_hash(dir, name, len));
+    if (!ncp) {
+        mtx_unlock(&nc_lock);
+        atomic_inc(&nc_nmisses);
+        return -EAGAIN;
+    }
+
+    TAILQ_REMOVE(&nc_lru, ncp, nc_lru);
+    TAILQ_INSERT_TAIL(&nc_lru, ncp, nc_lru);
+    vp = ncp->nc_vp;
+    if (vp) {
+        /* Can't fail because the entry holds a reference. */
+        vref(vp);
+    }
+    mtx_unlock(&nc_lock);
+
+    if (!vp) {
+        atomic_inc(&nc_nneghits);
+        return -ENOENT;
+    }
+
+    atomic_inc(&nc_nhits);
+    *vpp = vp;
+    return 0;
+}
+
+void namecache_enter(vnode_t * dir, const char * name, vnode_t * vp,
+                     unsigned gen)
+{
+    struct nc_entry * ncp;
+    vnode_t * old_dvp = NULL;
+    vnode_t * old_vp = NULL;
+    uint32_t hashval;
+    size_t len;
+
+    if (!nc_cacheable(dir, name, &len))
+        return;
+
+    hashval = nc_hash(dir, name, len);
+
+    if (vref(dir))
+        return;
+    if (vp && vref(vp)) {
+        vrele(dir);
+        return;
+    }
+
+    mtx_lock(&nc_lock);
+    /*
+     * The directory might have changed after the lookup was made or
+     * another thread might have entered the same name already.
+     */
+    if (gen != nc_gen || nc_find(dir, name, hashval)) {
+        mtx_unlock(&nc_lock);
+        vrele(vp);
+        vrele(dir);
+        return;
+    }
+
+    if (nc_nused < num_elem(nc_entries)) {
+        ncp = &nc_entries[nc_nused++];
+    } else {
+        ncp = TAILQ_FIRST(&nc_lru);
+        TAILQ_REMOVE(&nc_lru, ncp, nc_lru);
+        if (ncp->nc_dvp) {
+            LIST_REMOVE(ncp, nc_hash);
+            old_dvp = ncp->nc_dvp;
+            old_vp = ncp->nc_vp;
+        }
+    }
+
+    ncp->nc_dvp = dir;
+    ncp->nc_vp = vp;
+    ncp->nc_hashval = hashval;
+    memcpy(ncp->nc_name, name, len);
+    ncp->nc_name[len] = '\0';
+    LIST_INSERT_HEAD(&nc_hashtbl[hashval % NC_HASH_SIZE], ncp, nc_hash);
+    TAILQ_INSERT_TAIL(&nc_lru, ncp, nc_lru);
+    mtx_unlock(&nc_lock);
+
+    vrele(old_vp);
+    vrele(old_dvp);
+}
+
+/**
+ * Purge entries matching a condition.
+ * The vnodes are released in batches because vrele() may call back to the
+ * file system and can't be called while holding nc_lock.
+ */
+static void nc_purge(int (*match)(struct nc_entry * ncp, void * arg),
+                     void * arg)
+{
+    vnode_t * rele[2 * NC_PURGE_BATCH];
+    size_t n;
+
+    do {
+        n = 0;
+
+        mtx_lock(&nc_lock);
+        nc_gen++;
+        for (size_t i = 0; i < nc_nused && n < num_elem(rele); i++) {
+            struct nc_entry * ncp = &nc_entries[i];
+
+            if (!ncp->nc_dvp || !match(ncp, arg))
+                continue;
+
+            rele[n++] = ncp->nc_dvp;
+            rele[n++] = ncp->nc_vp;
+            nc_remove(ncp);
+        }
+        mtx_unlock(&nc_lock);
+
+        for (size_t i = 0; i < n; i++) {
+            vrele(rele[i]);
+        }
+    } while (n == num_elem(rele));
+}
+
+static int nc_match_dir(struct nc_entry * ncp, void * arg)
+{
+    return ncp->nc_dvp == arg;
+}
+
+void namecache_purge_dir(vnode_t * dir)
+{
+    nc_purge(nc_match_dir, dir);
+}
+
+static int nc_match_sb(struct nc_entry * ncp, void * arg)
+{
+    return ncp->nc_dvp->sb == arg;
+}
+
+void namecache_purge_sb(struct fs_superblock * sb)
+{
+    nc_purge(nc_match_sb, sb);
+}
@@ -33,6 +33,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <fs/fs.h>
 #include <kstring.h>
 #include <proc.h>
@@ -44,6 +45,7 @@ const vnode_ops_t nofs_vnode_ops = {
     .write = fs_enotsup_write,
     .lseek = fs_enotsup_lseek,
     .ioctl = fs_enotsup_ioctl,
+    .poll = nofs_poll,
     .event_vnode_opened = fs_enotsup_event_vnode_opened,
     .event_fd_created = fs_enotsup_event_fd_created,
     .event_fd_closed = fs_enotsup_event_fd_closed,
@@ -121,6 +123,14 @@ int fs_enotsup_ioctl(file_t * file, unsigned request, void * arg,
     return -ENOTTY;
 }
 
+/*
+ * Regular files are always ready for reading and writing.
+ */
+int nofs_poll(file_t * file, int events, struct poll_table * pt)
+{
+    return events & (POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM);
+}
+
 int fs_enotsup_event_vnode_opened(struct proc_info * p, vnode_t * vnode)
 {
     return 0;
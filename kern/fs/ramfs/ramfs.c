@@ -45,6 +45,7 @@
 #include <libkern.h>
 #include <kstring.h>
 #include <kmalloc.h>
+#include <kmem_cache.h>
 #include <buf.h>
 #include <proc.h>
 #include <fs/dehtable.h>
@@ -121,6 +122,14 @@ struct ramfs_dp {
     size_t len; /*!< Length of block pointed by p. */
 };
 
+static void ramfs_inode_ctor(void * obj);
+
+/**
+ * Cache for ramfs inodes.
+ */
+KMEM_CACHE_DEFINE(ramfs_inode_cache, ramfs_inode_t, 64, ramfs_inode_ctor,
+                  NULL);
+
 /* Private */
 static void ramfs_init_sb(fs_t * fs, ramfs_sb_t * ramfs_sb, uint32_t mode);
 static vnode_t * create_root(ramfs_sb_t * ramfs_sb);
@@ -205,6 +214,7 @@ int __kinit__ ramfs_init(void)
     static fs_t ramfs_fs = {
         .fsname = RAMFS_FSNAME,
         .fs_majornum = VDEV_MJNR_RAMFS,
+        .fs_flags = FS_FLAG_NAMECACHE,
         .mount = ramfs_mount,
         .sblist_head = SLIST_HEAD_INITIALIZER(),
     };
@@ -964,7 +974,7 @@ static vnode_t * ramfs_raw_create_inode(const struct fs_superblock * sb)
     if (!RAMFS_SB_IS_HEALTHY(ramfs_sb))
         return NULL;
 
-    inode = kzalloc(sizeof(ramfs_inode_t));
+    inode = kmem_cache_alloc(&ramfs_inode_cache);
     if (!inode)
         return NULL;
 
@@ -984,12 +994,23 @@ static vnode_t * ramfs_raw_create_inode(const struct fs_superblock * sb)
 static void init_inode(ramfs_inode_t * inode, ramfs_sb_t * ramfs_sb,
                        ino_t * num)
 {
-    memset((void *)inode, 0, sizeof(ramfs_inode_t));
-    rwlock_init(&inode->in_lock);
+    /* in_lock is initialized by the constructor. */
+    memset((void *)inode, 0, offsetof(ramfs_inode_t, in_lock));
     fs_vnode_init(&inode->in_vnode, *num, &ramfs_sb->sb,
                   &ramfs_vnode_ops);
 }
 
+/**
+ * Construct a new ramfs_inode struct for the inode cache.
+ */
+static void ramfs_inode_ctor(void * obj)
+{
+    ramfs_inode_t * inode = (ramfs_inode_t *)obj;
+
+    memset((void *)inode, 0, sizeof(ramfs_inode_t));
+    rwlock_init(&inode->in_lock);
+}
+
 static void destroy_vnode(vnode_t * vnode)
 {
     destroy_inode(get_inode_of_vnode(vnode));
@@ -1007,7 +1028,7 @@ static void destroy_inode(ramfs_inode_t * inode)
 
     atomic_dec(&ramfs_sb->nr_inodes);
     destroy_inode_data(inode);
-    kfree(inode);
+    kmem_cache_free(&ramfs_inode_cache, inode);
 }
 
 /**
@@ -0,0 +1,204 @@
+/**
+ *******************************************************************************
+ * @file    futex.c
+ * @author  Olli Vanhoja
+ * @brief   Fast userspace mutex wait queues.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#include <errno.h>
+#include <sys/futex.h>
+#include <sys/queue.h>
+#include <kinit.h>
+#include <klocks.h>
+#include <proc.h>
+#include <vm/vm.h>
+#include <waitq.h>
+
+#define FUTEX_HASH_SIZE 32
+
+/**
+ * Futex key.
+ * Private futexes are identified by the mm and the user space address,
+ * shared futexes by the physical address of the futex word so that
+ * any process mapping the same memory will find the same futex.
+ */
+struct futex_key {
+    const struct vm_mm_struct * fk_mm; /*!< Owner mm; NULL if shared. */
+    uintptr_t fk_addr;      /*!< Address of the futex word. */
+};
+
+/**
+ * A thread waiting on a futex.
+ * Allocated on the stack of the waiting thread.
+ */
+struct futex_waiter {
+    struct futex_key fw_key;
+    struct waitq fw_wq;
+    int fw_queued;          /*!< Set while on the bucket list. */
+    TAILQ_ENTRY(futex_waiter) fw_link;
+};
+
+/**
+ * Futex hash bucket.
+ */
+struct futex_bucket {
+    mtx_t fb_lock;
+    TAILQ_HEAD(futex_waiters, futex_waiter) fb_head;
+};
+
+static struct futex_bucket futex_hash[FUTEX_HASH_SIZE];
+
+int __kinit__ futex_init(void)
+{
+    SUBSYS_INIT("futex");
+
+    for (size_t i = 0; i < num_elem(futex_hash); i++) {
+        mtx_init(&futex_hash[i].fb_lock, MTX_TYPE_TICKET, 0);
+        TAILQ_INIT(&futex_hash[i].fb_head);
+    }
+
+    return 0;
+}
+
+static int futex_get_key(__user int * uaddr, int flags, struct futex_key * key)
+{
+    if ((uintptr_t)uaddr & (sizeof(int) - 1))
+        return -EINVAL;
+
+    if (!useracc(uaddr, sizeof(int), VM_PROT_READ))
+        return -EFAULT;
+
+    if (flags & FUTEX_PRIVATE) {
+        key->fk_mm = &curproc->mm;
+        key->fk_addr = (uintptr_t)uaddr;
+    } else {
+        void * kaddr;
+
+        kaddr = vm_uaddr2kaddr(curproc, uaddr, sizeof(int));
+        if (!kaddr)
+            return -EFAULT;
+
+        key->fk_mm = NULL;
+        key->fk_addr = (uintptr_t)kaddr;
+    }
+
+    return 0;
+}
+
+static int futex_key_equal(const struct futex_key * a,
+                           const struct futex_key * b)
+{
+    return a->fk_mm == b->fk_mm && a->fk_addr == b->fk_addr;
+}
+
+static struct futex_bucket * futex_get_bucket(const struct futex_key * key)
+{
+    const uintptr_t h = (key->fk_addr >> 2) ^ ((uintptr_t)key->fk_mm >> 4);
+
+    return &futex_hash[h % FUTEX_HASH_SIZE];
+}
+
+int futex_wait(__user int * uaddr, int val, int flags, long timeout)
+{
+    struct futex_waiter fw = { .fw_queued = 0 };
+    struct futex_bucket * fb;
+    int cur;
+    int err;
+
+    if (timeout < 0)
+        return -EINVAL;
+
+    err = futex_get_key(uaddr, flags, &fw.fw_key);
+    if (err)
+        return err;
+    waitq_init(&fw.fw_wq);
+    fb = futex_get_bucket(&fw.fw_key);
+
+    /*
+     * The value must be checked while holding the bucket lock, otherwise a
+     * futex_wake() between the check and queuing could be lost.
+     */
+    mtx_lock(&fb->fb_lock);
+
+    err = copyin(uaddr, &cur, sizeof(cur));
+    if (err)
+        goto out;
+    if (cur != val) {
+        err = -EAGAIN;
+        goto out;
+    }
+
+    TAILQ_INSERT_TAIL(&fb->fb_head, &fw, fw_link);
+    fw.fw_queued = 1;
+
+    err = waitq_sleep(&fw.fw_wq, &fb->fb_lock, timeout);
+    if (fw.fw_queued) {
+        /* Timed out. */
+        TAILQ_REMOVE(&fb->fb_head, &fw, fw_link);
+        fw.fw_queued = 0;
+    } else {
+        err = 0; /* Woken up by futex_wake(). */
+    }
+
+out:
+    mtx_unlock(&fb->fb_lock);
+    return err;
+}
+
+int futex_wake(__user int * uaddr, int n, int flags)
+{
+    struct futex_key key;
+    struct futex_bucket * fb;
+    struct futex_waiter * fw;
+    struct futex_waiter * fw_tmp;
+    int count = 0;
+    int err;
+
+    if (n <= 0)
+        return 0;
+
+    err = futex_get_key(uaddr, flags, &key);
+    if (err)
+        return err;
+    fb = futex_get_bucket(&key);
+
+    mtx_lock(&fb->fb_lock);
+    TAILQ_FOREACH_SAFE(fw, &fb->fb_head, fw_link, fw_tmp) {
+        if (!futex_key_equal(&fw->fw_key, &key))
+            continue;
+
+        TAILQ_REMOVE(&fb->fb_head, fw, fw_link);
+        fw->fw_queued = 0;
+        waitq_wakeup(&fw->fw_wq);
+        if (++count == n)
+            break;
+    }
+    mtx_unlock(&fb->fb_lock);
+
+    return count;
+}
@@ -187,25 +187,28 @@ void cpu_invalidate_caches(void)
 }
 
 /**
- * Set Context ID.
+ * Set the PROCID field of the Context ID.
  * Should be only called from ARM11 specific interrupt handlers.
- * @param cid new Context ID.
+ * The ASID field is owned by mmu_attach_pagetable() and it's preserved
+ * here, so changing the PROCID doesn't require any cache or TLB maintenance.
+ * @param pid is the new process ID.
  */
-void arm11_set_cid(uint32_t cid)
+void arm11_set_cid(uint32_t pid)
 {
     const int rd = 0;
-    uint32_t curr_cid;
+    uint32_t curr_cid, cid;
 
     __asm__ volatile (
         "MRC    p15, 0, %[cid], c13, c0, 1" /* Read CID */
          : [cid]"=r" (curr_cid)
     );
 
+    cid = (pid << MMU_CID_ASID_BITS) | (curr_cid & MMU_CID_ASID_MASK);
     if (curr_cid != cid) {
         __asm__ volatile (
             "MCR    p15, 0, %[rd], c7, c10, 4\n\t"  /* DSB */
             "MCR    p15, 0, %[cid], c13, c0, 1\n\t" /* Set CID */
-            "MCR    p15, 0, %[rd], c7, c5, 0\n\t"   /* Flush I cache & BTAC */
+            "MCR    p15, 0, %[rd], c7, c5, 4"       /* Prefetch flush */
             : : [rd]"r" (rd), [cid]"r" (cid)
         );
     }
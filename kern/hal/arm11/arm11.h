@@ -232,7 +232,7 @@ void core_set_tls_addr(__user struct _sched_tls_desc * tls);
     __asm__ volatile (                      \
         "MCR p15, 0, %[rd], c7, c10, 4\n\t" \
         "MCR p15, 0, %[rd], c7, c10, 5"     \
-        : [rd]"+r" (tmp));                  \
+        : [rd]"+r" (tmp) : : "memory");     \
 } while (0)
 
 /**
@@ -35,6 +35,7 @@
 #include <kstring.h>
 #include <kerror.h>
 #include <klocks.h>
+#include <kmem.h>
 #include <proc.h>
 #include <hal/core.h>
 #include <hal/mmu.h>
@@ -50,6 +51,194 @@ static mtx_t mmu_lock = MTX_INITIALIZER(MTX_TYPE_SPIN, MTX_OPT_DEFAULT);
 
 #define mmu_disable_ints() __asm__ volatile ("cpsid if")
 
+#define DCACHE_LINE_SIZE    32
+
+/**
+ * Max number of pages invalidated one by one from the TLB.
+ * Larger regions are invalidated by ASID or as a whole.
+ */
+#define TLB_INV_MAX_PAGES   16
+
+/**
+ * How TLB entries of a page table are tagged.
+ */
+enum tlb_tag {
+    TLB_TAG_NONE,   /*!< The table can't have any entries in the TLB. */
+    TLB_TAG_GLOBAL, /*!< Global entries, shared by all address spaces. */
+    TLB_TAG_ASID,   /*!< Entries tagged with the ASID of a process. */
+};
+
+/*
+ * ASID allocation.
+ * pt_asid of a master page table holds an ASID generation in the upper bits
+ * and the ASID in the lowest MMU_CID_ASID_BITS. ASID 0 is reserved for the
+ * kernel page tables that only contain global mappings. When ASIDs run out a
+ * new generation is started and the whole TLB is invalidated, the processes
+ * will get a new ASID the next time their page table is attached.
+ */
+#define ASID_GEN_FIRST      (1 << MMU_CID_ASID_BITS)
+static uint32_t asid_gen = ASID_GEN_FIRST;
+static uint32_t asid_next = 1;
+
+static inline void dsb(void)
+{
+    __asm__ volatile (
+        "MCR    p15, 0, %[rd], c7, c10, 4" /* DSB */
+        : : [rd]"r" (0) : "memory");
+}
+
+static inline void prefetch_flush(void)
+{
+    __asm__ volatile (
+        "MCR    p15, 0, %[rd], c7, c5, 4" /* Prefetch flush */
+        : : [rd]"r" (0) : "memory");
+}
+
+static inline void btac_flush(void)
+{
+    __asm__ volatile (
+        "MCR    p15, 0, %[rd], c7, c5, 6" /* Flush entire BTAC */
+        : : [rd]"r" (0));
+}
+
+/**
+ * Clean a range of D cache to make page table updates visible to the
+ * page table walk.
+ */
+static void dcache_clean_range(uintptr_t start, size_t len)
+{
+    for (uintptr_t addr = start & ~(DCACHE_LINE_SIZE - 1);
+         addr < start + len;
+         addr += DCACHE_LINE_SIZE) {
+        __asm__ volatile (
+            "MCR    p15, 0, %[addr], c7, c10, 1" /* Clean D line by MVA */
+            : : [addr]"r" (addr));
+    }
+    dsb();
+}
+
+/**
+ * Make new code visible to instruction fetches.
+ */
+static void icache_sync(void)
+{
+    const uint32_t rd = 0;
+
+    __asm__ volatile (
+        "MCR    p15, 0, %[rd], c7, c10, 0\n\t" /* Clean D cache. */
+        "MCR    p15, 0, %[rd], c7, c10, 4\n\t" /* DSB. */
+        "MCR    p15, 0, %[rd], c7, c5, 0\n\t"  /* Invalidate I cache. */
+        : : [rd]"r" (rd));
+}
+
+static void tlb_invalidate_all(void)
+{
+    __asm__ volatile (
+        "MCR    p15, 0, %[rd], c8, c7, 0" /* Invalidate all I+D TLBs. */
+        : : [rd]"r" (0));
+}
+
+static void tlb_invalidate_asid(uint32_t asid)
+{
+    __asm__ volatile (
+        "MCR    p15, 0, %[asid], c8, c7, 2" /* Invalidate TLB by ASID. */
+        : : [asid]"r" (asid));
+}
+
+static void tlb_invalidate_mva(uintptr_t mva, uint32_t asid)
+{
+    /* Global entries are invalidated regardless of the ASID. */
+    __asm__ volatile (
+        "MCR    p15, 0, %[mva], c8, c7, 1" /* Invalidate TLB by MVA. */
+        : : [mva]"r" ((mva & 0xfffff000) | asid));
+}
+
+/**
+ * Get the tag of the TLB entries of a page table.
+ * @param pt is the page table.
+ * @param[out] asid is the ASID of the page table.
+ */
+static enum tlb_tag get_tlb_tag(const mmu_pagetable_t * pt, uint32_t * asid)
+{
+    const mmu_pagetable_t * mpt;
+
+    mpt = (pt->pt_type == MMU_PTT_MASTER) ? pt : pt->master_pt;
+    *asid = 0;
+
+    if (!mpt || mpt->pt_addr == mmu_pagetable_master.pt_addr)
+        return TLB_TAG_GLOBAL;
+    if ((mpt->pt_asid & ~MMU_CID_ASID_MASK) != asid_gen)
+        return TLB_TAG_NONE; /* Not attached since the last rollover. */
+
+    *asid = mpt->pt_asid & MMU_CID_ASID_MASK;
+    return TLB_TAG_ASID;
+}
+
+/**
+ * Invalidate TLB entries of a range of pages.
+ * @param pt is the page table the pages are mapped in.
+ * @param vaddr is the first virtual address.
+ * @param count is the number of pages.
+ * @param pgsize is the size of a page.
+ */
+static void tlb_invalidate_range(const mmu_pagetable_t * pt, uintptr_t vaddr,
+                                 size_t count, size_t pgsize)
+{
+    uint32_t asid;
+
+    switch (get_tlb_tag(pt, &asid)) {
+    case TLB_TAG_NONE:
+        return;
+    case TLB_TAG_GLOBAL:
+        if (count > TLB_INV_MAX_PAGES) {
+            tlb_invalidate_all();
+            goto out;
+        }
+        break;
+    case TLB_TAG_ASID:
+        if (count > TLB_INV_MAX_PAGES) {
+            tlb_invalidate_asid(asid);
+            goto out;
+        }
+        break;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        tlb_invalidate_mva(vaddr + i * pgsize, asid);
+    }
+out:
+    btac_flush();
+    dsb();
+    prefetch_flush();
+}
+
+/**
+ * Get the ASID of a master page table.
+ * A new ASID is allocated if the table doesn't have one from the current
+ * generation.
+ */
+static uint32_t get_asid(mmu_pagetable_t * mpt)
+{
+    if (mpt->pt_addr == mmu_pagetable_master.pt_addr)
+        return 0;
+
+    if ((mpt->pt_asid & ~MMU_CID_ASID_MASK) != asid_gen) {
+        if (asid_next > MMU_CID_ASID_MASK) {
+            /* Start a new generation. */
+            asid_gen += ASID_GEN_FIRST;
+            if (asid_gen == 0)
+                asid_gen = ASID_GEN_FIRST;
+            asid_next = 1;
+            tlb_invalidate_all();
+            btac_flush();
+            dsb();
+        }
+        mpt->pt_asid = asid_gen | asid_next++;
+    }
+
+    return mpt->pt_asid & MMU_CID_ASID_MASK;
+}
+
 /**
  * MMU must be enabled early in the init to make atomic operations work
  * and to speed up the boot as caching can be enabled.
@@ -90,6 +279,7 @@ int mmu_init_pagetable(const mmu_pagetable_t * pt)
     const size_t nr_tables = pt->nr_tables;
     const uint32_t pte = MMU_PTE_FAULT;
     uint32_t * p_pte = (uint32_t *)pt->pt_addr; /* points to a pt entry in PT */
+    size_t size;
 
     KASSERT(nr_tables > 0, "nr_tables must be greater than zero");
 
@@ -101,13 +291,14 @@ int mmu_init_pagetable(const mmu_pagetable_t * pt)
 
     switch (pt->pt_type) {
     case MMU_PTT_COARSE:
-        i = nr_tables * MMU_PTSZ_COARSE / 4 / 32; break;
+        size = nr_tables * MMU_PTSZ_COARSE; break;
     case MMU_PTT_MASTER:
-        i = nr_tables * MMU_PTSZ_MASTER / 4 / 32; break;
+        size = nr_tables * MMU_PTSZ_MASTER; break;
     default:
         KERROR(KERROR_ERR, "Unknown page table type.\n");
         return -EINVAL;
     }
+    i = size / 4 / 32;
 
     __asm__ volatile (
         "MOV r4, %[pte]\n\t"
@@ -129,10 +320,36 @@ int mmu_init_pagetable(const mmu_pagetable_t * pt)
         : [pte]"r" (pte)
         : "r4", "r5", "r6", "r7"
     );
+    dcache_clean_range(pt->pt_addr, size);
 
     return 0;
 }
 
+/**
+ * Synchronize caches and TLBs after mapping a region.
+ * @param region    Structure that specifies the memory region.
+ * @param p_pte     is a pointer to the first pte of the region.
+ * @param control   is the control bits used in the ptes.
+ */
+static void map_sync(const mmu_region_t * region, uint32_t * p_pte,
+                     uint32_t control)
+{
+    const size_t pgsize = (region->pt->pt_type == MMU_PTT_MASTER) ?
+        MMU_PGSIZE_SECTION : MMU_PGSIZE_COARSE;
+
+    /*
+     * The physically tagged caches are not flushed on context switch, so any
+     * code written to the region through the D cache must be made visible to
+     * the I cache before it's executed by a process.
+     */
+    if (!(control & MMU_CTRL_XN) && (control & MMU_CTRL_NG))
+        icache_sync();
+
+    dcache_clean_range((uintptr_t)p_pte,
+                       region->num_pages * sizeof(uint32_t));
+    tlb_invalidate_range(region->pt, region->vaddr, region->num_pages, pgsize);
+}
+
 /**
  * Map a section of physical memory in multiples of 1 MB in virtual memory.
  * @param region    Structure that specifies the memory region.
@@ -142,6 +359,8 @@ static void mmu_map_section_region(const mmu_region_t * region)
     int i;
     uint32_t * p_pte;
     uint32_t pte;
+    uint32_t control = region->control;
+    uint32_t asid;
     const int pages = region->num_pages - 1;
     istate_t s;
 
@@ -149,14 +368,17 @@ static void mmu_map_section_region(const mmu_region_t * region)
     p_pte += region->vaddr >> 20;            /* Set to first pte in region */
     p_pte += pages;                          /* Set to last pte in region */
 
+    if (get_tlb_tag(region->pt, &asid) != TLB_TAG_GLOBAL)
+        control |= MMU_CTRL_NG;
+
     pte = region->paddr & 0xfff00000;       /* Set physical address */
     pte |= (region->ap & 0x3) << 10;        /* Set access permissions (AP) */
     pte |= (region->ap & 0x4) << 13;        /* Set access permissions (APX) */
     pte |= (region->pt->pt_dom & 0x7) << 5; /* Set domain */
-    pte |= (region->control & 0x3) << 16;   /* Set nG & S bits */
-    pte |= (region->control & 0x10);        /* Set XN bit */
-    pte |= (region->control & 0x60) >> 3;   /* Set C & B bits */
-    pte |= (region->control & 0x380) << 5;  /* Set TEX bits */
+    pte |= (control & 0x3) << 16;           /* Set nG & S bits */
+    pte |= (control & 0x10);                /* Set XN bit */
+    pte |= (control & 0x60) >> 3;           /* Set C & B bits */
+    pte |= (control & 0x380) << 5;          /* Set TEX bits */
     pte |= MMU_PTE_SECTION;                 /* Set entry type */
 
     MMU_LOCK();
@@ -167,7 +389,7 @@ static void mmu_map_section_region(const mmu_region_t * region)
         *p_pte-- = pte + (i << 20); /* i = 1 MB section */
     }
 
-    cpu_invalidate_caches();
+    map_sync(region, p_pte + 1, control);
     set_interrupt_state(s);
     MMU_UNLOCK();
 }
@@ -182,6 +404,8 @@ static void mmu_map_coarse_region(const mmu_region_t * region)
 {
     uint32_t * p_pte;
     uint32_t pte;
+    uint32_t control = region->control;
+    uint32_t asid;
     const int pages = region->num_pages - 1;
     istate_t s;
 
@@ -192,13 +416,16 @@ static void mmu_map_coarse_region(const mmu_region_t * region)
 
     KASSERT(p_pte, "p_pte not null");
 
+    if (get_tlb_tag(region->pt, &asid) != TLB_TAG_GLOBAL)
+        control |= MMU_CTRL_NG;
+
     pte = region->paddr & 0xfffff000;       /* Set physical address */
     pte |= (region->ap & 0x3) << 4;         /* Set access permissions (AP) */
     pte |= (region->ap & 0x4) << 7;         /* Set access permissions (APX) */
-    pte |= (region->control & 0x3) << 10;   /* Set nG & S bits */
-    pte |= (region->control & 0x10) >> 4;   /* Set XN bit */
-    pte |= (region->control & 0x60) >> 3;   /* Set C & B bits */
-    pte |= (region->control & 0x380) >> 1;  /* Set TEX bits */
+    pte |= (control & 0x3) << 10;           /* Set nG & S bits */
+    pte |= (control & 0x10) >> 4;           /* Set XN bit */
+    pte |= (control & 0x60) >> 3;           /* Set C & B bits */
+    pte |= (control & 0x380) >> 1;          /* Set TEX bits */
     pte |= 0x2;                             /* Set entry type (4 kB page) */
 
     MMU_LOCK();
@@ -209,7 +436,7 @@ static void mmu_map_coarse_region(const mmu_region_t * region)
         *p_pte-- = pte + (i << 12); /* i = 4 KB small page */
     }
 
-    cpu_invalidate_caches();
+    map_sync(region, p_pte + 1, control);
     set_interrupt_state(s);
     MMU_UNLOCK();
 }
@@ -257,7 +484,10 @@ static void mmu_unmap_section_region(const mmu_region_t * region)
         *p_pte-- = pte + (i << 20); /* i = 1 MB section */
     }
 
-    cpu_invalidate_caches();
+    dcache_clean_range((uintptr_t)(p_pte + 1),
+                       region->num_pages * sizeof(uint32_t));
+    tlb_invalidate_range(region->pt, region->vaddr, region->num_pages,
+                         MMU_PGSIZE_SECTION);
     set_interrupt_state(s);
     MMU_UNLOCK();
 }
@@ -286,7 +516,10 @@ static void mmu_unmap_coarse_region(const mmu_region_t * region)
         *p_pte-- = pte + (i << 12); /* i = 4 KB small page */
     }
 
-    cpu_invalidate_caches();
+    dcache_clean_range((uintptr_t)(p_pte + 1),
+                       region->num_pages * sizeof(uint32_t));
+    tlb_invalidate_range(region->pt, region->vaddr, region->num_pages,
+                         MMU_PGSIZE_COARSE);
     set_interrupt_state(s);
     MMU_UNLOCK();
 }
@@ -307,6 +540,22 @@ int mmu_unmap_region(const mmu_region_t * region)
     return 0;
 }
 
+/**
+ * Synchronize caches and TLBs after changing the L1 entries of a coarse
+ * page table.
+ */
+static void l1_sync(const mmu_pagetable_t * pt)
+{
+    const uint32_t * ttb = (uint32_t *)pt->master_pt_addr;
+
+    dcache_clean_range((uintptr_t)(ttb + (pt->vaddr >> 20)),
+                       pt->nr_tables * sizeof(uint32_t));
+    tlb_invalidate_range(pt, pt->vaddr,
+                         pt->nr_tables * (MMU_PGSIZE_SECTION /
+                                          MMU_PGSIZE_COARSE),
+                         MMU_PGSIZE_COARSE);
+}
+
 static void attach_coarse_pagetable(const mmu_pagetable_t * restrict pt)
 {
     uint32_t * ttb;
@@ -326,9 +575,46 @@ static void attach_coarse_pagetable(const mmu_pagetable_t * restrict pt)
         i = (pt->vaddr + j * MMU_PGSIZE_SECTION) >> 20;
         ttb[i] = pte;
     }
+
+    l1_sync(pt);
 }
 
-int mmu_attach_pagetable(const mmu_pagetable_t * pt)
+/**
+ * Switch the translation table base and the ASID.
+ * The reserved ASID 0 is used while switching so that no entries of the
+ * new table are tagged with the old ASID or vice versa.
+ */
+static void switch_ttb(uint32_t * ttb, uint32_t asid)
+{
+    uint32_t curr_ttb;
+    uint32_t cid;
+
+    __asm__ volatile (
+        "MRC    p15, 0, %[ttb], c2, c0, 0\n\t" /* Read TTBR0 */
+        "MRC    p15, 0, %[cid], c13, c0, 1"     /* Read CID */
+        : [ttb]"=r" (curr_ttb), [cid]"=r" (cid));
+
+    if ((curr_ttb & ~0x3fff) == (uintptr_t)ttb &&
+        (cid & MMU_CID_ASID_MASK) == asid)
+        return;
+
+    cid &= ~MMU_CID_ASID_MASK;
+    __asm__ volatile (
+        "MCR    p15, 0, %[rd], c7, c10, 4\n\t"    /* DSB */
+        "MCR    p15, 0, %[cid], c13, c0, 1\n\t"   /* Set ASID 0 */
+        "MCR    p15, 0, %[rd], c7, c5, 4\n\t"     /* Prefetch flush */
+        "MCR    p15, 0, %[ttb], c2, c0, 0\n\t"    /* Set TTBR0 */
+        "MCR    p15, 0, %[rd], c7, c5, 4\n\t"     /* Prefetch flush */
+        "MCR    p15, 0, %[ncid], c13, c0, 1\n\t"  /* Set the new ASID */
+        "MCR    p15, 0, %[rd], c7, c5, 6\n\t"     /* Flush BTAC */
+        "MCR    p15, 0, %[rd], c7, c5, 4"          /* Prefetch flush */
+        :
+        : [rd]"r" (0), [cid]"r" (cid), [ttb]"r" (ttb),
+          [ncid]"r" (cid | asid)
+        : "memory");
+}
+
+int mmu_attach_pagetable(mmu_pagetable_t * pt)
 {
     uint32_t * ttb;
     istate_t s;
@@ -343,11 +629,7 @@ int mmu_attach_pagetable(const mmu_pagetable_t * pt)
     switch (pt->pt_type) {
     case MMU_PTT_MASTER:
         /* TTB -> CP15:c2:c0,0 : TTBR0 */
-        __asm__ volatile (
-            "MCR p15, 0, %[ttb], c2, c0, 0"
-            :
-            : [ttb]"r" (ttb));
-
+        switch_ttb(ttb, get_asid(pt));
         break;
     case MMU_PTT_COARSE:
         /* First level coarse page table entry */
@@ -358,13 +640,46 @@ int mmu_attach_pagetable(const mmu_pagetable_t * pt)
         break;
     }
 
-    cpu_invalidate_caches();
     set_interrupt_state(s);
     MMU_UNLOCK();
 
     return retval;
 }
 
+void mmu_sync_pagetable(const mmu_pagetable_t * pt)
+{
+    istate_t s;
+
+    MMU_LOCK();
+    s = get_interrupt_state();
+    mmu_disable_ints();
+
+    dcache_clean_range(pt->pt_addr, mmu_sizeof_pt(pt));
+    if (pt->pt_type == MMU_PTT_MASTER) {
+        uint32_t asid;
+
+        switch (get_tlb_tag(pt, &asid)) {
+        case TLB_TAG_NONE:
+            break;
+        case TLB_TAG_GLOBAL:
+            tlb_invalidate_all();
+            break;
+        case TLB_TAG_ASID:
+            tlb_invalidate_asid(asid);
+            break;
+        }
+        dsb();
+    } else {
+        tlb_invalidate_range(pt, pt->vaddr,
+                             pt->nr_tables * (MMU_PGSIZE_SECTION /
+                                              MMU_PGSIZE_COARSE),
+                             MMU_PGSIZE_COARSE);
+    }
+
+    set_interrupt_state(s);
+    MMU_UNLOCK();
+}
+
 int mmu_detach_pagetable(const mmu_pagetable_t * pt)
 {
     uint32_t * ttb;
@@ -392,7 +707,7 @@ int mmu_detach_pagetable(const mmu_pagetable_t * pt)
         ttb[i] = MMU_PTE_FAULT;
     }
 
-    cpu_invalidate_caches();
+    l1_sync(pt);
     set_interrupt_state(s);
     MMU_UNLOCK();
 
@@ -65,6 +65,18 @@
  */
 #define MMU_TTBCR_N         0
 
+/**
+ * Context ID register fields.
+ * The lowest bits of the Context ID register are the ASID used to tag
+ * non-global TLB entries and the rest of the register is the PROCID.
+ * @{
+ */
+#define MMU_CID_ASID_BITS   8
+#define MMU_CID_ASID_MASK   ((1 << MMU_CID_ASID_BITS) - 1)
+/**
+ * @}
+ */
+
 /**
  * L1 Page Table Entry Types.
  * These corresponds directly to the bits of first-level descriptor on ARMv6
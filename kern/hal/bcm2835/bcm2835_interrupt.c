@@ -64,15 +64,15 @@ void irq_disable(int irq)
 
     if (irq >= 0 && irq <= 7) {
         mmio_start(&s_entry);
-        mmio_write(BCMIRQ_DISABLE_BASIC, 1 < irq);
+        mmio_write(BCMIRQ_DISABLE_BASIC, 1 << irq);
         mmio_end(&s_entry);
     } else if (irq >= 29 && irq <= 31) {
         mmio_start(&s_entry);
-        mmio_write(BCMIRQ_DISABLE_IRQ1, 1 < irq);
+        mmio_write(BCMIRQ_DISABLE_IRQ1, 1 << irq);
         mmio_end(&s_entry);
     } else if (irq >= 32 && irq <= 63) {
         mmio_start(&s_entry);
-        mmio_write(BCMIRQ_DISABLE_IRQ2, 1 < (irq - 32));
+        mmio_write(BCMIRQ_DISABLE_IRQ2, 1 << (irq - 32));
         mmio_end(&s_entry);
     } else {
         KERROR(KERROR_ERR, "%s(): Invalid IRQ%d\n", __func__, irq);
@@ -82,7 +82,6 @@ void irq_disable(int irq)
 void arm_handle_sys_interrupt(void)
 {
     istate_t s_entry;
-    int irq = -1;
     uint32_t pending[3];
 
     mmio_start(&s_entry);
@@ -93,29 +92,22 @@ void arm_handle_sys_interrupt(void)
 
     /*
      * Clear ambiguous bits.
+     * GPU IRQs are always resolved from the pending 1 & 2 registers,
+     * so the shortcut bits in the basic pending register are ignored.
      */
-    pending[0] &= ~0xffe00300;
-    pending[1] &= ~0xc0680;
-    pending[2] &= ~0x43e00000;
+    pending[0] &= 0xff;
+    pending[1] &= 0xe0000000;
 
+    /*
+     * Handle all pending IRQs at once to avoid taking a new exception for
+     * each of them.
+     */
     for (size_t i = 0; i < num_elem(pending); i++) {
-        int bit = ffs(pending[i]);
-        if (bit != 0) {
-            irq = 32 * i + bit - 1;
-        }
-    }
-    if (irq != -1 && irq < NR_IRQ && irq_handlers[irq]) {
-        struct irq_handler * handler = irq_handlers[irq];
-        handler->cnt++;
-        enum irq_ack ack_res = handler->ack(irq);
+        int bit;
 
-        if (ack_res == IRQ_NEEDS_HANDLING) {
-            handler->handle(irq);
-        } else if (ack_res == IRQ_WAKE_THREAD) {
-            if (!handler->flags.allow_multiple) {
-                irq_disable(irq); /* Disable irq until it has been handled. */
-            }
-            irq_thread_wakeup(irq);
+        while ((bit = ffs(pending[i]))) {
+            pending[i] &= ~(1u << (bit - 1));
+            irq_handle(((i == 2) ? 32 : 0) + bit - 1);
         }
     }
 }
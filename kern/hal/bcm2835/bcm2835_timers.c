@@ -73,8 +73,17 @@
 #define ARM_TIMER_EN            0x80
 #define ARM_TIMER_INT_EN        0x20
 
+#define ARM_TIMER_CTRL          (ARM_TIMER_PRESCALE_16 | ARM_TIMER_INT_EN | \
+                                 ARM_TIMER_23BIT)
+#define ARM_TIMER_MAX           0x7fffff
+
 #define SYS_CLOCK               700000 /* kHz */
 
+static uint32_t arm_timer_load; /*!< Load value of the periodic tick. */
+static uint32_t arm_timer_freq; /*!< Timer ticks per second at the same
+                                 *   scale as arm_timer_load. */
+static int arm_timer_oneshot;   /*!< Set if the periodic tick is stopped. */
+
 static enum irq_ack arm_timer_ack(int irq)
 {
     istate_t s_entry;
@@ -121,20 +130,76 @@ static int enable_arm_timer(unsigned freq_hz)
         return -ENOTSUP;
     }
 
+    arm_timer_load = SYS_CLOCK / (freq_hz * 16);
+    arm_timer_freq = arm_timer_load * freq_hz;
+
     mmio_start(&s_entry);
     /* Interrupt every (value * prescaler) timer ticks */
-    mmio_write(ARM_TIMER_LOAD, (SYS_CLOCK / (freq_hz * 16)));
-    mmio_write(ARM_TIMER_RELOAD, (SYS_CLOCK / (freq_hz * 16)));
+    mmio_write(ARM_TIMER_LOAD, arm_timer_load);
+    mmio_write(ARM_TIMER_RELOAD, arm_timer_load);
     mmio_write(ARM_TIMER_IRQ_CLEAR, 0);
-    mmio_write(ARM_TIMER_CONTROL,
-               ARM_TIMER_PRESCALE_16 | ARM_TIMER_EN |
-               ARM_TIMER_INT_EN | ARM_TIMER_23BIT);
+    mmio_write(ARM_TIMER_CONTROL, ARM_TIMER_CTRL | ARM_TIMER_EN);
     mmio_end(&s_entry);
 
     /* TODO defines for IRQ nums? */
     return irq_register(0, &bcm2835_timer_irq_handler);
 }
 
+uint32_t bcm2835_timer_usec2ticks(uint64_t usec)
+{
+    uint64_t ticks;
+
+    if (arm_timer_freq == 0 ||
+        usec >= ARM_TIMER_MAX * 1000000ULL / arm_timer_freq)
+        return ARM_TIMER_MAX;
+
+    ticks = (usec * arm_timer_freq) / 1000000;
+
+    return (ticks > 0) ? (uint32_t)ticks : 1;
+}
+
+uint32_t bcm2835_timer_period_ticks(void)
+{
+    return arm_timer_load;
+}
+
+void hw_sched_timer_oneshot(uint64_t usec)
+{
+    istate_t s_entry;
+
+    arm_timer_oneshot = 1;
+
+    mmio_start(&s_entry);
+    if (usec == 0) {
+        mmio_write(ARM_TIMER_CONTROL, ARM_TIMER_CTRL);
+    } else {
+        /*
+         * The ARM timer can't stop after an interrupt, so the reload value
+         * is set to the maximum and the scheduler reprograms the timer on
+         * the next interrupt anyway.
+         */
+        mmio_write(ARM_TIMER_RELOAD, ARM_TIMER_MAX);
+        mmio_write(ARM_TIMER_LOAD, bcm2835_timer_usec2ticks(usec));
+        mmio_write(ARM_TIMER_CONTROL, ARM_TIMER_CTRL | ARM_TIMER_EN);
+    }
+    mmio_end(&s_entry);
+}
+
+void hw_sched_timer_periodic(void)
+{
+    istate_t s_entry;
+
+    if (!arm_timer_oneshot)
+        return;
+    arm_timer_oneshot = 0;
+
+    mmio_start(&s_entry);
+    mmio_write(ARM_TIMER_LOAD, arm_timer_load);
+    mmio_write(ARM_TIMER_RELOAD, arm_timer_load);
+    mmio_write(ARM_TIMER_CONTROL, ARM_TIMER_CTRL | ARM_TIMER_EN);
+    mmio_end(&s_entry);
+}
+
 __weak_reference(bcm_udelay, udelay);
 void bcm_udelay(uint32_t delay)
 {
@@ -47,6 +47,20 @@
 #include <stdint.h>
 
 void bcm2835_timers_arm_clear(void);
+
+/**
+ * Convert a delay to ARM timer ticks for a one-shot expiry.
+ * The result is clamped to the range of the timer.
+ * @param usec is the delay in microseconds.
+ * @return Returns the number of prescaled ticks.
+ */
+uint32_t bcm2835_timer_usec2ticks(uint64_t usec);
+
+/**
+ * Get the ARM timer load value of a periodic scheduler tick.
+ */
+uint32_t bcm2835_timer_period_ticks(void);
+
 void bcm_udelay(uint32_t delay);
 
 #endif /* BCM2835_TIMERS_H */
@@ -31,6 +31,8 @@
  */
 
 #include <kinit.h>
+#include <queue_r.h>
+#include <hal/irq.h>
 #include "bcm2835_mmio.h"
 #include "bcm2835_gpio.h"
 #include "bcm2835_timers.h"
@@ -74,32 +76,197 @@
 #define UART0_FR_BUSY_OFFSET    3
 #define UART0_FR_CTS_OFFSET     0
 
+#define UART0_IFLS_TX_1_4       (0x1 << 0) /* TX FIFO <= 1/4 full */
+#define UART0_IFLS_RX_1_2       (0x2 << 3) /* RX FIFO >= 1/2 full */
+
+#define UART0_INT_RX            (1 << 4)
+#define UART0_INT_TX            (1 << 5)
+#define UART0_INT_RT            (1 << 6) /* Receive timeout */
+#define UART0_INT_ALL           0x7FF
+
+#define UART0_IRQ               57
+
 static void bcm2835_uart_setconf(struct termios * conf);
 static void set_baudrate(unsigned int baud_rate);
 static void set_lcrh(const struct termios * conf);
 int bcm2835_uart_uputc(struct uart_port * port, uint8_t byte);
 int bcm2835_uart_ugetc(struct uart_port * port);
 int bcm2835_uart_peek(struct uart_port * port);
+static void bcm2835_uart_start_tx(struct uart_port * port);
+static void bcm2835_uart_start_rx(struct uart_port * port);
+
+static uint8_t rx_buf[configUART_RING_SIZE];
+static uint8_t tx_buf[configUART_RING_SIZE];
 
 static struct uart_port port = {
+    .flags = UART_PORT_FLAG_INTR,
     .setconf = bcm2835_uart_setconf,
     .uputc = bcm2835_uart_uputc,
     .ugetc = bcm2835_uart_ugetc,
-    .peek = bcm2835_uart_peek
+    .peek = bcm2835_uart_peek,
+    .start_tx = bcm2835_uart_start_tx,
+    .start_rx = bcm2835_uart_start_rx,
+    .rx_queue = QUEUE_INITIALIZER(rx_buf, sizeof(uint8_t), sizeof(rx_buf)),
+    .tx_queue = QUEUE_INITIALIZER(tx_buf, sizeof(uint8_t), sizeof(tx_buf)),
 };
 
+/**
+ * Interrupts currently enabled in UART0_IMSC.
+ * Only modified with interrupts disabled.
+ */
+static uint32_t uart_imsc;
+
+static void set_imsc(uint32_t imsc)
+{
+    uart_imsc = imsc;
+    mmio_write(UART0_IMSC, imsc);
+}
+
+/**
+ * Move bytes from the RX FIFO to rx_queue.
+ * The RX interrupts are masked if rx_queue is full, leaving the rest of
+ * the data in the FIFO until a reader has made some room.
+ * Must be called with interrupts disabled.
+ */
+static int rx_drain(void)
+{
+    int n = 0;
+
+    while (!(mmio_read(UART0_FR) & (1 << UART0_FR_RXFE_OFFSET))) {
+        uint8_t * p = queue_alloc_get(&port.rx_queue);
+
+        if (!p) {
+            set_imsc(uart_imsc & ~(UART0_INT_RX | UART0_INT_RT));
+            break;
+        }
+        *p = mmio_read(UART0_DR);
+        queue_alloc_commit(&port.rx_queue);
+        n++;
+    }
+
+    return n;
+}
+
+/**
+ * Move bytes from tx_queue to the TX FIFO.
+ * The TX interrupt is enabled as long as there is data left in tx_queue.
+ * Must be called with interrupts disabled.
+ */
+static int tx_fill(void)
+{
+    int n = 0;
+
+    while (!(mmio_read(UART0_FR) & (1 << UART0_FR_TXFF_OFFSET))) {
+        uint8_t * p;
+
+        if (!queue_peek(&port.tx_queue, (void **)&p))
+            break;
+        mmio_write(UART0_DR, *p);
+        queue_skip(&port.tx_queue, 1);
+        n++;
+    }
+
+    if (queue_isempty(&port.tx_queue))
+        set_imsc(uart_imsc & ~UART0_INT_TX);
+    else
+        set_imsc(uart_imsc | UART0_INT_TX);
+
+    return n;
+}
+
+static enum irq_ack bcm2835_uart_ack(int irq)
+{
+    return IRQ_NEEDS_HANDLING;
+}
+
+static void bcm2835_uart_handle(int irq)
+{
+    istate_t s_entry;
+    uint32_t mis;
+    int rx = 0, tx = 0;
+
+    mmio_start(&s_entry);
+    mis = mmio_read(UART0_MIS);
+    mmio_write(UART0_ICR, mis);
+
+    if (mis & (UART0_INT_RX | UART0_INT_RT))
+        rx = rx_drain();
+    if (mis & UART0_INT_TX)
+        tx = tx_fill();
+    mmio_end(&s_entry);
+
+    if (rx)
+        uart_rx_wakeup(&port);
+    if (tx)
+        uart_tx_wakeup(&port);
+}
+
+static struct irq_handler bcm2835_uart_irq_handler = {
+    .name = "UART0",
+    .ack = bcm2835_uart_ack,
+    .handle = bcm2835_uart_handle,
+};
+
+/**
+ * Set FIFO levels and enable RX interrupts.
+ * Must be called with interrupts disabled.
+ */
+static void enable_interrupts(void)
+{
+    mmio_write(UART0_IFLS, UART0_IFLS_TX_1_4 | UART0_IFLS_RX_1_2);
+    set_imsc(UART0_INT_RX | UART0_INT_RT |
+             (queue_isempty(&port.tx_queue) ? 0 : UART0_INT_TX));
+}
 
 int bcm2835_uart_register(void)
 {
     SUBSYS_DEP(arm_interrupt_preinit);
     SUBSYS_INIT("BCM2836 UART");
+    istate_t s_entry;
+    int err;
 
     uart_register_port(&port);
 
+    mmio_start(&s_entry);
+    mmio_write(UART0_ICR, UART0_INT_ALL);
+    enable_interrupts();
+    mmio_end(&s_entry);
+
+    err = irq_register(UART0_IRQ, &bcm2835_uart_irq_handler);
+    if (err)
+        return err;
+    irq_enable(UART0_IRQ);
+
     return 0;
 }
 HW_PREINIT_ENTRY(bcm2835_uart_register);
 
+static void bcm2835_uart_start_tx(struct uart_port * port)
+{
+    istate_t s_entry;
+
+    mmio_start(&s_entry);
+    tx_fill();
+    mmio_end(&s_entry);
+}
+
+static void bcm2835_uart_start_rx(struct uart_port * port)
+{
+    istate_t s_entry;
+    int rx = 0;
+
+    mmio_start(&s_entry);
+    if (!(uart_imsc & UART0_INT_RX)) {
+        set_imsc(uart_imsc | UART0_INT_RX | UART0_INT_RT);
+        /* The FIFO level may not cross the threshold again. */
+        rx = rx_drain();
+    }
+    mmio_end(&s_entry);
+
+    if (rx)
+        uart_rx_wakeup(port);
+}
+
 static void bcm2835_uart_setconf(struct termios * conf)
 {
     istate_t s_entry;
@@ -135,25 +302,14 @@ static void bcm2835_uart_setconf(struct termios * conf)
 
     mmio_start(&s_entry);
 
-#if 0
     /* Enable interrupts. */
-    mmio_write(UART0_IMSC,
-               (1 << 1) |    /* CTS */
-               (1 << 4) |    /* RX */
-               (1 << 5) |    /* TX */
-               (1 << 6) |    /* Receive timeout */
-               (1 << 7) |    /* Framing error */
-               (1 << 8) |    /* Parity error */
-               (1 << 9) |    /* Break error */
-               (1 << 10)     /* Overrun error */
-    );
-#endif
+    enable_interrupts();
 
     /* Enable UART0, receive & transfer part of the UART.*/
     mmio_write(UART0_CR,
                (1 << 0) |                               /* UART Enable */
                (1 << 8) |                               /* TX Enable */
-               (conf->c_cflag & CREAD) ? (1 << 9) : 0   /* RX Enable */
+               ((conf->c_cflag & CREAD) ? (1 << 9) : 0) /* RX Enable */
     );
 
     mmio_end(&s_entry);
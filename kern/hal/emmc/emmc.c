@@ -72,6 +72,7 @@
 #include <sys/types.h>
 #include <fs/mbr.h>
 #include <hal/hw_timers.h>
+#include <hal/irq.h>
 #include <kerror.h>
 #include <kinit.h>
 #include <klocks.h>
@@ -320,6 +321,62 @@ static uint32_t sd_acommands[] = {
 
 static int emmc_card_init(struct emmc_block_dev ** edev);
 
+/*
+ * Card insertion and removal are signalled with an interrupt, everything else
+ * is still polled by the command issue functions.
+ */
+#define EMMC_IRPT_CARD  (SD_CARD_INSERTION | SD_CARD_REMOVAL)
+
+static struct emmc_block_dev * emmc_irq_dev;
+static uint32_t emmc_irq_pending;
+
+static enum irq_ack emmc_ack(int irq)
+{
+    uint32_t irpts;
+    istate_t s_entry;
+
+    mmio_start(&s_entry);
+    irpts = mmio_read(EMMC_BASE + EMMC_INTERRUPT) & EMMC_IRPT_CARD;
+    mmio_write(EMMC_BASE + EMMC_INTERRUPT, irpts);
+    mmio_end(&s_entry);
+
+    if (!irpts)
+        return IRQ_HANDLED;
+    emmc_irq_pending |= irpts;
+
+    return IRQ_WAKE_THREAD;
+}
+
+static void emmc_handle(int irq)
+{
+    struct emmc_block_dev * dev = emmc_irq_dev;
+    uint32_t irpts;
+    istate_t s;
+
+    s = get_interrupt_state();
+    disable_interrupt();
+    irpts = emmc_irq_pending;
+    emmc_irq_pending = 0;
+    set_interrupt_state(s);
+
+    if (irpts & SD_CARD_INSERTION)
+        KERROR(KERROR_INFO, "EMMC: card inserted\n");
+
+    if (irpts & SD_CARD_REMOVAL) {
+        KERROR(KERROR_INFO, "EMMC: card removed\n");
+        if (dev)
+            dev->card_removal = 1;
+    }
+}
+
+static struct irq_handler emmc_irq_handler = {
+    .name = "EMMC",
+    .ack = emmc_ack,
+    .handle = emmc_handle,
+    .flags.threaded = 1,
+    .thread_prio = 10,
+};
+
 int __kinit__ emmc_init(void)
 {
 #ifdef configBCM2835
@@ -338,6 +395,13 @@ int __kinit__ emmc_init(void)
     if (err)
         return err;
 
+    emmc_irq_dev = sd_edev;
+    err = irq_register(EMMC_IRQ, &emmc_irq_handler);
+    if (err) {
+        KERROR(KERROR_WARN,
+               "EMMC: Failed to register the IRQ handler (%d)\n", err);
+    }
+
     /* TODO Block cache not implemented */
 #ifdef ENABLE_BLOCK_CACHE
     struct dev_info * c_dev = sd_edev->dev;
@@ -1278,9 +1342,9 @@ static int emmc_card_init(struct emmc_block_dev ** edev)
     KERROR(KERROR_DEBUG, "EMMC: SD clock enabled\n");
 #endif
 
-    /* Mask off sending interrupts to the ARM */
+    /* Only send the card detect interrupts to the ARM */
     mmio_start(&s_entry);
-    mmio_write(EMMC_BASE + EMMC_IRPT_EN, 0);
+    mmio_write(EMMC_BASE + EMMC_IRPT_EN, EMMC_IRPT_CARD);
     /* Reset interrupts */
     mmio_write(EMMC_BASE + EMMC_INTERRUPT, 0xffffffff);
     mmio_end(&s_entry);
@@ -1294,7 +1358,7 @@ static int emmc_card_init(struct emmc_block_dev ** edev)
     mmio_end(&s_entry);
 
 #ifdef configEMMC_DEBUG
-    KERROR(KERROR_DEBUG, "EMMC: interrupts disabled\n");
+    KERROR(KERROR_DEBUG, "EMMC: card detect interrupts enabled\n");
 #endif
     udelay(2000);
 
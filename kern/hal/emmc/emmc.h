@@ -68,6 +68,8 @@
 #define SD_CLOCK_100        100000000
 #define SD_CLOCK_208        208000000
 
+/* The Arasan SD host controller interrupt line */
+#define EMMC_IRQ            62
 
 /* Register addresses */
 #define EMMC_BASE           0x20300000
@@ -129,6 +129,7 @@ void fb_mm_initbuf(struct fb_conf * fb)
     memset(bp, 0, sizeof(struct buf));
 
     mtx_init(&bp->lock, MTX_TYPE_TICKET, 0);
+    waitq_init(&bp->b_waitq);
 
     /* TODO We must implement a generic initializer for this */
     kobj_init(&bp->b_obj, fb_mm_free_callback);
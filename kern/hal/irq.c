@@ -32,16 +32,20 @@
 
 #include <errno.h>
 #include <sched.h>
-#include <bitmap.h>
 #include <fs/procfs.h>
 #include <fs/procfs_dbgfile.h>
+#include <hal/core.h>
+#include <hal/hw_timers.h>
 #include <hal/irq.h>
+#include <kerror.h>
 #include <kinit.h>
+#include <kstring.h>
 #include <thread.h>
 
-static bitmap_t irq_pending[E2BITMAP_SIZE(NR_IRQ)];
-static pthread_t irq_handler_tid;
 struct irq_handler * irq_handlers[NR_IRQ];
+static int irq_threads_ready;
+
+static int irq_create_thread(int irq);
 
 int irq_register(int irq, struct irq_handler * handler)
 {
@@ -51,7 +55,18 @@ int irq_register(int irq, struct irq_handler * handler)
     if (irq_handlers[irq])
         return -EBUSY;
 
+    handler->tid = 0;
+    handler->pending = 0;
     irq_handlers[irq] = handler;
+    if (handler->flags.threaded && irq_threads_ready) {
+        int err;
+
+        err = irq_create_thread(irq);
+        if (err) {
+            irq_handlers[irq] = NULL;
+            return err;
+        }
+    }
     irq_enable(irq);
 
     return 0;
@@ -59,46 +74,151 @@ int irq_register(int irq, struct irq_handler * handler)
 
 int irq_deregister(int irq)
 {
+    struct irq_handler * handler;
+
     if (irq < 0 || irq >= NR_IRQ)
         return -EINVAL;
 
+    handler = irq_handlers[irq];
     irq_handlers[irq] = NULL;
     irq_disable(irq);
 
+    /* The handler thread exits once it notices the handler is gone. */
+    if (handler && handler->tid > 0)
+        thread_release(handler->tid);
+
     return 0;
 }
 
+/**
+ * Update the latency stats of an IRQ.
+ * @param ts is the time the IRQ was received.
+ */
+static void irq_update_stats(struct irq_handler * handler, uint64_t ts)
+{
+    uint64_t lat = get_utime() - ts;
+
+    handler->lat_sum += lat;
+    if (lat > handler->lat_max)
+        handler->lat_max = (uint32_t)lat;
+    handler->nr_handled++;
+}
+
+void irq_handle(int irq)
+{
+    struct irq_handler * handler;
+    enum irq_ack ack_res;
+    uint64_t ts;
+
+    if (irq < 0 || irq >= NR_IRQ || !(handler = irq_handlers[irq]))
+        return;
+
+    ts = get_utime();
+    handler->cnt++;
+    ack_res = handler->ack(irq);
+
+    if (ack_res == IRQ_NEEDS_HANDLING) {
+        handler->handle(irq);
+        irq_update_stats(handler, ts);
+    } else if (ack_res == IRQ_WAKE_THREAD) {
+        if (!handler->flags.allow_multiple) {
+            irq_disable(irq); /* Disable irq until it has been handled. */
+        }
+        irq_thread_wakeup(irq);
+    }
+}
+
 void irq_thread_wakeup(int irq)
 {
-    bitmap_set(irq_pending, irq, sizeof(irq_pending));
-    thread_release(irq_handler_tid);
+    struct irq_handler * handler = irq_handlers[irq];
+    istate_t s;
+
+    if (!handler)
+        return;
+
+    if (handler->tid <= 0) {
+        /* No thread yet, handle it now. */
+        handler->handle(irq);
+        if (!handler->flags.allow_multiple)
+            irq_enable(irq);
+        return;
+    }
+
+    s = get_interrupt_state();
+    disable_interrupt();
+    if (!handler->pending)
+        handler->pending_ts = get_utime();
+    handler->pending = 1;
+    thread_release(handler->tid);
+    set_interrupt_state(s);
 }
 
 static void * irq_handler_thread(void * arg)
 {
+    const int irq = (int)(intptr_t)arg;
+    struct irq_handler * const handler = irq_handlers[irq];
+
     while (1) {
-        thread_wait(); /* Wait until the HW specific handler calls
-                        * irq_threaded_wakeup().
-                        */
-
-        for (int irq = 0; irq < NR_IRQ; irq++) {
-            /* NOTE: Ignoring errors */
-            if (bitmap_status(irq_pending, irq, sizeof(irq_pending))) {
-                struct irq_handler * handler = irq_handlers[irq];
-                handler->handle(irq);
-                bitmap_clear(irq_pending, irq, sizeof(irq_pending));
-
-                if (!handler->flags.allow_multiple) {
-                    irq_enable(irq);
-                }
-            }
+        uint64_t ts;
+        istate_t s;
+
+        /*
+         * Interrupts are kept disabled between checking for pending work and
+         * blocking, otherwise a wakeup could get lost. thread_wait() enables
+         * interrupts once the thread is in the blocked state.
+         */
+        s = get_interrupt_state();
+        disable_interrupt();
+        if (irq_handlers[irq] != handler) {
+            set_interrupt_state(s);
+            break;
+        }
+        if (!handler->pending) {
+            thread_wait();
+            set_interrupt_state(s);
+            continue;
+        }
+        handler->pending = 0;
+        ts = handler->pending_ts;
+        set_interrupt_state(s);
+
+        handler->handle(irq);
+        irq_update_stats(handler, ts);
+
+        if (!handler->flags.allow_multiple) {
+            irq_enable(irq);
         }
     }
+
+    return NULL;
+}
+
+static int irq_create_thread(int irq)
+{
+    struct irq_handler * handler = irq_handlers[irq];
+    struct sched_param param = {
+        .sched_policy = SCHED_FIFO,
+        .sched_priority = handler->thread_prio,
+    };
+    char name[16];
+    pthread_t tid;
+
+    ksprintf(name, sizeof(name), "irq%d", irq);
+    tid = kthread_create(name, &param, 0, irq_handler_thread,
+                         (void *)(intptr_t)irq);
+    if (tid < 0) {
+        KERROR(KERROR_ERR, "Failed to create a thread for IRQ%d\n", irq);
+        return tid;
+    }
+    handler->tid = tid;
+
+    return 0;
 }
 
 static int read_irq_file(void * buf, size_t max, void * elem)
 {
     struct irq_handler * handler = *((struct irq_handler **)elem);
+    unsigned lat_avg;
     int irq;
 
     if (!handler)
@@ -106,8 +226,12 @@ static int read_irq_file(void * buf, size_t max, void * elem)
 
     irq = (int)(((uintptr_t)elem - (uintptr_t)irq_handlers) /
                 (uintptr_t)sizeof(struct irq_handler *));
+    lat_avg = (handler->nr_handled > 0) ?
+        (unsigned)(handler->lat_sum / handler->nr_handled) : 0;
 
-    return ksprintf(buf, max, "%d: %u %s\n", irq, handler->cnt, handler->name);
+    return ksprintf(buf, max, "%d: %u %u %u %s\n",
+                    irq, handler->cnt, lat_avg, (unsigned)handler->lat_max,
+                    handler->name);
 }
 
 static ssize_t write_irq_file(const void * buf, size_t bufsize)
@@ -125,15 +249,19 @@ int __kinit__ irq_init(void)
     SUBSYS_DEP(sched_init);
     SUBSYS_INIT("irq");
 
-    struct sched_param param = {
-        .sched_policy = SCHED_FIFO,
-        .sched_priority = NICE_MIN,
-    };
-    irq_handler_tid = kthread_create("irq", &param, 0,
-                                     irq_handler_thread, NULL);
-    if (irq_handler_tid < 0) {
-        KERROR(KERROR_ERR, "Failed to create a thread for IRQ handling");
-        return irq_handler_tid;
+    irq_threads_ready = 1;
+
+    /* Create threads for handlers registered before the scheduler. */
+    for (int irq = 0; irq < NR_IRQ; irq++) {
+        struct irq_handler * handler = irq_handlers[irq];
+
+        if (handler && handler->flags.threaded && handler->tid <= 0) {
+            int err;
+
+            err = irq_create_thread(irq);
+            if (err)
+                return err;
+        }
     }
 
     return 0;
@@ -42,8 +42,8 @@
 #include <thread.h>
 
 /* Definitions for Page fault counter *****************************************/
-#define PFC_FREQ    (int)configSCHED_HZ /* We wan't to compute pf/s once per
-                                         * second. */
+#define PFC_PERIOD  1000000ULL /* We wan't to compute pf/s once per
+                                 * second. */
 #define FSHIFT      11              /*!< nr of bits of precision */
 #define FEXP_1      753             /*!< 1 sec */
 #define FIXED_1     (1 << FSHIFT)   /*!< 1.0 in fixed-point */
@@ -168,6 +168,7 @@ int mmu_ptcpy(mmu_pagetable_t * dest, const mmu_pagetable_t * src)
     }
 
     memcpy((void *)(dest->pt_addr), (void *)(src->pt_addr), len_src);
+    mmu_sync_pagetable(dest);
 
     return 0;
 }
@@ -254,7 +255,9 @@ void mmu_pf_event(void)
  */
 static void mmu_calc_pfcps(void)
 {
-    static int count = PFC_FREQ;
+    static uint64_t next;
+    const uint64_t now = get_utime();
+    unsigned long pfc;
 
     /* Tanenbaum suggests in one of his books that pf/s count could be first
      * averaged and then on each iteration summed with the current value and
@@ -262,14 +265,17 @@ static void mmu_calc_pfcps(void)
      * for loadavg.
      */
 
-    count--;
-    if (count < 0) {
-        unsigned long pfc;
+    if (now < next)
+        return;
 
-        count = PFC_FREQ;
-        pfc = (_pf_raw_count * FIXED_1);
-        CALC_PFC(mmu_pfps, pfc);
-        _pf_raw_count = 0;
-    }
+    /*
+     * The scheduler tick might have been stopped, so the faults are averaged
+     * over the whole time elapsed.
+     */
+    pfc = (_pf_raw_count * FIXED_1) /
+          (unsigned long)((now - next) / PFC_PERIOD + 1);
+    next = now + PFC_PERIOD;
+    CALC_PFC(mmu_pfps, pfc);
+    _pf_raw_count = 0;
 }
 TIMER_TASK(mmu_calc_pfcps);
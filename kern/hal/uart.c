@@ -38,12 +38,20 @@
 #include <termios.h>
 #include <thread.h>
 #include <fs/devfs.h>
+#include <fs/fs_poll.h>
 #include <hal/uart.h>
 #include <kinit.h>
 #include <kstring.h>
 #include <libkern.h>
+#include <queue_r.h>
 #include <tty.h>
 
+/**
+ * Receive status polling interval in ms.
+ * Only used with ports that are not interrupt driven.
+ */
+#define UART_POLL_INTERVAL 50
+
 static const char drv_name[] = "UART";
 
 static struct uart_port * uart_ports[UART_PORTS_MAX];
@@ -55,6 +63,7 @@ static ssize_t uart_read(struct tty * tty, off_t blkno,
                          uint8_t * buf, size_t bcount, int oflags);
 static ssize_t uart_write(struct tty * tty, off_t blkno,
                           uint8_t * buf, size_t bcount, int oflags);
+static int uart_poll(struct tty * tty, int events, struct poll_table * pt);
 static int uart_ioctl(struct dev_info * devnfo, uint32_t request,
                       void * arg, size_t arg_len);
 
@@ -99,6 +108,7 @@ static int make_uartdev(struct uart_port * port, int port_num)
     tty->write = uart_write;
     tty->setconf = port->setconf;
     tty->ioctl = uart_ioctl;
+    tty->poll = uart_poll;
 
     if (make_ttydev(tty)) {
         tty_free(tty);
@@ -118,6 +128,12 @@ int uart_register_port(struct uart_port * port)
     if (i >= UART_PORTS_MAX)
         return -1;
 
+    if (port->flags & UART_PORT_FLAG_INTR) {
+        mtx_init(&port->lock, MTX_TYPE_SPIN, MTX_OPT_DINT);
+        waitq_init(&port->rx_wq);
+        waitq_init(&port->tx_wq);
+    }
+
     uart_ports[i] = port;
     uart_nr_ports++;
     if (vfs_ready)
@@ -141,6 +157,96 @@ struct uart_port * uart_getport(int port_num)
     return retval;
 }
 
+void uart_rx_wakeup(struct uart_port * port)
+{
+    mtx_lock(&port->lock);
+    waitq_wakeup_all(&port->rx_wq);
+    mtx_unlock(&port->lock);
+}
+
+void uart_tx_wakeup(struct uart_port * port)
+{
+    mtx_lock(&port->lock);
+    waitq_wakeup_all(&port->tx_wq);
+    mtx_unlock(&port->lock);
+}
+
+/**
+ * Read from the receive ring of an interrupt driven port.
+ */
+static ssize_t uart_read_ring(struct uart_port * port, uint8_t * buf,
+                              size_t bcount, int oflags)
+{
+    size_t n = 0;
+
+    mtx_lock(&port->lock);
+    while (queue_isempty(&port->rx_queue)) {
+        if ((oflags & O_NONBLOCK) == O_NONBLOCK || bcount == 0) {
+            mtx_unlock(&port->lock);
+            return (bcount == 0) ? 0 : -EAGAIN;
+        }
+        waitq_sleep(&port->rx_wq, &port->lock, 0);
+    }
+
+    while (n < bcount) {
+        size_t count;
+        uint8_t * p;
+
+        p = queue_peek_n(&port->rx_queue, &count);
+        if (!p)
+            break;
+
+        count = min(count, bcount - n);
+        memcpy(buf + n, p, count);
+        queue_skip(&port->rx_queue, count);
+        n += count;
+    }
+    mtx_unlock(&port->lock);
+
+    if (port->start_rx)
+        port->start_rx(port);
+
+    return n;
+}
+
+/**
+ * Write to the transmit ring of an interrupt driven port.
+ */
+static ssize_t uart_write_ring(struct uart_port * port, uint8_t * buf,
+                               size_t bcount, int oflags)
+{
+    size_t n = 0;
+
+    mtx_lock(&port->lock);
+    while (n < bcount) {
+        size_t count;
+        uint8_t * p;
+
+        p = queue_alloc_get_n(&port->tx_queue, &count);
+        if (!p) {
+            if ((oflags & O_NONBLOCK) == O_NONBLOCK)
+                break;
+
+            /* Make sure the driver is draining the queue. */
+            port->start_tx(port);
+            waitq_sleep(&port->tx_wq, &port->lock, 0);
+            continue;
+        }
+
+        count = min(count, bcount - n);
+        memcpy(p, buf + n, count);
+        queue_alloc_commit_n(&port->tx_queue, count);
+        n += count;
+    }
+    mtx_unlock(&port->lock);
+
+    port->start_tx(port);
+
+    if (n == 0 && bcount != 0)
+        return -EAGAIN;
+    return n;
+}
+
 static ssize_t uart_read(struct tty * tty, off_t blkno,
                          uint8_t * buf, size_t bcount, int oflags)
 {
@@ -150,10 +256,13 @@ static ssize_t uart_read(struct tty * tty, off_t blkno,
     if (!port)
         return -ENODEV;
 
+    if (port->flags & UART_PORT_FLAG_INTR)
+        return uart_read_ring(port, buf, bcount, oflags);
+
     if ((oflags & O_NONBLOCK) != O_NONBLOCK) {
         /* TODO Block until new data event */
         while (!port->peek(port)) {
-            thread_sleep(50);
+            thread_sleep(UART_POLL_INTERVAL);
         }
     }
 
@@ -179,6 +288,9 @@ static ssize_t uart_write(struct tty * tty, off_t blkno,
     if (!port)
         return -ENODEV;
 
+    if (port->flags & UART_PORT_FLAG_INTR)
+        return uart_write_ring(port, buf, bcount, oflags);
+
     do {
         err = port->uputc(port, *buf);
     } while (block && err);
@@ -188,6 +300,42 @@ static ssize_t uart_write(struct tty * tty, off_t blkno,
     return 1;
 }
 
+static int uart_poll(struct tty * tty, int events, struct poll_table * pt)
+{
+    struct uart_port * port = (struct uart_port *)tty->opt_data;
+    int revents;
+
+    if (!port)
+        return POLLERR;
+
+    if (port->flags & UART_PORT_FLAG_INTR) {
+        revents = 0;
+
+        mtx_lock(&port->lock);
+        if (!queue_isempty(&port->rx_queue))
+            revents |= events & (POLLIN | POLLRDNORM);
+        else if (events & (POLLIN | POLLRDNORM))
+            poll_wait(pt, &port->rx_wq);
+        if (!queue_isfull(&port->tx_queue))
+            revents |= events & (POLLOUT | POLLWRNORM);
+        else if (events & (POLLOUT | POLLWRNORM))
+            poll_wait(pt, &port->tx_wq);
+        mtx_unlock(&port->lock);
+
+        return revents;
+    }
+
+    revents = events & (POLLOUT | POLLWRNORM);
+    if (port->peek(port)) {
+        revents |= events & (POLLIN | POLLRDNORM);
+    } else {
+        /* There is no event for new data without interrupts. */
+        poll_wait_interval(pt, UART_POLL_INTERVAL);
+    }
+
+    return revents;
+}
+
 static int uart_ioctl(struct dev_info * devnfo, uint32_t request,
                       void * arg, size_t arg_len)
 {
@@ -205,6 +353,11 @@ static int uart_ioctl(struct dev_info * devnfo, uint32_t request,
     /* TODO Support FIONWRITE and FIONSPACE */
     switch (request) {
     case FIONREAD:
+        if (port->flags & UART_PORT_FLAG_INTR) {
+            sizetto(queue_count(&port->rx_queue), arg, arg_len);
+            break;
+        }
+
         /*
          * Currently we don't have a generic way to tell how many bytes are
          * available but between 0 and 1 is a decent scale for most cases.
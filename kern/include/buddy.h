@@ -0,0 +1,142 @@
+/**
+ *******************************************************************************
+ * @file    buddy.h
+ * @author  Olli Vanhoja
+ * @brief   Binary buddy allocator.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+/**
+ * @addtogroup libkern
+ * @{
+ */
+
+/**
+ * @addtogroup buddy
+ * Binary buddy allocator for managing contiguous ranges of fixed size blocks,
+ * eg. dynmem sections or pages of a vregion. The allocator only keeps track of
+ * block indexes and all the bookkeeping is stored in an external array, so the
+ * managed memory itself is never touched.
+ * @{
+ */
+
+#pragma once
+#ifndef BUDDY_H
+#define BUDDY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Max order of a buddy block.
+ */
+#define BUDDY_ORDER_MAX 15
+
+/**
+ * Null block index.
+ */
+#define BUDDY_NIL       0xffff
+
+/**
+ * Per block bookkeeping of the buddy allocator.
+ * Only valid for the first block of a free buddy block.
+ */
+struct buddy_blk {
+    uint16_t next;      /*!< Next free block of the same order. */
+    uint16_t prev;      /*!< Previous free block of the same order. */
+    uint8_t order;      /*!< Order of the free block. */
+    uint8_t free;       /*!< Set if this is the first block of a free block. */
+};
+
+/**
+ * Buddy allocator descriptor.
+ */
+struct buddy {
+    size_t nblocks;     /*!< Number of blocks managed. */
+    size_t nfree;       /*!< Number of blocks currently free. */
+    uint16_t free_head[BUDDY_ORDER_MAX + 1]; /*!< Per order free lists. */
+    struct buddy_blk * blk; /*!< Bookkeeping array of nblocks entries. */
+};
+
+/**
+ * Initialize a buddy allocator.
+ * Initially all blocks are allocated, use buddy_free() to add free blocks.
+ * @param b is a pointer to the buddy allocator descriptor.
+ * @param blk is an array of nblocks entries used for bookkeeping.
+ * @param nblocks is the number of blocks, must be less than BUDDY_NIL.
+ */
+void buddy_init(struct buddy * b, struct buddy_blk * blk, size_t nblocks);
+
+/**
+ * Allocate a contiguous range of blocks.
+ * The range is taken from the smallest free buddy block that fits count
+ * blocks and the unused tail of the buddy block is freed immediately.
+ * @param b is a pointer to the buddy allocator descriptor.
+ * @param count is the number of blocks.
+ * @param[out] index is the index of the first block allocated.
+ * @return Returns 0 if succeed; Otherwise a negative errno is returned.
+ */
+int buddy_alloc(struct buddy * b, size_t count, size_t * index);
+
+/**
+ * Allocate a specific range of blocks.
+ * @param b is a pointer to the buddy allocator descriptor.
+ * @param index is the index of the first block.
+ * @param count is the number of blocks.
+ * @return Returns 0 if succeed;
+ *         -EBUSY if any of the blocks is not free;
+ *         Otherwise a negative errno is returned.
+ */
+int buddy_reserve(struct buddy * b, size_t index, size_t count);
+
+/**
+ * Free a range of blocks.
+ * Any range of allocated blocks can be freed, not only the ranges returned
+ * by buddy_alloc(). Freed blocks are coalesced with their free buddies.
+ * @param b is a pointer to the buddy allocator descriptor.
+ * @param index is the index of the first block.
+ * @param count is the number of blocks.
+ */
+void buddy_free(struct buddy * b, size_t index, size_t count);
+
+/**
+ * Test if a block is free.
+ * @param b is a pointer to the buddy allocator descriptor.
+ * @param index is the index of the block.
+ * @return Returns a boolean true if the block is free.
+ */
+int buddy_is_free(const struct buddy * b, size_t index);
+
+#endif /* BUDDY_H */
+
+/**
+ * @}
+ */
+
+/**
+ * @}
+ */
@@ -39,8 +39,11 @@
 #include <fs/fs.h>
 #include <hal/mmu.h>
 #include <kobj.h>
+#include <waitq.h>
 
 struct vm_pt;
+struct vr_cow;
+struct vr_pager;
 
 /**
  * @addtogroup buffercache vralloc bread breadn bwrite bawrite bdwrite getblk geteblk incore allocbuf brelse biodone biowait
@@ -75,6 +78,7 @@ struct buf {
     file_t b_devfile;       /*!< File descriptor for the buffered device. */
     size_t b_dirtyoff;      /*!< Offset in buffer of dirty region. */
     size_t b_dirtyend;      /*!< Offset of end of dirty region. */
+    uint64_t b_dirtytime;   /*!< Time when B_DELWRI was set [us]. */
 
     /* Status */
     unsigned long b_flags;  /*!< Buffer control flags. */
@@ -90,12 +94,19 @@ struct buf {
     const struct vm_ops * vm_ops;
 
     void * allocator_data;  /*!< Allocator specific data. */
+    struct vr_cow * b_cow;  /*!< Pages still shared with the region this
+                             *   region was lazily cloned from. */
+    struct vr_pager * b_pager; /*!< Demand paging state of a region backed
+                                *   by b_file. */
     SPLAY_ENTRY(buf) sentry_;
     LIST_ENTRY(buf) shmem_entry_; /*!< shmem sync list entry. */
     TAILQ_ENTRY(buf) relse_entry_; /*!< bio relse list entry. */
+    STAILQ_ENTRY(buf) ioq_entry_; /*!< bio async I/O queue entry. */
 
     struct kobj b_obj;
     mtx_t lock;
+    struct waitq b_waitq;   /*!< Threads waiting for the buffer to become
+                             *   unbusy or the I/O to complete. */
 };
 
 /**
@@ -121,6 +132,33 @@ typedef struct vm_ops {
      */
     struct buf * (*rclone)(struct buf * old_region);
 
+    /**
+     * Pointer to a lazy page-granular region cloning function.
+     * Works like `rclone()` but the returned region keeps sharing the pages
+     * of old_region until they are copied one at a time by `rpfault()`.
+     * @note Can be null.
+     * @param old_region    is a pointer to the current region.
+     */
+    struct buf * (*rpclone)(struct buf * old_region);
+
+    /**
+     * Resolve a fault of a single page.
+     * Copies the page containing vaddr from the region `this` was cloned
+     * from by `rpclone()`, or reads it in from the file backing a demand
+     * paged region, and maps it to pt.
+     * @note Can be null.
+     * @param this  is the current region.
+     * @param vaddr is the faulting user space address.
+     * @param pt    is the page table the page shall be mapped to; If NULL
+     *              the page is only copied and the caller must remap the
+     *              region later.
+     * @return  Returns zero if the page was copied or read in;
+     *          -ENOENT if the page is not shared with another region and
+     *          it's already in memory;
+     *          Otherwise a negative errno is returned.
+     */
+    int (*rpfault)(struct buf * this, uintptr_t vaddr, struct vm_pt * pt);
+
     /**
      * Free this region.
      * @note Can be null.
@@ -141,12 +179,16 @@ typedef struct vm_ops {
 } vm_ops_t;
 
 /* generic */
+#define B_READ      0x0000001  /*!< Read I/O requested. */
 #define B_DONE      0x0000002  /*!< Transaction finished. */
 #define B_ERROR     0x0000004  /*!< Transaction aborted. */
 #define B_BUSY      0x0000008  /*!< Buffer busy. */
 #define B_LOCKED    0x0000010  /*!< Locked in memory. */
 #define B_DIRTY     0x0000020
+#define B_RELSE     0x0000040  /*!< On the bio release list. */
+#define B_REF       0x0000080  /*!< Referenced since the last eviction scan. */
 #define B_NOCOPY    0x0000100  /*!< Don't copy-on-write this buf. */
+#define B_CACHE     0x0000200  /*!< Buffer contents are valid. */
 #define B_NOSYNC    0x0001000  /*!< Never synch to the fs. */
 #define B_ASYNC     0x0002000  /*!< Start I/O but don't wait for completion. */
 #define B_DELWRI    0x0004000  /*!< Delayed write. */
@@ -172,11 +214,14 @@ SPLAY_PROTOTYPE(bufhd_splay, buf, sentry_, biobuf_compar);
  * another thread can get it. If the buffer contents are modified and should be
  * written back to disk, it should be unbusied using one of the variants of
  * bwrite().  Otherwise, it should be unbusied using brelse().
+ * The block is only read from the device if the buffer doesn't contain
+ * valid data already.
  * @param[in]   vnode   is a pointer to a vnode.
  * @param[in]   blkno   is a block number.
  * @param[in]   size    is the size to be read.
  * @param[out]  buf     points to the returned buffer.
- * @return      Returns 0 if succeed; A negative errno if failed.
+ * @return      Returns 0 if succeed; A negative errno if failed. If the read
+ *              failed the buffer is still returned and must be released.
  */
 int bread(vnode_t * vnode, size_t blkno, int size, struct buf ** bpp);
 
@@ -184,22 +229,40 @@ int bread(vnode_t * vnode, size_t blkno, int size, struct buf ** bpp);
  * Get a buffer as bread().
  * In addition, breadn() will start read-ahead of blocks specified by rablks,
  * rasizes and nrablks. The read-ahead blocks aren't returned, but are available
- * in cache for future accesses.
+ * in cache for future accesses. The read-ahead is done asynchronously and
+ * blocks already in the cache are skipped.
  * @param[in]   vnode   is a pointer to a vnode.
  * @param[in]   blkno   is a block number.
  * @param[in]   size    is the size to be read.
- * @param[in]   rablks
- * @param[in]   rasizes
- * @param[in]   nrablks
+ * @param[in]   rablks  is an array of block numbers to be read ahead.
+ * @param[in]   rasizes is an array of sizes of the read-ahead blocks.
+ * @param[in]   nrablks is the number of elements in rablks and rasizes.
  * @param[out]  bpp     points to the returned buffer.
  * @return      Returns 0 if succeed; A negative errno if failed.
  */
 int  breadn(vnode_t * vnode, size_t blkno, int size, size_t rablks[],
             int rasizes[], int nrablks, struct buf ** bpp);
 
+/**
+ * Get a buffer as bread() with sequential read-ahead.
+ * Sequential access is detected using the read-ahead state of an open file.
+ * The read-ahead window is doubled on each sequential read up to
+ * vfs.bio.ra_max blocks and reset on a random access.
+ * @param[in]   vnode   is a pointer to a vnode.
+ * @param[in]   ra      is the read-ahead state of the open file.
+ * @param[in]   blkno   is a block number.
+ * @param[in]   size    is the size of a block.
+ * @param[in]   nblks   is the number of blocks in the file; 0 if unknown.
+ * @param[out]  bpp     points to the returned buffer.
+ * @return      Returns 0 if succeed; A negative errno if failed.
+ */
+int bread_ra(vnode_t * vnode, struct file_ra * ra, size_t blkno, int size,
+             size_t nblks, struct buf ** bpp);
+
 /**
  * Write a block.
- * This will block until IO is complete.
+ * This will block until IO is complete. The buffer is released after
+ * the write.
  * @param[in] buf   is the associated buffer.
  * @return  0 if IO was complete; -EIO in case of IO error.
  */
@@ -207,12 +270,16 @@ int bwrite(struct buf * bp);
 
 /**
  * Write a block asynchronously.
+ * The write is queued for the bio I/O thread and the buffer is released
+ * once the I/O is complete.
  * @param[in] buf   is the associated buffer.
  */
 void bawrite(struct buf * bp);
 
 /**
  * Delayed write.
+ * Mark the buffer dirty and release it. The buffer will be written out
+ * later by the flusher thread.
  * @param[in] buf   is the associated buffer.
  */
 void bdwrite(struct buf * bp);
@@ -228,6 +295,10 @@ void bio_clrbuf(struct buf * bp);
  * If the block is found in the cache, mark it as having been found, make it
  * busy and return. Otherwise, return an empty block of the correct size.  It
  * is up to the caller to ensure that the cache blocks are of the correct size.
+ * If the block is busy the calling thread will sleep until the block is
+ * released or slptimeo expires.
+ * @param[in] slptimeo is the sleep timeout in ms; 0 = no timeout.
+ * @return  Returns the buffer; NULL if out of memory or timed out.
  */
 struct buf * getblk(vnode_t * vnode, size_t blkno, size_t size, int slptimeo)
     __attribute__ ((warn_unused_result));
@@ -240,6 +311,23 @@ struct buf * getblk(vnode_t * vnode, size_t blkno, size_t size, int slptimeo)
 struct buf * geteblk(size_t size)
     __attribute__ ((warn_unused_result));
 
+/**
+ * Allocate a demand paged block backed by a file.
+ * The pages of the new buffer are read in from the file one at a time on
+ * the first page fault, or by vm_populate_region(), and are left unmapped
+ * until then. The buffer holds a reference to the vnode.
+ * @param[in] vnode is the vnode of the file.
+ * @param[in] foff is the file offset of the data.
+ * @param[in] doff is the offset of the data in the buffer.
+ * @param[in] filesz is the size of the data in the file; The rest of the
+ *                   buffer is zero filled.
+ * @param[in] size is the size of the new buffer.
+ * @return  Returns the new buffer; NULL if out of memory.
+ */
+struct buf * geteblk_file(vnode_t * vnode, off_t foff, size_t doff,
+                          size_t filesz, size_t size)
+    __attribute__ ((warn_unused_result));
+
 /**
  * Get a special block that has a mapping in ksect area as well as regular
  * mapping in kernel space.
@@ -297,11 +385,29 @@ void biodone(struct buf * bp);
 
 /**
  * Wait for operations on the buffer to complete.
+ * The calling thread will sleep until biodone() is called for the buffer.
  * @param[in] buf   is the buffer.
  * @return  Returns 0 if IO was complete; In case of IO error -EIO.
  */
 int biowait(struct buf * bp);
 
+/**
+ * Write out and free all buffers associated with a vnode.
+ * @param vnode is the vnode.
+ */
+void bio_vnode_cleanup(vnode_t * vnode);
+
+/**
+ * Write out all dirty buffers associated with a vnode.
+ * The buffers are kept in the cache. Busy buffers are waited for, and
+ * the function returns only after the vnode has no delayed writes left or
+ * a write has failed.
+ * @param vnode is the vnode.
+ * @return Returns 0 if succeed; Otherwise the negative errno of the first
+ *         failed write is returned.
+ */
+int bio_vnode_sync(vnode_t * vnode);
+
 /**
  * Get last error with a buf bp.
  * @param bp        is the buffer.
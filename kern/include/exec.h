@@ -67,4 +67,26 @@ int exec_file(struct exec_loadfn * loader, int fildes,
               char name[PROC_NAME_SIZE], struct buf * env_bp,
               int uargc, uintptr_t uargv, uintptr_t uenvp);
 
+/**
+ * Get the shared file image of a loadable segment of an executable file.
+ * The image is demand paged from the file and cached, so all the processes
+ * executing the same file share the same pages. The caller should get a lazy
+ * COW clone of the image if the segment is writable.
+ * @param vnode is the vnode of the executable file.
+ * @param foff is the file offset of the segment.
+ * @param filesz is the size of the segment in the file.
+ * @param vaddr is the address of the segment.
+ * @param memsz is the size of the segment in memory.
+ * @param prot is a OR'd VM_PROT flags mask.
+ * @return Returns a region referenced for the caller; NULL if out of memory.
+ */
+struct buf * exec_textcache_get(vnode_t * vnode, off_t foff, size_t filesz,
+                                uintptr_t vaddr, size_t memsz, int prot);
+
+/**
+ * Drop all the cached images of files on a superblock.
+ * @param sb is a pointer to the superblock.
+ */
+void exec_textcache_purge_sb(struct fs_superblock * sb);
+
 #endif /* EXEC_H */
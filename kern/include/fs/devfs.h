@@ -93,6 +93,16 @@ struct dev_info {
     int (*mmap)(struct dev_info * devnfo, size_t blkno, size_t bsize, int flags,
                 struct buf ** bp_out);
 
+    /**
+     * Poll the device for readiness.
+     * The function shall call poll_wait() for the wait queues woken up on
+     * state changes and return the ready events.
+     * @note This function is optional and can be NULL, in which case the
+     *       device is always ready.
+     */
+    int (*poll)(file_t * file, struct dev_info * devnfo, int events,
+                struct poll_table * pt);
+
     /**
      * The function is called if set and vnode deletion is triggered by
      * one of the vnode release functions.
@@ -91,6 +91,7 @@
 /* End of macros **************************************************************/
 
 struct cred;
+struct poll_table;
 struct proc_info;
 
 /*
@@ -169,6 +170,17 @@ typedef struct vnode {
  */
 #define VNOVAL  (-1)
 
+/**
+ * Sequential read-ahead state of an open file.
+ * Block numbers are in units used by the buffer cache for the file.
+ */
+struct file_ra {
+    off_t ra_next;      /*!< Expected block number of the next sequential
+                         *   read. */
+    off_t ra_end;       /*!< End of the read-ahead already started. */
+    size_t ra_win;      /*!< Current read-ahead window in blocks. */
+};
+
 /**
  * File descriptor.
  */
@@ -177,6 +189,7 @@ typedef struct file {
     int oflags;         /*!< File status flags. */
     vnode_t * vnode;
     void * stream;      /*!< Pointer to a special file stream data or info. */
+    struct file_ra f_ra; /*!< Read-ahead state. */
     struct kobj f_obj;
 } file_t;
 
@@ -215,6 +228,7 @@ typedef struct files_struct {
 typedef struct fs {
     char fsname[MFSNAMELEN];
     unsigned fs_majornum; /*!< Virtual major device number of the filesystem. */
+    unsigned fs_flags;    /*!< File system flags. */
     mtx_t fs_giant;
 
     /**
@@ -238,6 +252,14 @@ typedef struct fs {
     SLIST_ENTRY(fs) _fs_list;
 } fs_t;
 
+/*
+ * File system flags.
+ */
+#define FS_FLAG_NAMECACHE   0x1 /*!< Lookups can be cached by the vfs.
+                                 *   The directories of the file system must
+                                 *   be modified only with vnode ops called
+                                 *   by the vfs. */
+
 /**
  * File system superblock.
  */
@@ -334,6 +356,17 @@ typedef struct vnode_ops {
      *                  Otherwise a negative errno code is returned.
      */
     int (*ioctl)(file_t * file, unsigned request, void * arg, size_t arg_len);
+    /**
+     * Poll the readiness of an open file.
+     * The function shall call poll_wait() for each wait queue that is woken
+     * up when the readiness of the file changes and then return the events
+     * that can be completed without blocking.
+     * @param file      is the open file polled.
+     * @param events    is a mask of the requested POLL events.
+     * @param pt        is a pointer to the poll table, can be NULL.
+     * @return          A mask of ready POLL events.
+     */
+    int (*poll)(file_t * file, int events, struct poll_table * pt);
     /* Event handlers
      * -------------- */
     /**
@@ -836,6 +869,7 @@ ssize_t fs_enotsup_write(file_t * file, struct uio * uio, size_t count);
 off_t fs_enotsup_lseek(file_t * file, off_t offset, int whence);
 int fs_enotsup_ioctl(file_t * file, unsigned request, void * arg,
                      size_t arg_len);
+int nofs_poll(file_t * file, int events, struct poll_table * pt);
 int fs_enotsup_event_vnode_opened(struct proc_info * p, vnode_t * vnode);
 void fs_enotsup_event_fd_created(struct proc_info * p, file_t * file);
 void fs_enotsup_event_fd_closed(struct proc_info * p, file_t * file);
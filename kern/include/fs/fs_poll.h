@@ -0,0 +1,101 @@
+/**
+ *******************************************************************************
+ * @file    fs_poll.h
+ * @author  Olli Vanhoja
+ * @brief   Poll tables for poll() and select().
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+/**
+ * @addtogroup fs
+ * @{
+ */
+
+#pragma once
+#ifndef FS_POLL_H
+#define FS_POLL_H
+
+#include <stddef.h>
+#include <poll.h>
+#include <waitq.h>
+
+struct file;
+
+/**
+ * An entry in a poll table.
+ */
+struct poll_entry {
+    struct waitq * pe_wq;       /*!< Wait queue the entry is in. */
+    struct waitq_entry pe_we;
+    struct file * pe_file;      /*!< File ref held while sleeping, if any. */
+};
+
+/**
+ * Poll table.
+ * A poll table collects the wait queues of all polled files so that the
+ * polling thread can sleep on all of them at once.
+ */
+struct poll_table {
+    size_t pt_count;            /*!< Number of entries in use. */
+    size_t pt_size;             /*!< Size of pt_entries. */
+    long pt_interval;           /*!< Max sleep time in ms; 0 = no limit. */
+    struct poll_entry * pt_entries;
+};
+
+/**
+ * Register a wait queue that will be woken up when the readiness of a polled
+ * file changes.
+ * This function should be called by vnode poll() implementations.
+ * @param pt is a pointer to the poll table passed to poll(); Can be NULL.
+ * @param wq is a pointer to the wait queue.
+ */
+void poll_wait(struct poll_table * pt, struct waitq * wq);
+
+/**
+ * Limit the time a poller is allowed to sleep.
+ * This can be used by drivers that can't wake up pollers when the readiness
+ * changes and must be polled instead.
+ * @param pt is a pointer to the poll table passed to poll(); Can be NULL.
+ * @param ms is the maximum time to sleep in ms.
+ */
+void poll_wait_interval(struct poll_table * pt, long ms);
+
+/**
+ * Poll files of the current process.
+ * @param fds is an array of pollfd structs in kernel memory.
+ * @param nfds is the number of elements in fds.
+ * @param timeout is the timeout in ms; -1 = infinite.
+ * @return Returns the number of ready files;
+ *         Otherwise a negative errno code is returned.
+ */
+int fs_poll_curproc(struct pollfd * fds, nfds_t nfds, int timeout);
+
+#endif /* FS_POLL_H */
+
+/**
+ * @}
+ */
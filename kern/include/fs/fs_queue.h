@@ -36,7 +36,10 @@
 #include <fcntl.h>
 #include <buf.h>
 #include <queue_r.h>
-#include <ksignal.h>
+#include <klocks.h>
+#include <waitq.h>
+
+struct poll_table;
 
 struct fs_queue_packet {
     size_t size;
@@ -54,8 +57,10 @@ struct fs_queue {
     size_t last_rd; /*!< peek offset if the read count is less that block size. */
     mtx_t wr_lock;
     mtx_t rd_lock;
-    struct signals * waiting4read;
-    struct signals * waiting4write;
+    mtx_t wait_lock; /*!< Protects sleeping on rd_waitq and wr_waitq. */
+    struct waitq rd_waitq; /*!< Readers waiting for data. */
+    struct waitq wr_waitq; /*!< Writers waiting for free blocks. */
+    struct waitq poll_waitq; /*!< Pollers of both ends. */
     struct fs_queue_packet packet[];
 };
 
@@ -96,4 +101,15 @@ ssize_t fs_queue_write(struct fs_queue * fsq, uint8_t * buf, size_t count,
 ssize_t fs_queue_read(struct fs_queue * fsq, uint8_t * buf, size_t count,
                       int flags);
 
+/**
+ * Poll a fs queue.
+ * POLLIN is set if there is something to read and POLLOUT if there is room
+ * for at least one more block.
+ * @param fsq is a pointer to the fs queue object.
+ * @param events is the set of requested events.
+ * @param pt is a pointer to the poll table; Can be NULL.
+ * @return Returns the events that are currently ready.
+ */
+int fs_queue_poll(struct fs_queue * fsq, int events, struct poll_table * pt);
+
 #endif /* _FS_QUEUE_H_ */
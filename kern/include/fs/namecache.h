@@ -0,0 +1,125 @@
+/**
+ *******************************************************************************
+ * @file    namecache.h
+ * @author  Olli Vanhoja
+ * @brief   VFS name cache.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+/**
+ * @addtogroup fs
+ * @{
+ */
+
+#pragma once
+#ifndef NAMECACHE_H
+#define NAMECACHE_H
+
+#include <errno.h>
+
+struct vnode;
+struct fs_superblock;
+
+/**
+ * Max length of a component name stored in the name cache.
+ * Longer names are always looked up from the file system.
+ */
+#define NC_NAME_MAX     31
+
+#ifdef configFS_NAMECACHE
+
+/**
+ * Get the generation number of the name cache.
+ * The generation is incremented by every purge and it must be passed to
+ * namecache_enter() to avoid entering stale lookup results.
+ */
+unsigned namecache_gen(void);
+
+/**
+ * Lookup a name from the name cache.
+ * @param dir       is the directory vnode.
+ * @param name      is the component name.
+ * @param[out] vpp  is set to a referenced vnode if a positive entry was found.
+ * @return  0 if a positive entry was found;
+ *          -ENOENT if a negative entry was found;
+ *          -EAGAIN if the name is not in the cache.
+ */
+int namecache_lookup(struct vnode * dir, const char * name,
+                     struct vnode ** vpp);
+
+/**
+ * Enter a lookup result into the name cache.
+ * @param dir   is the directory vnode.
+ * @param name  is the component name.
+ * @param vp    is the vnode found or NULL for a negative entry.
+ * @param gen   is the value of namecache_gen() before the lookup was made.
+ */
+void namecache_enter(struct vnode * dir, const char * name, struct vnode * vp,
+                     unsigned gen);
+
+/**
+ * Purge all entries of a directory from the name cache.
+ * Must be called after a directory entry was added to or removed from dir.
+ */
+void namecache_purge_dir(struct vnode * dir);
+
+/**
+ * Purge all entries of a superblock from the name cache.
+ */
+void namecache_purge_sb(struct fs_superblock * sb);
+
+#else
+static inline unsigned namecache_gen(void)
+{
+    return 0;
+}
+
+static inline int namecache_lookup(struct vnode * dir, const char * name,
+                                   struct vnode ** vpp)
+{
+    return -EAGAIN;
+}
+
+static inline void namecache_enter(struct vnode * dir, const char * name,
+                                   struct vnode * vp, unsigned gen)
+{
+}
+
+static inline void namecache_purge_dir(struct vnode * dir)
+{
+}
+
+static inline void namecache_purge_sb(struct fs_superblock * sb)
+{
+}
+#endif
+
+#endif /* NAMECACHE_H */
+
+/**
+ * @}
+ */
@@ -65,4 +65,17 @@ typedef void timer_task_t(void);
  */
 void hw_timers_run(void);
 
+/**
+ * Program the scheduler timer to interrupt only once.
+ * The timer interrupts once after usec and then remains idle until it's
+ * reprogrammed. Used for the tickless idle.
+ * @param usec is the delay to the next interrupt; 0 stops the timer.
+ */
+void hw_sched_timer_oneshot(uint64_t usec);
+
+/**
+ * Restore the periodic configSCHED_HZ scheduler timer.
+ */
+void hw_sched_timer_periodic(void);
+
 #endif /* HW_TIMERS_H */
@@ -30,6 +30,8 @@
  *******************************************************************************
  */
 
+#include <stdint.h>
+#include <sys/types/_pthread_t.h>
 
 #define NR_IRQ 64
 
@@ -58,8 +60,21 @@ struct irq_handler {
     struct {
         unsigned allow_multiple : 1; /*!< Allow multiple IRQs to be received for
                                       *   a threaded handler. */
+        unsigned threaded : 1;       /*!< Create a handler thread for the IRQ.
+                                      *   ack() may return IRQ_WAKE_THREAD only
+                                      *   if this flag is set. */
     } flags; /*!< IRQ handler control flags */
 
+    int thread_prio; /*!< SCHED_FIFO priority of the handler thread. */
+
+    /* Managed by the IRQ subsystem. */
+    pthread_t tid;          /*!< Handler thread id or 0. */
+    int pending;            /*!< Handler thread has work pending. */
+    uint64_t pending_ts;    /*!< Time of the oldest unhandled IRQ in usec. */
+    uint64_t lat_sum;       /*!< Sum of IRQ handling latencies in usec. */
+    uint32_t lat_max;       /*!< Max IRQ handling latency in usec. */
+    unsigned int nr_handled; /*!< Number of completed handler calls. */
+
     unsigned int cnt; /*!< Interrupts received count. */
     char name[]; /*!< Name of the handler/IRQ. Should be incremented by the
                   *   HW specific IRQ resolver. */
@@ -93,6 +108,14 @@ int irq_register(int irq, struct irq_handler * handler);
 int irq_deregister(int irq);
 
 /**
- * Postpone IRQ handling to the threaded IRQ handler.
+ * Handle an interrupt.
+ * Called by the HW specific IRQ resolver from the interrupt context for each
+ * pending IRQ.
+ */
+void irq_handle(int irq);
+
+/**
+ * Postpone IRQ handling to the handler thread of the IRQ.
+ * The handler is called immediately if the IRQ has no handler thread.
  */
 void irq_thread_wakeup(int irq);
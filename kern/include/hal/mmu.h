@@ -175,7 +175,7 @@ enum mmu_ptt {
 /**
  * Page Table Control Block - PTCB
  */
-typedef struct {
+typedef struct mmu_pagetable {
     uintptr_t vaddr;    /*!< Identifies a starting virtual address of a 1MB
                          * section. (Only meaningful with coarse tables) */
     uintptr_t pt_addr;  /*!< The address where the page table is located in
@@ -185,8 +185,14 @@ typedef struct {
     uintptr_t master_pt_addr; /*!< The address of a parent master L1 page
                                * table. If the table is an L1 table, then
                                * the value is same as pt_addr. */
+    struct mmu_pagetable * master_pt; /*!< The parent master page table of
+                                       * an L2 table owned by a process.
+                                       * NULL for kernel tables. */
     enum mmu_ptt pt_type; /*!< Identifies the type of the page table. */
     uint32_t pt_dom;    /*!< The domain of the page table. */
+    uint32_t pt_asid;   /*!< Address space identifier of an L1 table.
+                         *   Managed by the HAL, must be initialized to
+                         *   zero. */
 } mmu_pagetable_t;
 
 /**
@@ -278,11 +284,24 @@ int mmu_unmap_region(const mmu_region_t * region);
 
 /**
  * Attach a L2 page table to a L1 master page table or attach a L1 page table.
+ * Attaching an L1 page table will also switch to the address space
+ * identifier of the table, so the TLB entries of other processes are not
+ * invalidated.
  * @param pt    A page table descriptor structure.
  * @return  Zero if attach succeed; non-zero error code if invalid page table
  *          type.
  */
-int mmu_attach_pagetable(const mmu_pagetable_t * pt);
+int mmu_attach_pagetable(mmu_pagetable_t * pt);
+
+/**
+ * Make changes written directly to the memory of a page table visible to
+ * the MMU.
+ * Page tables updated by the MMU HAL functions are always synchronized but
+ * this must be called after modifying a page table by other means,
+ * eg. by copying it.
+ * @param pt    A page table descriptor structure.
+ */
+void mmu_sync_pagetable(const mmu_pagetable_t * pt);
 
 /**
  * Detach a L2 page table from a L1 master page table.
@@ -46,11 +46,16 @@
 
 #include <stdint.h>
 #include <termios.h>
+#include <klocks.h>
+#include <queue_r.h>
+#include <waitq.h>
 
 /* UART HAL Configuration */
 #define UART_PORTS_MAX configUART_MAX_PORTS
 
 #define UART_PORT_FLAG_FS       0x01 /*!< Port is exported to the devfs. */
+#define UART_PORT_FLAG_INTR     0x02 /*!< Port is interrupt driven and uses
+                                      *   rx_queue and tx_queue. */
 
 struct uart_port {
     unsigned uart_id;       /*!< ID that can be used by the hal level driver.
@@ -84,6 +89,32 @@ struct uart_port {
      * @return 0 if no data avaiable; Otherwise value other than zero.
      */
     int (* peek)(struct uart_port * port);
+
+    /*
+     * Interrupt driven ports.
+     * The driver interrupt handler pushes received bytes to rx_queue and
+     * pops bytes to be sent from tx_queue. Both queues are initialized by
+     * the driver before the port is registered.
+     */
+
+    /**
+     * Start transmitting data queued to tx_queue.
+     * Called by the UART abstraction layer after new data was queued.
+     */
+    void (* start_tx)(struct uart_port * port);
+
+    /**
+     * Resume receiving after space was freed in rx_queue.
+     * Called by the UART abstraction layer after data was removed from
+     * rx_queue.
+     */
+    void (* start_rx)(struct uart_port * port);
+
+    queue_cb_t rx_queue;    /*!< Receive ring buffer. */
+    queue_cb_t tx_queue;    /*!< Transmit ring buffer. */
+    mtx_t lock;             /*!< Serializes readers and writers. */
+    struct waitq rx_wq;     /*!< Threads waiting for received data. */
+    struct waitq tx_wq;     /*!< Threads waiting for space in tx_queue. */
 };
 
 /**
@@ -92,6 +123,18 @@ struct uart_port {
  */
 int uart_register_port(struct uart_port * port);
 
+/**
+ * Wake up threads waiting for received data.
+ * Called by interrupt driven drivers after pushing to rx_queue.
+ */
+void uart_rx_wakeup(struct uart_port * port);
+
+/**
+ * Wake up threads waiting for space in tx_queue.
+ * Called by interrupt driven drivers after popping from tx_queue.
+ */
+void uart_tx_wakeup(struct uart_port * port);
+
 /**
  * Get nr of ports registered with UART.
  */
@@ -1,10 +1,10 @@
 /**
  *******************************************************************************
- * @file    mempool.h
+ * @file    kdata.h
  * @author  Olli Vanhoja
- * @brief   A simple memory pooler.
+ * @brief   Kernel data pages shared with the user space.
  * @section LICENSE
- * Copyright (c) 2016, 2017 Olli Vanhoja <olli.vanhoja@cs.helsinki.fi>
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -31,69 +31,58 @@
  */
 
 /**
- * @addtogroup mempool
+ * @addtogroup kdata
  * @{
  */
 
 #pragma once
-#ifndef MEMPOOL_H
-#define MEMPOOL_H
+#ifndef KDATA_H
+#define KDATA_H
 
-#include <stddef.h>
-#include <klocks.h>
-#include <queue_r.h>
+#include <stdint.h>
+#include <sys/kdata.h>
 
-/**
- * Mempool type.
- */
-enum mempool_type {
-    MEMPOOL_TYPE_NONBLOCKING,   /*!< Non-blocing mempool. */
-    MEMPOOL_TYPE_BLOCKING,      /*!< Blocking mempool. */
-};
+struct proc_info;
+struct timespec;
 
 /**
- * Mempool object.
+ * Map the kernel data pages to a process.
+ * Called on exec and fork. A new process data page is allocated if the process
+ * doesn't have one yet.
+ * @param proc is a pointer to the process.
+ * @return Returns 0 if succeed; Otherwise a negative errno code is returned.
  */
-struct mempool {
-    struct queue_cb head;
-    enum mempool_type type;
-    mtx_t lock;
-    sema_t sema;
-    void * data;
-    uintptr_t pool[0];
-};
+int kdata_map(struct proc_info * proc);
 
 /**
- * Initialize a memory pool.
- * @param bsize is the size of an element in the pool in bytes.
- * @param type selects the type of the mempool.
- * @param count is the initial number of elements in the pool.
- * @return Returns a pointer to the newly initialized memory pool.
+ * Release the process data page of a process.
+ * @param proc is a pointer to the process.
  */
-struct mempool * mempool_init(enum mempool_type type, size_t bsize,
-                              unsigned count);
+void kdata_free(struct proc_info * proc);
 
 /**
- * Destroy a memory pool and elements returned to it.
- * mp is set to NULL after it's destroyed.
- * @param mp is a pointer to the memory pool to be destroyed.
+ * Update the parent process ID in the process data page.
+ * Should be called when the parent of a process changes.
+ * @param proc is a pointer to the process.
  */
-void mempool_destroy(struct mempool ** mp);
+void kdata_update_ppid(struct proc_info * proc);
 
 /**
- * Get an elemenent from the memory pool.
- * @param mp is a pointer to the memory pool.
+ * Update the time in the shared kernel data page.
+ * The caller must serialize updates.
+ * @param uptime is the time since boot.
+ * @param realtime is the wall clock time.
  */
-void * mempool_get(struct mempool * mp);
+void kdata_update_time(const struct timespec * uptime,
+                       const struct timespec * realtime);
 
 /**
- * Return an element to the pool.
- * @param mp is a pointer to the memory pool.
- * @param p is a pointer to the element to be returned.
+ * Update the load averages in the shared kernel data page.
+ * @param loads is an array of load averages scaled by 100.
  */
-void mempool_return(struct mempool * mp, void * p);
+void kdata_update_loads(const uint32_t loads[3]);
 
-#endif /* MEMPOOL_H */
+#endif /* KDATA_H */
 
 /**
  * @}
@@ -51,4 +51,16 @@ int fs_pipe_curproc_creat(struct files_struct * files, int fildes[2],
  */
 int fs_pipe_destroy(vnode_t * vnode);
 
+/**
+ * Move data between a pipe and a file without a user space copy.
+ * Either in or out must be a pipe.
+ * @param in is the file read.
+ * @param out is the file written.
+ * @param len is the maximum number of bytes to move.
+ * @param flags is a bitwise or of SPLICE_F flags.
+ * @return Returns the number of bytes moved;
+ *         Otherwise a negative errno code is returned.
+ */
+ssize_t fs_pipe_splice(file_t * in, file_t * out, size_t len, int flags);
+
 #endif /* KERN_IPC_H */
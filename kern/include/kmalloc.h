@@ -130,6 +130,14 @@ void * krealloc(void * p, size_t size) __attribute__((warn_unused_result));
  */
 void * kpalloc(void * p);
 
+/**
+ * Get the reference count of a memory block.
+ * @param p is a pointer to a kmalloc'd block of data.
+ * @return Returns the number of references to the block; 0 if p is not a
+ *         valid block.
+ */
+int krefcnt(void * p);
+
 #endif /* KMALLOC_H */
 
 /**
@@ -0,0 +1,157 @@
+/**
+ *******************************************************************************
+ * @file    kmem_cache.h
+ * @author  Olli Vanhoja
+ * @brief   Object caches.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+/**
+ * @addtogroup kmem_cache
+ * Object caches for frequently allocated kernel structures.
+ * An object cache keeps a number of freed objects in a constructed state so
+ * that the next allocation of the same type doesn't need to go through
+ * kmalloc nor call the constructor again. Objects returned to a cache with
+ * kmem_cache_free() must be in their constructed state.
+ * @{
+ */
+
+#pragma once
+#ifndef KMEM_CACHE_H
+#define KMEM_CACHE_H
+
+#include <stddef.h>
+#include <klocks.h>
+
+/**
+ * Object constructor and destructor type.
+ */
+typedef void kmem_cache_cdtor_t(void * obj);
+
+/**
+ * Object cache.
+ */
+struct kmem_cache {
+    const char * kc_name;
+    size_t kc_size;                 /*!< Object size. */
+    kmem_cache_cdtor_t * kc_ctor;   /*!< Object constructor. */
+    kmem_cache_cdtor_t * kc_dtor;   /*!< Object destructor. */
+    mtx_t kc_lock;
+    size_t kc_nfree;                /*!< Number of cached objects. */
+    size_t kc_max_free;             /*!< Maximum number of cached objects. */
+    void ** kc_free;                /*!< Cached objects. */
+};
+
+/**
+ * Define a static object cache.
+ * @param _name_ is the name of the cache variable.
+ * @param _type_ is the type of the objects.
+ * @param _max_free_ is the maximum number of free objects kept in the cache.
+ * @param _ctor_ is an optional object constructor.
+ * @param _dtor_ is an optional object destructor.
+ */
+#define KMEM_CACHE_DEFINE(_name_, _type_, _max_free_, _ctor_, _dtor_)   \
+    static void * _name_##_free[_max_free_];                            \
+    static struct kmem_cache _name_ = {                                 \
+        .kc_name = #_name_,                                             \
+        .kc_size = sizeof(_type_),                                      \
+        .kc_ctor = _ctor_,                                              \
+        .kc_dtor = _dtor_,                                              \
+        .kc_lock = MTX_INITIALIZER(MTX_TYPE_TICKET, 0),                 \
+        .kc_nfree = 0,                                                  \
+        .kc_max_free = _max_free_,                                      \
+        .kc_free = _name_##_free,                                       \
+    }
+
+/**
+ * Create a new object cache.
+ * @param name is the name of the cache.
+ * @param size is the size of an object.
+ * @param max_free is the maximum number of free objects kept in the cache.
+ * @param ctor is an optional constructor called when a new object is
+ *             allocated for the cache.
+ * @param dtor is an optional destructor called when an object is released
+ *             from the cache.
+ * @return Returns a pointer to the new cache; NULL if out of memory.
+ */
+struct kmem_cache * kmem_cache_create(const char * name, size_t size,
+                                      size_t max_free,
+                                      kmem_cache_cdtor_t * ctor,
+                                      kmem_cache_cdtor_t * dtor);
+
+/**
+ * Destroy an object cache.
+ * All the free objects in the cache are destructed and freed. The caller
+ * must make sure that there are no objects of the cache in use.
+ * @param cache is a pointer to the cache created with kmem_cache_create().
+ */
+void kmem_cache_destroy(struct kmem_cache * cache);
+
+/**
+ * Fill an object cache with new constructed objects.
+ * @param cache is a pointer to the object cache.
+ * @param count is the number of objects to add, the cache will hold at most
+ *              kc_max_free objects.
+ * @return Returns 0 if succeed; Otherwise -ENOMEM.
+ */
+int kmem_cache_prealloc(struct kmem_cache * cache, size_t count);
+
+/**
+ * Allocate a constructed object from an object cache.
+ * @param cache is a pointer to the object cache.
+ * @return Returns a pointer to the object; NULL if out of memory.
+ */
+void * kmem_cache_alloc(struct kmem_cache * cache);
+
+/**
+ * Allocate an object from an object cache and zero it.
+ * This is meant for caches without a constructor.
+ * @param cache is a pointer to the object cache.
+ * @return Returns a pointer to the object; NULL if out of memory.
+ */
+void * kmem_cache_zalloc(struct kmem_cache * cache);
+
+/**
+ * Return an object to its cache.
+ * If the object has other references obtained with kpalloc() only the
+ * reference is dropped and the object is freed normally by the last kfree().
+ * @param cache is a pointer to the object cache.
+ * @param obj is a pointer to the object.
+ */
+void kmem_cache_free(struct kmem_cache * cache, void * obj);
+
+/**
+ * Release all the free objects from a cache.
+ * @param cache is a pointer to the object cache.
+ */
+void kmem_cache_reclaim(struct kmem_cache * cache);
+
+#endif /* KMEM_CACHE_H */
+
+/**
+ * @}
+ */
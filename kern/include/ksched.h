@@ -43,6 +43,7 @@
 
 #include <stdint.h>
 #include <sched.h>
+#include <libkern.h>
 
 struct thread_info;
 
@@ -63,6 +64,13 @@ struct scheduler {
      * @return  Zero if succeeded; Otherwise a negative errno code is returned.
      */
     int (*insert)(struct scheduler * sobj, struct thread_info * thread);
+    /**
+     * Remove a thread from scheduling by this policy.
+     * Called when a thread is no longer runnable, e.g. it was blocked.
+     * @param sobj is a pointer to the scheduling object.
+     * @param thread is a pointer to the thread to be removed.
+     */
+    void (*remove)(struct scheduler * sobj, struct thread_info * thread);
     /**
      * Run the scheduler.
      * @param sobj is a pointer to the scheduling object.
@@ -80,6 +88,65 @@ struct scheduler {
     unsigned (*get_nr_active_threads)(struct scheduler * sobj);
 };
 
+/**
+ * Number of distinct thread priorities.
+ */
+#define SCHED_NR_PRIO (NICE_MAX - NICE_MIN + 1)
+
+/**
+ * Priority bitmap.
+ * Bit n is set if the run queue for the priority index n is non-empty.
+ * The index 0 is the highest priority, NICE_MIN.
+ */
+struct sched_prio_map {
+    uint32_t map[(SCHED_NR_PRIO + 31) / 32];
+};
+
+/**
+ * Get the run queue index for a thread priority.
+ */
+static inline int sched_prio2idx(int prio)
+{
+    if (prio < NICE_MIN)
+        prio = NICE_MIN;
+    else if (prio > NICE_MAX)
+        prio = NICE_MAX;
+
+    return prio - NICE_MIN;
+}
+
+static inline void sched_prio_map_set(struct sched_prio_map * pm, int idx)
+{
+    pm->map[idx / 32] |= (uint32_t)1 << (idx % 32);
+}
+
+static inline void sched_prio_map_clear(struct sched_prio_map * pm, int idx)
+{
+    pm->map[idx / 32] &= ~((uint32_t)1 << (idx % 32));
+}
+
+/**
+ * Find the highest priority non-empty run queue.
+ * @param pm is a pointer to the priority bitmap.
+ * @param from is the first run queue index to look at.
+ * @return Returns the run queue index;
+ *         Or -1 if all the run queues starting from `from` are empty.
+ */
+static inline int sched_prio_map_first(const struct sched_prio_map * pm,
+                                       int from)
+{
+    for (int i = from / 32; i < (int)num_elem(pm->map); i++) {
+        uint32_t word = pm->map[i];
+
+        if (i == from / 32)
+            word &= ~(uint32_t)0 << (from % 32);
+        if (word)
+            return i * 32 + ffs((int)word) - 1;
+    }
+
+    return -1;
+}
+
 /**
  * The type of scheduler constructor creating a new thread scheduler object.
  * @return  Returns a pointer to a new thread scheduler; Otherwise -ENOMEM.
@@ -141,6 +141,7 @@ struct proc_info {
     struct vm_mm_struct mm;
     void * brk_start;           /*!< Break start address. (end of heap data) */
     void * brk_stop;            /*!< Break stop address. (end of heap region) */
+    struct buf * kdata_bp;      /*!< Process kernel data page. */
 
     /* Signals */
     struct signals sigs;        /*!< Per process signals. */
@@ -409,7 +410,7 @@ pid_t proc_fork(void);
 
 #ifdef PROC_INTERNAL
 
-extern struct mempool * proc_pool;
+extern struct kmem_cache * proc_cache;
 
 /**
  * Insert a new process to _procarr.
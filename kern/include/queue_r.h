@@ -104,6 +104,23 @@ void * queue_alloc_get(queue_cb_t * cb);
  */
 void queue_alloc_commit(queue_cb_t * cb);
 
+/**
+ * Allocate a contiguous run of elements from the queue.
+ * @param cb is a pointer to the queue control block.
+ * @param[out] count returns the number of contiguous elements available.
+ * @return A pointer to the first element in the queue;
+ *         NULL if the queue is full.
+ */
+void * queue_alloc_get_n(queue_cb_t * cb, size_t * count);
+
+/**
+ * Commit n elements allocated with queue_alloc_get_n().
+ * @param cb is a pointer to the queue control block.
+ * @param n is the number of elements written, at most the count returned
+ *          by queue_alloc_get_n().
+ */
+void queue_alloc_commit_n(queue_cb_t * cb, size_t n);
+
 /**
  * Pop an element from the queue.
  * @param cb is a pointer to the queue control block.
@@ -120,6 +137,16 @@ int queue_pop(queue_cb_t * cb, void * element);
  */
 int queue_peek(queue_cb_t * cb, void ** element);
 
+/**
+ * Peek a contiguous run of elements from the queue.
+ * The elements can be removed from the queue with queue_skip().
+ * @param cb is a pointer to the queue control block.
+ * @param[out] count returns the number of contiguous elements available.
+ * @return A pointer to the first element in the queue;
+ *         NULL if the queue is empty.
+ */
+void * queue_peek_n(queue_cb_t * cb, size_t * count);
+
 /**
  * Skip n number of elements in the queue.
  * @param cb is a pointer to the queue control block.
@@ -141,6 +168,13 @@ void queue_clear_from_push_end(queue_cb_t * cb);
  */
 void queue_clear_from_pop_end(queue_cb_t * cb);
 
+/**
+ * Get the number of elements in the queue.
+ * @param cb is a pointer to the queue control block.
+ * @return Returns the number of elements that can be popped.
+ */
+size_t queue_count(queue_cb_t * cb);
+
 /**
  * Check if the queue is empty.
  * @param cb is a pointer to the queue control block.
@@ -132,11 +132,12 @@ struct thread_info {
         union {
             /* FIFO policy */
             struct thread_sched_fifo {
-                int prio;           /*!< EXEC time priority. */
-                RB_ENTRY(thread_info) runq_entry_;
+                int prio;           /*!< Run queue index. */
+                TAILQ_ENTRY(thread_info) runq_entry_;
             } fifo;
             /* RR policy */
             struct thread_sched_rr {
+                int prio;           /*!< Run queue index. */
                 TAILQ_ENTRY(thread_info) runq_entry_;
             } rr;
         };
@@ -326,6 +327,11 @@ struct thread_info * thread_fork(pid_t new_pid)
  */
 int thread_ready(pthread_t thread_id);
 
+/**
+ * Test if there are threads in the readyq waiting to be scheduled.
+ */
+int thread_ready_pending(void);
+
 /**
  * Remove first thread that's ready.
  */
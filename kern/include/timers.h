@@ -59,8 +59,20 @@
 
 typedef int timers_flags_t;
 
+/**
+ * Run expired timers.
+ * Enabled timers are kept in a min-heap ordered by expiration time, so this
+ * only needs to look at the first timer unless some timers have expired.
+ */
 void timers_run(void);
 
+/**
+ * Get the expiration time of the next timer.
+ * @returns Returns the utime of the next expiration;
+ *          UINT64_MAX if there are no timers running.
+ */
+uint64_t timers_next_expiry(void);
+
 /**
  * Allocate a new timer
  * @param thread_id thread id to add this timer for.
@@ -68,6 +80,8 @@ void timers_run(void);
  * @param usec delay to trigger from the time when enabled.
  * @returns Returns the timer index if successfully allocated;
  *          Otherwise -1 is returned to indicate the allocation failure.
+ *          The allocation can only fail if the timer pool is exhausted and
+ *          either growing it fails or the caller has interrupts disabled.
  */
 int timers_add(void (*event_fn)(void *), void * event_arg,
                timers_flags_t flags, uint64_t usec);
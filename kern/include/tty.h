@@ -38,6 +38,7 @@
 
 struct file;
 struct vnode;
+struct poll_table;
 struct termios;
 struct winsize;
 
@@ -86,6 +87,12 @@ struct tty {
      */
     int (*ioctl)(struct dev_info * devnfo, uint32_t request,
                  void * arg, size_t arg_len);
+
+    /**
+     * Poll for readiness.
+     * @note Can be NULL, the tty is always ready then.
+     */
+    int (*poll)(struct tty * tty, int events, struct poll_table * pt);
 };
 
 /**
@@ -55,6 +55,7 @@
  */
 
 struct proc_info;
+struct vnode;
 
 /**
  * VM page table structure.
@@ -70,6 +71,23 @@ struct vm_pt {
 /* struct ptlist */
 RB_HEAD(ptlist, vm_pt);
 
+/**
+ * VM region tree node.
+ * Indexes a slot of the regions array of a process by the address range of
+ * the region in the slot. The tree is an interval tree ordered by the start
+ * address where each node also knows the greatest end address in its subtree.
+ */
+struct vm_regnode {
+    RB_ENTRY(vm_regnode) entry_;
+    uintptr_t start;    /*!< First address of the region. */
+    uintptr_t end;      /*!< Last address of the region. */
+    uintptr_t max_end;  /*!< Greatest end address in the subtree. */
+    int nr;             /*!< Region number. */
+};
+
+/* struct vm_regtree */
+RB_HEAD(vm_regtree, vm_regnode);
+
 /**
  * MM struct for processes.
  */
@@ -84,6 +102,10 @@ struct vm_mm_struct {
                                  *   [n] = allocs
                                  */
     int nr_regions;             /*!< Number of regions allocated. */
+    /** Interval tree of regions. */
+    struct vm_regtree regtree_head;
+    struct vm_regnode * regnodes; /*!< Region tree nodes, one per slot of
+                                   *   the regions array. */
     mtx_t regions_lock;
 };
 
@@ -150,6 +172,21 @@ RB_PROTOTYPE(ptlist, vm_pt, entry_, ptlist_compare);
  */
 #define VM_PT_CREAT 0x0002
 
+/**
+ * Compare vm_regtree nodes.
+ * Compares the start addresses of two regions, and the region numbers if
+ * the regions start from the same address.
+ * @param a is the left node.
+ * @param b is the right node.
+ * @return  If the first argument is smaller than the second, the function
+ *          returns a value smaller than zero;
+ *          If they are equal, the  function returns zero;
+ *          Otherwise, value greater than zero is returned.
+ */
+int vm_regtree_compare(struct vm_regnode * a, struct vm_regnode * b);
+
+RB_PROTOTYPE(vm_regtree, vm_regnode, entry_, vm_regtree_compare);
+
 /**
  * Get a page table for a given virtual address.
  * @param vaddr         is the virtual address that will be mapped into
@@ -288,6 +325,20 @@ int vm_find_reg(struct proc_info * proc, uintptr_t uaddr, struct buf ** bp);
  */
 struct buf * vm_newsect(uintptr_t vaddr, size_t size, int prot);
 
+/**
+ * Create a new demand paged section backed by a file.
+ * Works like vm_newsect() but the section is filled with filesz bytes read
+ * from the file starting at foff, one page at a time on page faults.
+ * @param vnode is the vnode of the file.
+ * @param foff is the file offset of the data.
+ * @param filesz is the number of bytes to be read from the file.
+ * @param vaddr is the addess of the data in the new section.
+ * @param size is the size of the new section.
+ * @param prot is a OR'd VM_PROT flags mask.
+ */
+struct buf * vm_newsect_file(struct vnode * vnode, off_t foff, size_t filesz,
+                             uintptr_t vaddr, size_t size, int prot);
+
 /**
  * Create a new section to a randomly selected address.
  * Returned section is inserted and mapped to the process if operation succeeds.
@@ -344,6 +395,40 @@ void vm_mm_destroy(struct vm_mm_struct * mm);
  */
 int realloc_mm_regions(struct vm_mm_struct * mm, int new_count);
 
+/**
+ * Set a region in the regions array of a mm.
+ * All changes to the regions array must be made with this function so that
+ * the region tree is kept in sync with the array. The address range of a
+ * region must not change while it's in the regions array.
+ * @note regions_lock must be held unless the mm is not yet visible to other
+ *       threads.
+ * @param mm is a pointer to the mm struct.
+ * @param region_nr is the region number, must be less than nr_regions.
+ * @param region is the new region; Can be NULL.
+ */
+void vm_mm_set_region(struct vm_mm_struct * mm, int region_nr,
+                      struct buf * region);
+
+/**
+ * Rebuild the region tree of a mm from the regions array.
+ * @note regions_lock must be held.
+ * @param mm is a pointer to the mm struct.
+ */
+void vm_regtree_rebuild(struct vm_mm_struct * mm);
+
+/**
+ * Find a region overlapping an address range.
+ * The lookup takes O(log n) time.
+ * @note regions_lock must be held.
+ * @param mm is a pointer to the mm struct.
+ * @param start is the first address of the range.
+ * @param end is the last address of the range.
+ * @return Returns the region number of a region overlapping the range;
+ *         Otherwise -1.
+ */
+int vm_regtree_find(struct vm_mm_struct * mm, uintptr_t start,
+                    uintptr_t end);
+
 /**
  * Insert a reference to a region, set its pt and map.
  * @param region is the region to be inserted, since the region pt attribute is
@@ -396,6 +481,31 @@ int vm_mapproc_region(struct proc_info * proc, struct buf * region);
  */
 int vm_unmapproc_region(struct proc_info * proc, struct buf * region);
 
+/**
+ * Resolve a copy-on-write or demand paging fault of a single page of a region.
+ * Copies the page containing vaddr if it's still shared with the region
+ * this region was lazily cloned from, or reads it in if the region is
+ * demand paged, and maps it to proc.
+ * @note Reading in a page may sleep.
+ * @param proc is a pointer to the process owning the region.
+ * @param region is the faulting region.
+ * @param vaddr is the faulting address.
+ * @return  Returns zero if a page was copied or read in;
+ *          -ENOENT if the page wasn't shared and it's already in memory;
+ *          Otherwise a negative errno is returned.
+ */
+int vm_pfault_region(struct proc_info * proc, struct buf * region,
+                     uintptr_t vaddr);
+
+/**
+ * Copy all the pages a region still shares with the region it was lazily
+ * cloned from and read in all the pages of a demand paged region.
+ * The caller should remap the region with vm_mapproc_region() afterwards.
+ * @param region is a vm region buffer.
+ * @return Zero if succeed; non-zero error code otherwise.
+ */
+int vm_populate_region(struct buf * region);
+
 /**
  * Unload regions from a proc mm.
  * @param end if end is -1 range will be from start to the last region.
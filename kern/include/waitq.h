@@ -0,0 +1,142 @@
+/**
+ *******************************************************************************
+ * @file    waitq.h
+ * @author  Olli Vanhoja
+ * @brief   Wait queues.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+/**
+ * @addtogroup waitq
+ * Wait queues.
+ * A wait queue is a list of threads sleeping on a condition. The condition
+ * itself is protected by a caller supplied mutex that is released atomically
+ * when the current thread is put to sleep, similar to a condition variable.
+ * Waking up is safe from interrupt handlers.
+ * @{
+ */
+
+#pragma once
+#ifndef WAITQ_H
+#define WAITQ_H
+
+#include <sys/queue.h>
+#include <sys/types/_pthread_t.h>
+#include <klocks.h>
+
+/**
+ * Wait queue entry.
+ * Allocated on the stack of the sleeping thread.
+ */
+struct waitq_entry {
+    pthread_t we_tid;       /*!< Sleeping thread. */
+    int we_woken;           /*!< Set when the thread was woken up. */
+    TAILQ_ENTRY(waitq_entry) we_link;
+};
+
+/**
+ * Wait queue.
+ */
+struct waitq {
+    mtx_t wq_lock;
+    TAILQ_HEAD(waitq_head, waitq_entry) wq_head;
+};
+
+/**
+ * Static initializer for a wait queue.
+ * @param _wq_ is the name of the wait queue variable.
+ */
+#define WAITQ_INITIALIZER(_wq_) {                                   \
+    .wq_lock = MTX_INITIALIZER(MTX_TYPE_SPIN, MTX_OPT_DINT),        \
+    .wq_head = TAILQ_HEAD_INITIALIZER((_wq_).wq_head),              \
+}
+
+/**
+ * Initialize a wait queue.
+ * @param wq is a pointer to the wait queue.
+ */
+void waitq_init(struct waitq * wq);
+
+/**
+ * Sleep on a wait queue.
+ * The caller must hold mtx, it's released while the thread is sleeping and
+ * reacquired before returning. The caller should always recheck the condition
+ * it's waiting for after this function returns.
+ * @param wq is a pointer to the wait queue.
+ * @param mtx is the mutex protecting the condition; Can be NULL.
+ * @param timeout is the maximum time to sleep in ms; 0 = no timeout.
+ * @return Returns 0 if the thread was woken up;
+ *         -ETIMEDOUT if the timeout expired.
+ */
+int waitq_sleep(struct waitq * wq, mtx_t * mtx, long timeout);
+
+/**
+ * Wake up the thread that has been waiting longest on a wait queue.
+ * @param wq is a pointer to the wait queue.
+ * @return Returns the number of threads woken up.
+ */
+int waitq_wakeup(struct waitq * wq);
+
+/**
+ * Wake up all threads sleeping on a wait queue.
+ * @param wq is a pointer to the wait queue.
+ * @return Returns the number of threads woken up.
+ */
+int waitq_wakeup_all(struct waitq * wq);
+
+/**
+ * Add the current thread to a wait queue without sleeping.
+ * This can be used to wait on multiple wait queues at once, the caller
+ * is responsible for blocking and must call waitq_remove() for every entry
+ * added.
+ * @param wq is a pointer to the wait queue.
+ * @param we is a pointer to an unused wait queue entry.
+ */
+void waitq_add(struct waitq * wq, struct waitq_entry * we);
+
+/**
+ * Remove an entry added with waitq_add().
+ * @param wq is a pointer to the wait queue.
+ * @param we is a pointer to the wait queue entry.
+ * @return Returns 1 if the entry was woken up; Otherwise 0.
+ */
+int waitq_remove(struct waitq * wq, struct waitq_entry * we);
+
+/**
+ * Test if there are threads sleeping on a wait queue.
+ * @param wq is a pointer to the wait queue.
+ */
+static inline int waitq_empty(struct waitq * wq)
+{
+    return TAILQ_EMPTY(&wq->wq_head);
+}
+
+#endif /* WAITQ_H */
+
+/**
+ * @}
+ */
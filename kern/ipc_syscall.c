@@ -31,7 +31,9 @@
  *******************************************************************************
  */
 
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/futex.h>
 #include <syscall.h>
 #include <errno.h>
 #include <proc.h>
@@ -59,10 +61,90 @@ static intptr_t sys_pipe(__user void * user_args)
     return 0;
 }
 
+static intptr_t sys_futex_wait(__user void * user_args)
+{
+    struct _ipc_futex_args args;
+    int err;
+
+    err = copyin(user_args, &args, sizeof(args));
+    if (err) {
+        set_errno(EFAULT);
+        return -1;
+    }
+
+    err = futex_wait((__user int *)args.uaddr, args.val, args.flags,
+                     args.timeout);
+    if (err) {
+        set_errno(-err);
+        return -1;
+    }
+
+    return 0;
+}
+
+static intptr_t sys_futex_wake(__user void * user_args)
+{
+    struct _ipc_futex_args args;
+    int retval;
+
+    retval = copyin(user_args, &args, sizeof(args));
+    if (retval) {
+        set_errno(EFAULT);
+        return -1;
+    }
+
+    retval = futex_wake((__user int *)args.uaddr, args.val, args.flags);
+    if (retval < 0) {
+        set_errno(-retval);
+        return -1;
+    }
+
+    return retval;
+}
+
+static intptr_t sys_splice(__user void * user_args)
+{
+    struct _ipc_splice_args args;
+    file_t * in;
+    file_t * out;
+    ssize_t retval;
+
+    if (copyin(user_args, &args, sizeof(args))) {
+        set_errno(EFAULT);
+        return -1;
+    }
+
+    in = fs_fildes_ref(curproc->files, args.fd_in, 1);
+    if (!in) {
+        set_errno(EBADF);
+        return -1;
+    }
+    out = fs_fildes_ref(curproc->files, args.fd_out, 1);
+    if (!out) {
+        fs_fildes_ref(curproc->files, args.fd_in, -1);
+        set_errno(EBADF);
+        return -1;
+    }
+
+    retval = fs_pipe_splice(in, out, args.len, args.flags);
+    if (retval < 0) {
+        set_errno(-retval);
+        retval = -1;
+    }
+
+    fs_fildes_ref(curproc->files, args.fd_out, -1);
+    fs_fildes_ref(curproc->files, args.fd_in, -1);
+
+    return retval;
+}
+
 /**
  * Declarations of ipc syscall functions.
  */
 static const syscall_handler_t ipc_sysfnmap[] = {
     ARRDECL_SYSCALL_HNDL(SYSCALL_IPC_PIPE, sys_pipe),
+    ARRDECL_SYSCALL_HNDL(SYSCALL_IPC_FUTEX_WAIT, sys_futex_wait),
+    ARRDECL_SYSCALL_HNDL(SYSCALL_IPC_FUTEX_WAKE, sys_futex_wake),
+    ARRDECL_SYSCALL_HNDL(SYSCALL_IPC_SPLICE, sys_splice),
 };
 SYSCALL_HANDLERDEF(ipc_syscall, ipc_sysfnmap)
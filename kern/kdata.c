@@ -0,0 +1,150 @@
+/**
+ *******************************************************************************
+ * @file    kdata.c
+ * @author  Olli Vanhoja
+ * @brief   Kernel data pages shared with the user space.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#include <errno.h>
+#include <sys/time.h>
+#include <buf.h>
+#include <hal/core.h>
+#include <kdata.h>
+#include <kerror.h>
+#include <kinit.h>
+#include <proc.h>
+#include <vm/vm.h>
+
+#if KDATA_PROC_ADDR + 0x1000 > configUENV_BASE_ADDR
+#error The kernel data pages overlap with the uenv page
+#endif
+
+static struct buf * kdata_bp;
+static struct kdata * kdata;
+
+int __kinit__ kdata_init(void)
+{
+    SUBSYS_DEP(proc_init);
+    SUBSYS_INIT("kdata");
+
+    kdata_bp = vm_newsect(KDATA_ADDR, MMU_PGSIZE_COARSE, VM_PROT_READ);
+    if (!kdata_bp)
+        return -ENOMEM;
+    kdata_bp->b_flags |= B_NOTSHARED | B_NOCORE;
+    kdata = (struct kdata *)kdata_bp->b_data;
+
+    return 0;
+}
+
+/**
+ * Insert a kernel data region to a process.
+ */
+static int insert_region(struct proc_info * proc, struct buf * bp)
+{
+    int err;
+
+    bp->vm_ops->rref(bp);
+    err = vm_insert_region(proc, bp, VM_INSOP_MAP_REG);
+    if (err < 0) {
+        bp->vm_ops->rfree(bp);
+        return err;
+    }
+
+    return 0;
+}
+
+int kdata_map(struct proc_info * proc)
+{
+    struct buf * bp = proc->kdata_bp;
+    int err;
+
+    if (!kdata_bp)
+        return -ENODEV;
+
+    if (!bp) {
+        bp = vm_newsect(KDATA_PROC_ADDR, MMU_PGSIZE_COARSE, VM_PROT_READ);
+        if (!bp)
+            return -ENOMEM;
+        bp->b_flags |= B_NOTSHARED | B_NOCORE;
+        proc->kdata_bp = bp;
+    }
+
+    ((struct kdata_proc *)bp->b_data)->kp_pid = proc->pid;
+    kdata_update_ppid(proc);
+
+    err = insert_region(proc, kdata_bp);
+    if (err)
+        return err;
+
+    return insert_region(proc, bp);
+}
+
+void kdata_free(struct proc_info * proc)
+{
+    struct buf * bp = proc->kdata_bp;
+
+    if (bp) {
+        proc->kdata_bp = NULL;
+        bp->vm_ops->rfree(bp);
+    }
+}
+
+void kdata_update_ppid(struct proc_info * proc)
+{
+    struct buf * bp = proc->kdata_bp;
+
+    if (bp) {
+        struct kdata_proc * kp = (struct kdata_proc *)bp->b_data;
+
+        kp->kp_ppid = (proc->inh.parent) ? proc->inh.parent->pid : 0;
+    }
+}
+
+void kdata_update_time(const struct timespec * uptime,
+                       const struct timespec * realtime)
+{
+    if (!kdata)
+        return;
+
+    kdata->kd_seq++;
+    cpu_wmb();
+    kdata->kd_uptime = *uptime;
+    kdata->kd_realtime = *realtime;
+    cpu_wmb();
+    kdata->kd_seq++;
+}
+
+void kdata_update_loads(const uint32_t loads[3])
+{
+    if (!kdata)
+        return;
+
+    for (size_t i = 0; i < 3; i++) {
+        kdata->kd_loads[i] = loads[i];
+    }
+}
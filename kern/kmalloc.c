@@ -33,7 +33,9 @@
 #include <machine/atomic.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/queue.h>
 #include <sys/sysctl.h>
+#include <bitmap.h>
 #include <dynmem.h>
 #include <hal/core.h>
 #include <hal/mmu.h>
@@ -51,6 +53,42 @@
 #define KM_SIGNATURE_VALID      0XBAADF00D /*!< a valid mblock entry. */
 #define KM_SIGNATURE_INVALID    0xDEADF00D /*!< an invalid mblock entry. */
 
+#if configKMALLOC_SLAB
+/*
+ * Slab size classes.
+ */
+#define KMSLAB_MIN_SHIFT        4
+#define KMSLAB_MAX_SHIFT        11
+#define KMSLAB_MIN_SIZE         (1 << KMSLAB_MIN_SHIFT)
+#define KMSLAB_MAX_SIZE         (1 << KMSLAB_MAX_SHIFT)
+#define KMSLAB_NR_CLASSES       (KMSLAB_MAX_SHIFT - KMSLAB_MIN_SHIFT + 1)
+
+/**
+ * Apply a macro to every slab size class.
+ * The arguments passed to apply are the class index and the object size.
+ */
+#define KMSLAB_FOREACH_CLASS(apply) \
+    apply(0, 16)                    \
+    apply(1, 32)                    \
+    apply(2, 64)                    \
+    apply(3, 128)                   \
+    apply(4, 256)                   \
+    apply(5, 512)                   \
+    apply(6, 1024)                  \
+    apply(7, 2048)
+
+/**
+ * Per slab class statistics.
+ */
+struct kmalloc_slab_stat {
+    size_t kmss_inuse;      /*!< Number of objects currently allocated. */
+    size_t kmss_inuse_max;  /*!< Maximum number of objects allocated. */
+    size_t kmss_slabs;      /*!< Number of slabs currently reserved. */
+    size_t kmss_slabs_max;  /*!< Maximum number of slabs reserved. */
+    unsigned kmss_fragm;    /*!< Percentage of free objects in the slabs. */
+};
+#endif
+
 /**
  * kmalloc statistics strcut.
  */
@@ -59,11 +97,12 @@ struct kmalloc_stat {
     size_t kms_mem_max;     /*!< Maximum amount of reserved memory. */
     size_t kms_mem_alloc;   /*!< Amount of currectly allocated memory. */
     size_t kms_mem_alloc_max; /*!< Maximum amount of allocated memory. */
+#if configKMALLOC_SLAB
+    struct kmalloc_slab_stat kms_slab[KMSLAB_NR_CLASSES];
+#endif
 };
 struct kmalloc_stat kmalloc_stat;
-#if 0
 int fragm_ratio;
-#endif
 
 SYSCTL_DECL(_vm_kmalloc);
 SYSCTL_NODE(_vm, OID_AUTO, kmalloc, CTLFLAG_RW, 0,
@@ -77,13 +116,32 @@ SYSCTL_UINT(_vm_kmalloc, OID_AUTO, max, CTLFLAG_RD,
         "Maximum peak amount of memory reserved for kmalloc.");
 SYSCTL_UINT(_vm_kmalloc, OID_AUTO, alloc, CTLFLAG_RD,
         ((unsigned int *)&(kmalloc_stat.kms_mem_alloc)), 0,
-        "Amount of memory currectly allocated with kmalloc.");
+        "Amount of memory currectly allocated from the kmalloc block list.");
 SYSCTL_UINT(_vm_kmalloc, OID_AUTO, alloc_max, CTLFLAG_RD,
         ((unsigned int *)&(kmalloc_stat.kms_mem_alloc_max)), 0,
-        "Maximum peak amount of memory allocated with kmalloc");
-#if 0
+        "Maximum peak amount of memory allocated from the kmalloc block list");
 SYSCTL_INT(_vm_kmalloc, OID_AUTO, fragm_rat, CTLFLAG_RD,
         &fragm_ratio, 0, "Fragmentation percentage");
+
+#if configKMALLOC_SLAB
+#define KMSLAB_CLASS_SYSCTL(idx, sz)                                        \
+    SYSCTL_DECL(_vm_kmalloc_slab##sz);                                      \
+    SYSCTL_NODE(_vm_kmalloc, OID_AUTO, slab##sz, CTLFLAG_RW, 0,             \
+            "kmalloc " #sz " byte slab class stats");                       \
+    SYSCTL_UINT(_vm_kmalloc_slab##sz, OID_AUTO, inuse, CTLFLAG_RD,          \
+            ((unsigned int *)&(kmalloc_stat.kms_slab[idx].kmss_inuse)), 0,  \
+            "Number of objects currently allocated.");                      \
+    SYSCTL_UINT(_vm_kmalloc_slab##sz, OID_AUTO, inuse_max, CTLFLAG_RD,      \
+            ((unsigned int *)&(kmalloc_stat.kms_slab[idx].kmss_inuse_max)), \
+            0, "Maximum peak number of objects allocated.");                \
+    SYSCTL_UINT(_vm_kmalloc_slab##sz, OID_AUTO, slabs, CTLFLAG_RD,          \
+            ((unsigned int *)&(kmalloc_stat.kms_slab[idx].kmss_slabs)), 0,  \
+            "Number of slabs currently reserved.");                         \
+    SYSCTL_UINT(_vm_kmalloc_slab##sz, OID_AUTO, fragm_rat, CTLFLAG_RD,      \
+            &(kmalloc_stat.kms_slab[idx].kmss_fragm), 0,                    \
+            "Percentage of free objects in reserved slabs.");
+
+KMSLAB_FOREACH_CLASS(KMSLAB_CLASS_SYSCTL)
 #endif
 
 /**
@@ -307,12 +365,371 @@ static int valid_addr(void * p)
             get_mblock(p)->signature == KM_SIGNATURE_VALID);
 }
 
+#if configKMALLOC_SLAB
+/*
+ * Slab front-end.
+ *
+ * Small allocations are served from power-of-two size class slabs. Slabs are
+ * carved from 1 MB dynmem arenas that are split into 4 kB pages. Each arena
+ * starts with a header containing a descriptor for every page in the arena,
+ * so objects don't need a header of their own and an object can be mapped
+ * back to its slab by just masking the object address.
+ */
+
+#define KMSLAB_ARENA_SIZE       DYNMEM_PAGE_SIZE
+#define KMSLAB_PAGE_SIZE        MMU_PGSIZE_COARSE
+#define KMSLAB_ARENA_NPAGES     (KMSLAB_ARENA_SIZE / KMSLAB_PAGE_SIZE)
+
+/**
+ * Slab descriptor.
+ * There is one descriptor for each page in an arena but only the descriptor
+ * of the first page of a slab is used to describe the slab. All the pages
+ * of a slab point to the descriptor of the first page with sl_head.
+ */
+struct kmslab {
+    LIST_ENTRY(kmslab) sl_link;     /*!< Partial/full list link. */
+    struct kmslab * sl_head;        /*!< The first page of the slab. */
+    struct kmslab_class * sl_class; /*!< Size class of the slab. */
+    uint8_t * sl_base;              /*!< Address of the first object. */
+    void * sl_freelist;             /*!< Free objects. */
+    unsigned sl_nfree;              /*!< Number of free objects. */
+};
+
+/**
+ * Slab arena header.
+ */
+struct kmslab_arena {
+    LIST_ENTRY(kmslab_arena) ka_link;
+    size_t ka_nfree;                /*!< Number of free pages. */
+    bitmap_t ka_map[E2BITMAP_SIZE(KMSLAB_ARENA_NPAGES)];
+    struct kmslab ka_pages[KMSLAB_ARENA_NPAGES];
+};
+
+/**
+ * Number of pages reserved for the arena header.
+ */
+#define KMSLAB_ARENA_HDR_NPAGES \
+    ((sizeof(struct kmslab_arena) + KMSLAB_PAGE_SIZE - 1) / KMSLAB_PAGE_SIZE)
+
+/**
+ * Slab size class.
+ */
+struct kmslab_class {
+    mtx_t kc_lock;
+    size_t kc_size;                 /*!< Object size. */
+    unsigned kc_shift;              /*!< log2(kc_size). */
+    unsigned kc_npages;             /*!< Size of a slab in pages. */
+    unsigned kc_nobjs;              /*!< Number of objects per slab. */
+    LIST_HEAD(, kmslab) kc_partial; /*!< Slabs with free objects. */
+    LIST_HEAD(, kmslab) kc_full;    /*!< Slabs without free objects. */
+    struct kmslab * kc_empty;       /*!< A cached empty slab. */
+    struct kmalloc_slab_stat * kc_stat;
+};
+
+/*
+ * The slab of a size class must hold at least eight objects. An object
+ * reference counter is stored in an array following the objects in a slab,
+ * so the counters are accounted for when rounding the slab up to pages.
+ */
+#define KMSLAB_MIN_OBJS 8
+#define KMSLAB_CLASS_NPAGES(sz) \
+    ((KMSLAB_MIN_OBJS * ((sz) + sizeof(atomic_t)) + KMSLAB_PAGE_SIZE - 1) / \
+     KMSLAB_PAGE_SIZE)
+#define KMSLAB_CLASS_INIT(idx, sz)                                          \
+    [idx] = {                                                               \
+        .kc_lock = MTX_INITIALIZER(MTX_TYPE_TICKET, 0),                     \
+        .kc_size = sz,                                                      \
+        .kc_shift = KMSLAB_MIN_SHIFT + idx,                                 \
+        .kc_npages = KMSLAB_CLASS_NPAGES(sz),                               \
+        .kc_nobjs = (KMSLAB_CLASS_NPAGES(sz) * KMSLAB_PAGE_SIZE) /          \
+                    ((sz) + sizeof(atomic_t)),                              \
+        .kc_partial = LIST_HEAD_INITIALIZER(kc_partial),                    \
+        .kc_full = LIST_HEAD_INITIALIZER(kc_full),                          \
+        .kc_stat = &kmalloc_stat.kms_slab[idx],                             \
+    },
+
+static struct kmslab_class kmslab_classes[KMSLAB_NR_CLASSES] = {
+    KMSLAB_FOREACH_CLASS(KMSLAB_CLASS_INIT)
+};
+
+#define KMSLAB_CLASS_CHECK(idx, sz)                                         \
+    CTASSERT((KMSLAB_CLASS_NPAGES(sz) * KMSLAB_PAGE_SIZE) /                 \
+             ((sz) + sizeof(atomic_t)) >= KMSLAB_MIN_OBJS);
+KMSLAB_FOREACH_CLASS(KMSLAB_CLASS_CHECK)
+
+static mtx_t kmslab_arena_lock = MTX_INITIALIZER(MTX_TYPE_TICKET, 0);
+static LIST_HEAD(, kmslab_arena) kmslab_arenas =
+    LIST_HEAD_INITIALIZER(kmslab_arenas);
+
+/**
+ * A map of all 1 MB sections of the address space used as slab arenas.
+ */
+static bitmap_t kmslab_arena_map[E2BITMAP_SIZE(4096)];
+
+static struct kmslab_class * kmslab_size2class(size_t size)
+{
+    int i = (size <= KMSLAB_MIN_SIZE) ? 0 : fls(size - 1) - KMSLAB_MIN_SHIFT;
+
+    return &kmslab_classes[i];
+}
+
+static atomic_t * kmslab_refcnt(struct kmslab * slab, void * p)
+{
+    const struct kmslab_class * cls = slab->sl_class;
+    atomic_t * refcnt;
+
+    refcnt = (atomic_t *)(slab->sl_base + cls->kc_nobjs * cls->kc_size);
+
+    return &refcnt[((uint8_t *)p - slab->sl_base) >> cls->kc_shift];
+}
+
+/**
+ * Get the slab of an object.
+ * @param p is a pointer to a memory block.
+ * @return  Returns a pointer to the slab descriptor if p is a valid slab
+ *          object; Otherwise NULL.
+ */
+static struct kmslab * kmslab_get(void * p)
+{
+    const uintptr_t addr = (uintptr_t)p;
+    struct kmslab_arena * arena;
+    struct kmslab * slab;
+    size_t off;
+
+    if (bitmap_status(kmslab_arena_map, addr / KMSLAB_ARENA_SIZE,
+                      sizeof(kmslab_arena_map)) <= 0)
+        return NULL;
+
+    arena = (struct kmslab_arena *)(addr & ~(KMSLAB_ARENA_SIZE - 1));
+    slab = arena->ka_pages[(addr - (uintptr_t)arena) / KMSLAB_PAGE_SIZE].sl_head;
+    if (!slab || !slab->sl_class)
+        return NULL;
+
+    off = (uint8_t *)p - slab->sl_base;
+    if ((off & (slab->sl_class->kc_size - 1)) ||
+        (off >> slab->sl_class->kc_shift) >= slab->sl_class->kc_nobjs)
+        return NULL;
+
+    return slab;
+}
+
+static struct kmslab_arena * kmslab_arena_new(void)
+{
+    struct kmslab_arena * arena;
+
+    arena = dynmem_alloc_region(KMSLAB_ARENA_SIZE / DYNMEM_PAGE_SIZE,
+                                MMU_AP_RWNA, MMU_CTRL_MEMTYPE_WB);
+    if (!arena) {
+        KERROR(KERROR_WARN, "dynmem returned null.\n");
+        return NULL;
+    }
+
+    memset(arena, 0, sizeof(struct kmslab_arena));
+    arena->ka_nfree = KMSLAB_ARENA_NPAGES - KMSLAB_ARENA_HDR_NPAGES;
+    bitmap_block_update(arena->ka_map, 1, 0, KMSLAB_ARENA_HDR_NPAGES,
+                        sizeof(arena->ka_map));
+    bitmap_set(kmslab_arena_map, (uintptr_t)arena / KMSLAB_ARENA_SIZE,
+               sizeof(kmslab_arena_map));
+    LIST_INSERT_HEAD(&kmslab_arenas, arena, ka_link);
+
+    mtx_lock(&kmalloc_giant_lock);
+    update_stat_up(&(kmalloc_stat.kms_mem_res), KMSLAB_ARENA_SIZE);
+    mtx_unlock(&kmalloc_giant_lock);
+
+    return arena;
+}
+
+/**
+ * Allocate pages for a new slab.
+ * @param npages is the number of contiguous pages needed.
+ * @return Returns the descriptor of the first page; NULL if out of memory.
+ */
+static struct kmslab * kmslab_pages_alloc(unsigned npages)
+{
+    struct kmslab_arena * arena;
+    struct kmslab * slab = NULL;
+    size_t start;
+
+    mtx_lock(&kmslab_arena_lock);
+    LIST_FOREACH(arena, &kmslab_arenas, ka_link) {
+        if (arena->ka_nfree >= npages &&
+            bitmap_block_alloc(&start, npages, arena->ka_map,
+                               sizeof(arena->ka_map)) == 0)
+            goto found;
+    }
+
+    arena = kmslab_arena_new();
+    if (!arena ||
+        bitmap_block_alloc(&start, npages, arena->ka_map,
+                           sizeof(arena->ka_map)))
+        goto out;
+
+found:
+    arena->ka_nfree -= npages;
+    slab = &arena->ka_pages[start];
+    for (size_t i = start; i < start + npages; i++) {
+        arena->ka_pages[i].sl_head = slab;
+    }
+    slab->sl_base = (uint8_t *)arena + start * KMSLAB_PAGE_SIZE;
+out:
+    mtx_unlock(&kmslab_arena_lock);
+    return slab;
+}
+
+/**
+ * Return the pages of a slab back to its arena.
+ * The arena is released back to dynmem when all its pages are free, unless
+ * it's the only arena left.
+ */
+static void kmslab_pages_free(struct kmslab * slab, unsigned npages)
+{
+    struct kmslab_arena * arena;
+    size_t start;
+
+    arena = (struct kmslab_arena *)((uintptr_t)slab->sl_base &
+                                    ~(KMSLAB_ARENA_SIZE - 1));
+    start = slab - arena->ka_pages;
+
+    mtx_lock(&kmslab_arena_lock);
+    memset(slab, 0, npages * sizeof(struct kmslab));
+    bitmap_block_update(arena->ka_map, 0, start, npages,
+                        sizeof(arena->ka_map));
+    arena->ka_nfree += npages;
+
+    if (arena->ka_nfree == KMSLAB_ARENA_NPAGES - KMSLAB_ARENA_HDR_NPAGES &&
+        (LIST_FIRST(&kmslab_arenas) != arena || LIST_NEXT(arena, ka_link))) {
+        LIST_REMOVE(arena, ka_link);
+        bitmap_clear(kmslab_arena_map, (uintptr_t)arena / KMSLAB_ARENA_SIZE,
+                     sizeof(kmslab_arena_map));
+        mtx_unlock(&kmslab_arena_lock);
+
+        mtx_lock(&kmalloc_giant_lock);
+        update_stat_down(&(kmalloc_stat.kms_mem_res), KMSLAB_ARENA_SIZE);
+        mtx_unlock(&kmalloc_giant_lock);
+
+        dynmem_free_region(arena);
+        return;
+    }
+    mtx_unlock(&kmslab_arena_lock);
+}
+
+/**
+ * Get an empty slab for a size class.
+ * The caller must hold cls->kc_lock.
+ */
+static struct kmslab * kmslab_new(struct kmslab_class * cls)
+{
+    struct kmslab * slab;
+    uint8_t * obj;
+
+    if (cls->kc_empty) {
+        slab = cls->kc_empty;
+        cls->kc_empty = NULL;
+        return slab;
+    }
+
+    slab = kmslab_pages_alloc(cls->kc_npages);
+    if (!slab)
+        return NULL;
+
+    slab->sl_class = cls;
+    slab->sl_nfree = cls->kc_nobjs;
+    slab->sl_freelist = NULL;
+    obj = slab->sl_base + cls->kc_nobjs * cls->kc_size;
+    memset(obj, 0, cls->kc_nobjs * sizeof(atomic_t));
+    while (obj != slab->sl_base) {
+        obj -= cls->kc_size;
+        *(void **)obj = slab->sl_freelist;
+        slab->sl_freelist = obj;
+    }
+
+    update_stat_up(&cls->kc_stat->kmss_slabs, 1);
+
+    return slab;
+}
+
+static void * kmslab_alloc(size_t size)
+{
+    struct kmslab_class * cls = kmslab_size2class(size);
+    struct kmslab * slab;
+    void * p;
+
+    mtx_lock(&cls->kc_lock);
+    slab = LIST_FIRST(&cls->kc_partial);
+    if (!slab) {
+        slab = kmslab_new(cls);
+        if (!slab) {
+            mtx_unlock(&cls->kc_lock);
+            return NULL;
+        }
+        LIST_INSERT_HEAD(&cls->kc_partial, slab, sl_link);
+    }
+
+    p = slab->sl_freelist;
+    slab->sl_freelist = *(void **)p;
+    if (--slab->sl_nfree == 0) {
+        LIST_REMOVE(slab, sl_link);
+        LIST_INSERT_HEAD(&cls->kc_full, slab, sl_link);
+    }
+    atomic_set(kmslab_refcnt(slab, p), 1);
+    update_stat_up(&cls->kc_stat->kmss_inuse, 1);
+    mtx_unlock(&cls->kc_lock);
+
+    return p;
+}
+
+static void kmslab_free(struct kmslab * slab, void * p)
+{
+    struct kmslab_class * cls = slab->sl_class;
+    atomic_t * refcnt = kmslab_refcnt(slab, p);
+    struct kmslab * release = NULL;
+
+    if (atomic_read(refcnt) <= 0) /* Already freed. */
+        return;
+    if (atomic_dec(refcnt) > 1)
+        return;
+
+    mtx_lock(&cls->kc_lock);
+    *(void **)p = slab->sl_freelist;
+    slab->sl_freelist = p;
+    if (slab->sl_nfree++ == 0) {
+        LIST_REMOVE(slab, sl_link);
+        LIST_INSERT_HEAD(&cls->kc_partial, slab, sl_link);
+    }
+    update_stat_down(&cls->kc_stat->kmss_inuse, 1);
+
+    if (slab->sl_nfree == cls->kc_nobjs) {
+        LIST_REMOVE(slab, sl_link);
+        if (!cls->kc_empty) {
+            cls->kc_empty = slab;
+        } else {
+            release = slab;
+            update_stat_down(&cls->kc_stat->kmss_slabs, 1);
+        }
+    }
+    mtx_unlock(&cls->kc_lock);
+
+    if (release)
+        kmslab_pages_free(release, cls->kc_npages);
+}
+#endif
+
 void * kmalloc(size_t size)
 {
     mblock_t * b;
     mblock_t * last;
     size_t s = memalign(size);
 
+#if configKMALLOC_SLAB
+    if (s <= KMSLAB_MAX_SIZE) {
+        void * p = kmslab_alloc(s);
+
+        if (p)
+            return p;
+        /* Fallback to the list allocator. */
+    }
+#endif
+
     mtx_lock(&kmalloc_giant_lock);
     if (kmalloc_base) {
         /* Find a mblock. */
@@ -390,6 +807,15 @@ void kfree(void * p)
 {
     mblock_t * b;
 
+#if configKMALLOC_SLAB
+    struct kmslab * slab = kmslab_get(p);
+
+    if (slab) {
+        kmslab_free(slab, p);
+        return;
+    }
+#endif
+
     if (!valid_addr(p))
         return;
 
@@ -453,9 +879,17 @@ void kfree_lazy(void * p)
     disable_interrupt();
 
     if (!queue_push(&lazy_free_queue, &p)) {
-        mblock_t * b = get_mblock(p);
+        size_t size;
+
+#if configKMALLOC_SLAB
+        struct kmslab * slab = kmslab_get(p);
+
+        size = (slab) ? slab->sl_class->kc_size : get_mblock(p)->size;
+#else
+        size = get_mblock(p)->size;
+#endif
         KERROR(KERROR_WARN, "kfree lazy queue full, leaked %u bytes\n",
-               (uint32_t)b->size);
+               (uint32_t)size);
     }
 
     set_interrupt_state(istate);
@@ -493,6 +927,32 @@ void * krealloc(void * p, size_t size)
         goto out;
     }
 
+#if configKMALLOC_SLAB
+    {
+        struct kmslab * slab = kmslab_get(p);
+
+        if (slab) {
+            const size_t old_size = slab->sl_class->kc_size;
+
+            if (memalign(size) <= old_size) {
+                /* Fits in the same object. */
+                retval = p;
+                goto out;
+            }
+
+            np = kmalloc(size);
+            if (!np) {
+                retval = NULL;
+                goto out;
+            }
+            memcpy(np, p, old_size);
+            kfree(p);
+            retval = np;
+            goto out;
+        }
+    }
+#endif
+
     if (!valid_addr(p))
         return NULL;
 
@@ -556,12 +1016,35 @@ out:
 
 void * kpalloc(void * p)
 {
+#if configKMALLOC_SLAB
+    struct kmslab * slab = kmslab_get(p);
+
+    if (slab) {
+        atomic_inc(kmslab_refcnt(slab, p));
+        return p;
+    }
+#endif
+
     if (valid_addr(p)) {
         atomic_inc(&(get_mblock(p)->refcount));
     }
     return p;
 }
 
+int krefcnt(void * p)
+{
+#if configKMALLOC_SLAB
+    struct kmslab * slab = kmslab_get(p);
+
+    if (slab)
+        return atomic_read(kmslab_refcnt(slab, p));
+#endif
+
+    if (valid_addr(p))
+        return atomic_read(&(get_mblock(p)->refcount));
+    return 0;
+}
+
 /**
  * Updates stat actual value by adding amount to it.
  * This function will also update related max value.
@@ -604,22 +1087,40 @@ static void update_stat_set(size_t * stat_act, size_t value)
 }
 #endif
 
-/*
- * There is currently no way of making this safe and efficiently.
- */
-#if 0
 /**
  * kmalloc fragmentation percentage stats.
+ * The stats are only updated if the lock protecting the stats can be
+ * acquired without waiting.
  */
 static void stat_fragmentation(uintptr_t arg)
 {
-    mblock_t * b = kmalloc_base;
+    mblock_t * b;
     int blocks_free = 0;
     int blocks_total = 0;
 
-    if (!b)
+#if configKMALLOC_SLAB
+    for (size_t i = 0; i < KMSLAB_NR_CLASSES; i++) {
+        struct kmslab_class * cls = &kmslab_classes[i];
+        struct kmalloc_slab_stat * stat = cls->kc_stat;
+        size_t nobjs;
+
+        if (mtx_trylock(&cls->kc_lock))
+            continue;
+
+        nobjs = stat->kmss_slabs * cls->kc_nobjs;
+        stat->kmss_fragm = (nobjs) ?
+            ((nobjs - stat->kmss_inuse) * 100) / nobjs : 0;
+        mtx_unlock(&cls->kc_lock);
+    }
+#endif
+
+    if (mtx_trylock(&kmalloc_giant_lock))
         return;
 
+    b = kmalloc_base;
+    if (!b)
+        goto out;
+
     do {
         if (atomic_read(&b->refcount) == 0) {
             blocks_free++;
@@ -628,6 +1129,7 @@ static void stat_fragmentation(uintptr_t arg)
     } while ((b = b->next));
 
     fragm_ratio = (blocks_free * 100) / blocks_total;
+out:
+    mtx_unlock(&kmalloc_giant_lock);
 }
 IDLE_TASK(stat_fragmentation, 0);
-#endif
@@ -0,0 +1,188 @@
+/**
+ *******************************************************************************
+ * @file    kmem_cache.c
+ * @author  Olli Vanhoja
+ * @brief   Object caches.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#include <errno.h>
+#include <kerror.h>
+#include <kmalloc.h>
+#include <kmem_cache.h>
+#include <kstring.h>
+
+struct kmem_cache * kmem_cache_create(const char * name, size_t size,
+                                      size_t max_free,
+                                      kmem_cache_cdtor_t * ctor,
+                                      kmem_cache_cdtor_t * dtor)
+{
+    struct kmem_cache * cache;
+
+    cache = kzalloc(sizeof(struct kmem_cache) + max_free * sizeof(void *));
+    if (!cache)
+        return NULL;
+
+    cache->kc_name = name;
+    cache->kc_size = size;
+    cache->kc_ctor = ctor;
+    cache->kc_dtor = dtor;
+    mtx_init(&cache->kc_lock, MTX_TYPE_TICKET, 0);
+    cache->kc_max_free = max_free;
+    cache->kc_free = (void **)(cache + 1);
+
+    return cache;
+}
+
+void kmem_cache_destroy(struct kmem_cache * cache)
+{
+    if (!cache)
+        return;
+
+    kmem_cache_reclaim(cache);
+    kfree(cache);
+}
+
+/**
+ * Allocate and construct a new object for a cache.
+ */
+static void * kmem_cache_new(struct kmem_cache * cache)
+{
+    void * obj;
+
+    obj = kmalloc(cache->kc_size);
+    if (obj && cache->kc_ctor)
+        cache->kc_ctor(obj);
+
+    return obj;
+}
+
+/**
+ * Destruct and free an object released from a cache.
+ */
+static void kmem_cache_release(struct kmem_cache * cache, void * obj)
+{
+    if (!obj)
+        return;
+
+    if (cache->kc_dtor)
+        cache->kc_dtor(obj);
+    kfree(obj);
+}
+
+int kmem_cache_prealloc(struct kmem_cache * cache, size_t count)
+{
+    while (count-- > 0) {
+        void * obj;
+
+        obj = kmem_cache_new(cache);
+        if (!obj)
+            return -ENOMEM;
+
+        mtx_lock(&cache->kc_lock);
+        if (cache->kc_nfree < cache->kc_max_free) {
+            cache->kc_free[cache->kc_nfree++] = obj;
+            obj = NULL;
+        }
+        mtx_unlock(&cache->kc_lock);
+
+        if (obj) {
+            kmem_cache_release(cache, obj);
+            break;
+        }
+    }
+
+    return 0;
+}
+
+void * kmem_cache_alloc(struct kmem_cache * cache)
+{
+    void * obj = NULL;
+
+    mtx_lock(&cache->kc_lock);
+    if (cache->kc_nfree > 0)
+        obj = cache->kc_free[--cache->kc_nfree];
+    mtx_unlock(&cache->kc_lock);
+
+    if (obj)
+        return obj;
+
+    return kmem_cache_new(cache);
+}
+
+void * kmem_cache_zalloc(struct kmem_cache * cache)
+{
+    void * obj;
+
+    KASSERT(!cache->kc_ctor, "zalloc would clear the constructed state");
+
+    obj = kmem_cache_alloc(cache);
+    if (obj)
+        memset(obj, 0, cache->kc_size);
+
+    return obj;
+}
+
+void kmem_cache_free(struct kmem_cache * cache, void * obj)
+{
+    if (!obj)
+        return;
+
+    /*
+     * Someone still holds a reference to the object and the last kfree()
+     * will free it.
+     */
+    if (krefcnt(obj) > 1) {
+        kfree(obj);
+        return;
+    }
+
+    mtx_lock(&cache->kc_lock);
+    if (cache->kc_nfree < cache->kc_max_free) {
+        cache->kc_free[cache->kc_nfree++] = obj;
+        obj = NULL;
+    }
+    mtx_unlock(&cache->kc_lock);
+
+    kmem_cache_release(cache, obj);
+}
+
+void kmem_cache_reclaim(struct kmem_cache * cache)
+{
+    void * obj;
+
+    do {
+        obj = NULL;
+
+        mtx_lock(&cache->kc_lock);
+        if (cache->kc_nfree > 0)
+            obj = cache->kc_free[--cache->kc_nfree];
+        mtx_unlock(&cache->kc_lock);
+
+        kmem_cache_release(cache, obj);
+    } while (obj);
+}
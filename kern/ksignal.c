@@ -241,6 +241,7 @@ void ksignal_signals_ctor(struct signals * sigs, enum signals_owner owner_type)
     sigemptyset(&sigs->s_block);
     sigemptyset(&sigs->s_wait);
     sigemptyset(&sigs->s_running);
+    sigs->s_flags = 0;
     mtx_init(&sigs->s_lock.l, KSIG_LOCK_TYPE, KSIG_LOCK_FLAGS);
     kobj_init(&sigs->s_obj, ksignal_free);
     sigs->s_owner_type = owner_type;
@@ -0,0 +1,218 @@
+/**
+ *******************************************************************************
+ * @file    buddy.c
+ * @author  Olli Vanhoja
+ * @brief   Binary buddy allocator.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#include <errno.h>
+#include <buddy.h>
+#include <kerror.h>
+#include <libkern.h>
+
+#define ORDER_SIZE(order) ((size_t)1 << (order))
+
+static void list_add(struct buddy * b, size_t i, unsigned order)
+{
+    struct buddy_blk * blk = b->blk + i;
+
+    blk->order = order;
+    blk->free = 1;
+    blk->prev = BUDDY_NIL;
+    blk->next = b->free_head[order];
+    if (blk->next != BUDDY_NIL)
+        b->blk[blk->next].prev = i;
+    b->free_head[order] = i;
+}
+
+static void list_del(struct buddy * b, size_t i)
+{
+    struct buddy_blk * blk = b->blk + i;
+
+    if (blk->prev != BUDDY_NIL)
+        b->blk[blk->prev].next = blk->next;
+    else
+        b->free_head[blk->order] = blk->next;
+    if (blk->next != BUDDY_NIL)
+        b->blk[blk->next].prev = blk->prev;
+    blk->free = 0;
+}
+
+/**
+ * Get the first block of the free buddy block containing the block i.
+ * @return Returns the index of the first block; Otherwise BUDDY_NIL.
+ */
+static size_t find_free(const struct buddy * b, size_t i)
+{
+    for (unsigned order = 0; order <= BUDDY_ORDER_MAX; order++) {
+        const size_t s = i & ~(ORDER_SIZE(order) - 1);
+        const struct buddy_blk * blk = b->blk + s;
+
+        if (blk->free && blk->order >= order)
+            return s;
+    }
+
+    return BUDDY_NIL;
+}
+
+/**
+ * Insert a single free buddy block and coalesce it with its buddies.
+ */
+static void insert_free(struct buddy * b, size_t i, unsigned order)
+{
+    while (order < BUDDY_ORDER_MAX) {
+        const size_t buddy = i ^ ORDER_SIZE(order);
+        const struct buddy_blk * blk = b->blk + buddy;
+
+        if (buddy + ORDER_SIZE(order) > b->nblocks ||
+            !blk->free || blk->order != order)
+            break;
+
+        list_del(b, buddy);
+        i = min(i, buddy);
+        order++;
+    }
+
+    list_add(b, i, order);
+}
+
+/**
+ * Split a range into aligned buddy blocks and insert them to the free lists.
+ */
+static void free_range(struct buddy * b, size_t index, size_t count)
+{
+    while (count > 0) {
+        unsigned order = fls(count) - 1;
+
+        if (index != 0)
+            order = min(order, (unsigned)(ffs(index) - 1));
+        order = min(order, BUDDY_ORDER_MAX);
+
+        insert_free(b, index, order);
+        index += ORDER_SIZE(order);
+        count -= ORDER_SIZE(order);
+    }
+}
+
+void buddy_init(struct buddy * b, struct buddy_blk * blk, size_t nblocks)
+{
+    KASSERT(nblocks < BUDDY_NIL, "Too many blocks");
+
+    b->nblocks = nblocks;
+    b->nfree = 0;
+    for (size_t i = 0; i < num_elem(b->free_head); i++) {
+        b->free_head[i] = BUDDY_NIL;
+    }
+    b->blk = blk;
+    memset(blk, 0, nblocks * sizeof(struct buddy_blk));
+}
+
+int buddy_alloc(struct buddy * b, size_t count, size_t * index)
+{
+    unsigned order;
+    unsigned j;
+    size_t i;
+
+    if (count == 0)
+        return -EINVAL;
+    if (count > b->nfree)
+        return -ENOMEM;
+
+    order = (count > 1) ? fls(count - 1) : 0;
+    if (order > BUDDY_ORDER_MAX)
+        return -ENOMEM;
+
+    for (j = order; j <= BUDDY_ORDER_MAX; j++) {
+        if (b->free_head[j] != BUDDY_NIL)
+            break;
+    }
+    if (j > BUDDY_ORDER_MAX)
+        return -ENOMEM;
+
+    i = b->free_head[j];
+    list_del(b, i);
+
+    /* Split until the block is of the right order. */
+    while (j > order) {
+        j--;
+        list_add(b, i + ORDER_SIZE(j), j);
+    }
+
+    /* Give back the unused tail. */
+    if (ORDER_SIZE(order) > count)
+        free_range(b, i + count, ORDER_SIZE(order) - count);
+
+    b->nfree -= count;
+    *index = i;
+
+    return 0;
+}
+
+int buddy_reserve(struct buddy * b, size_t index, size_t count)
+{
+    const size_t end = index + count;
+    size_t i;
+
+    if (count == 0 || end > b->nblocks)
+        return -EINVAL;
+
+    for (i = index; i < end; i++) {
+        if (find_free(b, i) == BUDDY_NIL)
+            return -EBUSY;
+    }
+
+    i = index;
+    while (i < end) {
+        const size_t s = find_free(b, i);
+        const size_t s_end = s + ORDER_SIZE(b->blk[s].order);
+
+        list_del(b, s);
+        if (s < index)
+            free_range(b, s, index - s);
+        if (s_end > end)
+            free_range(b, end, s_end - end);
+        i = s_end;
+    }
+
+    b->nfree -= count;
+
+    return 0;
+}
+
+void buddy_free(struct buddy * b, size_t index, size_t count)
+{
+    KASSERT(index + count <= b->nblocks, "Free out of range");
+
+    free_range(b, index, count);
+    b->nfree += count;
+}
+
+int buddy_is_free(const struct buddy * b, size_t index)
+{
+    return index < b->nblocks && find_free(b, index) != BUDDY_NIL;
+}
@@ -87,6 +87,30 @@ void queue_alloc_commit(queue_cb_t * cb)
     cb->m_write = next_element;
 }
 
+void * queue_alloc_get_n(queue_cb_t * cb, size_t * count)
+{
+    const size_t write = cb->m_write;
+    const size_t read = cb->m_read;
+    size_t n;
+
+    /* One element is always left unused to tell a full queue from empty. */
+    if (write >= read)
+        n = cb->a_len - write - ((read == 0) ? 1 : 0);
+    else
+        n = read - write - 1;
+
+    *count = n;
+    if (n == 0)
+        return NULL;
+
+    return (void *)((uintptr_t)cb->data + write * cb->b_size);
+}
+
+void queue_alloc_commit_n(queue_cb_t * cb, size_t n)
+{
+    cb->m_write = (cb->m_write + n) % cb->a_len;
+}
+
 int queue_pop(queue_cb_t * cb, void * element)
 {
     const size_t read = cb->m_read;
@@ -120,21 +144,28 @@ int queue_peek(queue_cb_t * cb, void ** element)
     return 1;
 }
 
-int queue_skip(queue_cb_t * cb, size_t n)
+void * queue_peek_n(queue_cb_t * cb, size_t * count)
 {
-    size_t count;
+    const size_t read = cb->m_read;
+    const size_t write = cb->m_write;
 
-    for (count = 0; count < n; count++) {
-        const size_t read = cb->m_read;
+    *count = (write >= read) ? write - read : cb->a_len - read;
+    if (*count == 0)
+        return NULL;
+
+    return &((uint8_t *)(cb->data))[read * cb->b_size];
+}
 
-        /* Check that the queue is not empty */
-        if (read == cb->m_write)
-            break;
+int queue_skip(queue_cb_t * cb, size_t n)
+{
+    const size_t read = cb->m_read;
+    const size_t used = (cb->m_write + cb->a_len - read) % cb->a_len;
 
-        cb->m_read = (read + 1) % cb->a_len;
-    }
+    if (n > used)
+        n = used;
+    cb->m_read = (read + n) % cb->a_len;
 
-    return count;
+    return n;
 }
 
 void queue_clear_from_push_end(queue_cb_t * cb)
@@ -147,6 +178,11 @@ void queue_clear_from_pop_end(queue_cb_t * cb)
     cb->m_read = cb->m_write;
 }
 
+size_t queue_count(queue_cb_t * cb)
+{
+    return (cb->m_write + cb->a_len - cb->m_read) % cb->a_len;
+}
+
 int queue_isempty(queue_cb_t * cb)
 {
     return (int)(cb->m_write == cb->m_read);
@@ -42,18 +42,21 @@
 #include <unistd.h>
 #include <buf.h>
 #include <exec.h>
+#include <hal/hw_timers.h>
+#include <kdata.h>
 #include <kerror.h>
 #include <kinit.h>
 #include <kmalloc.h>
+#include <kmem_cache.h>
 #include <kmem.h>
 #include <ksched.h>
 #include <kstring.h>
 #include <libkern.h>
-#include <mempool.h>
 #include <proc.h>
 #include <vm/vm_copyinstruct.h>
 
 #define SIZEOF_PROCARR ((configMAXPROC + 1) * sizeof(struct proc_info *))
+#define PROC_TICK_US (1000000 / configSCHED_HZ)
 
 /**
  * Processes indexed by pid.
@@ -196,17 +199,19 @@ static void init_kernel_proc(void)
 
     mtx_init(&(kprocvm_code->lock), MTX_TYPE_SPIN, 0);
     mtx_init(&(kprocvm_heap->lock), MTX_TYPE_SPIN, 0);
+    waitq_init(&kprocvm_code->b_waitq);
+    waitq_init(&kprocvm_heap->b_waitq);
 
     mtx_lock(&kernel_proc->mm.regions_lock);
-    (*kernel_proc->mm.regions)[MM_CODE_REGION] = kprocvm_code;
+    vm_mm_set_region(&kernel_proc->mm, MM_CODE_REGION, kprocvm_code);
     /*
      * proc 0 stack shouldn't be set here because NULL for
      * MM_STACK_REGION is a special case for intialization because
      * proc 1 is really not forked from the kernel but rather just
      * spawned and constructed by hand in kinit.
      */
-    (*kernel_proc->mm.regions)[MM_STACK_REGION] = NULL;
-    (*kernel_proc->mm.regions)[MM_HEAP_REGION] = kprocvm_heap;
+    vm_mm_set_region(&kernel_proc->mm, MM_STACK_REGION, NULL);
+    vm_mm_set_region(&kernel_proc->mm, MM_HEAP_REGION, kprocvm_heap);
     mtx_unlock(&kernel_proc->mm.regions_lock);
 
     /*
@@ -352,6 +357,7 @@ static void proc_remove(struct proc_info * proc)
             PROC_INH_REMOVE(proc, child);
 
             child->inh.parent = init; /* re-parent */
+            kdata_update_ppid(child);
             mtx_lock(&init->inh.lock);
             PROC_INH_INSERT_HEAD(init, child);
             mtx_unlock(&init->inh.lock);
@@ -382,11 +388,12 @@ void proc_free(struct proc_info * p)
     kfree(p->files);
 
     vm_mm_destroy(&p->mm);
+    kdata_free(p);
 
     PROC_LOCK();
     proc_pgrp_remove(p);
     PROC_UNLOCK();
-    mempool_return(proc_pool, p);
+    kmem_cache_free(proc_cache, p);
 }
 
 /**
@@ -534,13 +541,27 @@ void proc_thread_removed(pid_t pid, pthread_t thread_id)
     proc_unref(p);
 }
 
+/**
+ * Charge the time since the previous call to the current process.
+ * The time is counted in configSCHED_HZ ticks but it's calculated from
+ * timestamps as the scheduler isn't necessarily called on every tick.
+ */
 void proc_update_times(void)
 {
+    static uint64_t ts_last;
+    const uint64_t now = get_utime();
+    clock_t ticks;
+
+    ticks = (now - ts_last) / PROC_TICK_US;
+    if (ticks == 0)
+        return;
+    ts_last += (uint64_t)ticks * PROC_TICK_US;
+
     if (thread_flags_is_set(current_thread, SCHED_INSYS_FLAG) &&
         thread_state_get(current_thread) != THREAD_STATE_BLOCKED) {
-        curproc->tms.tms_stime++;
+        curproc->tms.tms_stime += ticks;
     } else {
-        curproc->tms.tms_utime++;
+        curproc->tms.tms_utime += ticks;
     }
 }
 SCHED_PRE_SCHED_TASK(proc_update_times);
@@ -550,7 +571,7 @@ int proc_abo_handler(const struct mmu_abo_param * restrict abo)
     const uintptr_t vaddr = abo->far;
     struct vm_mm_struct * mm;
     const char * abo_str = mmu_abo_strerror(abo);
-    int err;
+    int i, err;
 
     KASSERT(abo, "abo must be set");
 
@@ -565,14 +586,12 @@ int proc_abo_handler(const struct mmu_abo_param * restrict abo)
     mm = &abo->proc->mm;
 
     mtx_lock(&mm->regions_lock);
-    for (int i = 0; i < mm->nr_regions; i++) {
+    i = vm_regtree_find(mm, vaddr, vaddr);
+    if (i >= 0) {
         struct buf * region = (*mm->regions)[i];
         uintptr_t reg_start, reg_end;
         char uap[5];
 
-        if (!region)
-            continue;
-
         reg_start = region->b_mmu.vaddr;
         reg_end = region->b_mmu.vaddr + region->b_bufsize - 1;
 
@@ -581,9 +600,6 @@ int proc_abo_handler(const struct mmu_abo_param * restrict abo)
                    i, (unsigned)reg_start, (unsigned)reg_end,
                    (unsigned)region->b_mmu.paddr, uap);
 
-        if (!VM_ADDR_IS_IN_RANGE(vaddr, reg_start, reg_end))
-            continue; /* if not in range then try next region. */
-
         /*
          * This is the correct region.
          */
@@ -600,6 +616,25 @@ int proc_abo_handler(const struct mmu_abo_param * restrict abo)
              * it will cause the unmap operation to unmap some of the pages
              * now belonging to A.
              */
+            if (region->b_pager) {
+                /*
+                 * Pages of a demand paged region are left unmapped until
+                 * they are read in. Reading a page may sleep, so the region
+                 * is kept alive with a ref instead of regions_lock.
+                 */
+                region->vm_ops->rref(region);
+                mtx_unlock(&mm->regions_lock);
+                err = vm_pfault_region(abo->proc, region, vaddr);
+                if (err == -ENOENT) {
+                    /* Already read in by another process. */
+                    err = vm_mapproc_region(abo->proc, region);
+                }
+                region->vm_ops->rfree(region);
+
+                KERROR_DBG("Page in done (%d)\n", err);
+                return (err) ? -EFAULT : 0;
+            }
+
             mtx_unlock(&mm->regions_lock);
             vm_mapproc_region(abo->proc, region);
 
@@ -609,6 +644,18 @@ int proc_abo_handler(const struct mmu_abo_param * restrict abo)
             return 0;
         }
 
+        /*
+         * Pages of a lazily cloned region are mapped read-only until they
+         * are copied from the COW source region.
+         */
+        err = vm_pfault_region(abo->proc, region, vaddr);
+        if (err != -ENOENT) {
+            mtx_unlock(&mm->regions_lock);
+
+            KERROR_DBG("COW page done (%d)\n", err);
+            return err; /* COW of a single page done. */
+        }
+
         /* Test for COW and COR flags. */
         if ((region->b_uflags & (VM_PROT_COW | VM_PROT_COR)) == 0) {
             KERROR_DBG("Memory protection error\n");
@@ -616,7 +663,12 @@ int proc_abo_handler(const struct mmu_abo_param * restrict abo)
             goto fail;
         }
 
-        if (!region->vm_ops->rclone) {
+        if (region->vm_ops->rpclone) {
+            /* Only the faulting page is copied for now. */
+            region = region->vm_ops->rpclone(region);
+        } else if (region->vm_ops->rclone) {
+            region = region->vm_ops->rclone(region);
+        } else {
             /*
              * For whatever reason a read-only region doesn't seem to support
              * cloning.
@@ -625,8 +677,6 @@ int proc_abo_handler(const struct mmu_abo_param * restrict abo)
             err = -ENOTSUP; /* rclone() not supported. */
             goto fail;
         }
-
-        region = region->vm_ops->rclone(region);
         if (!region) {
             KERROR_DBG("Can't clone region; COW failed\n");
             err = -ENOMEM; /* Can't clone region; COW failed. */
@@ -639,6 +689,11 @@ int proc_abo_handler(const struct mmu_abo_param * restrict abo)
 
         mtx_unlock(&mm->regions_lock);
         err = vm_replace_region(abo->proc, region, i, VM_INSOP_MAP_REG);
+        if (!err) {
+            err = vm_pfault_region(abo->proc, region, vaddr);
+            if (err == -ENOENT)
+                err = 0;
+        }
 
         KERROR_DBG("COW done (%d)\n", err);
         return err; /* COW done. */
@@ -37,11 +37,13 @@
 #include <errno.h>
 #include <sys/sysctl.h>
 #include <buf.h>
+#include <hal/hw_timers.h>
+#include <kdata.h>
 #include <kerror.h>
 #include <kinit.h>
+#include <kmem_cache.h>
 #include <kstring.h>
 #include <libkern.h>
-#include <mempool.h>
 #include <proc.h>
 
 #ifdef configCOW_ENABLED
@@ -50,7 +52,7 @@
 #define COW_ENABLED_DEFAULT 0
 #endif
 
-struct mempool * proc_pool;
+struct kmem_cache * proc_cache;
 /** Enable copy on write for processses. */
 static int cow_enabled = COW_ENABLED_DEFAULT;
 static pid_t proc_lastpid;  /*!< last allocated pid. */
@@ -58,14 +60,42 @@ static pid_t proc_lastpid;  /*!< last allocated pid. */
 SYSCTL_BOOL(_kern, OID_AUTO, cow_enabled, CTLFLAG_RW,
             &cow_enabled, 0, "Enable copy on write for proc");
 
+SYSCTL_DECL(_kern_fork);
+SYSCTL_NODE(_kern, OID_AUTO, fork, CTLFLAG_RW, 0,
+            "fork stats");
+
+static atomic_t fork_count;
+SYSCTL_INT(_kern_fork, OID_AUTO, count, CTLFLAG_RD, &fork_count, 0,
+           "Number of successful forks");
+
+static int fork_last_us;
+SYSCTL_INT(_kern_fork, OID_AUTO, last_us, CTLFLAG_RD, &fork_last_us, 0,
+           "Duration of the last fork [us]");
+
+static int fork_max_us;
+SYSCTL_INT(_kern_fork, OID_AUTO, max_us, CTLFLAG_RW, &fork_max_us, 0,
+           "Maximum duration of a fork [us]");
+
+static size_t fork_last_shared;
+SYSCTL_UINT(_kern_fork, OID_AUTO, last_shared, CTLFLAG_RD, &fork_last_shared, 0,
+            "Bytes shared with the parent after the last fork");
+
+static size_t fork_last_private;
+SYSCTL_UINT(_kern_fork, OID_AUTO, last_private, CTLFLAG_RD,
+            &fork_last_private, 0,
+            "Bytes copied for the child on the last fork");
+
 int _proc_init_fork(void)
 {
-    proc_pool = mempool_init(MEMPOOL_TYPE_NONBLOCKING,
-                             sizeof(struct proc_info),
-                             configMAXPROC);
-    if (!proc_pool)
+    /*
+     * The number of processes is limited by the PID allocation, so all the
+     * descriptors can be preallocated.
+     */
+    proc_cache = kmem_cache_create("proc_info", sizeof(struct proc_info),
+                                   configMAXPROC, NULL, NULL);
+    if (!proc_cache)
         return -ENOMEM;
-    return 0;
+    return kmem_cache_prealloc(proc_cache, configMAXPROC);
 }
 
 static int clone_code_region(struct proc_info * new_proc,
@@ -88,7 +118,7 @@ static int clone_code_region(struct proc_info * new_proc,
     if (vm_reg_tmp->vm_ops->rref)
         vm_reg_tmp->vm_ops->rref(vm_reg_tmp);
 
-    (*new_proc->mm.regions)[MM_CODE_REGION] = vm_reg_tmp;
+    vm_mm_set_region(&new_proc->mm, MM_CODE_REGION, vm_reg_tmp);
 
     return 0;
 }
@@ -125,7 +155,7 @@ static int clone_regions_from(struct proc_info * new_proc,
 
         /* Don't clone regions in system page table */
         if (vm_reg_tmp->b_mmu.vaddr <= configKERNEL_END) {
-            (*new_proc->mm.regions)[i] = vm_reg_tmp;
+            vm_mm_set_region(&new_proc->mm, i, vm_reg_tmp);
             continue;
         }
 
@@ -135,6 +165,10 @@ static int clone_regions_from(struct proc_info * new_proc,
          */
         if (vm_reg_tmp->b_uflags & VM_PROT_WRITE) {
             if (cow_enabled) { /* Set COW bit if the feature is enabled. */
+                /*
+                 * A lazily cloned region is shared as is, the pages it still
+                 * shares with its sources are shared with the new clones too.
+                 */
                 vm_reg_tmp->b_uflags |= VM_PROT_COW;
 
                 /*
@@ -145,6 +179,9 @@ static int clone_regions_from(struct proc_info * new_proc,
                     KERROR(KERROR_ERR,
                            "Error while remapping a region for old_rpc (%d)\n",
                             err);
+                    if (vm_reg_tmp->vm_ops->rfree)
+                        vm_reg_tmp->vm_ops->rfree(vm_reg_tmp);
+                    return err;
                 }
             } else { /* copy immediately */
                 if (vm_reg_tmp->vm_ops->rclone) {
@@ -174,7 +211,7 @@ static int clone_regions_from(struct proc_info * new_proc,
                 }
             }
         }
-        (*new_proc->mm.regions)[i] = vm_reg_tmp;
+        vm_mm_set_region(&new_proc->mm, i, vm_reg_tmp);
 
         /*
          * Map the region to new_proc.
@@ -184,6 +221,7 @@ static int clone_regions_from(struct proc_info * new_proc,
             KERROR(KERROR_ERR,
                    "Error while mapping a region to new_proc (%d)\n",
                    err);
+            return err;
         }
     }
 
@@ -199,7 +237,7 @@ static struct proc_info * clone_proc_info(struct proc_info * const old_proc)
 
     KERROR_DBG("clone proc info of pid %u\n", old_proc->pid);
 
-    new_proc = mempool_get(proc_pool);
+    new_proc = kmem_cache_alloc(proc_cache);
     if (!new_proc) {
         return NULL;
     }
@@ -232,6 +270,41 @@ static int clone_stack(struct proc_info * new_proc, struct proc_info * old_proc)
     return err;
 }
 
+/**
+ * Update fork statistics after a successful fork.
+ * @param new_proc is the new child process.
+ * @param old_proc is the parent process.
+ * @param start is the time when the fork was started [us].
+ */
+static void update_fork_stats(struct proc_info * new_proc,
+                              struct proc_info * old_proc, uint64_t start)
+{
+    const int dt = (int)(get_utime() - start);
+    size_t shared = 0;
+    size_t private = 0;
+
+    for (int i = 0; i < new_proc->mm.nr_regions; i++) {
+        struct buf * region = (*new_proc->mm.regions)[i];
+
+        if (!region)
+            continue;
+
+        if (i < old_proc->mm.nr_regions &&
+            region == (*old_proc->mm.regions)[i]) {
+            shared += region->b_bufsize;
+        } else {
+            private += region->b_bufsize;
+        }
+    }
+
+    atomic_inc(&fork_count);
+    fork_last_us = dt;
+    if (dt > fork_max_us)
+        fork_max_us = dt;
+    fork_last_shared = shared;
+    fork_last_private = private;
+}
+
 static void set_proc_inher(struct proc_info * old_proc,
                            struct proc_info * new_proc)
 {
@@ -286,6 +359,7 @@ pid_t proc_fork(void)
 
     struct proc_info * const old_proc = curproc;
     struct proc_info * new_proc;
+    const uint64_t start = get_utime();
     pid_t retval = 0;
 
     /* Check that the old process is in valid state. */
@@ -301,6 +375,7 @@ pid_t proc_fork(void)
     new_proc->exit_ksiginfo = NULL;
     new_proc->files = NULL;
     new_proc->pgrp = NULL; /* Must be NULL so we don't free the old ref. */
+    new_proc->kdata_bp = NULL;
     memset(&new_proc->tms, 0, sizeof(new_proc->tms));
     /* ..and then start to fix things. */
 
@@ -409,6 +484,11 @@ pid_t proc_fork(void)
     /* Update inheritance attributes */
     set_proc_inher(old_proc, new_proc);
 
+    /* Map a new process data page. */
+    retval = kdata_map(new_proc);
+    if (retval)
+        goto out;
+
     priv_cred_init_fork(&new_proc->cred);
 
     /* Insert the new process into the process array */
@@ -447,6 +527,8 @@ pid_t proc_fork(void)
         new_proc->state = PROC_STATE_READY;
     }
 
+    update_fork_stats(new_proc, old_proc, start);
+
     KERROR_DBG("Fork %d -> %d created.\n", old_proc->pid, new_proc->pid);
     retval = new_proc->pid;
 out:
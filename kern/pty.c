@@ -46,6 +46,7 @@
 #include <klocks.h>
 #include <kmalloc.h>
 #include <libkern.h>
+#include <poll.h>
 #include <proc.h>
 #include <tty.h>
 
@@ -53,10 +54,13 @@ static ssize_t ptymaster_read(struct file * file, struct uio * uio,
                               size_t count);
 static ssize_t ptymaster_write(struct file * file, struct uio * uio,
                                size_t count);
+static int ptymaster_poll(struct file * file, int events,
+                          struct poll_table * pt);
 
 static vnode_ops_t ptmx_vnode_ops = {
     .read = ptymaster_read,
     .write = ptymaster_write,
+    .poll = ptymaster_poll,
 };
 
 /**
@@ -166,6 +170,44 @@ static ssize_t ptymaster_write(struct file * file, struct uio * uio,
     return fs_queue_write(ptydev->fsq_ms, buf, count, flags);
 }
 
+/**
+ * Poll a pair of fs queues.
+ * @param rdq is the queue read by the caller.
+ * @param wrq is the queue written by the caller.
+ */
+static int pty_poll(struct fs_queue * rdq, struct fs_queue * wrq, int events,
+                    struct poll_table * pt)
+{
+    const int rdevents = POLLIN | POLLRDNORM;
+    const int wrevents = POLLOUT | POLLWRNORM;
+    int revents = 0;
+
+    if (events & rdevents)
+        revents |= fs_queue_poll(rdq, events & rdevents, pt);
+    if (events & wrevents)
+        revents |= fs_queue_poll(wrq, events & wrevents, pt);
+
+    return revents;
+}
+
+static int ptymaster_poll(struct file * file, int events,
+                          struct poll_table * pt)
+{
+    struct pty_device * ptydev = (struct pty_device *)file->stream;
+
+    if (!ptydev)
+        return POLLERR;
+
+    return pty_poll(ptydev->fsq_sm, ptydev->fsq_ms, events, pt);
+}
+
+static int ptyslave_poll(struct tty * tty, int events, struct poll_table * pt)
+{
+    struct pty_device * ptydev = SLAVE_TTY2PTY(tty);
+
+    return pty_poll(ptydev->fsq_ms, ptydev->fsq_sm, events, pt);
+}
+
 static int ptyslave_read(struct tty * tty, off_t blkno,
                          uint8_t * buf, size_t bcount, int oflags)
 {
@@ -233,6 +275,7 @@ static void creat_pty(file_t * file, struct tty * tty)
      */
     slave_tty->read = ptyslave_read;
     slave_tty->write = ptyslave_write;
+    slave_tty->poll = ptyslave_poll;
 
     /*
      * Create queues.
@@ -57,7 +57,19 @@ void * idle_thread(void * arg)
             desc->fn(desc->arg);
         }
 
-        idle_sleep();
+        /*
+         * The scheduler tick might be stopped, so the readyq must be checked
+         * with interrupts disabled before sleeping. WFI still wakes up on a
+         * masked interrupt.
+         */
+        disable_interrupt();
+        if (!thread_ready_pending())
+            idle_sleep();
+        enable_interrupt();
+
+        /* Don't wait for the next tick if an interrupt woke up a thread. */
+        if (thread_ready_pending())
+            thread_yield(THREAD_YIELD_IMMEDIATE);
     }
 }
 
@@ -72,6 +84,11 @@ static int idle_insert(struct scheduler * sobj, struct thread_info * thread)
     return 0;
 }
 
+static void idle_remove(struct scheduler * sobj, struct thread_info * thread)
+{
+    /* The idle thread is never removed. */
+}
+
 static struct thread_info * idle_schedule(struct scheduler * sobj)
 {
     return idle_info;
@@ -85,6 +102,7 @@ static unsigned get_nr_active(struct scheduler * sobj)
 static struct scheduler sched_idle = {
     .name = "sched_idle",
     .insert = idle_insert,
+    .remove = idle_remove,
     .run = idle_schedule,
     .get_nr_active_threads = get_nr_active,
 };
@@ -42,10 +42,12 @@
 #include <buf.h>
 #include <hal/hw_timers.h>
 #include <idle.h>
+#include <kdata.h>
 #include <kerror.h>
 #include <kinit.h>
 #include <kmalloc.h>
 #include <kmem.h>
+#include <kmem_cache.h>
 #include <ksched.h>
 #include <kstring.h>
 #include <libkern.h>
@@ -53,6 +55,14 @@
 #include <queue_r.h>
 #include <timers.h>
 
+static void thread_info_ctor(void * obj);
+
+/*
+ * Cache for thread_info structs.
+ */
+KMEM_CACHE_DEFINE(thread_info_cache, struct thread_info, 32,
+                  thread_info_ctor, NULL);
+
 /* sysctl node for scheduler. */
 SYSCTL_NODE(_kern, OID_AUTO, sched, CTLFLAG_RW, 0, "Scheduler");
 
@@ -62,6 +72,7 @@ SYSCTL_NODE(_kern, OID_AUTO, sched, CTLFLAG_RW, 0, "Scheduler");
 extern struct scheduler * sched_create_fifo(void);
 extern struct scheduler * sched_create_rr(void);
 extern struct scheduler * sched_create_idle(void);
+extern struct thread_info * idle_info;
 
 /**
  * An array of scheduler constructors in order of desired execution order.
@@ -171,13 +182,13 @@ SYSCTL_UINT(_kern_sched, OID_AUTO, nr_threads, CTLFLAG_RD,
  * FEXP_N = 2^11/(2^(interval * log_2(e/N)))
  */
 #if defined(configSCHED_LAVGPERIOD_5SEC)
-#define LOAD_FREQ (5 * (int)configSCHED_HZ)
+#define LOAD_PERIOD (5 * 1000000ULL) /*!< Period in usec. */
 #define FSHIFT      11      /*!< nr of bits of precision */
 #define FEXP_1      1884    /*!< 1/exp(5sec/1min) */
 #define FEXP_5      2014    /*!< 1/exp(5sec/5min) */
 #define FEXP_15     2037    /*!< 1/exp(5sec/15min) */
 #elif defined(configSCHED_LAVGPERIOD_11SEC)
-#define LOAD_FREQ (11 * (int)configSCHED_HZ)
+#define LOAD_PERIOD (11 * 1000000ULL)
 #define FSHIFT      11
 #define FEXP_1      1704
 #define FEXP_5      1974
@@ -186,6 +197,8 @@ SYSCTL_UINT(_kern_sched, OID_AUTO, nr_threads, CTLFLAG_RD,
 #error Incorrect value of kernel configuration for LAVG
 #endif
 #define FIXED_1     (1 << FSHIFT) /*!< 1.0 in fixed-point */
+/** Max number of missed periods accounted after the tick was stopped. */
+#define LOAD_MAX_MISSED 256
 #define CALC_LOAD(load, exp, n)                  \
                     load *= exp;                 \
                     load += n * (FIXED_1 - exp); \
@@ -260,18 +273,35 @@ IDLE_TASK(update_nr_threads, 0);
  *
  * This function calculates unix-style load averages for the system.
  * Algorithm used here is similar to the algorithm used in Linux.
+ * The calculation is driven by timestamps rather than counting ticks because
+ * the tick might have been stopped while idle, in which case the periods
+ * missed are accounted as idle.
  */
 static void sched_calc_loads(void)
 {
-    static int count = LOAD_FREQ;
+    static uint64_t next;
+    const uint64_t now = get_utime();
     uint32_t active_threads = 0; /* Fixed-point value. */
 
-    count--;
-    if (count >= 0)
+    if (now < next)
+        return;
+
+    if (next == 0) {
+        next = now + LOAD_PERIOD;
         return;
+    }
 
     if (rwlock_trywrlock(&loadavg_lock) == 0) {
-        count = LOAD_FREQ;
+        uint64_t missed = (now - next) / LOAD_PERIOD;
+
+        next += (missed + 1) * LOAD_PERIOD;
+        if (missed > LOAD_MAX_MISSED)
+            missed = LOAD_MAX_MISSED;
+        while (missed--) {
+            CALC_LOAD(loadavg[0], FEXP_1, 0);
+            CALC_LOAD(loadavg[1], FEXP_5, 0);
+            CALC_LOAD(loadavg[2], FEXP_15, 0);
+        }
 
         for (size_t i = 0; i < NR_SCHEDULERS; i++) {
             struct scheduler * sched = CURRENT_CPU->sched_arr[i];
@@ -286,6 +316,12 @@ static void sched_calc_loads(void)
         CALC_LOAD(loadavg[1], FEXP_5, active_threads);
         CALC_LOAD(loadavg[2], FEXP_15, active_threads);
 
+        kdata_update_loads((uint32_t []){
+            SCALE_LOAD(loadavg[0]),
+            SCALE_LOAD(loadavg[1]),
+            SCALE_LOAD(loadavg[2]),
+        });
+
         rwlock_wrunlock(&loadavg_lock);
         rwlock_wrunwait(&loadavg_lock);
     } else {
@@ -350,6 +386,54 @@ FOREACH_CPU(CPU_SCHED_TIME_AVG)
 
 #endif
 
+/**
+ * Remove a thread from its scheduler if it's no longer runnable.
+ */
+static void sched_remove_unrunnable(struct thread_info * thread)
+{
+    const enum thread_state state = thread_state_get(thread);
+    const size_t policy = thread->param.sched_policy;
+    struct scheduler * sched;
+
+    if (state == THREAD_STATE_EXEC ||
+        thread_flags_is_set(thread, SCHED_INTERNAL_FLAG) ||
+        policy >= num_elem(CURRENT_CPU->sched_arr))
+        return;
+
+    sched = CURRENT_CPU->sched_arr[policy];
+    sched->remove(sched, thread);
+    if (state == THREAD_STATE_DEAD &&
+        thread_flags_is_set(thread, SCHED_DETACH_FLAG))
+        thread_remove(thread->id);
+}
+
+#ifdef configSCHED_TICKLESS
+/**
+ * Select the scheduler timer mode for the next thread.
+ * The periodic tick is only needed for time slicing, so while the idle thread
+ * is running the timer is programmed to interrupt on the next timer expiry,
+ * or stopped if there are no timers running.
+ */
+static void sched_update_tick(void)
+{
+    uint64_t expires, now;
+
+    if (current_thread != idle_info) {
+        hw_sched_timer_periodic();
+        return;
+    }
+
+    expires = timers_next_expiry();
+    if (expires == UINT64_MAX) {
+        hw_sched_timer_oneshot(0);
+        return;
+    }
+
+    now = get_utime();
+    hw_sched_timer_oneshot((expires > now) ? expires - now : 1);
+}
+#endif
+
 void sched_handler(void)
 {
     struct thread_info * const prev_thread = current_thread;
@@ -376,6 +460,12 @@ void sched_handler(void)
         current_thread->sched.ts_counter--;
     }
 
+    /*
+     * Only the current thread can block itself, so it's removed from its run
+     * queue here instead of being rescanned by the scheduler.
+     */
+    sched_remove_unrunnable(current_thread);
+
     /*
      * Exhaust global readyq.
      */
@@ -420,6 +510,10 @@ void sched_handler(void)
         task();
     }
 
+#ifdef configSCHED_TICKLESS
+    sched_update_tick();
+#endif
+
 #ifdef configSCHED_TIME_AVG
     calc_sched_time_avg(CURRENT_CPU, sched_start_time, get_utime());
 #endif
@@ -466,11 +560,32 @@ static void thread_free_kstack(struct buf * bp)
 /**
  * Initialize a sched data structure.
  */
+/**
+ * Construct a new thread_info for the cache.
+ * The scheduler lock of a thread is initialized only once and a thread is
+ * always freed with the lock released.
+ */
+static void thread_info_ctor(void * obj)
+{
+    struct thread_info * tp = (struct thread_info *)obj;
+
+    memset(tp, '\0', sizeof(struct thread_info));
+    mtx_init(&tp->sched.tdlock, MTX_TYPE_SPIN, MTX_OPT_DINT);
+}
+
+/**
+ * Reset the scheduler data of a thread.
+ * The tdlock is left as constructed.
+ */
 static void init_sched_data(struct sched_thread_data * data)
 {
-    memset(data, '\0', sizeof(struct sched_thread_data));
-    mtx_init(&data->tdlock, MTX_TYPE_SPIN, MTX_OPT_DINT);
     data->state = THREAD_STATE_INIT;
+    data->policy_flags = 0;
+    data->ts_counter = 0;
+    memset(&data->ttentry_, '\0', sizeof(data->ttentry_));
+    memset(&data->readyq_entry_, '\0', sizeof(data->readyq_entry_));
+    /* The rr policy data shares the layout of fifo. */
+    memset(&data->fifo, '\0', sizeof(data->fifo));
 }
 
 /**
@@ -556,12 +671,20 @@ pthread_t thread_create(struct _sched_pthread_create_args * thread_def,
     if (thread_id < 0)
         panic("Out of thread IDs");
 
-    tp = kzalloc(sizeof(struct thread_info));
+    tp = kmem_cache_alloc(&thread_info_cache);
     if (!tp)
         return -EAGAIN;
 
+    /* Clear the state left by the previous user of the object. */
+    memset(&tp->sframe, '\0', sizeof(tp->sframe));
+    memset(&tp->tls_regs, '\0', sizeof(tp->tls_regs));
+    tp->lock_tim = 0;
+    tp->retval = 0;
+    tp->exit_ksiginfo = NULL;
+    tp->sigwait_retval = NULL;
+
     if (!(tp->kstack_region = thread_alloc_kstack())) {
-        kfree(tp);
+        kmem_cache_free(&thread_info_cache, tp);
         return -EAGAIN;
     }
 
@@ -659,7 +782,7 @@ struct thread_info * thread_fork(pid_t new_pid)
         return NULL;
     }
 
-    new_thread = kmalloc(sizeof(struct thread_info));
+    new_thread = kmem_cache_alloc(&thread_info_cache);
     if (!new_thread)
         return NULL;
 
@@ -670,10 +793,12 @@ struct thread_info * thread_fork(pid_t new_pid)
 
     /* New thread kstack */
     if (!(new_thread->kstack_region = thread_alloc_kstack())) {
-        kfree(new_thread);
+        kmem_cache_free(&thread_info_cache, new_thread);
         return NULL;
     }
 
+    /* The lock was copied from the old thread. */
+    mtx_init(&new_thread->sched.tdlock, MTX_TYPE_SPIN, MTX_OPT_DINT);
     init_sched_data(&new_thread->sched);
     thread_set_inheritance(new_thread, NULL, new_pid);
 
@@ -731,6 +856,11 @@ int thread_ready(pthread_t thread_id)
     return 0;
 }
 
+int thread_ready_pending(void)
+{
+    return !STAILQ_EMPTY(&CURRENT_CPU->readyq);
+}
+
 struct thread_info * thread_remove_ready(void)
 {
     struct thread_info * thread;
@@ -1090,7 +1220,7 @@ static void free_threads(uintptr_t arg)
     while (queue_pop(&CURRENT_CPU->thread_free_queue, &thread)) {
         thread_free_kstack(thread->kstack_region);
         kfree(thread->exit_ksiginfo);
-        kfree_lazy(thread);
+        kmem_cache_free(&thread_info_cache, thread);
     }
 }
 IDLE_TASK(free_threads, 0);
@@ -31,7 +31,6 @@
  */
 
 #include <stddef.h>
-#include <sys/tree.h>
 #include <kerror.h>
 #include <kmalloc.h>
 #include <ksched.h>
@@ -42,41 +41,55 @@
 
 #define FIFORUNQ_ENTRY  sched.fifo.runq_entry_
 
+/**
+ * FIFO scheduler.
+ * There is a separate run queue for each priority and a bitmap of non-empty
+ * queues, so the highest priority runnable thread is found in O(1).
+ */
 struct sched_fifo {
     struct scheduler sched;
     unsigned nr_active;
-    RB_HEAD(fiforunq, thread_info) runq_head;
+    struct sched_prio_map prio_map;
+    TAILQ_HEAD(fiforunq, thread_info) runq_head[SCHED_NR_PRIO];
 };
 
-static int fifo_prio_compare(struct thread_info * a, struct thread_info * b)
+static void fifo_enqueue(struct sched_fifo * fifo, struct thread_info * thread)
 {
-    return a->sched.fifo.prio - b->sched.fifo.prio;
+    const int idx = sched_prio2idx(thread_p_get_scheduling_priority(thread));
+
+    TAILQ_INSERT_TAIL(&fifo->runq_head[idx], thread, FIFORUNQ_ENTRY);
+    sched_prio_map_set(&fifo->prio_map, idx);
+    thread->sched.fifo.prio = idx;
 }
 
-RB_PROTOTYPE_STATIC(fiforunq, thread_info, FIFORUNQ_ENTRY, fifo_prio_compare);
-RB_GENERATE_STATIC(fiforunq, thread_info, FIFORUNQ_ENTRY, fifo_prio_compare);
+static void fifo_dequeue(struct sched_fifo * fifo, struct thread_info * thread)
+{
+    const int idx = thread->sched.fifo.prio;
+
+    TAILQ_REMOVE(&fifo->runq_head[idx], thread, FIFORUNQ_ENTRY);
+    if (TAILQ_EMPTY(&fifo->runq_head[idx]))
+        sched_prio_map_clear(&fifo->prio_map, idx);
+}
 
 static int fifo_insert(struct scheduler * sobj, struct thread_info * thread)
 {
     struct sched_fifo * fifo = containerof(sobj, struct sched_fifo, sched);
 
     if (!thread_test_polflag(thread, SCHED_POLFLAG_INFIFORQ)) {
-        RB_INSERT(fiforunq, &fifo->runq_head, thread);
         thread->sched.ts_counter = -1; /* Not used. */
 
         /*
          * The priority of a process is static until it's removed from the queue
          * and it can only change on reinsert.
          */
-        thread->sched.fifo.prio = thread_p_get_scheduling_priority(thread);
+        fifo_enqueue(fifo, thread);
 
         thread->sched.policy_flags |= SCHED_POLFLAG_INFIFORQ;
         fifo->nr_active++;
     } else {
         /* Reinsert should update the priority. */
-        RB_REMOVE(fiforunq, &fifo->runq_head, thread);
-        thread->sched.fifo.prio = thread_p_get_scheduling_priority(thread);
-        RB_INSERT(fiforunq, &fifo->runq_head, thread);
+        fifo_dequeue(fifo, thread);
+        fifo_enqueue(fifo, thread);
     }
 
     return 0;
@@ -87,7 +100,7 @@ static void fifo_remove(struct scheduler * sobj, struct thread_info * thread)
     struct sched_fifo * fifo = containerof(sobj, struct sched_fifo, sched);
 
     if (thread_test_polflag(thread, SCHED_POLFLAG_INFIFORQ)) {
-        RB_REMOVE(fiforunq, &fifo->runq_head, thread);
+        fifo_dequeue(fifo, thread);
         thread->sched.policy_flags &= ~SCHED_POLFLAG_INFIFORQ;
         fifo->nr_active--;
     }
@@ -96,43 +109,58 @@ static void fifo_remove(struct scheduler * sobj, struct thread_info * thread)
 static struct thread_info * fifo_schedule(struct scheduler * sobj)
 {
     struct sched_fifo * fifo = containerof(sobj, struct sched_fifo, sched);
-    struct thread_info * thread;
-
-    if (RB_EMPTY(&fifo->runq_head))
-        return NULL;
-
-    while ((thread = RB_MIN(fiforunq, &fifo->runq_head))) {
-        const enum thread_state state = thread_state_get(thread);
-        const int yield = thread_flags_is_set(thread, SCHED_YIELD_FLAG);
-
-        switch (state) {
-        case THREAD_STATE_READY:
-            fifo_remove(sobj, thread);
-            break;
-        case THREAD_STATE_EXEC:
-            if (!yield) {
-                if (thread_flags_is_set(thread, SCHED_IN_USE_FLAG)) {
+    struct thread_info * yielded = NULL;
+    int idx;
+
+    for (idx = sched_prio_map_first(&fifo->prio_map, 0);
+         idx >= 0;
+         idx = sched_prio_map_first(&fifo->prio_map, idx + 1)) {
+        struct thread_info * thread;
+        struct thread_info * tmp;
+
+        TAILQ_FOREACH_SAFE(thread, &fifo->runq_head[idx], FIFORUNQ_ENTRY, tmp) {
+            const enum thread_state state = thread_state_get(thread);
+
+            if (thread == yielded)
+                continue;
+
+            switch (state) {
+            case THREAD_STATE_READY:
+                fifo_remove(sobj, thread);
+                break;
+            case THREAD_STATE_EXEC:
+                if (thread_flags_is_set(thread, SCHED_YIELD_FLAG)) {
+                    /* Move to the tail of the queue and let others run. */
+                    thread_flags_clear(thread, SCHED_YIELD_FLAG);
+                    fifo_dequeue(fifo, thread);
+                    TAILQ_INSERT_TAIL(&fifo->runq_head[idx], thread,
+                                      FIFORUNQ_ENTRY);
+                    sched_prio_map_set(&fifo->prio_map, idx);
+                    if (!yielded)
+                        yielded = thread;
+                } else if (thread_flags_is_set(thread, SCHED_IN_USE_FLAG)) {
                     return thread; /* select */
+                } else {
+                    fifo_remove(sobj, thread);
                 }
-            } else {
-                thread_flags_clear(thread, SCHED_YIELD_FLAG);
+                break;
+            case THREAD_STATE_BLOCKED:
+                fifo_remove(sobj, thread);
+                break;
+            case THREAD_STATE_DEAD:
+                fifo_remove(sobj, thread);
+                if (thread_flags_is_set(thread, SCHED_DETACH_FLAG))
+                    thread_remove(thread->id);
+                break;
+            default:
+                 KERROR(KERROR_ERR, "Thread (%d) state: %d\n",
+                        thread->id, state);
+                 panic("Inconsistent thread state");
             }
-            break;
-        case THREAD_STATE_BLOCKED:
-            fifo_remove(sobj, thread);
-            break;
-        case THREAD_STATE_DEAD:
-            fifo_remove(sobj, thread);
-            if (thread_flags_is_set(thread, SCHED_DETACH_FLAG))
-                thread_remove(thread->id);
-            break;
-        default:
-             KERROR(KERROR_ERR, "Thread (%d) state: %d\n", thread->id, state);
-             panic("Inconsistent thread state");
         }
     }
 
-    return NULL;
+    return yielded;
 }
 
 static unsigned get_nr_active(struct scheduler * sobj)
@@ -148,6 +176,7 @@ static unsigned get_nr_active(struct scheduler * sobj)
 static const struct sched_fifo sched_fifo_init = {
     .sched.name = "sched_fifo",
     .sched.insert = fifo_insert,
+    .sched.remove = fifo_remove,
     .sched.run = fifo_schedule,
     .sched.get_nr_active_threads = get_nr_active,
 };
@@ -161,7 +190,9 @@ struct scheduler * sched_create_fifo(void)
         return NULL;
 
     *sched = sched_fifo_init; /* init */
-    RB_INIT(&sched->runq_head);
+    for (size_t i = 0; i < num_elem(sched->runq_head); i++) {
+        TAILQ_INIT(&sched->runq_head[i]);
+    }
 
     return &sched->sched;
 }
@@ -41,10 +41,16 @@
 
 #define RRRUNQ_ENTRY    sched.rr.runq_entry_
 
+/**
+ * Round robin scheduler.
+ * There is a separate run queue for each priority and a bitmap of non-empty
+ * queues, so the highest priority runnable thread is found in O(1).
+ */
 struct sched_rr {
     struct scheduler sched;
     unsigned nr_active;
-    TAILQ_HEAD(runq, thread_info) runq_head;
+    struct sched_prio_map prio_map;
+    TAILQ_HEAD(runq, thread_info) runq_head[SCHED_NR_PRIO];
 };
 
 static inline int get_tts(struct thread_info * thread)
@@ -57,7 +63,12 @@ static int rr_insert(struct scheduler * sobj, struct thread_info * thread)
     struct sched_rr * rr = containerof(sobj, struct sched_rr, sched);
 
     if (!thread_test_polflag(thread, SCHED_POLFLAG_INRRRQ)) {
-        TAILQ_INSERT_TAIL(&rr->runq_head, thread, RRRUNQ_ENTRY);
+        const int prio = thread_p_get_scheduling_priority(thread);
+        const int idx = sched_prio2idx(prio);
+
+        TAILQ_INSERT_TAIL(&rr->runq_head[idx], thread, RRRUNQ_ENTRY);
+        sched_prio_map_set(&rr->prio_map, idx);
+        thread->sched.rr.prio = idx;
         thread->sched.ts_counter = get_tts(thread);
         thread->sched.policy_flags |= SCHED_POLFLAG_INRRRQ;
         rr->nr_active++;
@@ -71,12 +82,27 @@ static void rr_remove(struct scheduler * sobj, struct thread_info * thread)
     struct sched_rr * rr = containerof(sobj, struct sched_rr, sched);
 
     if (thread_test_polflag(thread, SCHED_POLFLAG_INRRRQ)) {
-        TAILQ_REMOVE(&rr->runq_head, thread, RRRUNQ_ENTRY);
+        const int idx = thread->sched.rr.prio;
+
+        TAILQ_REMOVE(&rr->runq_head[idx], thread, RRRUNQ_ENTRY);
+        if (TAILQ_EMPTY(&rr->runq_head[idx]))
+            sched_prio_map_clear(&rr->prio_map, idx);
         thread->sched.policy_flags &= ~SCHED_POLFLAG_INRRRQ;
         rr->nr_active--;
     }
 }
 
+/**
+ * Move a thread to the tail of its run queue.
+ */
+static void rr_requeue(struct sched_rr * rr, struct thread_info * thread)
+{
+    struct runq * runq = &rr->runq_head[thread->sched.rr.prio];
+
+    TAILQ_REMOVE(runq, thread, RRRUNQ_ENTRY);
+    TAILQ_INSERT_TAIL(runq, thread, RRRUNQ_ENTRY);
+}
+
 static void rr_thread_act(struct scheduler * sobj, struct thread_info * thread,
                           enum thread_state state)
 {
@@ -107,29 +133,56 @@ static void rr_thread_act(struct scheduler * sobj, struct thread_info * thread,
 static struct thread_info * rr_schedule(struct scheduler * sobj)
 {
     struct sched_rr * rr = containerof(sobj, struct sched_rr, sched);
-    struct thread_info * next;
-    struct thread_info * tmp;
-
-    TAILQ_FOREACH_SAFE(next, &rr->runq_head, RRRUNQ_ENTRY, tmp) {
-        const enum thread_state state = thread_state_get(next);
-        const int yield = thread_flags_is_set(next, SCHED_YIELD_FLAG);
+    struct thread_info * yielded = NULL;
+    int idx;
+
+    for (idx = sched_prio_map_first(&rr->prio_map, 0);
+         idx >= 0;
+         idx = sched_prio_map_first(&rr->prio_map, idx + 1)) {
+        struct thread_info * next;
+        struct thread_info * tmp;
+
+        /*
+         * Normally the first thread in the highest priority queue is
+         * selected. Blocked threads are removed by sched_handler() already
+         * but threads killed by someone else are still removed here.
+         */
+        TAILQ_FOREACH_SAFE(next, &rr->runq_head[idx], RRRUNQ_ENTRY, tmp) {
+            const enum thread_state state = thread_state_get(next);
+
+            if (next == yielded)
+                continue;
+
+            if (thread_flags_not_set(next, SCHED_IN_USE_FLAG) ||
+                state != THREAD_STATE_EXEC) {
+                rr_thread_act(sobj, next, state);
+                continue;
+            }
 
-        if (thread_flags_not_set(next, SCHED_IN_USE_FLAG)) {
-            rr_thread_act(sobj, next, state);
-            continue;
-        }
+            if (thread_flags_is_set(next, SCHED_YIELD_FLAG)) {
+                /* Let any other thread run before this one. */
+                thread_flags_clear(next, SCHED_YIELD_FLAG);
+                rr_requeue(rr, next);
+                if (!yielded)
+                    yielded = next;
+                continue;
+            }
 
-        if (!yield) {
-            if (state == THREAD_STATE_EXEC && next->sched.ts_counter > 0) {
-                return next;
+            if (next->sched.ts_counter <= 0) {
+                /* Time slice used, the next thread of the same priority. */
+                rr_thread_act(sobj, next, state);
+                if (tmp)
+                    rr_requeue(rr, next);
+                else
+                    return next;
+                continue;
             }
-            rr_thread_act(sobj, next, state);
-        } else {
-            thread_flags_clear(next, SCHED_YIELD_FLAG);
+
+            return next;
         }
     }
 
-    return NULL;
+    return yielded;
 }
 
 static unsigned get_nr_active(struct scheduler * sobj)
@@ -145,6 +198,7 @@ static unsigned get_nr_active(struct scheduler * sobj)
 static const struct sched_rr sched_rr_init = {
     .sched.name = "sched_rr",
     .sched.insert = rr_insert,
+    .sched.remove = rr_remove,
     .sched.run = rr_schedule,
     .sched.get_nr_active_threads = get_nr_active,
 };
@@ -158,7 +212,9 @@ struct scheduler * sched_create_rr(void)
         return NULL;
 
     *sched = sched_rr_init; /* init */
-    TAILQ_INIT(&sched->runq_head);
+    for (size_t i = 0; i < num_elem(sched->runq_head); i++) {
+        TAILQ_INIT(&sched->runq_head[i]);
+    }
 
     return &sched->sched;
 }
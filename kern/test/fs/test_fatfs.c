@@ -0,0 +1,146 @@
+/**
+ * @file test_fatfs.c
+ * @brief Test fatfs fast seek.
+ */
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <buf.h>
+#include <fs/fs.h>
+#include <fs/fs_util.h>
+#include <kmalloc.h>
+#include <kstring.h>
+#include <kunit.h>
+#include <uio.h>
+#include "../../fs/fatfs/fatfs.h"
+
+#ifdef configFATFS_FASTSEEK
+
+#define TEST_SSIZE      512
+#define TEST_NSECT      1
+#define TEST_SCLUST     2
+#define TEST_NCLUST     4
+
+static uint8_t disk_data[TEST_NSECT * TEST_SSIZE];
+static int disk_nreads;
+static int disk_err;
+static struct fatfs_sb sb;
+static struct fatfs_inode in;
+
+static off_t disk_lseek(file_t * file, off_t offset, int whence)
+{
+    file->seek_pos = offset;
+    return offset;
+}
+
+static ssize_t disk_read(file_t * file, struct uio * uio, size_t count)
+{
+    const size_t off = file->seek_pos * TEST_SSIZE;
+
+    disk_nreads++;
+    if (disk_err)
+        return disk_err;
+    if (off + count > sizeof(disk_data))
+        return -EINVAL;
+
+    if (uio_copyout(disk_data + off, uio, 0, count))
+        return -EFAULT;
+
+    return count;
+}
+
+static vnode_ops_t disk_vnode_ops;
+static vnode_t disk_vnode;
+
+static void setup(void)
+{
+    uint8_t * fat = disk_data;
+
+    /* A FAT32 volume with a single contiguous file. */
+    memset(disk_data, 0, sizeof(disk_data));
+    for (DWORD cl = TEST_SCLUST; cl < TEST_SCLUST + TEST_NCLUST; cl++) {
+        DWORD next = (cl + 1 < TEST_SCLUST + TEST_NCLUST) ? cl + 1 : 0x0FFFFFFF;
+
+        ST_DWORD(fat + cl * 4, next);
+    }
+    disk_nreads = 0;
+    disk_err = 0;
+
+    disk_vnode_ops = nofs_vnode_ops;
+    disk_vnode_ops.lseek = disk_lseek;
+    disk_vnode_ops.read = disk_read;
+    memset(&disk_vnode, 0, sizeof(disk_vnode));
+    fs_vnode_init(&disk_vnode, 0, NULL, &disk_vnode_ops);
+    disk_vnode.vn_mode = S_IFCHR;
+
+    memset(&sb, 0, sizeof(sb));
+    sb.ff_devfile.vnode = &disk_vnode;
+    sb.ff_fs.fs_type = FS_FAT32;
+    sb.ff_fs.ssize = TEST_SSIZE;
+    sb.ff_fs.opt = FATFS_READONLY;
+    sb.ff_fs.n_fatent = TEST_SSIZE / 4;
+    sb.ff_fs.winsect = 0xFFFFFFFF;
+    mtx_init(&sb.ff_fs.sobj, MTX_TYPE_TICKET, 0);
+
+    memset(&in, 0, sizeof(in));
+    in.fp.fs = &sb.ff_fs;
+    in.fp.sclust = TEST_SCLUST;
+    in.fp.fsize = configFATFS_FASTSEEK_MIN;
+}
+
+static void teardown(void)
+{
+    kfree(in.fp.cltbl);
+    bio_vnode_cleanup(&disk_vnode);
+}
+
+static char * test_clmt_build(void)
+{
+    ku_test_description("Test that a cluster link map is built for a large "
+                        "file.");
+
+    fatfs_select_seek(&in, 0, 1, 0);
+    ku_assert("Link map was built", in.fp.cltbl);
+    ku_assert_equal("One fragment", in.fp.cltbl[1], TEST_NCLUST);
+    ku_assert_equal("Fragment start", in.fp.cltbl[2], TEST_SCLUST);
+    ku_assert_equal("No error", in.fp.err, 0);
+
+    return NULL;
+}
+
+static char * test_clmt_fallback(void)
+{
+    int nreads;
+
+    ku_test_description("Test that a failure to build a link map falls back "
+                        "to the normal seek and isn't retried.");
+
+    disk_err = -EIO;
+    fatfs_select_seek(&in, 0, 1, 0);
+    ku_assert("Link map wasn't built", !in.fp.cltbl);
+    ku_assert_equal("File wasn't aborted", in.fp.err, 0);
+    ku_assert("Disk was read", disk_nreads > 0);
+
+    disk_err = 0;
+    nreads = disk_nreads;
+    fatfs_select_seek(&in, 0, 1, 0);
+    ku_assert("Link map wasn't built", !in.fp.cltbl);
+    ku_assert_equal("Build wasn't retried", disk_nreads, nreads);
+
+    /* The file changed. */
+    in.fp.fsize += TEST_SSIZE;
+    fatfs_select_seek(&in, 0, 1, 0);
+    ku_assert("Link map was built", in.fp.cltbl);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_clmt_build, KU_RUN);
+    ku_def_test(test_clmt_fallback, KU_RUN);
+}
+
+TEST_MODULE(fs, fatfs);
+
+#endif
@@ -0,0 +1,160 @@
+/**
+ * @file test_namecache.c
+ * @brief Test the vfs name cache.
+ */
+
+#include <errno.h>
+#include <kunit.h>
+#include <fs/fs.h>
+#include <fs/fs_util.h>
+#include <fs/namecache.h>
+
+#ifdef configFS_NAMECACHE
+
+static int delete_tst_vnode(vnode_t * vnode)
+{
+    return 0;
+}
+
+static fs_t fs_tst = {
+    .fsname = "nctst",
+    .fs_flags = FS_FLAG_NAMECACHE,
+};
+
+static fs_t fs_tst_nocache = {
+    .fsname = "nctst2",
+};
+
+static struct fs_superblock sb_tst = {
+    .fs = &fs_tst,
+    .delete_vnode = delete_tst_vnode,
+};
+
+static struct fs_superblock sb_tst_nocache = {
+    .fs = &fs_tst_nocache,
+    .delete_vnode = delete_tst_vnode,
+};
+
+static vnode_t dir;
+static vnode_t file;
+
+static void setup(void)
+{
+    fs_vnode_init(&dir, 1, &sb_tst, NULL);
+    fs_vnode_init(&file, 2, &sb_tst, NULL);
+    vrefset(&dir, 1);
+    vrefset(&file, 1);
+}
+
+static void teardown(void)
+{
+    namecache_purge_sb(&sb_tst);
+    namecache_purge_sb(&sb_tst_nocache);
+}
+
+static char * test_positive(void)
+{
+    vnode_t * vn = NULL;
+
+    ku_test_description("Test that a positive entry is found and referenced.");
+
+    namecache_enter(&dir, "file", &file, namecache_gen());
+    ku_assert_equal("Entry holds a ref", vrefcnt(&file), 2);
+
+    ku_assert_equal("Hit", namecache_lookup(&dir, "file", &vn), 0);
+    ku_assert_ptr_equal("Got the vnode", vn, &file);
+    ku_assert_equal("Lookup took a ref", vrefcnt(&file), 3);
+    vrele(vn);
+
+    ku_assert_equal("Miss", namecache_lookup(&dir, "fil", &vn), -EAGAIN);
+
+    return NULL;
+}
+
+static char * test_negative(void)
+{
+    vnode_t * vn = NULL;
+
+    ku_test_description("Test that a negative entry returns ENOENT.");
+
+    namecache_enter(&dir, "nonexist", NULL, namecache_gen());
+    ku_assert_equal("Negative hit",
+                    namecache_lookup(&dir, "nonexist", &vn), -ENOENT);
+    ku_assert_ptr_equal("vnode not set", vn, NULL);
+
+    return NULL;
+}
+
+static char * test_purge_dir(void)
+{
+    vnode_t * vn;
+
+    ku_test_description("Test that purging a directory drops its entries.");
+
+    namecache_enter(&dir, "file", &file, namecache_gen());
+    namecache_enter(&dir, "nonexist", NULL, namecache_gen());
+    namecache_purge_dir(&dir);
+
+    ku_assert_equal("Positive entry purged",
+                    namecache_lookup(&dir, "file", &vn), -EAGAIN);
+    ku_assert_equal("Negative entry purged",
+                    namecache_lookup(&dir, "nonexist", &vn), -EAGAIN);
+    ku_assert_equal("file refs released", vrefcnt(&file), 1);
+    ku_assert_equal("dir refs released", vrefcnt(&dir), 1);
+
+    return NULL;
+}
+
+static char * test_stale_gen(void)
+{
+    vnode_t * vn;
+    unsigned gen;
+
+    ku_test_description("Test that a result older than a purge isn't entered.");
+
+    gen = namecache_gen();
+    namecache_purge_dir(&dir);
+    namecache_enter(&dir, "file", &file, gen);
+
+    ku_assert_equal("Not entered",
+                    namecache_lookup(&dir, "file", &vn), -EAGAIN);
+    ku_assert_equal("No refs held", vrefcnt(&file), 1);
+
+    return NULL;
+}
+
+static char * test_not_cacheable(void)
+{
+    vnode_t ncdir;
+    vnode_t * vn;
+    const char longname[] = "a_very_long_file_name_not_cached_by_namecache";
+
+    ku_test_description("Test that uncacheable lookups are not entered.");
+
+    fs_vnode_init(&ncdir, 3, &sb_tst_nocache, NULL);
+    vrefset(&ncdir, 1);
+
+    namecache_enter(&ncdir, "file", &file, namecache_gen());
+    ku_assert_equal("fs without FS_FLAG_NAMECACHE",
+                    namecache_lookup(&ncdir, "file", &vn), -EAGAIN);
+
+    namecache_enter(&dir, longname, &file, namecache_gen());
+    ku_assert_equal("Long name",
+                    namecache_lookup(&dir, longname, &vn), -EAGAIN);
+    ku_assert_equal("No refs held", vrefcnt(&file), 1);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_positive, KU_RUN);
+    ku_def_test(test_negative, KU_RUN);
+    ku_def_test(test_purge_dir, KU_RUN);
+    ku_def_test(test_stale_gen, KU_RUN);
+    ku_def_test(test_not_cacheable, KU_RUN);
+}
+
+TEST_MODULE(fs, namecache);
+
+#endif
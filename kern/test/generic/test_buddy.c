@@ -0,0 +1,101 @@
+/**
+ * @file test_buddy.c
+ * @brief Test the buddy allocator.
+ */
+
+#include <errno.h>
+#include <buddy.h>
+#include <kunit.h>
+
+#define NBLOCKS 20
+
+static struct buddy b;
+static struct buddy_blk blk[NBLOCKS];
+
+static void setup(void)
+{
+    buddy_init(&b, blk, NBLOCKS);
+    buddy_free(&b, 0, NBLOCKS);
+}
+
+static void teardown(void)
+{
+    /* Intentionally unimplemented... */
+}
+
+static char * test_alloc_exact(void)
+{
+    size_t i1, i2;
+
+    ku_test_description("Test that only the requested blocks are allocated.");
+
+    ku_assert_equal("Allocated", buddy_alloc(&b, 3, &i1), 0);
+    ku_assert_equal("Aligned", i1 % 4, 0);
+    ku_assert_equal("Free count", b.nfree, NBLOCKS - 3);
+    ku_assert("Tail was freed", buddy_is_free(&b, i1 + 3));
+
+    ku_assert_equal("Allocated", buddy_alloc(&b, 1, &i2), 0);
+    ku_assert_equal("Tail block was used", i2, i1 + 3);
+
+    buddy_free(&b, i1, 3);
+    buddy_free(&b, i2, 1);
+    ku_assert_equal("All free", b.nfree, NBLOCKS);
+
+    return NULL;
+}
+
+static char * test_coalesce(void)
+{
+    size_t i;
+
+    ku_test_description("Test that freed blocks are coalesced.");
+
+    for (int n = 0; n < NBLOCKS; n++) {
+        ku_assert_equal("Allocated", buddy_alloc(&b, 1, &i), 0);
+    }
+    ku_assert_equal("Out of blocks", buddy_alloc(&b, 1, &i), -ENOMEM);
+
+    for (size_t n = 0; n < NBLOCKS; n++) {
+        buddy_free(&b, n, 1);
+    }
+
+    ku_assert_equal("Can allocate the largest block",
+                    buddy_alloc(&b, 16, &i), 0);
+    ku_assert_equal("Largest block is at the start", i, 0);
+    buddy_free(&b, i, 16);
+
+    return NULL;
+}
+
+static char * test_reserve(void)
+{
+    size_t i;
+
+    ku_test_description("Test reserving a specific range of blocks.");
+
+    ku_assert_equal("Reserved", buddy_reserve(&b, 5, 6), 0);
+    ku_assert("Before is free", buddy_is_free(&b, 4));
+    ku_assert("Start is reserved", !buddy_is_free(&b, 5));
+    ku_assert("End is reserved", !buddy_is_free(&b, 10));
+    ku_assert("After is free", buddy_is_free(&b, 11));
+    ku_assert_equal("Can't reserve twice", buddy_reserve(&b, 10, 2), -EBUSY);
+    ku_assert_equal("Free count", b.nfree, NBLOCKS - 6);
+
+    ku_assert_equal("Allocated", buddy_alloc(&b, 4, &i), 0);
+    ku_assert("Didn't overlap", i + 4 <= 5 || i >= 11);
+
+    buddy_free(&b, i, 4);
+    buddy_free(&b, 5, 6);
+    ku_assert_equal("All free", b.nfree, NBLOCKS);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_alloc_exact, KU_RUN);
+    ku_def_test(test_coalesce, KU_RUN);
+    ku_def_test(test_reserve, KU_RUN);
+}
+
+TEST_MODULE(generic, buddy);
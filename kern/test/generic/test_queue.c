@@ -129,6 +129,95 @@ static char * test_queue_alloc(void)
     return NULL;
 }
 
+static char * test_queue_skip_many(void)
+{
+    int x = 0;
+    int ret;
+
+    queue_push(&queue, &x);
+    queue_push(&queue, &x);
+
+    ret = queue_skip(&queue, 3);
+    ku_assert_equal("Only queued elements were skipped", ret, 2);
+    ku_assert("Queue is empty", queue_isempty(&queue) != 0);
+
+    return NULL;
+}
+
+static char * test_queue_alloc_n(void)
+{
+    int * p;
+    size_t n;
+
+    p = queue_alloc_get_n(&queue, &n);
+    ku_assert_ptr_equal("Alloc starts from the beginning", p, &tarr[0]);
+    ku_assert_equal("All but one element are free", n, 4);
+
+    p[0] = 1;
+    p[1] = 2;
+    queue_alloc_commit_n(&queue, 2);
+
+    p = queue_peek_n(&queue, &n);
+    ku_assert_ptr_equal("Peek the first element", p, &tarr[0]);
+    ku_assert_equal("Two elements can be read", n, 2);
+    ku_assert_equal("Committed value is valid", p[1], 2);
+
+    return NULL;
+}
+
+static char * test_queue_alloc_n_wrap(void)
+{
+    int * p;
+    size_t n;
+
+    queue_alloc_get_n(&queue, &n);
+    queue_alloc_commit_n(&queue, 3);
+    ku_assert_equal("Skipped", queue_skip(&queue, 3), 3);
+
+    p = queue_alloc_get_n(&queue, &n);
+    ku_assert_ptr_equal("Alloc continues from the write index", p, &tarr[3]);
+    ku_assert_equal("Run ends at the end of the array", n, 2);
+    queue_alloc_commit_n(&queue, 2);
+
+    p = queue_alloc_get_n(&queue, &n);
+    ku_assert_ptr_equal("Alloc wrapped", p, &tarr[0]);
+    ku_assert_equal("Run stops before the read index", n, 2);
+
+    p = queue_peek_n(&queue, &n);
+    ku_assert_ptr_equal("Peek from the read index", p, &tarr[3]);
+    ku_assert_equal("Run ends at the end of the array", n, 2);
+
+    return NULL;
+}
+
+static char * test_queue_peek_n_empty(void)
+{
+    size_t n;
+
+    ku_assert("Peek fails", queue_peek_n(&queue, &n) == NULL);
+    ku_assert_equal("Nothing to read", n, 0);
+
+    return NULL;
+}
+
+static char * test_queue_count(void)
+{
+    int x = 1;
+
+    ku_assert_equal("Queue is empty", queue_count(&queue), 0);
+    for (int i = 0; i < 4; i++) {
+        queue_push(&queue, &x);
+    }
+    ku_assert_equal("Queue is full", queue_count(&queue), 4);
+
+    queue_skip(&queue, 3);
+    queue_push(&queue, &x);
+    queue_push(&queue, &x);
+    ku_assert_equal("Count over the wrap", queue_count(&queue), 3);
+
+    return NULL;
+}
+
 static char * test_queue_is_empty(void)
 {
     ku_assert("Queue is empty", queue_isempty(&queue) != 0);
@@ -155,6 +244,11 @@ static void all_tests(void)
     ku_def_test(test_queue_peek_fail, KU_RUN);
     ku_def_test(test_queue_skip_one, KU_RUN);
     ku_def_test(test_queue_alloc, KU_RUN);
+    ku_def_test(test_queue_skip_many, KU_RUN);
+    ku_def_test(test_queue_alloc_n, KU_RUN);
+    ku_def_test(test_queue_alloc_n_wrap, KU_RUN);
+    ku_def_test(test_queue_peek_n_empty, KU_RUN);
+    ku_def_test(test_queue_count, KU_RUN);
     ku_def_test(test_queue_is_empty, KU_RUN);
     ku_def_test(test_queue_is_not_empty, KU_RUN);
 }
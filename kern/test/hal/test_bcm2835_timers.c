@@ -0,0 +1,70 @@
+/**
+ * @file test_bcm2835_timers.c
+ * @brief Test BCM2835 scheduler timer tick conversions.
+ */
+
+#include <kunit.h>
+#include <libkern.h>
+#include "../../hal/bcm2835/bcm2835_timers.h"
+
+#ifdef configBCM2835
+
+#define TICK_USEC   (1000000 / configSCHED_HZ)
+
+static void setup(void)
+{
+}
+
+static void teardown(void)
+{
+}
+
+static char * test_oneshot_period(void)
+{
+    uint32_t period = bcm2835_timer_period_ticks();
+    uint32_t ticks = bcm2835_timer_usec2ticks(TICK_USEC);
+
+    ku_test_description("Test that a one-shot of one tick period matches the periodic tick.");
+
+    ku_assert("Periodic tick is configured", period > 0);
+    ku_assert("One-shot and periodic tick rates agree",
+              ticks + 1 >= period && ticks <= period + 1);
+
+    return NULL;
+}
+
+static char * test_oneshot_second(void)
+{
+    ku_test_description("Test that a one second one-shot equals configSCHED_HZ ticks.");
+
+    ku_assert_equal("One second in ticks",
+                    bcm2835_timer_usec2ticks(1000000),
+                    bcm2835_timer_period_ticks() * configSCHED_HZ);
+
+    return NULL;
+}
+
+static char * test_oneshot_clamp(void)
+{
+    uint32_t max = bcm2835_timer_usec2ticks(UINT64_MAX);
+
+    ku_test_description("Test that one-shot delays are clamped to the timer range.");
+
+    ku_assert("Huge delay doesn't wrap",
+              max >= bcm2835_timer_usec2ticks(1000000));
+    ku_assert_equal("Zero delay is at least one tick",
+                    bcm2835_timer_usec2ticks(0), 1);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_oneshot_period, KU_RUN);
+    ku_def_test(test_oneshot_second, KU_RUN);
+    ku_def_test(test_oneshot_clamp, KU_RUN);
+}
+
+TEST_MODULE(hal, bcm2835_timers);
+
+#endif
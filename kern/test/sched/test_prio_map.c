@@ -0,0 +1,77 @@
+/**
+ * @file test_prio_map.c
+ * @brief Test the scheduler priority bitmap.
+ */
+
+#include <limits.h>
+#include <kstring.h>
+#include <kunit.h>
+#include <ksched.h>
+
+static struct sched_prio_map pm;
+
+static void setup(void)
+{
+    memset(&pm, 0, sizeof(pm));
+}
+
+static void teardown(void)
+{
+}
+
+static char * test_prio_map_empty(void)
+{
+    ku_test_description("Test that an empty priority map has no queues.");
+
+    ku_assert_equal("No queues", sched_prio_map_first(&pm, 0), -1);
+
+    return NULL;
+}
+
+static char * test_prio_map_order(void)
+{
+    const int hi = sched_prio2idx(NICE_MIN);
+    const int mid = sched_prio2idx(NZERO);
+    const int lo = sched_prio2idx(NICE_MAX);
+
+    ku_test_description("Test that the highest priority queue is found first.");
+
+    sched_prio_map_set(&pm, lo);
+    sched_prio_map_set(&pm, mid);
+    ku_assert_equal("Found mid", sched_prio_map_first(&pm, 0), mid);
+
+    sched_prio_map_set(&pm, hi);
+    ku_assert_equal("Found hi", sched_prio_map_first(&pm, 0), hi);
+    ku_assert_equal("Found mid after hi",
+                    sched_prio_map_first(&pm, hi + 1), mid);
+    ku_assert_equal("Found lo after mid",
+                    sched_prio_map_first(&pm, mid + 1), lo);
+    ku_assert_equal("Nothing after lo",
+                    sched_prio_map_first(&pm, lo + 1), -1);
+
+    sched_prio_map_clear(&pm, mid);
+    ku_assert_equal("Found lo after hi",
+                    sched_prio_map_first(&pm, hi + 1), lo);
+
+    return NULL;
+}
+
+static char * test_prio2idx_range(void)
+{
+    ku_test_description("Test that out of range priorities are clamped.");
+
+    ku_assert_equal("Clamped to NICE_MIN", sched_prio2idx(NICE_MIN - 5), 0);
+    ku_assert_equal("Clamped to NICE_MAX", sched_prio2idx(NICE_MAX + 5),
+                    SCHED_NR_PRIO - 1);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_prio_map_empty, KU_RUN);
+    ku_def_test(test_prio_map_order, KU_RUN);
+    ku_def_test(test_prio2idx_range, KU_RUN);
+}
+
+TEST_MODULE(sched, prio_map);
@@ -0,0 +1,131 @@
+/**
+ * @file test_timers.c
+ * @brief Test kernel timers.
+ */
+
+#include <hal/hw_timers.h>
+#include <kunit.h>
+#include <thread.h>
+#include <timers.h>
+
+#define NR_GROW_TIMERS (configTIMERS_MAX + 16)
+
+static int fired[3];
+static int nr_fired;
+static int grow_timers[NR_GROW_TIMERS];
+
+static void setup(void)
+{
+    nr_fired = 0;
+}
+
+static void teardown(void)
+{
+}
+
+static void record_event(void * arg)
+{
+    if (nr_fired < (int)num_elem(fired))
+        fired[nr_fired] = (int)arg;
+    nr_fired++;
+}
+
+static char * test_timers_order(void)
+{
+    static const uint64_t delay[] = { 30000, 10000, 20000 };
+    int tim[num_elem(delay)];
+
+    ku_test_description("Test that timers fire in expiration order.");
+
+    for (size_t i = 0; i < num_elem(delay); i++) {
+        tim[i] = timers_add(record_event, (void *)i,
+                            TIMERS_FLAG_ONESHOT | TIMERS_FLAG_ENABLED,
+                            delay[i]);
+        ku_assert("Timer allocated", tim[i] >= 0);
+    }
+
+    thread_sleep(100);
+
+    for (size_t i = 0; i < num_elem(delay); i++) {
+        timers_release(tim[i]);
+    }
+
+    ku_assert_equal("All timers fired once", nr_fired, 3);
+    ku_assert_equal("First", fired[0], 1);
+    ku_assert_equal("Second", fired[1], 2);
+    ku_assert_equal("Third", fired[2], 0);
+
+    return NULL;
+}
+
+static char * test_timers_stop(void)
+{
+    int tim;
+
+    ku_test_description("Test that a stopped timer doesn't fire.");
+
+    tim = timers_add(record_event, NULL,
+                     TIMERS_FLAG_ONESHOT | TIMERS_FLAG_ENABLED, 10000);
+    ku_assert("Timer allocated", tim >= 0);
+    timers_stop(tim);
+
+    thread_sleep(30);
+    timers_release(tim);
+
+    ku_assert_equal("Timer didn't fire", nr_fired, 0);
+
+    return NULL;
+}
+
+static char * test_timers_next_expiry(void)
+{
+    uint64_t expires;
+    int tim;
+
+    ku_test_description("Test that timers_next_expiry() sees a new timer.");
+
+    tim = timers_add(record_event, NULL,
+                     TIMERS_FLAG_ONESHOT | TIMERS_FLAG_ENABLED, 10000000);
+    ku_assert("Timer allocated", tim >= 0);
+
+    expires = timers_next_expiry();
+    timers_release(tim);
+
+    ku_assert("Next expiry is set", expires != UINT64_MAX);
+    ku_assert("Next expiry is before the new timer",
+              expires <= get_utime() + 10000000);
+
+    return NULL;
+}
+
+static char * test_timers_grow(void)
+{
+    int err = 0;
+
+    ku_test_description("Test that more than configTIMERS_MAX timers can be allocated.");
+
+    for (size_t i = 0; i < NR_GROW_TIMERS; i++) {
+        grow_timers[i] = timers_add(record_event, NULL,
+                                    TIMERS_FLAG_ONESHOT, 1000);
+        if (grow_timers[i] < 0)
+            err = 1;
+    }
+
+    for (size_t i = 0; i < NR_GROW_TIMERS; i++) {
+        timers_release(grow_timers[i]);
+    }
+
+    ku_assert_equal("All timers allocated", err, 0);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_timers_order, KU_RUN);
+    ku_def_test(test_timers_stop, KU_RUN);
+    ku_def_test(test_timers_next_expiry, KU_RUN);
+    ku_def_test(test_timers_grow, KU_RUN);
+}
+
+TEST_MODULE(sched, timers);
@@ -0,0 +1,87 @@
+/**
+ * @file test_waitq.c
+ * @brief Test wait queues.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <kunit.h>
+#include <thread.h>
+#include <waitq.h>
+
+static struct waitq wq;
+static mtx_t wq_lock;
+static int wq_cond;
+
+static void setup(void)
+{
+    waitq_init(&wq);
+    mtx_init(&wq_lock, MTX_TYPE_TICKET, 0);
+    wq_cond = 0;
+}
+
+static void teardown(void)
+{
+}
+
+static void * waker_thread(void * arg)
+{
+    thread_sleep(10);
+
+    mtx_lock(&wq_lock);
+    wq_cond = 1;
+    waitq_wakeup_all(&wq);
+    mtx_unlock(&wq_lock);
+
+    return NULL;
+}
+
+static char * test_waitq_timeout(void)
+{
+    int err;
+
+    ku_test_description("Test that waitq_sleep() times out.");
+
+    mtx_lock(&wq_lock);
+    err = waitq_sleep(&wq, &wq_lock, 10);
+    mtx_unlock(&wq_lock);
+
+    ku_assert_equal("Timed out", err, -ETIMEDOUT);
+    ku_assert("Wait queue is empty", waitq_empty(&wq));
+
+    return NULL;
+}
+
+static char * test_waitq_wakeup(void)
+{
+    struct sched_param param = {
+        .sched_policy = SCHED_OTHER,
+        .sched_priority = NZERO,
+    };
+    pthread_t tid;
+    int err = 0;
+
+    ku_test_description("Test that a sleeping thread is woken up.");
+
+    tid = kthread_create("waitq_test", &param, 0, waker_thread, NULL);
+    ku_assert("Thread created", tid > 0);
+
+    mtx_lock(&wq_lock);
+    while (!wq_cond && !err) {
+        err = waitq_sleep(&wq, &wq_lock, 1000);
+    }
+    mtx_unlock(&wq_lock);
+
+    ku_assert_equal("Woken up", err, 0);
+    ku_assert("Condition set", wq_cond);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_waitq_timeout, KU_RUN);
+    ku_def_test(test_waitq_wakeup, KU_RUN);
+}
+
+TEST_MODULE(sched, waitq);
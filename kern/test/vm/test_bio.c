@@ -3,12 +3,29 @@
  * @brief Test buffered IO.
  */
 
+#include <errno.h>
 #include <fcntl.h>
+#include <machine/atomic.h>
+#include <sys/stat.h>
+#include <sys/sysctl.h>
 #include <buf.h>
 #include <fs/fs.h>
+#include <fs/fs_util.h>
+#include <hal/hw_timers.h>
+#include <kstring.h>
 #include <kunit.h>
 #include <libkern.h>
 #include <proc.h>
+#include <thread.h>
+
+#define BENCH_NR_THREADS    4
+#define BENCH_NR_BLOCKS     8
+#define BENCH_ITERATIONS    1000
+
+static vnode_t bench_vnodes[2];
+static atomic_t bench_running;
+static atomic_t conc_holders[BENCH_NR_BLOCKS]; /* Threads holding a block. */
+static atomic_t conc_errors;
 
 static void setup(void)
 {
@@ -89,11 +106,444 @@ static char * test_bread(void)
     return NULL;
 }
 
+static void * bench_reader_thread(void * arg)
+{
+    vnode_t * vn = (vnode_t *)arg;
+
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        struct buf * bp;
+
+        bp = getblk(vn, i % BENCH_NR_BLOCKS, 4096, 0);
+        if (bp)
+            brelse(bp);
+    }
+
+    atomic_dec(&bench_running);
+
+    return NULL;
+}
+
+static void * conc_getblk_thread(void * arg)
+{
+    vnode_t * vn = (vnode_t *)arg;
+
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        const size_t blkno = i % BENCH_NR_BLOCKS;
+        struct buf * bp;
+
+        bp = getblk(vn, blkno, 4096, 0);
+        if (!bp) {
+            atomic_inc(&conc_errors);
+            continue;
+        }
+
+        /* Only one thread can have the buffer at a time. */
+        if (atomic_inc(&conc_holders[blkno]) != 0)
+            atomic_inc(&conc_errors);
+        if (bp->b_blkno != blkno || bp->b_file.vnode != vn ||
+            !(bp->b_flags & B_BUSY))
+            atomic_inc(&conc_errors);
+        atomic_dec(&conc_holders[blkno]);
+
+        brelse(bp);
+    }
+
+    atomic_dec(&bench_running);
+
+    return NULL;
+}
+
+static char * test_getblk_concurrent(void)
+{
+    struct sched_param param = {
+        .sched_policy = SCHED_OTHER,
+        .sched_priority = NZERO,
+    };
+    vnode_t vn;
+    struct buf * bufs[BENCH_NR_BLOCKS];
+
+    ku_test_description("Test that concurrent getblk() calls for the same "
+                        "blocks return consistent buffers.");
+
+    memset(&vn, 0, sizeof(vn));
+    fs_vnode_init(&vn, 0, NULL, &nofs_vnode_ops);
+    vn.vn_mode = S_IFCHR;
+    atomic_set(&conc_errors, 0);
+
+    atomic_set(&bench_running, BENCH_NR_THREADS);
+    for (int i = 0; i < BENCH_NR_THREADS; i++) {
+        pthread_t tid;
+
+        tid = kthread_create("bio_conc", &param, 0, conc_getblk_thread, &vn);
+        if (tid < 0)
+            atomic_dec(&bench_running);
+    }
+    while (atomic_read(&bench_running) > 0) {
+        thread_yield(THREAD_YIELD_LAZY);
+    }
+
+    ku_assert_equal("No errors in the threads", atomic_read(&conc_errors), 0);
+
+    for (size_t i = 0; i < BENCH_NR_BLOCKS; i++) {
+        struct buf * bp = incore(&vn, i);
+
+        ku_assert("Buffer is in core", bp);
+        ku_assert_equal("Block number is correct", bp->b_blkno, i);
+        ku_assert("Buffer is released", !(bp->b_flags & B_BUSY));
+        ku_assert_equal("Only the cache holds a reference",
+                        kobj_refcnt(&bp->b_obj), 1);
+        for (size_t j = 0; j < i; j++) {
+            ku_assert("Buffers are distinct", bufs[j] != bp);
+        }
+        bufs[i] = bp;
+    }
+
+    bio_vnode_cleanup(&vn);
+
+    return NULL;
+}
+
+static char * test_getblk_vnodes_parallel(void)
+{
+    struct sched_param param = {
+        .sched_policy = SCHED_OTHER,
+        .sched_priority = NZERO,
+    };
+    vnode_t * const locked_vn = &bench_vnodes[0];
+    vnode_t * const vn = &bench_vnodes[1];
+    const uint64_t timeout = 1000000; /* usec */
+    uint64_t start;
+    pthread_t tid;
+    int running;
+
+    ku_test_description("Test that getblk() on a vnode doesn't wait for "
+                        "another vnode.");
+
+    for (int i = 0; i < 2; i++) {
+        fs_vnode_init(&bench_vnodes[i], i, NULL, &nofs_vnode_ops);
+        bench_vnodes[i].vn_mode = S_IFCHR;
+
+        for (size_t blkno = 0; blkno < BENCH_NR_BLOCKS; blkno++) {
+            struct buf * bp;
+
+            bp = getblk(&bench_vnodes[i], blkno, 4096, 0);
+            ku_assert("got a buffer", bp);
+            brelse(bp);
+        }
+    }
+
+    /*
+     * A reader of vn must be able to complete all of its lookups while
+     * locked_vn is held, i.e. the lookups don't serialise on a lock shared
+     * between the files.
+     */
+    VN_LOCK(locked_vn);
+    atomic_set(&bench_running, 1);
+    tid = kthread_create("bio_par", &param, 0, bench_reader_thread, vn);
+    if (tid < 0)
+        atomic_set(&bench_running, 0);
+    start = get_utime();
+    while ((running = atomic_read(&bench_running)) > 0 &&
+           get_utime() - start < timeout) {
+        thread_yield(THREAD_YIELD_LAZY);
+    }
+    VN_UNLOCK(locked_vn);
+
+    ku_assert("Reader thread was created", tid >= 0);
+    ku_assert_equal("Reader completed while the other vnode was locked",
+                    running, 0);
+
+    while (atomic_read(&bench_running) > 0) {
+        thread_yield(THREAD_YIELD_LAZY);
+    }
+    for (int i = 0; i < 2; i++) {
+        bio_vnode_cleanup(&bench_vnodes[i]);
+    }
+
+    return NULL;
+}
+
+static char * test_vnode_cleanup(void)
+{
+    vnode_t vn;
+
+    ku_test_description("Test that bio_vnode_cleanup() frees all buffers of "
+                        "a vnode.");
+
+    memset(&vn, 0, sizeof(vn));
+    fs_vnode_init(&vn, 0, NULL, &nofs_vnode_ops);
+    vn.vn_mode = S_IFCHR;
+
+    for (size_t i = 0; i < BENCH_NR_BLOCKS; i++) {
+        struct buf * bp;
+
+        bp = getblk(&vn, i * 4096, 4096, 0);
+        ku_assert("got a buffer", bp);
+        brelse(bp);
+    }
+    ku_assert("Buffer is in core", incore(&vn, 0));
+
+    bio_vnode_cleanup(&vn);
+
+    for (size_t i = 0; i < BENCH_NR_BLOCKS; i++) {
+        ku_assert("Buffer was freed", !incore(&vn, i * 4096));
+    }
+
+    return NULL;
+}
+
+static char * test_bread_ra_window(void)
+{
+    vnode_t vn;
+    struct file_ra ra = { 0 };
+    struct buf * bp;
+
+    ku_test_description("Test that bread_ra() grows the read-ahead window on "
+                        "sequential access and resets it on random access.");
+
+    memset(&vn, 0, sizeof(vn));
+    fs_vnode_init(&vn, 0, NULL, &nofs_vnode_ops);
+    vn.vn_mode = S_IFCHR;
+
+    for (size_t i = 0; i < 4; i++) {
+        bp = NULL;
+        (void)bread_ra(&vn, &ra, i, 512, 0, &bp);
+        if (bp)
+            brelse(bp);
+    }
+    ku_assert_equal("Window grows", (int)ra.ra_win, 8);
+    ku_assert_equal("Next block", (int)ra.ra_next, 4);
+
+    bp = NULL;
+    (void)bread_ra(&vn, &ra, 100, 512, 0, &bp);
+    if (bp)
+        brelse(bp);
+    ku_assert_equal("Window is reset", (int)ra.ra_win, 0);
+
+    bio_vnode_cleanup(&vn);
+
+    return NULL;
+}
+
+static int sync_nwrites;
+static int sync_write_err;
+
+static off_t sync_lseek(file_t * file, off_t offset, int whence)
+{
+    file->seek_pos = offset;
+    return offset;
+}
+
+static ssize_t sync_write(file_t * file, struct uio * uio, size_t bcount)
+{
+    if (sync_write_err)
+        return sync_write_err;
+
+    sync_nwrites++;
+    return bcount;
+}
+
+static void sync_vnode_init(vnode_t * vn, struct vnode_ops * vnops)
+{
+    *vnops = nofs_vnode_ops;
+    vnops->lseek = sync_lseek;
+    vnops->write = sync_write;
+    memset(vn, 0, sizeof(*vn));
+    fs_vnode_init(vn, 0, NULL, vnops);
+    vn->vn_mode = S_IFCHR;
+    sync_nwrites = 0;
+    sync_write_err = 0;
+}
+
+static char * test_vnode_sync(void)
+{
+    struct vnode_ops vnops;
+    vnode_t vn;
+
+    ku_test_description("Test that bio_vnode_sync() writes out delayed "
+                        "writes and keeps the buffers in the cache.");
+
+    sync_vnode_init(&vn, &vnops);
+
+    for (size_t i = 0; i < BENCH_NR_BLOCKS; i++) {
+        struct buf * bp;
+
+        bp = getblk(&vn, i * 4096, 4096, 0);
+        ku_assert("got a buffer", bp);
+        bdwrite(bp);
+    }
+    ku_assert_equal("Nothing written yet", sync_nwrites, 0);
+
+    ku_assert_equal("Sync succeeds", bio_vnode_sync(&vn), 0);
+    ku_assert("Buffers were written", sync_nwrites > 0);
+    ku_assert("Buffer is still in core", incore(&vn, 0));
+    ku_assert("Buffer is clean", !(incore(&vn, 0)->b_flags & B_DELWRI));
+
+    sync_nwrites = 0;
+    ku_assert_equal("Second sync succeeds", bio_vnode_sync(&vn), 0);
+    ku_assert_equal("Nothing to write", sync_nwrites, 0);
+
+    bio_vnode_cleanup(&vn);
+
+    return NULL;
+}
+
+static void * sync_release_thread(void * arg)
+{
+    thread_sleep(20);
+    brelse((struct buf *)arg);
+
+    return NULL;
+}
+
+static char * test_vnode_sync_busy(void)
+{
+    struct sched_param param = {
+        .sched_policy = SCHED_OTHER,
+        .sched_priority = NZERO,
+    };
+    struct vnode_ops vnops;
+    vnode_t vn;
+    struct buf * bp;
+    pthread_t tid;
+
+    ku_test_description("Test that bio_vnode_sync() waits for busy dirty "
+                        "buffers.");
+
+    sync_vnode_init(&vn, &vnops);
+
+    bp = getblk(&vn, 0, 4096, 0);
+    ku_assert("got a buffer", bp);
+    bdwrite(bp);
+
+    /* Keep the dirty buffer busy for a while. */
+    bp = getblk(&vn, 0, 4096, 0);
+    ku_assert("got the buffer again", bp);
+    tid = kthread_create("bio_sync_test", &param, 0, sync_release_thread, bp);
+    ku_assert("thread created", tid >= 0);
+
+    ku_assert_equal("Sync succeeds", bio_vnode_sync(&vn), 0);
+    ku_assert_equal("Busy buffer was written", sync_nwrites, 1);
+    ku_assert("Buffer is clean", !(incore(&vn, 0)->b_flags & B_DELWRI));
+
+    bio_vnode_cleanup(&vn);
+
+    return NULL;
+}
+
+static char * test_vnode_sync_error(void)
+{
+    struct vnode_ops vnops;
+    vnode_t vn;
+    struct buf * bp;
+
+    ku_test_description("Test that a failed write keeps the buffer dirty.");
+
+    sync_vnode_init(&vn, &vnops);
+
+    bp = getblk(&vn, 0, 4096, 0);
+    ku_assert("got a buffer", bp);
+    bdwrite(bp);
+
+    sync_write_err = -EIO;
+    ku_assert_equal("Sync fails", bio_vnode_sync(&vn), -EIO);
+    ku_assert("Buffer is still dirty", incore(&vn, 0)->b_flags & B_DELWRI);
+
+    sync_write_err = 0;
+    ku_assert_equal("Sync succeeds", bio_vnode_sync(&vn), 0);
+    ku_assert_equal("Buffer was written", sync_nwrites, 1);
+    ku_assert("Buffer is clean", !(incore(&vn, 0)->b_flags & B_DELWRI));
+
+    bio_vnode_cleanup(&vn);
+
+    return NULL;
+}
+
+static char * test_vnode_cleanup_dirty(void)
+{
+    struct vnode_ops vnops;
+    vnode_t vn;
+
+    ku_test_description("Test that dirty buffers are written before they are "
+                        "freed.");
+
+    sync_vnode_init(&vn, &vnops);
+
+    for (size_t i = 0; i < BENCH_NR_BLOCKS; i++) {
+        struct buf * bp;
+
+        bp = getblk(&vn, i * 4096, 4096, 0);
+        ku_assert("got a buffer", bp);
+        bdwrite(bp);
+    }
+    ku_assert_equal("Nothing written yet", sync_nwrites, 0);
+
+    bio_vnode_cleanup(&vn);
+    ku_assert_equal("All buffers were written", sync_nwrites, BENCH_NR_BLOCKS);
+
+    return NULL;
+}
+
+static int bio_sysctl_int(char * name, int value)
+{
+    int old;
+    size_t oldlen = sizeof(old);
+
+    if (kernel_sysctlbyname(NULL, name, &old, &oldlen, &value, sizeof(value),
+                            NULL, 0))
+        return -1;
+    return old;
+}
+
+static char * test_flusher(void)
+{
+    struct vnode_ops vnops;
+    vnode_t vn;
+    struct buf * bp;
+    int old_age, old_period;
+
+    ku_test_description("Test that the flusher writes back dirty buffers.");
+
+    sync_vnode_init(&vn, &vnops);
+
+    old_age = bio_sysctl_int("vfs.bio.dirty_age", 0);
+    ku_assert("dirty_age set", old_age >= 0);
+    old_period = bio_sysctl_int("vfs.bio.flush_period", 10);
+    ku_assert("flush_period set", old_period >= 0);
+
+    bp = getblk(&vn, 0, 4096, 0);
+    ku_assert("got a buffer", bp);
+    bdwrite(bp);
+
+    for (int i = 0; i < 100 && (incore(&vn, 0)->b_flags & B_DELWRI); i++) {
+        thread_sleep(20);
+    }
+
+    (void)bio_sysctl_int("vfs.bio.dirty_age", old_age);
+    (void)bio_sysctl_int("vfs.bio.flush_period", old_period);
+
+    ku_assert_equal("Buffer was written", sync_nwrites, 1);
+    ku_assert("Buffer is clean", !(incore(&vn, 0)->b_flags & B_DELWRI));
+
+    bio_vnode_cleanup(&vn);
+
+    return NULL;
+}
+
 static void all_tests(void)
 {
     ku_def_test(test_geteblk, KU_RUN);
     ku_def_test(test_getblk, KU_RUN);
     ku_def_test(test_bread, KU_SKIP);
+    ku_def_test(test_getblk_concurrent, KU_RUN);
+    ku_def_test(test_getblk_vnodes_parallel, KU_RUN);
+    ku_def_test(test_vnode_cleanup, KU_RUN);
+    ku_def_test(test_bread_ra_window, KU_RUN);
+    ku_def_test(test_vnode_sync, KU_RUN);
+    ku_def_test(test_vnode_sync_busy, KU_RUN);
+    ku_def_test(test_vnode_sync_error, KU_RUN);
+    ku_def_test(test_vnode_cleanup_dirty, KU_RUN);
+    ku_def_test(test_flusher, KU_RUN);
 }
 
 TEST_MODULE(vm, bio);
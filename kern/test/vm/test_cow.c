@@ -0,0 +1,190 @@
+/**
+ * @file test_cow.c
+ * @brief Test page-granular copy-on-write of vralloc regions.
+ */
+
+#include <errno.h>
+#include <buf.h>
+#include <kstring.h>
+#include <kunit.h>
+#include <vm/vm.h>
+
+#define TEST_VADDR  0x10000000
+#define TEST_PAGES  3
+
+static struct buf * region;
+
+static void setup(void)
+{
+    region = geteblk(TEST_PAGES * MMU_PGSIZE_COARSE);
+    if (!region)
+        return;
+
+    region->b_mmu.vaddr = TEST_VADDR;
+    for (int i = 0; i < TEST_PAGES; i++) {
+        memset((void *)(region->b_data + i * MMU_PGSIZE_COARSE), i + 1,
+               MMU_PGSIZE_COARSE);
+    }
+}
+
+static void teardown(void)
+{
+    if (region)
+        vrfree(region);
+}
+
+static char * test_rpclone_single_page(void)
+{
+    struct buf * clone;
+    uint8_t * p;
+
+    ku_test_description("Test that a COW fault copies only the faulting page.");
+
+    ku_assert("Region was allocated", region);
+    ku_assert("rpclone is supported", region->vm_ops->rpclone);
+
+    /* Simulate a region shared by two processes. */
+    region->vm_ops->rref(region);
+    region->b_uflags |= VM_PROT_COW;
+
+    clone = region->vm_ops->rpclone(region);
+    ku_assert("Got a clone", clone);
+    ku_assert("Clone is a new region", clone != region);
+    ku_assert("Clone is not COW", !(clone->b_uflags & VM_PROT_COW));
+    ku_assert("Clone shares pages", clone->b_cow);
+
+    ku_assert_equal("Page was copied",
+                    clone->vm_ops->rpfault(clone,
+                                           TEST_VADDR + MMU_PGSIZE_COARSE,
+                                           NULL), 0);
+    ku_assert_equal("Page is already private",
+                    clone->vm_ops->rpfault(clone,
+                                           TEST_VADDR + MMU_PGSIZE_COARSE + 8,
+                                           NULL), -ENOENT);
+
+    p = (uint8_t *)(clone->b_data + MMU_PGSIZE_COARSE);
+    ku_assert_equal("Data was copied", p[0], 2);
+    ku_assert_equal("Data was copied", p[MMU_PGSIZE_COARSE - 1], 2);
+
+    ku_assert_equal("Populate succeeds", vm_populate_region(clone), 0);
+    for (int i = 0; i < TEST_PAGES; i++) {
+        p = (uint8_t *)(clone->b_data + i * MMU_PGSIZE_COARSE);
+        ku_assert_equal("All pages were copied", p[0], i + 1);
+    }
+
+    vrfree(clone);
+    vrfree(region);
+
+    return NULL;
+}
+
+static char * test_rpclone_lazy_clone(void)
+{
+    struct buf * clone;
+    struct buf * clone2;
+    uint8_t * p;
+
+    ku_test_description("Test that a shared lazy clone is cloned lazily "
+                        "from the right sources.");
+
+    ku_assert("Region was allocated", region);
+
+    region->vm_ops->rref(region);
+    region->b_uflags |= VM_PROT_COW;
+    clone = region->vm_ops->rpclone(region);
+    ku_assert("Got a clone", clone);
+
+    /* Make the second page private to the first clone. */
+    ku_assert_equal("Page was copied",
+                    clone->vm_ops->rpfault(clone,
+                                           TEST_VADDR + MMU_PGSIZE_COARSE,
+                                           NULL), 0);
+    memset((void *)(clone->b_data + MMU_PGSIZE_COARSE), 0x55,
+           MMU_PGSIZE_COARSE);
+
+    /* Share the first clone as in fork. */
+    clone->vm_ops->rref(clone);
+    clone->b_uflags |= VM_PROT_COW;
+    clone2 = clone->vm_ops->rpclone(clone);
+    ku_assert("Got a second clone", clone2);
+    ku_assert("Second clone is lazy", clone2->b_cow);
+
+    ku_assert_equal("Populate succeeds", vm_populate_region(clone2), 0);
+    p = (uint8_t *)clone2->b_data;
+    ku_assert_equal("First page from the original region", p[0], 1);
+    ku_assert_equal("Second page from the first clone",
+                    p[MMU_PGSIZE_COARSE], 0x55);
+    ku_assert_equal("Third page from the original region",
+                    p[2 * MMU_PGSIZE_COARSE], 3);
+
+    vrfree(clone2);
+    vrfree(clone);
+    vrfree(clone);
+    vrfree(region);
+
+    return NULL;
+}
+
+static char * test_allocbuf_detach(void)
+{
+    struct buf * clone;
+    int refcnt;
+    uint8_t * p;
+
+    ku_test_description("Test that allocbuf() releases the COW source region.");
+
+    ku_assert("Region was allocated", region);
+
+    region->vm_ops->rref(region);
+    region->b_uflags |= VM_PROT_COW;
+
+    clone = region->vm_ops->rpclone(region);
+    ku_assert("Got a clone", clone && clone != region);
+    ku_assert("Clone shares pages", clone->b_cow);
+    refcnt = atomic_read(&region->b_obj.ko_refcount);
+
+    allocbuf(clone, (TEST_PAGES + 1) * MMU_PGSIZE_COARSE);
+    ku_assert("COW state was detached", !clone->b_cow);
+    ku_assert_equal("Source region was released",
+                    atomic_read(&region->b_obj.ko_refcount), refcnt - 1);
+    for (int i = 0; i < TEST_PAGES; i++) {
+        p = (uint8_t *)(clone->b_data + i * MMU_PGSIZE_COARSE);
+        ku_assert_equal("All pages were copied", p[0], i + 1);
+    }
+
+    vrfree(clone);
+    vrfree(region);
+
+    return NULL;
+}
+
+static char * test_rpclone_sole_owner(void)
+{
+    struct buf * clone;
+
+    ku_test_description("Test that an unshared COW region is reused.");
+
+    ku_assert("Region was allocated", region);
+
+    region->b_uflags |= VM_PROT_COW;
+
+    clone = region->vm_ops->rpclone(region);
+    ku_assert_ptr_equal("Region was reused", clone, region);
+    ku_assert("COW was cleared", !(region->b_uflags & VM_PROT_COW));
+    ku_assert("No pages are shared", !region->b_cow);
+
+    /* rpclone() took a ref for the caller. */
+    vrfree(clone);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_rpclone_single_page, KU_RUN);
+    ku_def_test(test_rpclone_lazy_clone, KU_RUN);
+    ku_def_test(test_allocbuf_detach, KU_RUN);
+    ku_def_test(test_rpclone_sole_owner, KU_RUN);
+}
+
+TEST_MODULE(vm, cow);
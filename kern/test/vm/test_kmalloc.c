@@ -0,0 +1,109 @@
+/**
+ * @file test_kmalloc.c
+ * @brief Test kmalloc.
+ */
+
+#include <kmalloc.h>
+#include <kstring.h>
+#include <kunit.h>
+
+static void setup(void)
+{
+    /* Intentionally unimplemented... */
+}
+
+static void teardown(void)
+{
+    /* Intentionally unimplemented... */
+}
+
+static char * test_kmalloc_sizes(void)
+{
+    static const size_t sizes[] = { 1, 16, 17, 100, 512, 2048, 2049, 8192 };
+    void * p[num_elem(sizes)];
+
+    ku_test_description("Test that kmalloc() returns usable blocks of various sizes.");
+
+    for (size_t i = 0; i < num_elem(sizes); i++) {
+        p[i] = kmalloc(sizes[i]);
+        ku_assert("Got a block", p[i]);
+        memset(p[i], (int)i, sizes[i]);
+    }
+
+    for (size_t i = 0; i < num_elem(sizes); i++) {
+        ku_assert_equal("Block wasn't overwritten",
+                        ((uint8_t *)p[i])[sizes[i] - 1], (uint8_t)i);
+        kfree(p[i]);
+    }
+
+    return NULL;
+}
+
+static char * test_kmalloc_small_reuse(void)
+{
+    void * p1;
+    void * p2;
+
+    ku_test_description("Test that a freed small block is reused.");
+
+    p1 = kmalloc(32);
+    ku_assert("Got a block", p1);
+    kfree(p1);
+    p2 = kmalloc(32);
+    ku_assert_ptr_equal("Same block was returned", p2, p1);
+    kfree(p2);
+
+    return NULL;
+}
+
+static char * test_kpalloc(void)
+{
+    void * p1;
+    void * p2;
+
+    ku_test_description("Test that kpalloc() keeps a small block allocated.");
+
+    p1 = kmalloc(64);
+    ku_assert("Got a block", p1);
+    kpalloc(p1);
+    kfree(p1);
+
+    p2 = kmalloc(64);
+    ku_assert("Block is still referenced", p2 != p1);
+
+    kfree(p2);
+    kfree(p1);
+
+    return NULL;
+}
+
+static char * test_krealloc_small(void)
+{
+    uint8_t * p;
+
+    ku_test_description("Test that krealloc() can grow a small block.");
+
+    p = kmalloc(16);
+    ku_assert("Got a block", p);
+    memset(p, 0xa5, 16);
+
+    p = krealloc(p, 4096);
+    ku_assert("Got a new block", p);
+    for (size_t i = 0; i < 16; i++) {
+        ku_assert_equal("Data was copied", p[i], 0xa5);
+    }
+
+    kfree(p);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_kmalloc_sizes, KU_RUN);
+    ku_def_test(test_kmalloc_small_reuse, KU_RUN);
+    ku_def_test(test_kpalloc, KU_RUN);
+    ku_def_test(test_krealloc_small, KU_RUN);
+}
+
+TEST_MODULE(vm, kmalloc);
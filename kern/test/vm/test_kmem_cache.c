@@ -0,0 +1,185 @@
+/**
+ * @file test_kmem_cache.c
+ * @brief Test object caches.
+ */
+
+#include <kmalloc.h>
+#include <kmem_cache.h>
+#include <kstring.h>
+#include <kunit.h>
+
+#define TEST_OBJ_SIZE   48
+#define TEST_MAX_FREE   2
+
+static struct kmem_cache * cache;
+static int nr_ctor;
+static int nr_dtor;
+
+static void test_ctor(void * obj)
+{
+    memset(obj, 0x5a, TEST_OBJ_SIZE);
+    nr_ctor++;
+}
+
+static void test_dtor(void * obj)
+{
+    nr_dtor++;
+}
+
+static void setup(void)
+{
+    cache = kmem_cache_create("test", TEST_OBJ_SIZE, TEST_MAX_FREE,
+                              NULL, NULL);
+    nr_ctor = 0;
+    nr_dtor = 0;
+}
+
+static void teardown(void)
+{
+    kmem_cache_destroy(cache);
+    cache = NULL;
+}
+
+static char * test_alloc_reuse(void)
+{
+    void * p1;
+    void * p2;
+
+    ku_test_description("Test that a freed object is reused.");
+
+    ku_assert("Cache was created", cache);
+
+    p1 = kmem_cache_alloc(cache);
+    ku_assert("Got an object", p1);
+    kmem_cache_free(cache, p1);
+    ku_assert_equal("Object was cached", cache->kc_nfree, 1);
+
+    p2 = kmem_cache_alloc(cache);
+    ku_assert_ptr_equal("Same object was returned", p2, p1);
+    ku_assert_equal("Cache is empty", cache->kc_nfree, 0);
+    kmem_cache_free(cache, p2);
+
+    return NULL;
+}
+
+static char * test_zalloc(void)
+{
+    uint8_t * p;
+
+    ku_test_description("Test that kmem_cache_zalloc() clears a cached object.");
+
+    p = kmem_cache_alloc(cache);
+    ku_assert("Got an object", p);
+    memset(p, 0xa5, TEST_OBJ_SIZE);
+    kmem_cache_free(cache, p);
+
+    p = kmem_cache_zalloc(cache);
+    ku_assert("Got an object", p);
+    for (size_t i = 0; i < TEST_OBJ_SIZE; i++) {
+        ku_assert_equal("Object was cleared", p[i], 0);
+    }
+    kmem_cache_free(cache, p);
+
+    return NULL;
+}
+
+static char * test_max_free(void)
+{
+    void * p[TEST_MAX_FREE + 1];
+
+    ku_test_description("Test that the cache keeps at most max_free objects.");
+
+    for (size_t i = 0; i < num_elem(p); i++) {
+        p[i] = kmem_cache_alloc(cache);
+        ku_assert("Got an object", p[i]);
+    }
+    for (size_t i = 0; i < num_elem(p); i++) {
+        kmem_cache_free(cache, p[i]);
+    }
+    ku_assert_equal("Cache is full", cache->kc_nfree, TEST_MAX_FREE);
+
+    kmem_cache_reclaim(cache);
+    ku_assert_equal("Cache was emptied", cache->kc_nfree, 0);
+
+    return NULL;
+}
+
+static char * test_ctor_dtor(void)
+{
+    struct kmem_cache * ccache;
+    uint8_t * p1;
+    uint8_t * p2;
+
+    ku_test_description("Test that the constructor and destructor are called only when an object enters or leaves the cache.");
+
+    ccache = kmem_cache_create("test_cdtor", TEST_OBJ_SIZE, 1,
+                               test_ctor, test_dtor);
+    ku_assert("Cache was created", ccache);
+
+    p1 = kmem_cache_alloc(ccache);
+    ku_assert("Got an object", p1);
+    ku_assert_equal("New object was constructed", nr_ctor, 1);
+    ku_assert_equal("Object is in constructed state", p1[0], 0x5a);
+
+    kmem_cache_free(ccache, p1);
+    ku_assert_equal("Cached object wasn't destructed", nr_dtor, 0);
+
+    p2 = kmem_cache_alloc(ccache);
+    ku_assert_ptr_equal("Cached object was reused", p2, p1);
+    ku_assert_equal("Cached object wasn't constructed again", nr_ctor, 1);
+
+    p1 = kmem_cache_alloc(ccache);
+    ku_assert("Got an object", p1);
+    ku_assert_equal("Second object was constructed", nr_ctor, 2);
+
+    kmem_cache_free(ccache, p1);
+    kmem_cache_free(ccache, p2);
+    ku_assert_equal("Object over max_free was destructed", nr_dtor, 1);
+
+    kmem_cache_destroy(ccache);
+    ku_assert_equal("Cached object was destructed on destroy", nr_dtor, 2);
+
+    return NULL;
+}
+
+static char * test_prealloc(void)
+{
+    ku_test_description("Test that kmem_cache_prealloc() fills the cache up to max_free.");
+
+    ku_assert_equal("Prealloc succeeds",
+                    kmem_cache_prealloc(cache, TEST_MAX_FREE + 1), 0);
+    ku_assert_equal("Cache is full", cache->kc_nfree, TEST_MAX_FREE);
+
+    return NULL;
+}
+
+static char * test_free_referenced(void)
+{
+    void * p;
+
+    ku_test_description("Test that a referenced object isn't cached.");
+
+    p = kmem_cache_alloc(cache);
+    ku_assert("Got an object", p);
+    kpalloc(p);
+
+    kmem_cache_free(cache, p);
+    ku_assert_equal("Object wasn't cached", cache->kc_nfree, 0);
+    ku_assert_equal("Reference was dropped", krefcnt(p), 1);
+
+    kfree(p);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_alloc_reuse, KU_RUN);
+    ku_def_test(test_zalloc, KU_RUN);
+    ku_def_test(test_max_free, KU_RUN);
+    ku_def_test(test_ctor_dtor, KU_RUN);
+    ku_def_test(test_prealloc, KU_RUN);
+    ku_def_test(test_free_referenced, KU_RUN);
+}
+
+TEST_MODULE(vm, kmem_cache);
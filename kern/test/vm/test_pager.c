@@ -0,0 +1,182 @@
+/**
+ * @file test_pager.c
+ * @brief Test demand paging of file backed vralloc regions.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <buf.h>
+#include <fs/fs.h>
+#include <kstring.h>
+#include <kunit.h>
+#include <uio.h>
+#include <vm/vm.h>
+
+#define TEST_VADDR  0x10000000
+#define TEST_DOFF   16
+#define TEST_FOFF   4
+#define TEST_FILESZ (MMU_PGSIZE_COARSE + 32)
+#define TEST_SIZE   (3 * MMU_PGSIZE_COARSE)
+
+static uint8_t file_data[TEST_FOFF + TEST_FILESZ];
+static int nreads;
+static vnode_t vnode;
+
+static off_t test_lseek(file_t * file, off_t offset, int whence)
+{
+    file->seek_pos = offset;
+    return offset;
+}
+
+static ssize_t test_read(file_t * file, struct uio * uio, size_t count)
+{
+    if (file->seek_pos + count > sizeof(file_data))
+        return -EINVAL;
+
+    nreads++;
+    if (uio_copyout(file_data + file->seek_pos, uio, 0, count))
+        return -EFAULT;
+    file->seek_pos += count;
+
+    return count;
+}
+
+static vnode_ops_t test_vnode_ops = {
+    .lseek = test_lseek,
+    .read = test_read,
+};
+
+static void setup(void)
+{
+    for (size_t i = 0; i < sizeof(file_data); i++) {
+        file_data[i] = (uint8_t)(i + 1);
+    }
+    nreads = 0;
+
+    memset(&vnode, 0, sizeof(vnode));
+    vrefset(&vnode, 1);
+    vnode.vnode_ops = &test_vnode_ops;
+}
+
+static void teardown(void)
+{
+    /* Intentionally unimplemented... */
+}
+
+static char * test_pagein_on_fault(void)
+{
+    struct buf * region;
+    uint8_t * p;
+
+    ku_test_description("Test that a page is read in on the first fault.");
+
+    region = geteblk_file(&vnode, TEST_FOFF, TEST_DOFF, TEST_FILESZ,
+                          TEST_SIZE);
+    ku_assert("Region was allocated", region);
+    ku_assert_equal("vnode was referenced", vrefcnt(&vnode), 2);
+    ku_assert_equal("Nothing was read", nreads, 0);
+
+    region->b_mmu.vaddr = TEST_VADDR;
+
+    ku_assert_equal("Page was read in",
+                    region->vm_ops->rpfault(region,
+                                            TEST_VADDR + MMU_PGSIZE_COARSE,
+                                            NULL), 0);
+    ku_assert_equal("One read", nreads, 1);
+    ku_assert_equal("Page is already in memory",
+                    region->vm_ops->rpfault(region,
+                                            TEST_VADDR + MMU_PGSIZE_COARSE + 8,
+                                            NULL), -ENOENT);
+    ku_assert_equal("No more reads", nreads, 1);
+
+    p = (uint8_t *)(region->b_data + MMU_PGSIZE_COARSE);
+    ku_assert_equal("Data was read",
+                    p[0], file_data[TEST_FOFF + MMU_PGSIZE_COARSE - TEST_DOFF]);
+    ku_assert_equal("Tail is zero filled",
+                    p[TEST_DOFF + TEST_FILESZ - MMU_PGSIZE_COARSE], 0);
+
+    vrfree(region);
+    ku_assert_equal("vnode was released", vrefcnt(&vnode), 1);
+
+    return NULL;
+}
+
+static char * test_populate(void)
+{
+    struct buf * region;
+    uint8_t * p;
+
+    ku_test_description("Test that populate reads in all the pages.");
+
+    region = geteblk_file(&vnode, TEST_FOFF, TEST_DOFF, TEST_FILESZ,
+                          TEST_SIZE);
+    ku_assert("Region was allocated", region);
+    region->b_mmu.vaddr = TEST_VADDR;
+
+    ku_assert_equal("Populate succeeds", vm_populate_region(region), 0);
+    ku_assert_equal("Two pages were read", nreads, 2);
+
+    p = (uint8_t *)region->b_data;
+    ku_assert_equal("Head is zero filled", p[TEST_DOFF - 1], 0);
+    ku_assert_equal("Data was read", p[TEST_DOFF], file_data[TEST_FOFF]);
+    p = (uint8_t *)(region->b_data + 2 * MMU_PGSIZE_COARSE);
+    ku_assert_equal("Page past the file is zero filled", p[0], 0);
+
+    vrfree(region);
+
+    return NULL;
+}
+
+static char * test_rpclone_paged(void)
+{
+    struct buf * region;
+    struct buf * clone;
+    uint8_t * p;
+
+    ku_test_description("Test that a lazy clone of a paged region reads in the file data on demand.");
+
+    region = geteblk_file(&vnode, TEST_FOFF, TEST_DOFF, TEST_FILESZ,
+                          TEST_SIZE);
+    ku_assert("Region was allocated", region);
+    region->b_mmu.vaddr = TEST_VADDR;
+
+    /* Simulate the reference held by the text cache. */
+    region->vm_ops->rref(region);
+
+    clone = region->vm_ops->rpclone(region);
+    ku_assert("Got a clone", clone);
+    ku_assert("Clone is a new region", clone != region);
+    ku_assert("Clone is not paged", !clone->b_pager);
+    ku_assert("Clone shares the pages", clone->b_cow);
+    ku_assert_equal("Nothing was read on clone", nreads, 0);
+
+    ku_assert_equal("Page was read in and copied",
+                    clone->vm_ops->rpfault(clone,
+                                           TEST_VADDR + MMU_PGSIZE_COARSE,
+                                           NULL), 0);
+    ku_assert_equal("Only the faulting page was read", nreads, 1);
+    p = (uint8_t *)(clone->b_data + MMU_PGSIZE_COARSE);
+    ku_assert_equal("Data was copied",
+                    p[0], file_data[TEST_FOFF + MMU_PGSIZE_COARSE - TEST_DOFF]);
+
+    ku_assert_equal("Populate succeeds", vm_populate_region(clone), 0);
+    ku_assert_equal("Remaining page with data was read", nreads, 2);
+    p = (uint8_t *)clone->b_data;
+    ku_assert_equal("Data was copied", p[TEST_DOFF], file_data[TEST_FOFF]);
+
+    vrfree(clone);
+    vrfree(region);
+    vrfree(region);
+    ku_assert_equal("vnode was released", vrefcnt(&vnode), 1);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_pagein_on_fault, KU_RUN);
+    ku_def_test(test_populate, KU_RUN);
+    ku_def_test(test_rpclone_paged, KU_RUN);
+}
+
+TEST_MODULE(vm, pager);
@@ -0,0 +1,109 @@
+/**
+ * @file test_regtree.c
+ * @brief Test the region interval tree.
+ */
+
+#include <buf.h>
+#include <kstring.h>
+#include <kunit.h>
+#include <vm/vm.h>
+
+#define TEST_NR_REGIONS 64
+#define TEST_BASE       0x10000000
+#define TEST_STRIDE     (4 * MMU_PGSIZE_COARSE)
+
+static const vm_ops_t test_vm_ops;
+static struct buf regions[TEST_NR_REGIONS];
+static struct vm_mm_struct mm;
+
+static void setup(void)
+{
+    memset(&mm, 0, sizeof(mm));
+    RB_INIT(&mm.regtree_head);
+
+    for (int i = 0; i < TEST_NR_REGIONS; i++) {
+        memset(&regions[i], 0, sizeof(struct buf));
+        regions[i].b_mmu.vaddr = TEST_BASE + i * TEST_STRIDE;
+        regions[i].b_bufsize = MMU_PGSIZE_COARSE;
+        regions[i].vm_ops = &test_vm_ops;
+    }
+}
+
+static void teardown(void)
+{
+    vm_mm_destroy(&mm);
+}
+
+static char * test_find(void)
+{
+    ku_test_description("Test that regions are found by an address.");
+
+    ku_assert_equal("Realloc succeeds", realloc_mm_regions(&mm, 4), 0);
+    for (int i = 0; i < TEST_NR_REGIONS; i++) {
+        if (i >= mm.nr_regions) {
+            /* Growing the array moves the tree nodes. */
+            ku_assert_equal("Realloc succeeds",
+                            realloc_mm_regions(&mm, mm.nr_regions * 2), 0);
+        }
+        vm_mm_set_region(&mm, i, &regions[i]);
+    }
+
+    for (int i = 0; i < TEST_NR_REGIONS; i++) {
+        const uintptr_t start = regions[i].b_mmu.vaddr;
+
+        ku_assert_equal("First address is found",
+                        vm_regtree_find(&mm, start, start), i);
+        ku_assert_equal("Last address is found",
+                        vm_regtree_find(&mm, start + MMU_PGSIZE_COARSE - 1,
+                                        start + MMU_PGSIZE_COARSE - 1), i);
+        ku_assert_equal("Gap is not found",
+                        vm_regtree_find(&mm, start + MMU_PGSIZE_COARSE,
+                                        start + MMU_PGSIZE_COARSE), -1);
+    }
+    ku_assert_equal("Address below all regions is not found",
+                    vm_regtree_find(&mm, 0, TEST_BASE - 1), -1);
+    ku_assert("A range covering several regions is found",
+              vm_regtree_find(&mm, 0, TEST_BASE + TEST_STRIDE) >= 0);
+
+    return NULL;
+}
+
+static char * test_replace(void)
+{
+    ku_test_description("Test that replaced regions are removed from the tree.");
+
+    ku_assert_equal("Realloc succeeds",
+                    realloc_mm_regions(&mm, TEST_NR_REGIONS), 0);
+    for (int i = 0; i < TEST_NR_REGIONS; i++) {
+        vm_mm_set_region(&mm, i, &regions[i]);
+    }
+
+    vm_mm_set_region(&mm, 5, NULL);
+    ku_assert_equal("Removed region is not found",
+                    vm_regtree_find(&mm, regions[5].b_mmu.vaddr,
+                                    regions[5].b_mmu.vaddr), -1);
+
+    /* A bigger region overlapping its neighbours. */
+    regions[5].b_bufsize = 3 * TEST_STRIDE;
+    vm_mm_set_region(&mm, 5, &regions[5]);
+    ku_assert_equal("Overlapping region is found",
+                    vm_regtree_find(&mm, regions[7].b_mmu.vaddr +
+                                         MMU_PGSIZE_COARSE,
+                                    regions[7].b_mmu.vaddr +
+                                    MMU_PGSIZE_COARSE), 5);
+
+    for (int i = 0; i < TEST_NR_REGIONS; i++) {
+        vm_mm_set_region(&mm, i, NULL);
+    }
+    ku_assert("Tree is empty", RB_EMPTY(&mm.regtree_head));
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_find, KU_RUN);
+    ku_def_test(test_replace, KU_RUN);
+}
+
+TEST_MODULE(vm, regtree);
@@ -0,0 +1,51 @@
+/**
+ * @file test_zpool.c
+ * @brief Test clearing of vralloc pages.
+ */
+
+#include <buf.h>
+#include <kstring.h>
+#include <kunit.h>
+
+#define TEST_PAGES  4
+
+static void setup(void)
+{
+    /* Intentionally unimplemented... */
+}
+
+static void teardown(void)
+{
+    /* Intentionally unimplemented... */
+}
+
+static char * test_geteblk_reused_pages_zeroed(void)
+{
+    struct buf * bp;
+    uint8_t * p;
+
+    ku_test_description("Test that geteblk() clears freed dirty pages.");
+
+    bp = geteblk(TEST_PAGES * MMU_PGSIZE_COARSE);
+    ku_assert("Got a buffer", bp);
+    memset((void *)bp->b_data, 0xa5, bp->b_bufsize);
+    vrfree(bp);
+
+    bp = geteblk(TEST_PAGES * MMU_PGSIZE_COARSE);
+    ku_assert("Got a buffer", bp);
+    p = (uint8_t *)bp->b_data;
+    for (size_t i = 0; i < bp->b_bufsize; i += 64) {
+        ku_assert_equal("Page is clear", p[i], 0);
+    }
+    ku_assert_equal("Page is clear", p[bp->b_bufsize - 1], 0);
+    vrfree(bp);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_geteblk_reused_pages_zeroed, KU_RUN);
+}
+
+TEST_MODULE(vm, zpool);
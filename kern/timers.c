@@ -34,127 +34,368 @@
 
 /* TODO MP version, per CPU timers */
 
+#include <errno.h>
 #include <sys/linker_set.h>
-#include <machine/atomic.h>
+#include <hal/core.h>
 #include <hal/hw_timers.h>
+#include <idle.h>
 #include <kinit.h>
+#include <klocks.h>
+#include <kmalloc.h>
 #include <ksched.h>
+#include <kstring.h>
 #include <thread.h>
 #include <timers.h>
 
 /** Timer allocation struct */
 struct timer_cb {
-    atomic_t flags;             /*!< Timer flags:
-                                 * + 0 = Timer state
+    timers_flags_t flags;       /*!< Timer flags:
+                                 * + 0 = Timer allocated
+                                 * + 1 = Timer state
                                  *     + 0 = disabled
                                  *     + 1 = enabled
-                                 * + 1 = Timer type
+                                 * + 2 = Timer type
                                  *     + 0 = one-shot
                                  *     + 1 = periodic
                                  */
+    int heap_idx;               /*!< Index in timers_heap or -1. */
+    int next_free;              /*!< Next free timer if not allocated. */
     void (*event_fn)(void *);   /*!< Event handler for the timer. */
     void * event_arg;           /*!< Argument for event handler. */
     uint64_t interval;          /*!< Timer interval. */
     uint64_t start;             /*!< Timer start value. */
+    uint64_t expires;           /*!< Expiration time, the heap key. */
 };
 
-static struct timer_cb timers_array[configTIMERS_MAX] = {
-    [0 ... (configTIMERS_MAX - 1)] = {
-        .flags = ATOMIC_INIT(0),
-        .event_fn = NULL,
-        .interval = 0,
-        .start = 0,
+/*
+ * The first configTIMERS_MAX timers are allocated statically, so timers can
+ * be used before kmalloc is ready. The arrays are doubled with kmalloc by an
+ * idle task when the number of free timers drops below the low watermark, so
+ * that timers_add() can be called with interrupts disabled.
+ */
+static struct timer_cb timers_static[configTIMERS_MAX];
+static int timers_heap_static[configTIMERS_MAX];
+
+static struct timer_cb * timers_array = timers_static;
+static int * timers_heap = timers_heap_static; /*!< Min-heap of enabled
+                                                *   timers by expiration. */
+static int timers_size = configTIMERS_MAX;
+static int timers_heap_len;
+static int timers_hwm;          /*!< Timers above this have never been used. */
+static int timers_free = -1;    /*!< Head of the list of released timers. */
+static int timers_nfree = configTIMERS_MAX; /*!< Number of free timers. */
+static mtx_t timers_lock = MTX_INITIALIZER(MTX_TYPE_SPIN, MTX_OPT_DINT);
+
+#define VALID_TIMER_ID(x) ((x) < timers_size && (x) >= 0)
+
+/**
+ * Low watermark of free timers.
+ * The timer pool is grown when there are less free timers left.
+ */
+#define TIMERS_LOW_WATERMARK() (timers_size / 4)
+
+static inline int timer_before(int a, int b)
+{
+    return timers_array[a].expires < timers_array[b].expires;
+}
+
+static void heap_set(int i, int tim)
+{
+    timers_heap[i] = tim;
+    timers_array[tim].heap_idx = i;
+}
+
+static void heap_sift_up(int i)
+{
+    const int tim = timers_heap[i];
+
+    while (i > 0) {
+        const int parent = (i - 1) / 2;
+
+        if (!timer_before(tim, timers_heap[parent]))
+            break;
+        heap_set(i, timers_heap[parent]);
+        i = parent;
     }
-};
-#define VALID_TIMER_ID(x) ((x) < configTIMERS_MAX && (x) >= 0)
+    heap_set(i, tim);
+}
+
+static void heap_sift_down(int i)
+{
+    const int tim = timers_heap[i];
+
+    while (1) {
+        int child = 2 * i + 1;
+
+        if (child >= timers_heap_len)
+            break;
+        if (child + 1 < timers_heap_len &&
+            timer_before(timers_heap[child + 1], timers_heap[child]))
+            child++;
+        if (!timer_before(timers_heap[child], tim))
+            break;
+        heap_set(i, timers_heap[child]);
+        i = child;
+    }
+    heap_set(i, tim);
+}
+
+/**
+ * Insert a timer to the heap.
+ * timers_lock must be held.
+ */
+static void heap_insert(int tim)
+{
+    const int i = timers_heap_len++;
+
+    heap_set(i, tim);
+    heap_sift_up(i);
+}
+
+/**
+ * Remove a timer from the heap if it's there.
+ * timers_lock must be held.
+ */
+static void heap_remove(int tim)
+{
+    const int i = timers_array[tim].heap_idx;
+    int last;
+
+    if (i < 0)
+        return;
+
+    timers_array[tim].heap_idx = -1;
+    last = timers_heap[--timers_heap_len];
+    if (i == timers_heap_len)
+        return;
+
+    heap_set(i, last);
+    if (i > 0 && timer_before(last, timers_heap[(i - 1) / 2]))
+        heap_sift_up(i);
+    else
+        heap_sift_down(i);
+}
 
 void timers_run(void)
 {
-    size_t i = 0;
-    uint64_t now = get_utime();
-    const int enflags = TIMERS_FLAG_INUSE | TIMERS_FLAG_ENABLED;
-
-    do {
-        struct timer_cb * const timer = &timers_array[i];
-        timers_flags_t flags = atomic_read(&timer->flags);
-
-        if ((flags & enflags) == enflags) {
-            if ((now - timer->start) >= timer->interval) {
-                timer->event_fn(timer->event_arg);
-
-                if (!(flags & TIMERS_FLAG_PERIODIC)) {
-                    /* Stop the timer */
-                    timer->flags &= ~TIMERS_FLAG_ENABLED;
-                } else {
-                    /* Repeating timer */
-                    timer->start = get_utime();
-                }
+    uint64_t now;
+
+    /* Nothing to do unless the first timer in the heap has expired. */
+    if (timers_heap_len == 0)
+        return;
+
+    now = get_utime();
+    mtx_lock(&timers_lock);
+    while (timers_heap_len > 0) {
+        const int tim = timers_heap[0];
+        struct timer_cb * const timer = &timers_array[tim];
+        void (*event_fn)(void *) = timer->event_fn;
+        void * event_arg = timer->event_arg;
+
+        if (timer->expires > now)
+            break;
+
+        heap_remove(tim);
+        if (timer->flags & TIMERS_FLAG_PERIODIC) {
+            /* Repeating timer, don't accumulate drift. */
+            timer->start = timer->expires;
+            timer->expires = timer->start + timer->interval;
+            if (timer->expires <= now) {
+                timer->start = now;
+                timer->expires = now + ((timer->interval) ? timer->interval : 1);
             }
+            heap_insert(tim);
+        } else {
+            /* Stop the timer */
+            timer->flags &= ~TIMERS_FLAG_ENABLED;
         }
-    } while (++i < configTIMERS_MAX);
+
+        /* The handler may release or restart the timer. */
+        mtx_unlock(&timers_lock);
+        event_fn(event_arg);
+        mtx_lock(&timers_lock);
+    }
+    mtx_unlock(&timers_lock);
 }
 SCHED_PRE_SCHED_TASK(timers_run);
 
+uint64_t timers_next_expiry(void)
+{
+    uint64_t expires = UINT64_MAX;
+
+    mtx_lock(&timers_lock);
+    if (timers_heap_len > 0)
+        expires = timers_array[timers_heap[0]].expires;
+    mtx_unlock(&timers_lock);
+
+    return expires;
+}
+
+/**
+ * Double the size of the timer arrays.
+ * Must be called without timers_lock.
+ */
+static int timers_grow(void)
+{
+    const int old_size = timers_size;
+    const int new_size = 2 * old_size;
+    struct timer_cb * new_array;
+    int * new_heap;
+    struct timer_cb * old_array;
+    int * old_heap;
+
+    new_array = kmalloc(new_size * sizeof(struct timer_cb));
+    new_heap = kmalloc(new_size * sizeof(int));
+    if (!new_array || !new_heap) {
+        kfree(new_array);
+        kfree(new_heap);
+        return -ENOMEM;
+    }
+
+    mtx_lock(&timers_lock);
+    if (timers_size != old_size) {
+        /* Someone else was faster. */
+        mtx_unlock(&timers_lock);
+        kfree(new_array);
+        kfree(new_heap);
+        return 0;
+    }
+
+    memcpy(new_array, timers_array, old_size * sizeof(struct timer_cb));
+    memcpy(new_heap, timers_heap, timers_heap_len * sizeof(int));
+    old_array = timers_array;
+    old_heap = timers_heap;
+    timers_array = new_array;
+    timers_heap = new_heap;
+    timers_size = new_size;
+    timers_nfree += new_size - old_size;
+    mtx_unlock(&timers_lock);
+
+    if (old_array != timers_static) {
+        kfree(old_array);
+        kfree(old_heap);
+    }
+
+    return 0;
+}
+
+/**
+ * Grow the timer pool ahead of time.
+ * kmalloc can't be called with interrupts disabled, so the pool is grown
+ * here rather than in timers_add().
+ */
+static void timers_prealloc(uintptr_t arg)
+{
+    if (timers_nfree >= TIMERS_LOW_WATERMARK())
+        return;
+
+    (void)timers_grow();
+}
+IDLE_TASK(timers_prealloc, 0);
+
 int timers_add(void (*event_fn)(void *), void * event_arg,
                timers_flags_t flags, uint64_t usec)
 {
     struct timer_cb * timer;
-    size_t i = 0;
+    int tim;
 
     flags &= TIMERS_EXT_FLAGS; /* Allow only external flags to be set */
 
-    do { /* Locate first free timer */
-        timer = &timers_array[i];
+    mtx_lock(&timers_lock);
+    while (timers_free < 0 && timers_hwm == timers_size) {
+        mtx_unlock(&timers_lock);
+        /* Can't allocate in an atomic context. */
+        if ((get_interrupt_state() & PSR_INT_I) || timers_grow())
+            return TMNOVAL;
+        mtx_lock(&timers_lock);
+    }
 
-        if (atomic_cmpxchg(&timer->flags, 0, flags) == 0) {
-            timer->event_fn = event_fn;
-            timer->event_arg = event_arg;
-            timer->interval = usec;
-            timer->start = get_utime();
-            flags |= TIMERS_FLAG_INUSE;
-            atomic_set(&timer->flags, flags);
+    /* Prefer recently released timers over never used ones. */
+    if (timers_free >= 0) {
+        tim = timers_free;
+        timers_free = timers_array[tim].next_free;
+    } else {
+        tim = timers_hwm++;
+    }
+    timers_nfree--;
 
-            return i;
-        }
-    } while (++i < configTIMERS_MAX);
+    timer = &timers_array[tim];
+    timer->flags = flags | TIMERS_FLAG_INUSE;
+    timer->heap_idx = -1;
+    timer->event_fn = event_fn;
+    timer->event_arg = event_arg;
+    timer->interval = usec;
+    timer->start = get_utime();
+    timer->expires = timer->start + usec;
+    if (flags & TIMERS_FLAG_ENABLED)
+        heap_insert(tim);
+    mtx_unlock(&timers_lock);
 
-    return TMNOVAL;
+    return tim;
 }
 
 int64_t timers_get_split(int tim)
 {
     uint64_t now;
-    struct timer_cb * timer;
+    int64_t split;
 
     if (!VALID_TIMER_ID(tim))
         return -1;
 
     now = get_utime();
-    timer = &timers_array[tim];
+    mtx_lock(&timers_lock);
+    split = now - timers_array[tim].start;
+    mtx_unlock(&timers_lock);
 
-    return now - timer->start;
+    return split;
 }
 
 void timers_start(int tim)
 {
+    struct timer_cb * timer;
+
     if (!VALID_TIMER_ID(tim))
         return;
 
-    atomic_add(&timers_array[tim].flags, TIMERS_FLAG_ENABLED);
+    mtx_lock(&timers_lock);
+    timer = &timers_array[tim];
+    if ((timer->flags & TIMERS_FLAG_INUSE) &&
+        !(timer->flags & TIMERS_FLAG_ENABLED)) {
+        timer->flags |= TIMERS_FLAG_ENABLED;
+        heap_insert(tim);
+    }
+    mtx_unlock(&timers_lock);
 }
 
 void timers_stop(int tim)
 {
+    struct timer_cb * timer;
+
     if (!VALID_TIMER_ID(tim))
         return;
 
-    atomic_sub(&timers_array[tim].flags, TIMERS_FLAG_ENABLED);
+    mtx_lock(&timers_lock);
+    timer = &timers_array[tim];
+    timer->flags &= ~TIMERS_FLAG_ENABLED;
+    heap_remove(tim);
+    mtx_unlock(&timers_lock);
 }
 
 void timers_release(int tim)
 {
+    struct timer_cb * timer;
+
     if (!VALID_TIMER_ID(tim))
         return;
 
-    atomic_set(&timers_array[tim].flags, 0);
+    mtx_lock(&timers_lock);
+    timer = &timers_array[tim];
+    if (timer->flags & TIMERS_FLAG_INUSE) {
+        heap_remove(tim);
+        timer->flags = 0;
+        timer->next_free = timers_free;
+        timers_free = tim;
+        timers_nfree++;
+    }
+    mtx_unlock(&timers_lock);
 }
@@ -206,32 +206,35 @@ int copyoutstr(__kernel char * kaddr, __user const char * uaddr, size_t len,
 
 int vm_find_reg(struct proc_info * proc, uintptr_t uaddr, struct buf ** bp)
 {
-    struct buf * region = NULL;
     struct vm_mm_struct * mm = &proc->mm;
-    uintptr_t reg_start, reg_end;
+    int i;
 
+    /*
+     * TODO Would be good idea to use region size instead of mmu alloc size
+     *      but before that it has to be fixed everywhere in the codebase.
+     */
     mtx_lock(&mm->regions_lock);
-    for (int i = 0; i < mm->nr_regions; i++) {
-        region = (*mm->regions)[i];
-        if (!region)
-            continue;
-
-        /*
-         * TODO Would be good idea to use region size instead of mmu alloc size
-         *      but before that it has to be fixed everywhere in the codebase.
-         */
-        reg_start = region->b_mmu.vaddr;
-        reg_end = region->b_mmu.vaddr + region->b_bufsize - 1;
-
-        if (VM_ADDR_IS_IN_RANGE(uaddr, reg_start, reg_end)) {
-            mtx_unlock(&mm->regions_lock);
-            *bp = region;
-            return i;
-        }
-    }
+    i = vm_regtree_find(mm, uaddr, uaddr);
+    if (i >= 0)
+        *bp = (*mm->regions)[i];
     mtx_unlock(&mm->regions_lock);
 
-    return -1;
+    return i;
+}
+
+/**
+ * Set the attributes of a new section.
+ */
+static void vm_initsect(struct buf * new_region, uintptr_t start_vaddr,
+                        int prot)
+{
+    /*
+     * COW|COR not allowed for a new section.
+     */
+    new_region->b_uflags = prot & ~(VM_PROT_COW | VM_PROT_COR);
+    new_region->b_mmu.vaddr = start_vaddr;
+    new_region->b_mmu.control = MMU_CTRL_MEMTYPE_WB;
+    vm_updateusr_ap(new_region);
 }
 
 struct buf * vm_newsect(uintptr_t vaddr, size_t size, int prot)
@@ -248,13 +251,24 @@ struct buf * vm_newsect(uintptr_t vaddr, size_t size, int prot)
     if (!new_region)
         return NULL;
 
-    /*
-     * COW|COR not allowed for a new section.
-     */
-    new_region->b_uflags = prot & ~(VM_PROT_COW | VM_PROT_COR);
-    new_region->b_mmu.vaddr = start_vaddr;
-    new_region->b_mmu.control = MMU_CTRL_MEMTYPE_WB;
-    vm_updateusr_ap(new_region);
+    vm_initsect(new_region, start_vaddr, prot);
+
+    return new_region;
+}
+
+struct buf * vm_newsect_file(struct vnode * vnode, off_t foff, size_t filesz,
+                             uintptr_t vaddr, size_t size, int prot)
+{
+    const uintptr_t start_vaddr = (vaddr & ~(MMU_PGSIZE_COARSE - 1));
+    const size_t sectsize = (vaddr + size) - start_vaddr;
+    struct buf * new_region;
+
+    new_region = geteblk_file(vnode, foff, vaddr - start_vaddr, filesz,
+                              sectsize);
+    if (!new_region)
+        return NULL;
+
+    vm_initsect(new_region, start_vaddr, prot);
 
     return new_region;
 }
@@ -268,24 +282,9 @@ static bool is_overlaping_current_regions(
     uintptr_t vaddr,
     size_t size)
 {
-    const size_t nr_regions = mm->nr_regions;
     const uintptr_t newreg_end = vaddr + size - 1;
 
-    for (size_t i = 0; i < nr_regions; i++) {
-        struct buf * bp = (*mm->regions)[i];
-        if (!bp)
-            continue;
-
-        const uintptr_t reg_start = bp->b_mmu.vaddr;
-        const uintptr_t reg_end = bp->b_mmu.vaddr + bp->b_bufsize - 1;
-
-        if (VM_RANGE_IS_OVERLAPPING(reg_start, reg_end,
-                                    vaddr, newreg_end)) {
-            return true;
-        }
-    }
-
-    return false;
+    return vm_regtree_find(mm, vaddr, newreg_end) >= 0;
 }
 
 /**
@@ -453,13 +452,17 @@ int vm_mm_init(struct vm_mm_struct * mm, int nr_regions)
     mm->mpt.nr_tables = 1;
     mm->mpt.pt_type = MMU_PTT_MASTER;
     mm->mpt.pt_dom = MMU_DOM_USER;
+    mm->mpt.master_pt = NULL;
+    mm->mpt.pt_asid = 0; /* Assigned on the first attach. */
 
     if (ptmapper_alloc(&mm->mpt))
         return -ENOMEM;
 
     /* Allocate an array for regions. */
     mm->regions = NULL;
+    mm->regnodes = NULL;
     mm->nr_regions = 0;
+    RB_INIT(&mm->regtree_head);
     realloc_mm_regions(mm, nr_regions);
     if (!mm->regions)
         return -ENOMEM;
@@ -493,6 +496,9 @@ void vm_mm_destroy(struct vm_mm_struct * mm)
         /* Free regions array. */
         kfree(mm->regions);
         mm->regions = NULL;
+        kfree(mm->regnodes);
+        mm->regnodes = NULL;
+        RB_INIT(&mm->regtree_head);
     }
 
     /* Free the mpt. */
@@ -503,6 +509,7 @@ void vm_mm_destroy(struct vm_mm_struct * mm)
 static int realloc_mm_regions_locked(struct vm_mm_struct * mm, int new_count)
 {
     struct buf * (*new_regions)[];
+    struct vm_regnode * new_regnodes;
     int i = mm->nr_regions;
 
     KERROR_DBG("realloc_mm_regions(mm %p, new_count %d), old %d\n",
@@ -519,14 +526,22 @@ static int realloc_mm_regions_locked(struct vm_mm_struct * mm, int new_count)
     new_regions = krealloc(mm->regions, new_count * sizeof(struct buf *));
     if (!new_regions)
         return -ENOMEM;
+    mm->regions = new_regions;
+
+    new_regnodes = krealloc(mm->regnodes,
+                            new_count * sizeof(struct vm_regnode));
+    if (!new_regnodes)
+        return -ENOMEM;
+    mm->regnodes = new_regnodes;
 
     for (; i < new_count; i++) {
         (*new_regions)[i] = NULL;
     }
-
-    mm->regions = new_regions;
     mm->nr_regions = new_count;
 
+    /* The nodes may have moved. */
+    vm_regtree_rebuild(mm);
+
     return 0;
 }
 
@@ -577,7 +592,7 @@ static int vm_insert_region_ref(struct vm_mm_struct * mm, struct buf * region)
             return err;
     }
 
-    (*mm->regions)[slot] = region;
+    vm_mm_set_region(mm, slot, region);
     mtx_unlock(&mm->regions_lock);
 
     return slot;
@@ -619,7 +634,7 @@ int vm_replace_region(struct proc_info * proc, struct buf * region,
 
     mtx_lock(&mm->regions_lock);
     old_region = (*mm->regions)[region_nr];
-    (*mm->regions)[region_nr] = NULL;
+    vm_mm_set_region(mm, region_nr, NULL);
     mtx_unlock(&mm->regions_lock);
 
     if (old_region) {
@@ -661,7 +676,7 @@ int vm_replace_region(struct proc_info * proc, struct buf * region,
     }
 
     mtx_lock(&mm->regions_lock);
-    (*mm->regions)[region_nr] = region;
+    vm_mm_set_region(mm, region_nr, region);
     mtx_unlock(&mm->regions_lock);
 
     if (region) {
@@ -719,6 +734,40 @@ int vm_unmapproc_region(struct proc_info * proc, struct buf * region)
     return mmu_unmap_region(&mmu_region);
 }
 
+int vm_pfault_region(struct proc_info * proc, struct buf * region,
+                     uintptr_t vaddr)
+{
+    struct vm_pt * vpt;
+
+    if ((!region->b_cow && !region->b_pager) || !region->vm_ops->rpfault)
+        return -ENOENT;
+
+    vpt = ptlist_get_pt(&proc->mm, region->b_mmu.vaddr,
+                        region->b_bufsize, VM_PT_CREAT);
+    if (!vpt)
+        return -ENOMEM;
+
+    return region->vm_ops->rpfault(region, vaddr, vpt);
+}
+
+int vm_populate_region(struct buf * region)
+{
+    const uintptr_t start = region->b_mmu.vaddr;
+
+    if ((!region->b_cow && !region->b_pager) || !region->vm_ops->rpfault)
+        return 0;
+
+    for (size_t off = 0; off < region->b_bufsize; off += MMU_PGSIZE_COARSE) {
+        int err;
+
+        err = region->vm_ops->rpfault(region, start + off, NULL);
+        if (err && err != -ENOENT)
+            return err;
+    }
+
+    return 0;
+}
+
 int vm_unload_regions(struct proc_info * proc, int start, int end)
 {
     struct vm_mm_struct * const mm = &proc->mm;
@@ -920,9 +969,37 @@ int useracc_proc(__user const void * addr, size_t len, struct proc_info * proc,
         KERROR(KERROR_WARN, "VMPROT_WRITE tested for COW region\n");
     }
 
-    if (VM_ADDR_IS_IN_RANGE(uaddr, start, end))
-        return test_ap_user(rw, region);
-    return 0;
+    if (!VM_ADDR_IS_IN_RANGE(uaddr, start, end))
+        return 0;
+
+    if (region->b_pager || ((rw & VM_PROT_WRITE) && region->b_cow)) {
+        /*
+         * The kernel accesses the user space through the page tables, so
+         * the pages still shared with the COW source must be copied before
+         * writing and the pages of a demand paged region must be read in.
+         */
+        const uintptr_t last = (len == 0) ? uaddr
+                               : (uaddr + len - 1 < end) ? uaddr + len - 1
+                               : end;
+        int remap = 0;
+
+        for (uintptr_t addr = uaddr & ~(MMU_PGSIZE_COARSE - 1); addr <= last;
+             addr += MMU_PGSIZE_COARSE) {
+            int err;
+
+            err = vm_pfault_region(proc, region, addr);
+            if (err == -ENOENT && region->b_pager &&
+                !vm_uaddr2kaddr(proc, (__user void *)addr, 1)) {
+                remap = 1; /* Read in but not yet mapped to this process. */
+            } else if (err && err != -ENOENT) {
+                return 0;
+            }
+        }
+        if (remap && vm_mapproc_region(proc, region))
+            return 0;
+    }
+
+    return test_ap_user(rw, region);
 }
 
 void vm_get_uapstring(char str[5], struct buf * bp)
@@ -0,0 +1,134 @@
+/**
+ *******************************************************************************
+ * @file    vm_regtree.c
+ * @author  Olli Vanhoja
+ * @brief   Interval tree of process memory regions.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#include <buf.h>
+#include <kerror.h>
+#include <libkern.h>
+#include <vm/vm.h>
+
+static void vm_regtree_augment(struct vm_regnode * node)
+{
+    struct vm_regnode * child;
+    uintptr_t max_end = node->end;
+
+    child = RB_LEFT(node, entry_);
+    if (child && child->max_end > max_end)
+        max_end = child->max_end;
+    child = RB_RIGHT(node, entry_);
+    if (child && child->max_end > max_end)
+        max_end = child->max_end;
+
+    node->max_end = max_end;
+}
+
+/*
+ * Keep max_end up to date on every subtree modified by the RB tree
+ * operations.
+ */
+#undef RB_AUGMENT
+#define RB_AUGMENT(x) vm_regtree_augment(x)
+RB_GENERATE(vm_regtree, vm_regnode, entry_, vm_regtree_compare);
+#undef RB_AUGMENT
+#define RB_AUGMENT(x) break
+
+int vm_regtree_compare(struct vm_regnode * a, struct vm_regnode * b)
+{
+    KASSERT(a && b, "vm_regnodes are set");
+
+    if (a->start != b->start)
+        return (a->start < b->start) ? -1 : 1;
+    return a->nr - b->nr;
+}
+
+static void vm_regtree_insert(struct vm_mm_struct * mm, int region_nr,
+                              const struct buf * region)
+{
+    struct vm_regnode * node = &mm->regnodes[region_nr];
+
+    node->start = region->b_mmu.vaddr;
+    node->end = region->b_mmu.vaddr + region->b_bufsize - 1;
+    node->max_end = node->end;
+    node->nr = region_nr;
+    RB_INSERT(vm_regtree, &mm->regtree_head, node);
+}
+
+void vm_mm_set_region(struct vm_mm_struct * mm, int region_nr,
+                      struct buf * region)
+{
+    KASSERT(region_nr >= 0 && region_nr < mm->nr_regions,
+            "region_nr is valid");
+
+    /* A slot is in the tree only if it's set. */
+    if ((*mm->regions)[region_nr])
+        RB_REMOVE(vm_regtree, &mm->regtree_head, &mm->regnodes[region_nr]);
+
+    (*mm->regions)[region_nr] = region;
+    if (region)
+        vm_regtree_insert(mm, region_nr, region);
+}
+
+void vm_regtree_rebuild(struct vm_mm_struct * mm)
+{
+    RB_INIT(&mm->regtree_head);
+
+    for (int i = 0; i < mm->nr_regions; i++) {
+        struct buf * region = (*mm->regions)[i];
+
+        if (region)
+            vm_regtree_insert(mm, i, region);
+    }
+}
+
+int vm_regtree_find(struct vm_mm_struct * mm, uintptr_t start,
+                    uintptr_t end)
+{
+    struct vm_regnode * node = RB_ROOT(&mm->regtree_head);
+
+    while (node) {
+        struct vm_regnode * left = RB_LEFT(node, entry_);
+
+        if (node->start <= end && start <= node->end)
+            return node->nr;
+
+        /*
+         * If the left subtree has a region ending after start but none of
+         * them overlaps then all of them, and all the regions in the right
+         * subtree, start after end.
+         */
+        if (left && left->max_end >= start)
+            node = left;
+        else
+            node = RB_RIGHT(node, entry_);
+    }
+
+    return -1;
+}
@@ -32,14 +32,18 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/queue.h>
 #include <sys/sysctl.h>
 #include <bitmap.h>
+#include <buddy.h>
 #include <buf.h>
 #include <dynmem.h>
 #include <hal/mmu.h>
+#include <idle.h>
 #include <kerror.h>
 #include <kmalloc.h>
+#include <kmem_cache.h>
 #include <kstring.h>
 #include <libkern.h>
 #include <proc.h>
@@ -61,14 +65,65 @@ struct vregion {
 #define VREG_MAGIC_VALUE 0x6C542D55
     unsigned magic;
 #endif
+    struct buddy buddy; /*!< Buddy allocator for the pages. */
     size_t size;        /*!< Size of allocation bitmap in bytes. */
-    bitmap_t map[0];    /*!< Bitmap of reserved pages. */
+    bitmap_t map[0];    /*!< Bitmap of reserved pages followed by a bitmap
+                         *   of zeroed pages, see VREG_ZMAP(), and the
+                         *   bookkeeping array of the buddy allocator. */
+};
+
+#define VR_COW_NSRC     4       /*!< Max number of COW source regions. */
+#define VR_COW_PRIVATE  0xff    /*!< The page is private to the region. */
+
+/**
+ * Page-granular copy-on-write state of a lazily cloned region.
+ * The clone holds a reference to the source regions until every page has
+ * been copied, so the shared pages can't disappear under it. A lazy clone of
+ * a region that is itself a lazy clone inherits the sources of the pages not
+ * yet copied, so a page is always copied from the region actually holding
+ * it. The source regions are never written to as they are shared COW.
+ */
+struct vr_cow {
+    struct buf * src[VR_COW_NSRC]; /*!< Regions the pages are copied from. */
+    size_t nsrc;        /*!< Number of source regions. */
+    size_t npending;    /*!< Number of pages still shared with a source. */
+    uint8_t psrc[0];    /*!< Source index of each page or VR_COW_PRIVATE. */
+};
+
+/**
+ * Demand paging state of a region backed by a file.
+ * Pages are read in from bp->b_file on the first access and left unmapped
+ * until then. Only one page of a region is read in at a time.
+ */
+struct vr_pager {
+    off_t foff;         /*!< File offset of the data. */
+    size_t doff;        /*!< Region offset of the data. */
+    size_t filesz;      /*!< Size of the data in the file. */
+    int busy;           /*!< A page is being read in. */
+    size_t size;        /*!< Size of the bitmap in bytes. */
+    bitmap_t map[0];    /*!< Bitmap of pages already read in. */
 };
 
 #define DMEM_BLOCK_SIZE (DYNMEM_PAGE_SIZE / MMU_PGSIZE_COARSE)
 
 #define VREG_SIZE(count) \
-    (sizeof(struct vregion) + E2BITMAP_SIZE(count) * sizeof(bitmap_t))
+    (sizeof(struct vregion) + 2 * E2BITMAP_SIZE(count) * sizeof(bitmap_t) + \
+     (count) * sizeof(struct buddy_blk))
+
+/**
+ * Bitmap of zeroed pages of a vregion.
+ * A bit is set when a free page has been cleared by the idle task and
+ * cleared when the page is freed after use, so the bits of an allocated
+ * page tell whether the page was zeroed when it was allocated.
+ */
+#define VREG_ZMAP(vreg_) \
+    ((vreg_)->map + (vreg_)->size / sizeof(bitmap_t))
+
+#define VREG_NPAGES(vreg_) \
+    ((vreg_)->size * 8)
+
+#define VREG_BUDDY_BLK(vreg_) \
+    ((struct buddy_blk *)(VREG_ZMAP(vreg_) + (vreg_)->size / sizeof(bitmap_t)))
 
 #define VREG_PCOUNT(byte_size_) \
     ((byte_size_) / MMU_PGSIZE_COARSE)
@@ -84,15 +139,27 @@ struct vregion {
 
 #define ROUND_UP(N, S) ((((N) + (S) - 1) / (S)) * (S))
 
+/**
+ * Max number of pages cleared by a single call of the idle task.
+ */
+#define VR_ZPOOL_BATCH 8
+
 static struct vregion * vreg_alloc_node(size_t count);
 static void vrref(struct buf * region);
 static struct buf * vr_rclone(struct buf * old_region);
+static struct buf * vr_rpclone(struct buf * old_region);
+static int vr_rpfault(struct buf * bp, uintptr_t vaddr, struct vm_pt * pt);
 
 /** List of all allocations done by vralloc. */
 static LIST_HEAD(vrlisthead, vregion) vrlist_head =
     LIST_HEAD_INITIALIZER(vrlisthead);
 static mtx_t vr_big_lock = MTX_INITIALIZER(MTX_TYPE_TICKET, MTX_OPT_DINT);
 
+static void vr_buf_ctor(void * obj);
+
+/** Cache for struct buf descriptors of vralloc allocations. */
+KMEM_CACHE_DEFINE(vr_buf_cache, struct buf, 64, vr_buf_ctor, NULL);
+
 SYSCTL_DECL(_vm_vralloc);
 SYSCTL_NODE(_vm, OID_AUTO, vralloc, CTLFLAG_RW, 0,
             "vralloc stats");
@@ -105,12 +172,66 @@ static size_t vralloc_used;
 SYSCTL_UINT(_vm_vralloc, OID_AUTO, used, CTLFLAG_RD, &vralloc_used, 0,
             "Amount of vralloc memory used");
 
+SYSCTL_DECL(_vm_zpool);
+SYSCTL_NODE(_vm, OID_AUTO, zpool, CTLFLAG_RW, 0,
+            "Zeroed page pool");
+
+static size_t zpool_low = configVRALLOC_ZPOOL_LOW;
+SYSCTL_UINT(_vm_zpool, OID_AUTO, low, CTLFLAG_RW, &zpool_low, 0,
+            "Low watermark for refilling the pool, in pages");
+
+static size_t zpool_high = configVRALLOC_ZPOOL_HIGH;
+SYSCTL_UINT(_vm_zpool, OID_AUTO, high, CTLFLAG_RW, &zpool_high, 0,
+            "High watermark for refilling the pool, in pages");
+
+static size_t zpool_pages;
+SYSCTL_UINT(_vm_zpool, OID_AUTO, pages, CTLFLAG_RD, &zpool_pages, 0,
+            "Free pages currently zeroed");
+
+static atomic_t zpool_nhits;
+SYSCTL_INT(_vm_zpool, OID_AUTO, hits, CTLFLAG_RD, &zpool_nhits, 0,
+           "Pages served zeroed from the pool");
+
+static atomic_t zpool_nmisses;
+SYSCTL_INT(_vm_zpool, OID_AUTO, misses, CTLFLAG_RD, &zpool_nmisses, 0,
+           "Pages cleared on allocation");
+
+SYSCTL_DECL(_vm_cow);
+SYSCTL_NODE(_vm, OID_AUTO, cow, CTLFLAG_RW, 0,
+            "Copy-on-write stats");
+
+static atomic_t cow_nclones;
+SYSCTL_INT(_vm_cow, OID_AUTO, clones, CTLFLAG_RD, &cow_nclones, 0,
+           "Regions cloned lazily on a COW fault");
+
+static atomic_t cow_nreused;
+SYSCTL_INT(_vm_cow, OID_AUTO, reused, CTLFLAG_RD, &cow_nreused, 0,
+           "COW regions made writable in place without a copy");
+
+static atomic_t cow_ncopied;
+SYSCTL_INT(_vm_cow, OID_AUTO, copied, CTLFLAG_RD, &cow_ncopied, 0,
+           "Pages copied on COW faults");
+
+static atomic_t cow_nshared;
+SYSCTL_INT(_vm_cow, OID_AUTO, shared, CTLFLAG_RD, &cow_nshared, 0,
+           "Pages currently shared by lazily cloned regions");
+
+SYSCTL_DECL(_vm_pager);
+SYSCTL_NODE(_vm, OID_AUTO, pager, CTLFLAG_RW, 0,
+            "Demand paging stats");
+
+static atomic_t pager_npageins;
+SYSCTL_INT(_vm_pager, OID_AUTO, pageins, CTLFLAG_RD, &pager_npageins, 0,
+           "Pages read in from files on page faults");
+
 /**
  * VRA specific operations for allocated vm regions.
  */
 static const vm_ops_t vra_ops = {
     .rref = vrref,
     .rclone = vr_rclone,
+    .rpclone = vr_rpclone,
+    .rpfault = vr_rpfault,
     .rfree = vrfree,
     .rmmap = vrmmap,
 };
@@ -162,6 +283,8 @@ static struct vregion * vreg_alloc_node(size_t count)
     }
 
     vreg->size = E2BITMAP_SIZE(count) * sizeof(bitmap_t);
+    buddy_init(&vreg->buddy, VREG_BUDDY_BLK(vreg), count);
+    buddy_free(&vreg->buddy, 0, count);
 #ifdef configVRALLOC_DEBUG
     vreg->magic = VREG_MAGIC_VALUE;
 #endif
@@ -174,46 +297,407 @@ static struct vregion * vreg_alloc_node(size_t count)
     return vreg;
 }
 
+/**
+ * Count zeroed pages in a range of a vregion.
+ * @note vr_big_lock must be held.
+ * @param vreg is a pointer to the vregion.
+ * @param iblock is the index of the first page.
+ * @param pcount is the number of pages.
+ */
+static size_t vreg_zcount(const struct vregion * vreg, size_t iblock,
+                          size_t pcount)
+{
+    const bitmap_t * zmap = VREG_ZMAP(vreg);
+    size_t n = 0;
+
+    for (size_t i = iblock; i < iblock + pcount; i++) {
+        n += bitmap_status(zmap, i, vreg->size) == 1;
+    }
+
+    return n;
+}
+
+/**
+ * Remove an unused vregion node from the list of nodes.
+ * A single block node is kept around for the zeroed page pool if the pool
+ * would otherwise run below its high watermark.
+ * @note vr_big_lock must be held.
+ * @param vreg is a pointer to the vregion.
+ * @return Returns 1 if the node was removed and should be freed with
+ *         vreg_free_node() after vr_big_lock is released; Otherwise 0.
+ */
+static int vreg_release_locked(struct vregion * vreg)
+{
+    const size_t npages = VREG_NPAGES(vreg);
+
+    if (vreg->count > 0)
+        return 0;
+
+    if (npages == DMEM_BLOCK_SIZE &&
+        VREG_PCOUNT(vralloc_all - vralloc_used) - npages < zpool_high)
+        return 0;
+
+    LIST_REMOVE(vreg, _entry);
+    vralloc_all -= VREG_BYTESIZE(npages);
+    zpool_pages -= vreg_zcount(vreg, 0, npages);
+
+    return 1;
+}
+
+/**
+ * Free a vregion node removed with vreg_release_locked().
+ * @param vreg is a pointer to the vregion.
+ */
+static void vreg_free_node(struct vregion * vreg)
+{
+    dynmem_free_region((void *)vreg->kaddr);
+    kfree(vreg);
+}
+
 /**
  * Get pcount number of unallocated pages.
- * @note needs to get vr_big_lock.
+ * @note vr_big_lock must be held.
  * @param[out] iblock is the returned index of the allocation made.
  * @param pcount is the number of pages requested.
  * @return Returns a pointer to the allocated vreg.
  */
-static struct vregion * get_iblocks(size_t * iblock, size_t pcount)
+static struct vregion * get_iblocks_locked(size_t * iblock, size_t pcount)
 {
-    struct vregion * vreg_temp;
-    struct vregion * vreg = NULL;
+    struct vregion * vreg;
     int err;
 
-    mtx_lock(&vr_big_lock);
+    KASSERT(mtx_test(&vr_big_lock), "vr_big_lock should be locked");
 
-retry:
-    LIST_FOREACH(vreg_temp, &vrlist_head, _entry) {
-        if (bitmap_block_search(iblock, pcount, vreg_temp->map,
-                                vreg_temp->size) == 0) {
-            vreg = vreg_temp;
+    LIST_FOREACH(vreg, &vrlist_head, _entry) {
+        if (buddy_alloc(&vreg->buddy, pcount, iblock) == 0)
             break; /* Found a block */
-        }
     }
 
     if (!vreg) { /* Not found */
         vreg = vreg_alloc_node(pcount);
         if (!vreg)
-            goto out;
-        goto retry;
+            return NULL;
+        err = buddy_alloc(&vreg->buddy, pcount, iblock);
+        KASSERT(err == 0, "new vreg must have space");
     }
 
     err = bitmap_block_update(vreg->map, 1, *iblock, pcount, vreg->size);
     KASSERT(err == 0, "vreg map update OOB");
     vreg->count += pcount;
     vralloc_used += VREG_BYTESIZE(pcount);
-out:
+    zpool_pages -= vreg_zcount(vreg, *iblock, pcount);
+
+    return vreg;
+}
+
+/**
+ * Free pages allocated with get_iblocks().
+ * @note vr_big_lock must be held.
+ * @param vreg is a pointer to the vregion.
+ * @param iblock is the index of the first page.
+ * @param pcount is the number of pages.
+ */
+static void put_iblocks_locked(struct vregion * vreg, size_t iblock,
+                               size_t pcount)
+{
+    int err;
+
+    err = bitmap_block_update(vreg->map, 0, iblock, pcount, vreg->size);
+    KASSERT(err == 0, "vreg map update OOB");
+    /* The pages are dirty now. */
+    err = bitmap_block_update(VREG_ZMAP(vreg), 0, iblock, pcount, vreg->size);
+    KASSERT(err == 0, "vreg zmap update OOB");
+    buddy_free(&vreg->buddy, iblock, pcount);
+    vreg->count -= pcount;
+
+    vralloc_used -= VREG_BYTESIZE(pcount); /* Update stats */
+}
+
+/**
+ * Get pcount number of unallocated pages.
+ * @note needs to get vr_big_lock.
+ * @param[out] iblock is the returned index of the allocation made.
+ * @param pcount is the number of pages requested.
+ * @return Returns a pointer to the allocated vreg.
+ */
+static struct vregion * get_iblocks(size_t * iblock, size_t pcount)
+{
+    struct vregion * vreg;
+
+    mtx_lock(&vr_big_lock);
+    vreg = get_iblocks_locked(iblock, pcount);
     mtx_unlock(&vr_big_lock);
+
     return vreg;
 }
 
+/**
+ * Free the page-granular COW state of a region.
+ * Drops the reference to the source region.
+ * @param cow is a pointer to a COW state already detached from its region.
+ */
+static void vr_cow_free(struct vr_cow * cow)
+{
+    atomic_sub(&cow_nshared, cow->npending);
+    for (size_t i = 0; i < cow->nsrc; i++) {
+        vrfree(cow->src[i]);
+    }
+    kfree(cow);
+}
+
+/**
+ * Detach the COW state of a region once all of its pages are private.
+ * @note bp->lock must be held.
+ * @param bp is a pointer to the region.
+ * @return Returns the state to be freed by the caller with vr_cow_free()
+ *         after bp->lock is released; Otherwise NULL.
+ */
+static struct vr_cow * vr_cow_detach(struct buf * bp)
+{
+    struct vr_cow * cow = bp->b_cow;
+
+    if (!cow || cow->npending > 0)
+        return NULL;
+
+    bp->b_cow = NULL;
+    return cow;
+}
+
+/**
+ * Get the kernel address of the current contents of a page.
+ * @note bp->lock must be held.
+ * @param bp is a pointer to the region.
+ * @param i is the page index.
+ */
+static uintptr_t vr_cow_pdata(const struct buf * bp, size_t i)
+{
+    const struct vr_cow * cow = bp->b_cow;
+
+    if (cow && cow->psrc[i] != VR_COW_PRIVATE)
+        return cow->src[cow->psrc[i]]->b_data + VREG_BYTESIZE(i);
+    return bp->b_data + VREG_BYTESIZE(i);
+}
+
+/**
+ * Copy a single page from the COW source region.
+ * @note bp->lock must be held.
+ * @param bp is a pointer to the region.
+ * @param i is the page index.
+ * @return Returns zero if the page was copied;
+ *         -ENOENT if the page was already private.
+ */
+static int vr_cow_copy(struct buf * bp, size_t i)
+{
+    struct vr_cow * cow = bp->b_cow;
+
+    if (!cow || cow->psrc[i] == VR_COW_PRIVATE)
+        return -ENOENT;
+
+    memcpy((void *)(bp->b_data + VREG_BYTESIZE(i)),
+           (void *)vr_cow_pdata(bp, i), MMU_PGSIZE_COARSE);
+    cow->psrc[i] = VR_COW_PRIVATE;
+    cow->npending--;
+
+    atomic_dec(&cow_nshared);
+    atomic_inc(&cow_ncopied);
+
+    return 0;
+}
+
+/**
+ * Copy all the pages still shared with the COW source region.
+ * @note bp->lock must be held.
+ * @param bp is a pointer to the region.
+ */
+static void vr_cow_copy_all(struct buf * bp)
+{
+    const size_t pcount = VREG_PCOUNT(bp->b_bufsize);
+
+    for (size_t i = 0; bp->b_cow && bp->b_cow->npending > 0 && i < pcount;
+         i++) {
+        (void)vr_cow_copy(bp, i);
+    }
+}
+
+/**
+ * Read in a single page of a demand paged region.
+ * @note bp->lock must be held, it's released while the page is being read.
+ * @param bp is a pointer to the region.
+ * @param i is the page index.
+ * @return Returns zero if the page was read in;
+ *         -ENOENT if the page was already in memory;
+ *         Otherwise a negative errno is returned.
+ */
+static int vr_pagein(struct buf * bp, size_t i)
+{
+    struct vr_pager * pager = bp->b_pager;
+    const size_t pstart = VREG_BYTESIZE(i);
+    const size_t dstart = max(pstart, pager->doff);
+    const size_t dend = min(pstart + MMU_PGSIZE_COARSE,
+                            pager->doff + pager->filesz);
+    uint8_t * page = (uint8_t *)(bp->b_data + pstart);
+    int err = 0;
+
+    while (pager->busy) {
+        waitq_sleep(&bp->b_waitq, &bp->lock, 0);
+    }
+    if (bitmap_status(pager->map, i, pager->size))
+        return -ENOENT;
+
+    pager->busy = 1;
+    mtx_unlock(&bp->lock);
+
+    /* The page isn't mapped anywhere yet so it's safe to fill it unlocked. */
+    memset(page, 0, MMU_PGSIZE_COARSE);
+    if (dstart < dend) {
+        vnode_t * vn = bp->b_file.vnode;
+        const size_t len = dend - dstart;
+        struct uio uio;
+
+        uio_init_kbuf(&uio, page + (dstart - pstart), len);
+        if (vn->vnode_ops->lseek(&bp->b_file,
+                                 pager->foff + (dstart - pager->doff),
+                                 SEEK_SET) < 0 ||
+            vn->vnode_ops->read(&bp->b_file, &uio, len) != (ssize_t)len) {
+            err = -EIO;
+        }
+    }
+
+    mtx_lock(&bp->lock);
+    if (!err) {
+        bitmap_set(pager->map, i, pager->size);
+        atomic_inc(&pager_npageins);
+    }
+    pager->busy = 0;
+    waitq_wakeup_all(&bp->b_waitq);
+
+    return err;
+}
+
+/**
+ * Read in all the pages of a demand paged region that are not yet in memory.
+ * @param bp is a pointer to the region.
+ * @return Returns zero if succeed; Otherwise a negative errno is returned.
+ */
+static int vr_pagein_all(struct buf * bp)
+{
+    const size_t pcount = VREG_PCOUNT(bp->b_bufsize);
+    int err = 0;
+
+    mtx_lock(&bp->lock);
+    for (size_t i = 0; bp->b_pager && i < pcount; i++) {
+        err = vr_pagein(bp, i);
+        if (err == -ENOENT)
+            err = 0;
+        else if (err)
+            break;
+    }
+    mtx_unlock(&bp->lock);
+
+    return err;
+}
+
+/**
+ * Free the demand paging state of a region.
+ * Drops the reference to the vnode.
+ * @param bp is a pointer to the region.
+ */
+static void vr_pager_free(struct buf * bp)
+{
+    kfree(bp->b_pager);
+    bp->b_pager = NULL;
+    vrele(bp->b_file.vnode);
+}
+
+/**
+ * Test whether a page of a region is in memory.
+ * The pages of a demand paged region are only ever added to the bitmap, so
+ * it's safe to test without the lock of bp as long as bp is referenced.
+ * @param bp is a pointer to the region.
+ * @param i is the page index.
+ */
+static int vr_page_loaded(const struct buf * bp, size_t i)
+{
+    const struct vr_pager * pager = bp->b_pager;
+
+    return !pager || bitmap_status(pager->map, i, pager->size);
+}
+
+/**
+ * Read in the source page of a page shared with a demand paged COW source.
+ * @note bp->lock must be held, it's released while the page is being read,
+ *       so the caller must reload bp->b_cow.
+ * @param bp is a pointer to the lazily cloned region.
+ * @param i is the page index.
+ * @return Returns zero if the page is in memory or private;
+ *         Otherwise a negative errno is returned.
+ */
+static int vr_cow_pagein(struct buf * bp, size_t i)
+{
+    struct vr_cow * cow = bp->b_cow;
+    struct buf * src;
+    int err;
+
+    if (!cow || cow->psrc[i] == VR_COW_PRIVATE)
+        return 0;
+    src = cow->src[cow->psrc[i]];
+    if (vr_page_loaded(src, i))
+        return 0;
+
+    /* The COW state may be freed while bp is unlocked. */
+    vrref(src);
+    mtx_unlock(&bp->lock);
+
+    mtx_lock(&src->lock);
+    err = src->b_pager ? vr_pagein(src, i) : 0;
+    mtx_unlock(&src->lock);
+
+    mtx_lock(&bp->lock);
+    vrfree(src);
+
+    return (err == -ENOENT) ? 0 : err;
+}
+
+/**
+ * Read in all the source pages of a lazily cloned region.
+ * @param bp is a pointer to the lazily cloned region.
+ * @return Returns zero if succeed; Otherwise a negative errno is returned.
+ */
+static int vr_cow_pagein_all(struct buf * bp)
+{
+    const size_t pcount = VREG_PCOUNT(bp->b_bufsize);
+    int err = 0;
+
+    mtx_lock(&bp->lock);
+    for (size_t i = 0; bp->b_cow && i < pcount; i++) {
+        err = vr_cow_pagein(bp, i);
+        if (err)
+            break;
+    }
+    mtx_unlock(&bp->lock);
+
+    return err;
+}
+
+/**
+ * Map a single page of a region.
+ * @note bp->lock must be held.
+ * @param bp is a pointer to the region.
+ * @param i is the page index.
+ * @param pt is the page table.
+ */
+static int vr_map_page(const struct buf * bp, size_t i, struct vm_pt * pt)
+{
+    mmu_region_t mmu_region = bp->b_mmu;
+
+    mmu_region.vaddr += VREG_BYTESIZE(i);
+    mmu_region.paddr += VREG_BYTESIZE(i);
+    mmu_region.num_pages = 1;
+    mmu_region.pt = &(pt->pt);
+
+    return mmu_map_region(&mmu_region);
+}
+
 /**
  * vregion free callback.
  * This function is called by kobj.
@@ -224,7 +708,13 @@ static void vreg_free_callback(struct kobj * obj)
     struct vregion * vreg = (struct vregion *)(bp->allocator_data);
     const size_t bcount = VREG_PCOUNT(bp->b_bufsize);
     size_t iblock;
-    int err;
+
+    if (bp->b_cow) {
+        vr_cow_free(bp->b_cow);
+        bp->b_cow = NULL;
+    }
+    if (bp->b_pager)
+        vr_pager_free(bp);
 
     mtx_lock(&vr_big_lock);
 
@@ -234,29 +724,39 @@ static void vreg_free_callback(struct kobj * obj)
 
     /* Get the iblock no. */
     iblock = VREG_ADDR2I(vreg, bp->b_data);
+    put_iblocks_locked(vreg, iblock, bcount);
 
-    err = bitmap_block_update(vreg->map, 0, iblock, bcount, vreg->size);
-    KASSERT(err == 0, "vreg map update OOB");
-    vreg->count -= bcount;
-
-    vralloc_used -= bp->b_bufsize; /* Update stats */
-
-    if (vreg->count == 0) { /* Free the vregion node */
-        LIST_REMOVE(vreg, _entry);
-        vralloc_all -= vreg->size * (4 * 8) * MMU_PGSIZE_COARSE;
-
+    if (vreg_release_locked(vreg)) { /* Free the vregion node */
         mtx_unlock(&vr_big_lock);
-
-        dynmem_free_region((void *)vreg->kaddr);
-        kfree(vreg);
+        vreg_free_node(vreg);
     } else {
         mtx_unlock(&vr_big_lock);
     }
 
-    kfree(bp);
+    KASSERT(!mtx_test(&bp->lock), "buffer must be freed unlocked");
+    kmem_cache_free(&vr_buf_cache, bp);
 }
 
-struct buf * geteblk(size_t size)
+/**
+ * Construct a new struct buf for the vr_buf_cache.
+ * The lock and the wait queue are initialized only once, a buffer is always
+ * freed unlocked and without waiters.
+ */
+static void vr_buf_ctor(void * obj)
+{
+    struct buf * bp = (struct buf *)obj;
+
+    memset(bp, 0, sizeof(struct buf));
+    mtx_init(&bp->lock, MTX_TYPE_TICKET, 0);
+    waitq_init(&bp->b_waitq);
+}
+
+/**
+ * Allocate a new vrallocated buffer without clearing its contents.
+ * @param size is the size of the buffer in bytes.
+ * @return Returns a pointer to the new buffer; Otherwise NULL.
+ */
+static struct buf * vr_alloc(size_t size)
 {
     size_t iblock; /* Block index of the allocation */
     const size_t orig_size = size;
@@ -265,7 +765,7 @@ struct buf * geteblk(size_t size)
     struct vregion * vreg;
     struct buf * bp;
 
-    bp = kzalloc(sizeof(struct buf));
+    bp = kmem_cache_alloc(&vr_buf_cache);
     if (!bp) {
         KERROR_DBG("%s: Can't allocate vm_region struct\n", __func__);
         return NULL;
@@ -275,11 +775,12 @@ struct buf * geteblk(size_t size)
     if (!vreg) {
         KERROR_DBG("%s: Can't get vregion for a new buffer\n",
                    __func__);
-        kfree(bp);
+        kmem_cache_free(&vr_buf_cache, bp);
         return NULL;
     }
 
-    mtx_init(&bp->lock, MTX_TYPE_TICKET, 0);
+    /* Everything before b_obj is reset, the rest is constructed. */
+    memset(bp, 0, offsetof(struct buf, b_obj));
 
     /* Update target struct */
     bp->b_mmu.paddr = VREG_I2ADDR(vreg, iblock);
@@ -295,10 +796,161 @@ struct buf * geteblk(size_t size)
     bp->b_uflags = VM_PROT_READ | VM_PROT_WRITE;
     vm_updateusr_ap(bp);
 
-    /* Clear allocated pages. */
-    memset((void *)bp->b_data, 0, bp->b_bufsize);
+    return bp;
+}
+
+struct buf * geteblk(size_t size)
+{
+    struct buf * bp;
+    struct vregion * vreg;
+    size_t iblock;
+    size_t pcount;
+    size_t nhits = 0;
+
+    bp = vr_alloc(size);
+    if (!bp)
+        return NULL;
+
+    vreg = bp->allocator_data;
+    iblock = VREG_ADDR2I(vreg, bp->b_data);
+    pcount = VREG_PCOUNT(bp->b_bufsize);
+
+    /*
+     * Clear allocated pages that were not already zeroed by the idle task.
+     * The zmap bits of allocated pages only change when the pages are freed,
+     * so it's safe to read them without vr_big_lock.
+     */
+    for (size_t i = 0; i < pcount; i++) {
+        if (bitmap_status(VREG_ZMAP(vreg), iblock + i, vreg->size) == 1) {
+            nhits++;
+            continue;
+        }
+        memset((void *)(bp->b_data + VREG_BYTESIZE(i)), 0, MMU_PGSIZE_COARSE);
+    }
+    atomic_add(&zpool_nhits, nhits);
+    atomic_add(&zpool_nmisses, pcount - nhits);
+
+    return bp;
+}
+
+/**
+ * Find and reserve a free page that is not yet zeroed.
+ * The page is reserved so that it can't be allocated while it's being
+ * cleared.
+ * @note vr_big_lock must be held.
+ * @param[out] iblock is the index of the page reserved.
+ * @return Returns a pointer to the vregion of the page;
+ *         NULL if all the free pages are zeroed already.
+ */
+static struct vregion * vr_zpool_reserve(size_t * iblock)
+{
+    struct vregion * vreg;
+
+    LIST_FOREACH(vreg, &vrlist_head, _entry) {
+        const bitmap_t * zmap = VREG_ZMAP(vreg);
+
+        for (size_t k = 0; k < vreg->size / sizeof(bitmap_t); k++) {
+            const bitmap_t dirty = ~(vreg->map[k] | zmap[k]);
+
+            if (dirty) {
+                int err;
+
+                *iblock = k * 8 * sizeof(bitmap_t) + ffs(dirty) - 1;
+                err = buddy_reserve(&vreg->buddy, *iblock, 1);
+                KASSERT(err == 0, "free page must be free in the buddy map");
+                bitmap_set(vreg->map, *iblock, vreg->size);
+                vreg->count++;
+                return vreg;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Refill the zeroed page pool.
+ * The pool is refilled once it drops below the low watermark and until it
+ * reaches the high watermark. Only a few pages are cleared per call to allow
+ * other idle tasks run as well.
+ */
+static void vr_zpool_refill(uintptr_t arg)
+{
+    static int refilling;
+
+    if (zpool_pages >= zpool_high) {
+        refilling = 0;
+        return;
+    }
+    if (!refilling && zpool_pages >= zpool_low)
+        return;
+    refilling = 1;
+
+    for (int n = 0; n < VR_ZPOOL_BATCH; n++) {
+        struct vregion * vreg;
+        size_t iblock;
+        int release;
+
+        mtx_lock(&vr_big_lock);
+        vreg = vr_zpool_reserve(&iblock);
+        mtx_unlock(&vr_big_lock);
+        if (!vreg) {
+            /* Nothing left to clear. */
+            refilling = 0;
+            break;
+        }
+
+        memset((void *)VREG_I2ADDR(vreg, iblock), 0, MMU_PGSIZE_COARSE);
+
+        mtx_lock(&vr_big_lock);
+        bitmap_clear(vreg->map, iblock, vreg->size);
+        bitmap_set(VREG_ZMAP(vreg), iblock, vreg->size);
+        buddy_free(&vreg->buddy, iblock, 1);
+        vreg->count--;
+        zpool_pages++;
+        release = vreg_release_locked(vreg);
+        mtx_unlock(&vr_big_lock);
+        if (release)
+            vreg_free_node(vreg);
+    }
+}
+IDLE_TASK(vr_zpool_refill, 0);
+
+struct buf * geteblk_file(vnode_t * vnode, off_t foff, size_t doff,
+                          size_t filesz, size_t size)
+{
+    const size_t pcount = VREG_PCOUNT(memalign_size(size, MMU_PGSIZE_COARSE));
+    const size_t map_size = E2BITMAP_SIZE(pcount) * sizeof(bitmap_t);
+    struct vr_pager * pager;
+    struct buf * bp;
+
+    if (doff + filesz > size || vref(vnode))
+        return NULL;
+
+    pager = kzalloc(sizeof(struct vr_pager) + map_size);
+    if (!pager)
+        goto fail;
+
+    /* No need to clear the pages as they are cleared when read in. */
+    bp = vr_alloc(size);
+    if (!bp) {
+        kfree(pager);
+        goto fail;
+    }
+
+    pager->foff = foff;
+    pager->doff = doff;
+    pager->filesz = filesz;
+    pager->size = map_size;
+
+    fs_fildes_set(&bp->b_file, vnode, O_RDONLY);
+    bp->b_file.stream = NULL;
+    bp->b_pager = pager;
 
     return bp;
+fail:
+    vrele(vnode);
+    return NULL;
 }
 
 /**
@@ -312,17 +964,35 @@ static void vrref(struct buf * bp)
 }
 
 /**
- * Clone a vregion.
- * @param old_region is the old region to be cloned.
- * @return  Returns a pointer to the new vregion if operation was successful;
- *          Otherwise zero.
+ * Copy the attributes of a cloned region.
+ * COW|COR needs to be cleared on clone.
+ * @param new_region is the clone.
+ * @param old_region is the region new_region was cloned from.
  */
+static void vr_clone_attrs(struct buf * new_region,
+                           const struct buf * old_region)
+{
+    new_region->b_uflags = ~(VM_PROT_COW | VM_PROT_COR) & old_region->b_uflags;
+    new_region->b_mmu.vaddr = old_region->b_mmu.vaddr;
+    /* num_pages already set */
+    new_region->b_mmu.ap = old_region->b_mmu.ap;
+    new_region->b_mmu.control = old_region->b_mmu.control;
+    /* paddr already set */
+    new_region->b_mmu.pt = old_region->b_mmu.pt;
+    vm_updateusr_ap(new_region);
+}
+
 static struct buf * vr_rclone(struct buf * old_region)
 {
     struct buf * new_region;
     const size_t rsize = old_region->b_bufsize;
 
-    new_region = geteblk(rsize);
+    if ((old_region->b_pager && vr_pagein_all(old_region)) ||
+        (old_region->b_cow && vr_cow_pagein_all(old_region)))
+        return NULL;
+
+    /* No need to clear the pages as all of them are overwritten. */
+    new_region = vr_alloc(rsize);
     if (!new_region) {
         KERROR(KERROR_ERR, "%s: Out of memory, tried to allocate %d bytes\n",
                __func__, (unsigned)rsize);
@@ -334,25 +1004,201 @@ static struct buf * vr_rclone(struct buf * old_region)
                (unsigned)rsize);
 
     /* Copy data */
-    memcpy((void *)(new_region->b_data), (void *)(old_region->b_data),
-           rsize);
+    mtx_lock(&old_region->lock);
+    if (old_region->b_cow) {
+        /* Some of the pages may still live in the COW source region. */
+        for (size_t i = 0; i < VREG_PCOUNT(rsize); i++) {
+            memcpy((void *)(new_region->b_data + VREG_BYTESIZE(i)),
+                   (void *)vr_cow_pdata(old_region, i), MMU_PGSIZE_COARSE);
+        }
+    } else {
+        memcpy((void *)(new_region->b_data), (void *)(old_region->b_data),
+               rsize);
+    }
+    mtx_unlock(&old_region->lock);
+
+    vr_clone_attrs(new_region, old_region);
+
+    return new_region;
+}
+
+/**
+ * Add a COW source region for a lazy clone.
+ * @return Returns the index of the source; VR_COW_PRIVATE if the source table
+ *         is full.
+ */
+static uint8_t vr_cow_addsrc(struct vr_cow * cow, struct buf * src)
+{
+    for (size_t i = 0; i < cow->nsrc; i++) {
+        if (cow->src[i] == src)
+            return i;
+    }
+    if (cow->nsrc == VR_COW_NSRC)
+        return VR_COW_PRIVATE;
+
+    vrref(src);
+    cow->src[cow->nsrc] = src;
+    return cow->nsrc++;
+}
+
+/**
+ * Clone a vregion lazily.
+ * Only the memory for the new region is reserved here, the pages are copied
+ * from old_region, or from the regions old_region was lazily cloned from,
+ * one at a time by vr_rpfault() when they are written to.
+ * If the caller holds the only reference to old_region then nothing needs to
+ * be copied and the region is just made writable again.
+ * @param old_region is the old region to be cloned.
+ * @return  Returns a pointer to the new vregion if operation was successful;
+ *          Otherwise zero.
+ */
+static struct buf * vr_rpclone(struct buf * old_region)
+{
+    const size_t pcount = VREG_PCOUNT(old_region->b_bufsize);
+    struct buf * new_region;
+    struct vr_cow * cow;
+
+    if (kobj_refcnt(&old_region->b_obj) == 1) {
+        /*
+         * The region is no longer shared, so the caller can have it. A ref
+         * is taken because the caller will free the old region.
+         */
+        vrref(old_region);
+        mtx_lock(&old_region->lock);
+        old_region->b_uflags &= ~(VM_PROT_COW | VM_PROT_COR);
+        mtx_unlock(&old_region->lock);
+        vm_updateusr_ap(old_region);
+
+        atomic_inc(&cow_nreused);
+        return old_region;
+    }
 
     /*
-     * Copy attributes.
-     * COW|COR needs to be cleared on clone.
+     * The pages of a demand paged region are read in to old_region when the
+     * clone faults on them, except if the source table of the clone would
+     * overflow and some of the pages must be copied right away.
      */
-    new_region->b_uflags = ~(VM_PROT_COW | VM_PROT_COR) & old_region->b_uflags;
-    new_region->b_mmu.vaddr = old_region->b_mmu.vaddr;
-    /* num_pages already set */
-    new_region->b_mmu.ap = old_region->b_mmu.ap;
-    new_region->b_mmu.control = old_region->b_mmu.control;
-    /* paddr already set */
-    new_region->b_mmu.pt = old_region->b_mmu.pt;
-    vm_updateusr_ap(new_region);
+    if (old_region->b_cow && old_region->b_cow->nsrc == VR_COW_NSRC &&
+        vr_cow_pagein_all(old_region))
+        return NULL;
+
+    cow = kzalloc(sizeof(struct vr_cow) + pcount);
+    if (!cow)
+        return NULL;
+
+    new_region = vr_alloc(old_region->b_bufsize);
+    if (!new_region) {
+        KERROR(KERROR_ERR, "%s: Out of memory, tried to allocate %d bytes\n",
+               __func__, (unsigned)old_region->b_bufsize);
+        kfree(cow);
+        return NULL;
+    }
+
+    /*
+     * Pages not yet copied to old_region are shared with its sources rather
+     * than chaining the clones.
+     */
+    mtx_lock(&old_region->lock);
+    for (size_t i = 0; i < pcount; i++) {
+        const struct vr_cow * old_cow = old_region->b_cow;
+        struct buf * src = old_region;
+        uint8_t isrc;
+
+        if (old_cow && old_cow->psrc[i] != VR_COW_PRIVATE)
+            src = old_cow->src[old_cow->psrc[i]];
+
+        isrc = vr_cow_addsrc(cow, src);
+        if (isrc == VR_COW_PRIVATE) {
+            /* Too many sources, copy the page now. */
+            memcpy((void *)(new_region->b_data + VREG_BYTESIZE(i)),
+                   (void *)vr_cow_pdata(old_region, i), MMU_PGSIZE_COARSE);
+            atomic_inc(&cow_ncopied);
+        } else {
+            cow->npending++;
+        }
+        cow->psrc[i] = isrc;
+    }
+    mtx_unlock(&old_region->lock);
+
+    new_region->b_cow = cow;
+    vr_clone_attrs(new_region, old_region);
+
+    atomic_add(&cow_nshared, cow->npending);
+    atomic_inc(&cow_nclones);
+
+    KERROR_DBG("lazy clone %x -> %x, %u pages\n",
+               (unsigned)old_region->b_data, (unsigned)new_region->b_data,
+               (unsigned)pcount);
 
     return new_region;
 }
 
+static int vr_rpfault(struct buf * bp, uintptr_t vaddr, struct vm_pt * pt)
+{
+    struct vr_cow * cow;
+    size_t i;
+    int err;
+
+    mtx_lock(&bp->lock);
+
+    if (!bp->b_cow && !bp->b_pager) {
+        err = -ENOENT;
+        goto out;
+    }
+    if (vaddr < bp->b_mmu.vaddr ||
+        vaddr - bp->b_mmu.vaddr >= bp->b_bufsize) {
+        err = -EFAULT;
+        goto out;
+    }
+
+    i = VREG_PCOUNT(vaddr - bp->b_mmu.vaddr);
+
+    if (bp->b_pager) {
+        /*
+         * A page already read in by someone else is mapped by the caller
+         * remapping the region.
+         */
+        err = vr_pagein(bp, i);
+        if (!err && pt)
+            err = vr_map_page(bp, i, pt);
+        goto out;
+    }
+
+    if (pt && (bp->b_uflags & VM_PROT_COW)) {
+        /*
+         * The region is shared and other processes may still have the
+         * source pages mapped, so it must be cloned instead.
+         */
+        err = -ENOENT;
+        goto out;
+    }
+
+    err = vr_cow_pagein(bp, i);
+    if (err)
+        goto out;
+    err = vr_cow_copy(bp, i);
+    if (err || !pt)
+        goto out;
+
+    /* Map the private copy of the page. */
+    err = vr_map_page(bp, i, pt);
+    if (err)
+        goto out;
+
+    /*
+     * The region is only mapped to a single process, so once the last page
+     * is mapped there are no more mappings to the source region.
+     */
+    cow = vr_cow_detach(bp);
+    mtx_unlock(&bp->lock);
+    if (cow)
+        vr_cow_free(cow);
+    return 0;
+out:
+    mtx_unlock(&bp->lock);
+    return err;
+}
+
 void allocbuf(struct buf * bp, size_t size)
 {
     const size_t orig_size = size;
@@ -362,53 +1208,68 @@ void allocbuf(struct buf * bp, size_t size)
     size_t iblock;
     size_t bcount = VREG_PCOUNT(bp->b_bufsize);
     struct vregion * vreg = bp->allocator_data;
+    struct vr_cow * cow;
+    int release = 0;
 
     KASSERT(vreg, "bp->allocator_data should be always set");
 
     if (bp->b_bufsize == new_size)
         return;
 
+    if (bp->b_pager) {
+        /* The pager doesn't know about the new pages. */
+        if (vr_pagein_all(bp))
+            KERROR(KERROR_ERR, "%s: Page in failed\n", __func__);
+        vr_pager_free(bp);
+    }
+    if (bp->b_cow && vr_cow_pagein_all(bp))
+        KERROR(KERROR_ERR, "%s: Page in failed\n", __func__);
+
     mtx_lock(&bp->lock);
+    vr_cow_copy_all(bp);
+    cow = vr_cow_detach(bp);
     mtx_lock(&vr_big_lock);
 
-    if (blockdiff > 0) {
-        const size_t sblock = VREG_ADDR2I(vreg, bp->b_data) + bcount;
+    if (pcount > bcount) {
+        const size_t oblock = VREG_ADDR2I(vreg, bp->b_data);
+        const size_t sblock = oblock + bcount;
+
+        if (sblock + blockdiff <= VREG_NPAGES(vreg) &&
+            buddy_reserve(&vreg->buddy, sblock, blockdiff) == 0) {
+            int err;
+
+            /* The pages following the buffer were free. */
+            err = bitmap_block_update(vreg->map, 1, sblock, blockdiff,
+                                      vreg->size);
+            KASSERT(err == 0, "vreg map update OOB");
+            vreg->count += blockdiff;
+            vralloc_used += VREG_BYTESIZE(blockdiff);
+            zpool_pages -= vreg_zcount(vreg, sblock, blockdiff);
+        } else { /* Must allocate a new region */
+            struct vregion * nvreg;
+            uintptr_t new_addr;
+
+            nvreg = get_iblocks_locked(&iblock, pcount);
+            if (!nvreg) {
+                /*
+                 * It's not nice to panic here but we don't have any
+                 * method to inform the caller about OOM.
+                 */
+                /* TODO We should probably kill the caller */
+                panic("OOM during allocbuf()");
+            }
 
-        if (bitmap_block_search_s(sblock, &iblock, blockdiff, vreg->map,
-                    vreg->size) == 0) {
-            if (iblock == sblock + 1) {
-                int err;
-                err = bitmap_block_update(vreg->map, 1, sblock, blockdiff,
-                                          vreg->size);
-                KASSERT(err == 0, "vreg map update OOB");
-            } else { /* Must allocate a new region */
-                struct vregion * nvreg;
-                uintptr_t new_addr;
-                int err;
+            new_addr = VREG_I2ADDR(nvreg, iblock);
+            memcpy((void *)(new_addr), (void *)(bp->b_data), bp->b_bufsize);
 
-                nvreg = get_iblocks(&iblock, pcount);
-                if (!nvreg) {
-                    /*
-                     * It's not nice to panic here but we don't have any
-                     * method to inform the caller about OOM.
-                     */
-                    /* TODO We should probably kill the caller */
-                    panic("OOM during allocbuf()");
-                }
-
-                new_addr = VREG_I2ADDR(nvreg, iblock);
-                memcpy((void *)(new_addr), (void *)(bp->b_data), bp->b_bufsize);
-
-                bp->b_mmu.paddr = new_addr;
-                bp->b_data = bp->b_mmu.paddr; /* Currently this way as
-                                               * kernel space is 1:1 */
-                bp->allocator_data = nvreg;
-
-                /* Free blocks from old vreg */
-                err = bitmap_block_update(vreg->map, 0, iblock, bcount,
-                                          vreg->size);
-                KASSERT(err == 0, "vreg map update OOB");
-            }
+            bp->b_mmu.paddr = new_addr;
+            bp->b_data = bp->b_mmu.paddr; /* Currently this way as
+                                           * kernel space is 1:1 */
+            bp->allocator_data = nvreg;
+
+            /* Free blocks from old vreg */
+            put_iblocks_locked(vreg, oblock, bcount);
+            release = vreg_release_locked(vreg);
         }
     } else {
 #if 0 /*
@@ -429,6 +1290,12 @@ void allocbuf(struct buf * bp, size_t size)
 
     mtx_unlock(&bp->lock);
     mtx_unlock(&vr_big_lock);
+
+    /* All the pages are private now, release the source regions. */
+    if (cow)
+        vr_cow_free(cow);
+    if (release)
+        vreg_free_node(vreg);
 }
 
 void vrfree(struct buf * bp)
@@ -438,9 +1305,114 @@ void vrfree(struct buf * bp)
     kobj_unref(&bp->b_obj);
 }
 
+/**
+ * Test whether a page of a lazily cloned region can be mapped.
+ * @note bp->lock must be held.
+ */
+static int vr_cow_loaded(const struct buf * bp, size_t i)
+{
+    const struct vr_cow * cow = bp->b_cow;
+
+    return cow->psrc[i] == VR_COW_PRIVATE ||
+           vr_page_loaded(cow->src[cow->psrc[i]], i);
+}
+
+/**
+ * Map a lazily cloned region.
+ * The pages not yet copied are mapped read-only from the source regions.
+ * Pages of a demand paged source region that are not yet read in are left
+ * unmapped.
+ * @note bp->lock must be held.
+ * @param bp is a pointer to the region.
+ * @param mmu_region is the mapping of the whole region.
+ */
+static int vr_cow_mmap(const struct buf * bp, const mmu_region_t * mmu_region)
+{
+    const struct vr_cow * cow = bp->b_cow;
+    const size_t pcount = mmu_region->num_pages;
+    size_t i = 0;
+
+    while (i < pcount) {
+        const uint8_t src = cow->psrc[i];
+        const int loaded = vr_cow_loaded(bp, i);
+        mmu_region_t part;
+        size_t n = 1;
+        int err;
+
+        while (i + n < pcount && cow->psrc[i + n] == src &&
+               vr_cow_loaded(bp, i + n) == loaded) {
+            n++;
+        }
+        if (!loaded) {
+            i += n;
+            continue;
+        }
+
+        part = *mmu_region;
+        part.vaddr += VREG_BYTESIZE(i);
+        part.num_pages = n;
+        if (src == VR_COW_PRIVATE) {
+            part.paddr += VREG_BYTESIZE(i);
+        } else {
+            part.paddr = cow->src[src]->b_mmu.paddr + VREG_BYTESIZE(i);
+            part.ap = (mmu_region->ap == MMU_AP_RWRW) ? MMU_AP_RORO
+                                                      : MMU_AP_RONA;
+        }
+        err = mmu_map_region(&part);
+        if (err)
+            return err;
+        i += n;
+    }
+
+    return 0;
+}
+
+/**
+ * Map the pages of a demand paged region that are already in memory.
+ * The rest of the pages are left unmapped until they are read in.
+ * @note bp->lock must be held.
+ * @param bp is a pointer to the region.
+ * @param mmu_region is the mapping of the whole region.
+ */
+static int vr_pager_mmap(const struct buf * bp,
+                         const mmu_region_t * mmu_region)
+{
+    const struct vr_pager * pager = bp->b_pager;
+    const size_t pcount = mmu_region->num_pages;
+    size_t i = 0;
+
+    while (i < pcount) {
+        mmu_region_t loaded;
+        size_t n = 0;
+        int err;
+
+        while (i + n < pcount &&
+               bitmap_status(pager->map, i + n, pager->size)) {
+            n++;
+        }
+        if (n == 0) {
+            i++;
+            continue;
+        }
+
+        loaded = *mmu_region;
+        loaded.vaddr += VREG_BYTESIZE(i);
+        loaded.paddr += VREG_BYTESIZE(i);
+        loaded.num_pages = n;
+        err = mmu_map_region(&loaded);
+        if (err)
+            return err;
+        i += n;
+    }
+
+    return 0;
+}
+
 int vrmmap(struct buf * region, struct vm_pt * pt)
 {
     mmu_region_t mmu_region;
+    struct vr_cow * cow;
+    int err;
 
     KASSERT(region, "region can't be null\n");
 
@@ -450,9 +1422,25 @@ int vrmmap(struct buf * region, struct vm_pt * pt)
     mmu_region = region->b_mmu; /* Make a copy. */
     mmu_region.pt = &(pt->pt);
 
+    if (region->b_pager) {
+        err = vr_pager_mmap(region, &mmu_region);
+        mtx_unlock(&region->lock);
+        return err;
+    }
+    if (!region->b_cow) {
+        mtx_unlock(&region->lock);
+        return mmu_map_region(&mmu_region);
+    }
+
+    err = vr_cow_mmap(region, &mmu_region);
+    /* A shared region may still have the sources mapped to other processes. */
+    cow = (err || (region->b_uflags & VM_PROT_COW)) ? NULL
+                                                    : vr_cow_detach(region);
     mtx_unlock(&region->lock);
+    if (cow)
+        vr_cow_free(cow);
 
-    return mmu_map_region(&mmu_region);
+    return err;
 }
 
 int clone2vr(struct buf * src, struct buf ** out)
@@ -0,0 +1,166 @@
+/**
+ *******************************************************************************
+ * @file    waitq.c
+ * @author  Olli Vanhoja
+ * @brief   Wait queues.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#include <errno.h>
+#include <hal/core.h>
+#include <hal/hw_timers.h>
+#include <thread.h>
+#include <waitq.h>
+
+void waitq_init(struct waitq * wq)
+{
+    mtx_init(&wq->wq_lock, MTX_TYPE_SPIN, MTX_OPT_DINT);
+    TAILQ_INIT(&wq->wq_head);
+}
+
+int waitq_sleep(struct waitq * wq, mtx_t * mtx, long timeout)
+{
+    struct waitq_entry we = {
+        .we_tid = current_thread->id,
+        .we_woken = 0,
+    };
+    const uint64_t deadline = get_utime() + (uint64_t)timeout * 1000;
+    istate_t s;
+    int retval = 0;
+
+    mtx_lock(&wq->wq_lock);
+    TAILQ_INSERT_TAIL(&wq->wq_head, &we, we_link);
+    mtx_unlock(&wq->wq_lock);
+
+    if (mtx)
+        mtx_unlock(mtx);
+
+    while (1) {
+        int timer_id = -1;
+
+        /*
+         * Interrupts are kept disabled between checking the wakeup status and
+         * blocking, otherwise a wakeup could get lost. thread_wait() will
+         * enable interrupts once the thread is in the blocked state.
+         */
+        s = get_interrupt_state();
+        disable_interrupt();
+
+        mtx_lock(&wq->wq_lock);
+        if (we.we_woken) {
+            mtx_unlock(&wq->wq_lock);
+            set_interrupt_state(s);
+            break;
+        }
+        mtx_unlock(&wq->wq_lock);
+
+        if (timeout > 0) {
+            uint64_t now = get_utime();
+
+            if (now >= deadline) {
+                retval = -ETIMEDOUT;
+                set_interrupt_state(s);
+                break;
+            }
+            timer_id = thread_alarm((long)((deadline - now + 999) / 1000));
+            if (timer_id < 0) {
+                /* Out of timers, poll instead. */
+                set_interrupt_state(s);
+                thread_yield(THREAD_YIELD_LAZY);
+                continue;
+            }
+        }
+
+        thread_wait();
+        set_interrupt_state(s);
+
+        if (timer_id >= 0)
+            thread_alarm_rele(timer_id);
+    }
+
+    mtx_lock(&wq->wq_lock);
+    if (!we.we_woken)
+        TAILQ_REMOVE(&wq->wq_head, &we, we_link);
+    else
+        retval = 0; /* A wakeup raced with the timeout. */
+    mtx_unlock(&wq->wq_lock);
+
+    if (mtx)
+        mtx_lock(mtx);
+
+    return retval;
+}
+
+void waitq_add(struct waitq * wq, struct waitq_entry * we)
+{
+    we->we_tid = current_thread->id;
+    we->we_woken = 0;
+
+    mtx_lock(&wq->wq_lock);
+    TAILQ_INSERT_TAIL(&wq->wq_head, we, we_link);
+    mtx_unlock(&wq->wq_lock);
+}
+
+int waitq_remove(struct waitq * wq, struct waitq_entry * we)
+{
+    int woken;
+
+    mtx_lock(&wq->wq_lock);
+    woken = we->we_woken;
+    if (!woken)
+        TAILQ_REMOVE(&wq->wq_head, we, we_link);
+    mtx_unlock(&wq->wq_lock);
+
+    return woken;
+}
+
+static int waitq_wakeup_n(struct waitq * wq, int n)
+{
+    struct waitq_entry * we;
+    int count = 0;
+
+    mtx_lock(&wq->wq_lock);
+    while ((n < 0 || count < n) && (we = TAILQ_FIRST(&wq->wq_head))) {
+        TAILQ_REMOVE(&wq->wq_head, we, we_link);
+        we->we_woken = 1;
+        thread_release(we->we_tid);
+        count++;
+    }
+    mtx_unlock(&wq->wq_lock);
+
+    return count;
+}
+
+int waitq_wakeup(struct waitq * wq)
+{
+    return waitq_wakeup_n(wq, 1);
+}
+
+int waitq_wakeup_all(struct waitq * wq)
+{
+    return waitq_wakeup_n(wq, -1);
+}
@@ -0,0 +1,123 @@
+/**
+ *******************************************************************************
+ * @file    select.c
+ * @author  Olli Vanhoja
+ * @brief   Synchronous input/output multiplexing.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/select.h>
+
+int select(int nfds, fd_set * restrict readfds, fd_set * restrict writefds,
+           fd_set * restrict errorfds, struct timeval * restrict timeout)
+{
+    int timeout_ms;
+    nfds_t npfds = 0;
+    int retval;
+
+    if (nfds < 0 || nfds > FD_SETSIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (timeout) {
+        if (timeout->tv_sec < 0 || timeout->tv_usec < 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        timeout_ms = timeout->tv_sec * 1000 + timeout->tv_usec / 1000;
+    } else {
+        timeout_ms = -1;
+    }
+
+    for (int fd = 0; fd < nfds; fd++) {
+        if ((readfds && FD_ISSET(fd, readfds)) ||
+            (writefds && FD_ISSET(fd, writefds)) ||
+            (errorfds && FD_ISSET(fd, errorfds)))
+            npfds++;
+    }
+
+    struct pollfd pfds[npfds > 0 ? npfds : 1];
+
+    npfds = 0;
+    for (int fd = 0; fd < nfds; fd++) {
+        short events = 0;
+
+        if (readfds && FD_ISSET(fd, readfds))
+            events |= POLLIN;
+        if (writefds && FD_ISSET(fd, writefds))
+            events |= POLLOUT;
+        if (!(events || (errorfds && FD_ISSET(fd, errorfds))))
+            continue;
+
+        pfds[npfds].fd = fd;
+        pfds[npfds].events = events;
+        pfds[npfds].revents = 0;
+        npfds++;
+    }
+
+    retval = poll(pfds, npfds, timeout_ms);
+    if (retval < 0)
+        return retval;
+
+    if (readfds)
+        FD_ZERO(readfds);
+    if (writefds)
+        FD_ZERO(writefds);
+    if (errorfds)
+        FD_ZERO(errorfds);
+
+    retval = 0;
+    for (nfds_t i = 0; i < npfds; i++) {
+        const int fd = pfds[i].fd;
+        const short revents = pfds[i].revents;
+
+        if (revents & POLLNVAL) {
+            errno = EBADF;
+            return -1;
+        }
+        /* A hangup or an error makes a read or write not to block. */
+        if (readfds && (pfds[i].events & POLLIN) &&
+            (revents & (POLLIN | POLLHUP | POLLERR))) {
+            FD_SET(fd, readfds);
+            retval++;
+        }
+        if (writefds && (pfds[i].events & POLLOUT) &&
+            (revents & (POLLOUT | POLLERR))) {
+            FD_SET(fd, writefds);
+            retval++;
+        }
+        if (errorfds && (revents & POLLERR)) {
+            FD_SET(fd, errorfds);
+            retval++;
+        }
+    }
+
+    return retval;
+}
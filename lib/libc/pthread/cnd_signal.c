@@ -0,0 +1,7 @@
+#include <threads.h>
+#include <pthread.h>
+
+int cnd_signal(cnd_t *cond)
+{
+    return (pthread_cond_signal(cond)) ? thrd_error : thrd_success;
+}
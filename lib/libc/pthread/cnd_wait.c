@@ -0,0 +1,7 @@
+#include <threads.h>
+#include <pthread.h>
+
+int cnd_wait(cnd_t *cond, mtx_t *mtx)
+{
+    return (pthread_cond_wait(cond, mtx)) ? thrd_error : thrd_success;
+}
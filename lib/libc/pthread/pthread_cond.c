@@ -0,0 +1,166 @@
+/**
+ *******************************************************************************
+ * @file    pthread_cond.c
+ * @author  Olli Vanhoja
+ * @brief   POSIX condition variables.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <machine/atomic.h>
+#include <pthread.h>
+#include "pthread_futex.h"
+
+int pthread_condattr_init(pthread_condattr_t *attr)
+{
+    if (!attr)
+        return EINVAL;
+
+    attr->pshared = PTHREAD_PROCESS_PRIVATE;
+
+    return 0;
+}
+
+int pthread_condattr_destroy(pthread_condattr_t *attr)
+{
+    return 0;
+}
+
+int pthread_condattr_getpshared(const pthread_condattr_t *attr, int *pshared)
+{
+    if (!attr || !pshared)
+        return EINVAL;
+
+    *pshared = attr->pshared;
+
+    return 0;
+}
+
+int pthread_condattr_setpshared(pthread_condattr_t *attr, int pshared)
+{
+    if (!attr)
+        return EINVAL;
+
+    if (pshared != PTHREAD_PROCESS_PRIVATE && pshared != PTHREAD_PROCESS_SHARED)
+        return EINVAL;
+
+    attr->pshared = pshared;
+
+    return 0;
+}
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr)
+{
+    if (!cond)
+        return EINVAL;
+
+    cond->seq = 0;
+    cond->pshared = attr ? attr->pshared : PTHREAD_PROCESS_PRIVATE;
+
+    return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t *cond)
+{
+    if (!cond)
+        return EINVAL;
+
+    return 0;
+}
+
+/*
+ * A waiter samples the sequence number before releasing the mutex and the
+ * kernel only puts it to sleep if the number hasn't changed since, so a
+ * signal between the unlock and the futex wait is never lost.
+ */
+static int cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                     const struct timespec *abstime)
+{
+    const int errno_save = errno;
+    const int seq = atomic_read(&cond->seq);
+    long timeout;
+    int retval = 0;
+    int err;
+
+    timeout = _pthread_abstime2ms(abstime);
+    if (timeout < 0)
+        return ETIMEDOUT;
+
+    err = pthread_mutex_unlock(mutex);
+    if (err)
+        return err;
+
+    if (futex_wait(&cond->seq, seq, PTHREAD_FUTEX_FLAGS(cond->pshared),
+                   timeout) && errno == ETIMEDOUT) {
+        retval = ETIMEDOUT;
+    }
+    errno = errno_save;
+
+    err = pthread_mutex_lock(mutex);
+
+    return (err) ? err : retval;
+}
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+    if (!cond || !mutex)
+        return EINVAL;
+
+    return cond_wait(cond, mutex, NULL);
+}
+
+int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                           const struct timespec *abstime)
+{
+    if (!cond || !mutex || !abstime)
+        return EINVAL;
+
+    return cond_wait(cond, mutex, abstime);
+}
+
+int pthread_cond_signal(pthread_cond_t *cond)
+{
+    if (!cond)
+        return EINVAL;
+
+    atomic_inc(&cond->seq);
+    futex_wake(&cond->seq, 1, PTHREAD_FUTEX_FLAGS(cond->pshared));
+
+    return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t *cond)
+{
+    if (!cond)
+        return EINVAL;
+
+    atomic_inc(&cond->seq);
+    futex_wake(&cond->seq, INT_MAX, PTHREAD_FUTEX_FLAGS(cond->pshared));
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+/**
+ *******************************************************************************
+ * @file    pthread_futex.h
+ * @author  Olli Vanhoja
+ * @brief   Futex helpers for pthread synchronization primitives.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#ifndef PTHREAD_FUTEX_H
+#define PTHREAD_FUTEX_H
+
+#include <sys/futex.h>
+#include <pthread.h>
+#include <time.h>
+
+/**
+ * Get futex flags for a pshared attribute value.
+ */
+#define PTHREAD_FUTEX_FLAGS(pshared) \
+    (((pshared) == PTHREAD_PROCESS_SHARED) ? 0 : FUTEX_PRIVATE)
+
+/**
+ * Convert an absolute CLOCK_REALTIME timeout into a futex timeout.
+ * @param abstime is the absolute timeout; Can be NULL.
+ * @return Returns the remaining time in ms, at least 1 ms;
+ *         0 if abstime is NULL;
+ *         -1 if the timeout has already expired.
+ */
+static inline long _pthread_abstime2ms(const struct timespec * abstime)
+{
+    struct timespec now;
+    long long ns;
+
+    if (!abstime)
+        return 0;
+
+    if (clock_gettime(CLOCK_REALTIME, &now))
+        return -1;
+
+    ns = (long long)(abstime->tv_sec - now.tv_sec) * 1000000000LL +
+         (abstime->tv_nsec - now.tv_nsec);
+    if (ns <= 0)
+        return -1;
+
+    return (long)((ns + 999999) / 1000000);
+}
+
+#endif /* PTHREAD_FUTEX_H */
@@ -35,8 +35,8 @@
 #include <errno.h>
 #include <machine/atomic.h>
 #include <sys/types_pthread.h>
-#include <signal.h>
 #include <pthread.h>
+#include "pthread_futex.h"
 
 int pthread_mutexattr_init(pthread_mutexattr_t *attr)
 {
@@ -101,25 +101,54 @@ int pthread_mutexattr_settype(pthread_mutexattr_t *attr, int kind)
     return 0;
 }
 
-static void init_mtxsigset(sigset_t * set)
+/*
+ * Lock the futex word of a mutex.
+ * The lock word is 0 if unlocked, 1 if locked and 2 if locked and there might
+ * be threads sleeping in the kernel. The unlocking thread only needs to make
+ * a system call in the last case.
+ */
+static int lock_word(pthread_mutex_t *mutex, const struct timespec *abstime)
 {
-    sigemptyset(set);
-    sigaddset(set, _SIGMTX);
+    const int flags = PTHREAD_FUTEX_FLAGS(mutex->pshared);
+    int c;
+
+    c = atomic_cmpxchg(&mutex->lock, 0, 1);
+    if (c == 0)
+        return 0; /* Uncontended */
+
+    if (c != 2)
+        c = atomic_set(&mutex->lock, 2);
+    while (c != 0) {
+        const int errno_save = errno;
+        long timeout;
+
+        timeout = _pthread_abstime2ms(abstime);
+        if (timeout < 0)
+            return ETIMEDOUT;
+
+        if (futex_wait(&mutex->lock, 2, flags, timeout) &&
+            errno == ETIMEDOUT) {
+            errno = errno_save;
+            return ETIMEDOUT;
+        }
+        errno = errno_save;
+
+        c = atomic_set(&mutex->lock, 2);
+    }
+
+    return 0;
 }
 
-static void on_sigmtx(int i)
+static int unlock_word(pthread_mutex_t *mutex)
 {
-    sigset_t set;
+    const int c = atomic_set(&mutex->lock, 0);
 
-    /*
-     * Block signal _SIGMTX as someone has unblocked it.
-     */
-    init_mtxsigset(&set);
-    sigprocmask(SIG_BLOCK, &set, NULL);
-    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    if (c == 0)
+        return EPERM;
+    if (c == 2)
+        futex_wake(&mutex->lock, 1, PTHREAD_FUTEX_FLAGS(mutex->pshared));
 
-    /* Let's try again. */
-    raise(_SIGMTX);
+    return 0;
 }
 
 int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr)
@@ -127,20 +156,11 @@ int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr)
     if (!mutex)
         return EINVAL;
 
-    if (attr && attr->pshared == PTHREAD_PROCESS_SHARED)
-        return ENOSYS;
-
     mutex->lock = 0;
     mutex->recursion = 0;
     mutex->kind = attr ? attr->kind : PTHREAD_MUTEX_DEFAULT;
     mutex->owner = -1;
-
-    /*
-     * We must set a handler for _SIGMTX or otherwise it woudn't work with
-     * sigwait().
-     */
-    signal(_SIGMTX, &on_sigmtx);
-    on_sigmtx(0);
+    mutex->pshared = attr ? attr->pshared : PTHREAD_PROCESS_PRIVATE;
 
     return 0;
 }
@@ -154,91 +174,44 @@ int pthread_mutex_destroy(pthread_mutex_t *mutex)
   return 0;
 }
 
-int pthread_mutex_lock(pthread_mutex_t *mutex)
+static int mutex_lock(pthread_mutex_t *mutex, const struct timespec *abstime)
 {
-    if (mutex->kind == PTHREAD_MUTEX_NORMAL) {
-        if (atomic_set(&mutex->lock, 1) != 0) {
-            while (atomic_set(&mutex->lock, -1) != 0) {
-                sigset_t set;
-                int sig;
-
-                init_mtxsigset(&set);
-                if (sigwait(&set, &sig) != 0)
-                    return EINVAL;
-            }
-        }
-    } else {
-        pthread_t self = pthread_self();
+    pthread_t self;
+    int err;
 
-        if (atomic_set(&mutex->lock, 1) == 0) {
-            mutex->recursion = 1;
-            mutex->owner = self;
-        } else {
-            if (pthread_equal(mutex->owner, self)) {
-                if (mutex->kind == PTHREAD_MUTEX_RECURSIVE)
-                    mutex->recursion++;
-                else
-                    return EDEADLK;
-            } else {
-                while (atomic_set(&mutex->lock, -1) != 0) {
-                    sigset_t set;
-                    int sig;
-
-                    init_mtxsigset(&set);
-                    if (sigwait(&set, &sig) != 0)
-                        return EINVAL;
-                    mutex->recursion = 1;
-                    mutex->owner = self;
-                }
-            }
+    if (mutex->kind == PTHREAD_MUTEX_NORMAL)
+        return lock_word(mutex, abstime);
+
+    self = pthread_self();
+    if (atomic_read(&mutex->lock) != 0 && pthread_equal(mutex->owner, self)) {
+        if (mutex->kind == PTHREAD_MUTEX_RECURSIVE) {
+            mutex->recursion++;
+            return 0;
         }
+        return EDEADLK;
     }
 
+    err = lock_word(mutex, abstime);
+    if (err)
+        return err;
+    mutex->recursion = 1;
+    mutex->owner = self;
+
     return 0;
 }
 
+int pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+    return mutex_lock(mutex, NULL);
+}
+
 int pthread_mutex_timedlock(pthread_mutex_t *mutex,
                             const struct timespec *abstime)
 {
-    if (mutex->kind == PTHREAD_MUTEX_NORMAL) {
-        if (atomic_set(&mutex->lock, 1) != 0) {
-            while (atomic_set(&mutex->lock, -1) != 0) {
-                sigset_t set;
-                siginfo_t info;
-
-                init_mtxsigset(&set);
-                if (sigtimedwait(&set, &info, abstime) != 0)
-                    return EINVAL;
-            }
-        }
-    } else {
-        pthread_t self = pthread_self();
-
-        if (atomic_set(&mutex->lock, 1) == 0) {
-            mutex->recursion = 1;
-            mutex->owner = self;
-        } else {
-            if (pthread_equal(mutex->owner, self)) {
-                if (mutex->kind == PTHREAD_MUTEX_RECURSIVE)
-                    mutex->recursion++;
-                else
-                    return EDEADLK;
-            } else {
-                while (atomic_set(&mutex->lock, -1) != 0) {
-                    sigset_t set;
-                    siginfo_t info;
-
-                    init_mtxsigset(&set);
-                    if (sigtimedwait(&set, &info, abstime) != 0)
-                        return EINVAL;
-                    mutex->recursion = 1;
-                    mutex->owner = self;
-                }
-            }
-        }
-    }
+    if (!abstime)
+        return EINVAL;
 
-    return 0;
+    return mutex_lock(mutex, abstime);
 }
 
 int pthread_mutex_trylock(pthread_mutex_t *mutex)
@@ -261,33 +234,15 @@ int pthread_mutex_trylock(pthread_mutex_t *mutex)
 
 int pthread_mutex_unlock(pthread_mutex_t *mutex)
 {
-    if (mutex->kind == PTHREAD_MUTEX_NORMAL) {
-        long idx;
-
-        idx = atomic_set(&mutex->lock, 0);
-        if (idx != 0) {
-            if (idx < 0) {
-                /* Signal to all threads of the current process */
-                if (pthread_kill(-2, _SIGMTX))
-                    return EINVAL;
-            }
-        } else {
-            return EPERM;
-        }
-    } else {
-        if (pthread_equal(mutex->owner, pthread_self())) {
-            if (mutex->kind != PTHREAD_MUTEX_RECURSIVE ||
-                    --mutex->recursion == 0) {
-                mutex->owner = -1;
-                if (atomic_set(&mutex->lock, 0) < 0) {
-                    /* Signal to all threads of the current process */
-                    if (pthread_kill(-2, _SIGMTX))
-                        return EINVAL;
-                }
-            }
-        } else {
-            return EPERM;
-        }
+    if (mutex->kind == PTHREAD_MUTEX_NORMAL)
+        return unlock_word(mutex);
+
+    if (!pthread_equal(mutex->owner, pthread_self()))
+        return EPERM;
+
+    if (mutex->kind != PTHREAD_MUTEX_RECURSIVE || --mutex->recursion == 0) {
+        mutex->owner = -1;
+        return unlock_word(mutex);
     }
 
     return 0;
@@ -31,26 +31,31 @@
  */
 
 #include <errno.h>
+#include <limits.h>
+#include <machine/atomic.h>
+#include <sys/futex.h>
 #include <pthread.h>
 
 int pthread_once(pthread_once_t * once_control, void (*init_routine)(void))
 {
-    int * pe;
+    const int errno_save = errno;
+    int state;
 
-    if (once_control->state == PTHREAD_NEEDS_INIT &&
-        pthread_key_create(&once_control->key, NULL)) {
-        errno = ENOMEM;
-        return -1;
-    }
-    once_control->state = PTHREAD_DONE_INIT;
-    pe = pthread_getspecific(once_control->key);
-    if (pe == NULL) {
-        if (pthread_setspecific(once_control->key, (void *)1)) {
-            errno = ENOMEM;
-            return -1;
+    while ((state = atomic_cmpxchg(&once_control->state, PTHREAD_NEEDS_INIT,
+                                   PTHREAD_INPROGRESS_INIT)) !=
+           PTHREAD_DONE_INIT) {
+        if (state == PTHREAD_NEEDS_INIT) {
+            init_routine();
+            atomic_set(&once_control->state, PTHREAD_DONE_INIT);
+            futex_wake(&once_control->state, INT_MAX, FUTEX_PRIVATE);
+            break;
         }
-        init_routine();
+
+        /* Another thread is running init_routine(). */
+        futex_wait(&once_control->state, PTHREAD_INPROGRESS_INIT,
+                   FUTEX_PRIVATE, 0);
     }
+    errno = errno_save;
 
     return 0;
 }
@@ -32,24 +32,20 @@
  *******************************************************************************
 */
 
-#include <syscall.h>
 #include <errno.h>
+#include <sys/kdata.h>
 #include <sys/types_pthread.h>
 #include <sys/resource.h>
 
 int getloadavg(double loadavg[3], int nelem)
 {
-    uint32_t loads[3];
     int i;
 
     if (nelem > 3)
         return -1;
 
-    if (syscall(SYSCALL_SCHED_GET_LOADAVG, loads))
-        return -1;
-
     for (i = 0; i < nelem; i++) {
-        loadavg[i] = (double)loads[i] / 100.0;
+        loadavg[i] = (double)KDATA->kd_loads[i] / 100.0;
     }
 
     return nelem;
@@ -34,6 +34,7 @@
 #include <syscall.h>
 #include <errno.h>
 #include <time.h>
+#include <sys/kdata.h>
 
 int clock_gettime(clockid_t clk_id, struct timespec * tp)
 {
@@ -41,6 +42,23 @@ int clock_gettime(clockid_t clk_id, struct timespec * tp)
         .clk_id = clk_id,
         .tp = tp
     };
+    uint32_t seq;
 
-    return syscall(SYSCALL_TIME_GETTIME, &args);
+    /*
+     * The time in the kernel data page is only as accurate as the last
+     * scheduler run, which is the same as what the kernel would return for
+     * the wall clock time. The monotonic clocks are read from the timer by
+     * the kernel, so they still need a syscall.
+     */
+    switch (clk_id) {
+    case CLOCK_REALTIME:
+        do {
+            seq = kdata_read_begin();
+            tp->tv_sec = KDATA->kd_realtime.tv_sec;
+            tp->tv_nsec = KDATA->kd_realtime.tv_nsec;
+        } while (kdata_read_retry(seq));
+        return 0;
+    default:
+        return syscall(SYSCALL_TIME_GETTIME, &args);
+    }
 }
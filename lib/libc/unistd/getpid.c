@@ -33,17 +33,10 @@
 */
 
 #include <sys/types.h>
+#include <sys/kdata.h>
 #include <unistd.h>
-#include <syscall.h>
 
 pid_t getpid(void)
 {
-    pid_t pid;
-    int err;
-
-    err = (int)syscall(SYSCALL_PROC_GETPID, &pid);
-
-    if (err)
-        return -1;
-    return pid;
+    return KDATA_PROC->kp_pid;
 }
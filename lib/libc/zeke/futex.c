@@ -0,0 +1,58 @@
+/**
+ *******************************************************************************
+ * @file    futex.c
+ * @author  Olli Vanhoja
+ * @brief   Futex system calls.
+ * @section LICENSE
+ * Copyright (c) 2026 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#define __SYSCALL_DEFS__
+#include <sys/futex.h>
+#include <syscall.h>
+
+int futex_wait(int * uaddr, int val, int flags, long timeout)
+{
+    struct _ipc_futex_args args = {
+        .uaddr = uaddr,
+        .val = val,
+        .flags = flags,
+        .timeout = timeout,
+    };
+
+    return (int)syscall(SYSCALL_IPC_FUTEX_WAIT, &args);
+}
+
+int futex_wake(int * uaddr, int n, int flags)
+{
+    struct _ipc_futex_args args = {
+        .uaddr = uaddr,
+        .val = n,
+        .flags = flags,
+    };
+
+    return (int)syscall(SYSCALL_IPC_FUTEX_WAKE, &args);
+}
@@ -0,0 +1,175 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <zeke.h>
+#include "punit.h"
+
+#define UNCONTENDED_ITER    100000
+#define CONTENDED_ITER      10000
+
+static char stack[2][4096];
+static pthread_mutex_t mtx;
+static pthread_cond_t cond;
+static unsigned counter;
+static int turn;
+
+static void setup(void)
+{
+    pthread_mutex_init(&mtx, NULL);
+    pthread_cond_init(&cond, NULL);
+    counter = 0;
+    turn = 0;
+}
+
+static void teardown(void)
+{
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mtx);
+}
+
+static int64_t ns_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int start_thread(pthread_t * tid, int i, void * (*fn)(void *))
+{
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack[i], sizeof(stack[i]));
+
+    return pthread_create(tid, &attr, fn, (void *)(intptr_t)i);
+}
+
+static char * test_uncontended(void)
+{
+    int64_t start, elapsed;
+
+    start = ns_now();
+    for (int i = 0; i < UNCONTENDED_ITER; i++) {
+        pthread_mutex_lock(&mtx);
+        counter++;
+        pthread_mutex_unlock(&mtx);
+    }
+    elapsed = ns_now() - start;
+
+    pu_assert_equal("All increments done", counter, UNCONTENDED_ITER);
+    printf("uncontended lock/unlock: %d ns/op\n",
+           (int)(elapsed / UNCONTENDED_ITER));
+
+    return NULL;
+}
+
+static void * incr_thread(void * arg)
+{
+    for (int i = 0; i < CONTENDED_ITER; i++) {
+        pthread_mutex_lock(&mtx);
+        counter++;
+        pthread_mutex_unlock(&mtx);
+    }
+
+    return NULL;
+}
+
+static char * test_contended(void)
+{
+    pthread_t tid[2];
+    int64_t start, elapsed;
+
+    start = ns_now();
+    pu_assert_equal("Thread created", start_thread(&tid[0], 0, incr_thread), 0);
+    pu_assert_equal("Thread created", start_thread(&tid[1], 1, incr_thread), 0);
+    pthread_join(tid[0], NULL);
+    pthread_join(tid[1], NULL);
+    elapsed = ns_now() - start;
+
+    pu_assert_equal("No increments were lost", counter, 2 * CONTENDED_ITER);
+    printf("contended lock/unlock: %d ns/op\n",
+           (int)(elapsed / (2 * CONTENDED_ITER)));
+
+    return NULL;
+}
+
+static void * pong_thread(void * arg)
+{
+    const int me = (int)(intptr_t)arg;
+
+    for (int i = 0; i < CONTENDED_ITER; i++) {
+        pthread_mutex_lock(&mtx);
+        while (turn != me)
+            pthread_cond_wait(&cond, &mtx);
+        counter++;
+        turn = !me;
+        pthread_cond_signal(&cond);
+        pthread_mutex_unlock(&mtx);
+    }
+
+    return NULL;
+}
+
+static char * test_cond_pingpong(void)
+{
+    pthread_t tid[2];
+    int64_t start, elapsed;
+
+    start = ns_now();
+    pu_assert_equal("Thread created", start_thread(&tid[0], 0, pong_thread), 0);
+    pu_assert_equal("Thread created", start_thread(&tid[1], 1, pong_thread), 0);
+    pthread_join(tid[0], NULL);
+    pthread_join(tid[1], NULL);
+    elapsed = ns_now() - start;
+
+    pu_assert_equal("All round trips done", counter, 2 * CONTENDED_ITER);
+    printf("cond ping-pong: %d ns/switch\n",
+           (int)(elapsed / (2 * CONTENDED_ITER)));
+
+    return NULL;
+}
+
+static char * test_timedlock(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutex_t nmtx;
+    struct timespec ts;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_NORMAL);
+    pthread_mutex_init(&nmtx, &attr);
+    pthread_mutex_lock(&nmtx);
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += 10000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    pu_assert_equal("Timed out", pthread_mutex_timedlock(&nmtx, &ts),
+                    ETIMEDOUT);
+
+    pthread_mutex_unlock(&nmtx);
+    pthread_mutex_destroy(&nmtx);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    pu_def_test(test_uncontended, PU_RUN);
+    pu_def_test(test_contended, PU_RUN);
+    pu_def_test(test_cond_pingpong, PU_RUN);
+    pu_def_test(test_timedlock, PU_RUN);
+}
+
+int main(int argc, char **argv)
+{
+    return pu_run_tests(&all_tests);
+}
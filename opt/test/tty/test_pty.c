@@ -1,10 +1,16 @@
 #include <stdio.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/wait.h>
 #include "punit.h"
 
+#define BENCH_BYTES     (64 * 1024)
+#define BENCH_ROUNDS    1000
+
 int masterfd, slavefd;
 char *slavedev;
 
@@ -90,11 +96,95 @@ static char * test_slave2master(void)
     return NULL;
 }
 
+static int64_t ns_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static char * test_bench_throughput(void)
+{
+    static char buf[512];
+    size_t total = 0;
+    int64_t start, elapsed;
+    pid_t pid;
+    char * res;
+
+    res = open_pty();
+    if (res)
+        return res;
+
+    pid = fork();
+    pu_assert("fork ok", pid != -1);
+    if (pid == 0) {
+        for (size_t i = 0; i < BENCH_BYTES; i += sizeof(buf)) {
+            write(masterfd, buf, sizeof(buf));
+        }
+        _exit(0);
+    }
+
+    start = ns_now();
+    while (total < BENCH_BYTES) {
+        ssize_t n;
+
+        n = read(slavefd, buf, sizeof(buf));
+        pu_assert("read from slave ok", n > 0);
+        total += n;
+    }
+    elapsed = ns_now() - start;
+    wait(NULL);
+
+    pu_assert("time elapsed", elapsed > 0);
+    printf("pty throughput: %d kB/s\n",
+           (int)((int64_t)BENCH_BYTES * 1000000000 / 1024 / elapsed));
+
+    return NULL;
+}
+
+static char * test_bench_latency(void)
+{
+    char c = 'a';
+    int64_t start, elapsed;
+    pid_t pid;
+    char * res;
+
+    res = open_pty();
+    if (res)
+        return res;
+
+    pid = fork();
+    pu_assert("fork ok", pid != -1);
+    if (pid == 0) {
+        for (int i = 0; i < BENCH_ROUNDS; i++) {
+            if (read(slavefd, &c, 1) != 1 || write(slavefd, &c, 1) != 1)
+                _exit(1);
+        }
+        _exit(0);
+    }
+
+    start = ns_now();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        pu_assert_equal("write to master ok", write(masterfd, &c, 1), 1);
+        pu_assert_equal("read from master ok", read(masterfd, &c, 1), 1);
+    }
+    elapsed = ns_now() - start;
+    wait(NULL);
+
+    printf("pty round trip: %d ns\n", (int)(elapsed / BENCH_ROUNDS));
+
+    return NULL;
+}
+
 static void all_tests(void)
 {
     pu_def_test(test_open_pty, PU_RUN);
     pu_def_test(test_master2slave, PU_RUN);
     pu_def_test(test_slave2master, PU_RUN);
+    pu_def_test(test_bench_throughput, PU_RUN);
+    pu_def_test(test_bench_latency, PU_RUN);
 }
 
 int main(int argc, char **argv)
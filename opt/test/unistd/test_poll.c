@@ -0,0 +1,180 @@
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/select.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "punit.h"
+
+static int fd[2];
+
+static void setup(void)
+{
+    /* Intentionally unimplemented... */
+}
+
+static void teardown(void)
+{
+    if (fd[0] > 0)
+        close(fd[0]);
+    fd[0] = 0;
+
+    if (fd[1] > 0)
+        close(fd[1]);
+    fd[1] = 0;
+}
+
+static char * test_poll_empty(void)
+{
+    struct pollfd pfd[2];
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+
+    pfd[0].fd = fd[0];
+    pfd[0].events = POLLIN;
+    pfd[1].fd = fd[1];
+    pfd[1].events = POLLOUT;
+
+    pu_assert_equal("Only the write end is ready", poll(pfd, 2, 0), 1);
+    pu_assert_equal("Nothing to read", pfd[0].revents, 0);
+    pu_assert_equal("Can write", pfd[1].revents, POLLOUT);
+
+    return NULL;
+}
+
+static char * test_poll_in(void)
+{
+    struct pollfd pfd;
+    char c = 'a';
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+    write(fd[1], &c, sizeof(c));
+
+    pfd.fd = fd[0];
+    pfd.events = POLLIN;
+    pu_assert_equal("Read end is ready", poll(&pfd, 1, 0), 1);
+    pu_assert_equal("Can read", pfd.revents, POLLIN);
+
+    return NULL;
+}
+
+static char * test_poll_hup(void)
+{
+    struct pollfd pfd;
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+    close(fd[1]);
+    fd[1] = 0;
+
+    pfd.fd = fd[0];
+    pfd.events = POLLIN;
+    pu_assert_equal("Read end is ready", poll(&pfd, 1, 0), 1);
+    pu_assert("Hangup", pfd.revents & POLLHUP);
+
+    return NULL;
+}
+
+static char * test_poll_nval(void)
+{
+    struct pollfd pfd[2];
+
+    pfd[0].fd = 100;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = -1;
+    pfd[1].events = POLLIN;
+
+    pu_assert_equal("One fd is reported", poll(pfd, 2, 0), 1);
+    pu_assert_equal("Invalid fd", pfd[0].revents, POLLNVAL);
+    pu_assert_equal("Negative fd is ignored", pfd[1].revents, 0);
+
+    return NULL;
+}
+
+static char * test_poll_timeout(void)
+{
+    struct pollfd pfd;
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+
+    pfd.fd = fd[0];
+    pfd.events = POLLIN;
+    pu_assert_equal("Timed out", poll(&pfd, 1, 10), 0);
+
+    return NULL;
+}
+
+static char * test_poll_wakeup(void)
+{
+    struct pollfd pfd;
+    pid_t pid;
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+
+    pid = fork();
+    pu_assert("PID OK\n", pid != -1);
+    if (pid == 0) {
+        char c = 'a';
+
+        close(fd[0]);
+        sleep(1);
+        write(fd[1], &c, sizeof(c));
+
+        _exit(0);
+    }
+
+    pfd.fd = fd[0];
+    pfd.events = POLLIN;
+    pu_assert_equal("Woken up by the writer", poll(&pfd, 1, -1), 1);
+    pu_assert("Can read", pfd.revents & POLLIN);
+
+    wait(NULL);
+
+    return NULL;
+}
+
+static char * test_select(void)
+{
+    fd_set rfds;
+    fd_set wfds;
+    char c = 'a';
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+
+    FD_ZERO(&rfds);
+    FD_ZERO(&wfds);
+    FD_SET(fd[0], &rfds);
+    FD_SET(fd[1], &wfds);
+    pu_assert_equal("Only the write end is ready",
+                    select(fd[1] + 1, &rfds, &wfds, NULL,
+                           &(struct timeval){ 0 }), 1);
+    pu_assert("Nothing to read", !FD_ISSET(fd[0], &rfds));
+    pu_assert("Can write", FD_ISSET(fd[1], &wfds));
+
+    write(fd[1], &c, sizeof(c));
+
+    FD_ZERO(&rfds);
+    FD_SET(fd[0], &rfds);
+    pu_assert_equal("Read end is ready",
+                    select(fd[0] + 1, &rfds, NULL, NULL, NULL), 1);
+    pu_assert("Can read", FD_ISSET(fd[0], &rfds));
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    pu_def_test(test_poll_empty, PU_RUN);
+    pu_def_test(test_poll_in, PU_RUN);
+    pu_def_test(test_poll_hup, PU_RUN);
+    pu_def_test(test_poll_nval, PU_RUN);
+    pu_def_test(test_poll_timeout, PU_RUN);
+    pu_def_test(test_poll_wakeup, PU_RUN);
+    pu_def_test(test_select, PU_RUN);
+}
+
+int main(int argc, char **argv)
+{
+    return pu_run_tests(&all_tests);
+}
@@ -0,0 +1,104 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "punit.h"
+
+static int fd[2];
+static int fd2[2];
+static int filefd;
+
+static void setup(void)
+{
+    fd[0] = fd[1] = -1;
+    fd2[0] = fd2[1] = -1;
+    filefd = -1;
+}
+
+static void teardown(void)
+{
+    int * fds[] = { &fd[0], &fd[1], &fd2[0], &fd2[1], &filefd };
+
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (*fds[i] >= 0)
+            close(*fds[i]);
+    }
+}
+
+static char * test_pipe2pipe(void)
+{
+    char str[] = "testing";
+    char rd[sizeof(str)];
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+    pu_assert_equal("pipe creation ok", pipe(fd2), 0);
+
+    write(fd[1], str, sizeof(str));
+    pu_assert_equal("All data was moved",
+                    splice(fd[0], fd2[1], sizeof(str), 0), sizeof(str));
+
+    memset(rd, '\0', sizeof(rd));
+    pu_assert_equal("read() ok", read(fd2[0], rd, sizeof(rd)), sizeof(rd));
+    pu_assert_str_equal("read string equals written", rd, str);
+
+    return NULL;
+}
+
+static char * test_file2pipe(void)
+{
+    char rd[64];
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+    filefd = open("/dev/zero", O_RDONLY);
+    pu_assert("file opened", filefd >= 0);
+
+    pu_assert_equal("All data was moved",
+                    splice(filefd, fd[1], sizeof(rd), 0), sizeof(rd));
+
+    memset(rd, 0xff, sizeof(rd));
+    pu_assert_equal("read() ok", read(fd[0], rd, sizeof(rd)), sizeof(rd));
+    pu_assert_equal("Data was read from the file", rd[sizeof(rd) - 1], 0);
+
+    return NULL;
+}
+
+static char * test_nonblock_empty(void)
+{
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+    pu_assert_equal("pipe creation ok", pipe(fd2), 0);
+
+    errno = 0;
+    pu_assert_equal("Nothing to move",
+                    splice(fd[0], fd2[1], 10, SPLICE_F_NONBLOCK), -1);
+    pu_assert_equal("errno is EAGAIN", errno, EAGAIN);
+
+    return NULL;
+}
+
+static char * test_no_pipe(void)
+{
+    filefd = open("/dev/zero", O_RDWR);
+    pu_assert("file opened", filefd >= 0);
+
+    errno = 0;
+    pu_assert_equal("splice fails", splice(filefd, filefd, 10, 0), -1);
+    pu_assert_equal("errno is EINVAL", errno, EINVAL);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    pu_def_test(test_pipe2pipe, PU_RUN);
+    pu_def_test(test_file2pipe, PU_RUN);
+    pu_def_test(test_nonblock_empty, PU_RUN);
+    pu_def_test(test_no_pipe, PU_RUN);
+}
+
+int main(int argc, char **argv)
+{
+    return pu_run_tests(&all_tests);
+}